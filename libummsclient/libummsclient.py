@@ -84,12 +84,26 @@ def request_player(attended, time_to_execution):
 
     return (player, player_name)
 
+def cancel_execution(token):
+    global obj_mngr
+    print "UMMS client lib: Canceling execution '%s'" % token
+    obj_mngr.CancelExecution(token)
+
+def query_execution(token):
+    # (object_path, state, start_time, stop_time), state 0: pending, 1: running
+    global obj_mngr
+    return obj_mngr.QueryExecution(token)
+
 def remove_player(proxy):
     global obj_mngr
     obj_path = proxy.object_path
     print "UMMS client lib: Removing media player '%s'" % obj_path
     obj_mngr.RemoveMediaPlayer(obj_path)
 
+def get_properties(player, names = []):
+    # Query several properties in one round trip, empty names means all.
+    return player.GetProperties(names, signature='as')
+
 def get_metadata_viewer():
     global metadata_viewer;
     print "Return global metadata_viewer"
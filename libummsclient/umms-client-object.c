@@ -22,8 +22,10 @@
  */
 
 #include <dbus/dbus-glib.h>
+#include <dbus/dbus-glib-lowlevel.h>
 #include <glib-object.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "../src/umms-server.h"
 #include "../src/umms-debug.h"
@@ -100,6 +102,8 @@ umms_client_object_class_init (UmmsClientObjectClass *klass)
   object_class->dispose = umms_client_object_dispose;
   object_class->finalize = umms_client_object_finalize;
 
+  //No conf on the client side, the levels come from UMMS_LOG.
+  umms_log_init (NULL);
 }
 
 static void
@@ -222,3 +226,54 @@ void umms_client_object_remove_player (UmmsClientObject *self, DBusGProxy *playe
   }
   return;
 }
+
+GHashTable *umms_client_object_get_properties (UmmsClientObject *self, DBusGProxy *player, const gchar **names)
+{
+  static const gchar *all[] = {NULL};
+  GHashTable *props = NULL;
+  GError *error = NULL;
+
+  if (!dbus_g_proxy_call (player, "GetProperties", &error,
+                          G_TYPE_STRV, names ? names : all, G_TYPE_INVALID,
+                          dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE), &props,
+                          G_TYPE_INVALID)) {
+    UMMS_GERROR ("GetProperties failed", error);
+    return NULL;
+  }
+  return props;
+}
+
+UmmsFrameRing *umms_client_object_open_frame_ring (UmmsClientObject *self, DBusGProxy *player, GError **err)
+{
+  DBusGConnection *bus;
+  DBusMessage *msg;
+  DBusMessage *reply;
+  DBusError dbus_err;
+  gint fd = -1, event_fd = -1;
+  UmmsFrameRing *ring = NULL;
+
+  if (!(bus = dbus_g_bus_get (DBUS_BUS_SYSTEM, err)))
+    return NULL;
+
+  //GetFrameRing returns unix fds, which dbus-glib can't demarshal.
+  msg = dbus_message_new_method_call (UMMS_SERVICE_NAME, dbus_g_proxy_get_path (player),
+                                      MEDIA_PLAYER_INTERFACE_NAME, "GetFrameRing");
+  dbus_error_init (&dbus_err);
+  reply = dbus_connection_send_with_reply_and_block (dbus_g_connection_get_connection (bus), msg, -1, &dbus_err);
+  dbus_message_unref (msg);
+
+  if (reply && dbus_message_get_args (reply, &dbus_err,
+                                      DBUS_TYPE_UNIX_FD, &fd,
+                                      DBUS_TYPE_UNIX_FD, &event_fd,
+                                      DBUS_TYPE_INVALID)) {
+    ring = umms_frame_ring_open (fd, event_fd, err);
+  } else {
+    g_set_error (err, DBUS_GERROR, DBUS_GERROR_FAILED, "GetFrameRing failed: %s", dbus_err.message);
+    dbus_error_free (&dbus_err);
+  }
+
+  if (reply)
+    dbus_message_unref (reply);
+  dbus_g_connection_unref (bus);
+  return ring;
+}
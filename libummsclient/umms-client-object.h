@@ -25,6 +25,7 @@
 #define _UMMS_CLIENT_OBJECT_H
 
 #include <glib-object.h>
+#include <umms-frame-ring.h>
 
 G_BEGIN_DECLS
 
@@ -70,6 +71,19 @@ GType umms_client_object_get_type (void) G_GNUC_CONST;
 UmmsClientObject *umms_client_object_new (void);
 DBusGProxy *umms_client_object_request_player (UmmsClientObject *self, gboolean attended, gdouble time_to_execution, gchar **name);
 void umms_client_object_remove_player (UmmsClientObject *self, DBusGProxy *player);
+/*
+ * Query several properties of player in one round trip, see GetProperties.
+ * names is NULL terminated, NULL queries all. Returns NULL on failure,
+ * otherwise a table of property name to GValue, g_hash_table_unref() it after usage.
+ */
+GHashTable *umms_client_object_get_properties (UmmsClientObject *self, DBusGProxy *player, const gchar **names);
+
+/*
+ * Map the frame ring of a player whose target is DataCopy, call it after
+ * SetTarget. Frames are read with umms_frame_ring_wait/acquire, the ring is
+ * released by umms_frame_ring_free().
+ */
+UmmsFrameRing *umms_client_object_open_frame_ring (UmmsClientObject *self, DBusGProxy *player, GError **err);
 
 G_END_DECLS
 
@@ -0,0 +1,2716 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Reference player backend on playbin2.
+ *
+ * All the vmethods map to playbin2 properties, queries and action signals.
+ * The state transitions are asynchronous: play_async/pause_async and
+ * set_position_async return once the request is issued and complete from the
+ * bus watch, the blocking variants wait for the pipeline to settle. The bus
+ * watch runs on the default main context.
+ *
+ * The limits of the queue2 (network buffering) and of the multiqueues (demuxer
+ * output) are set as the elements are added to the pipeline, from the
+ * UmmsGstQueueConf of the backend, which defaults to the preset and the keys of
+ * the [GStreamer Backend] group of umms.conf.
+ *
+ * The buffers of the source element are probed: transport streams are fed to
+ * the PSI cache of the backend, and Record writes the incoming stream as is,
+ * so that a recording doesn't open the source a second time.
+ *
+ * Live uris are timeshifted when umms-server enables it: a capture pipeline
+ * (source ! appsink) writes the stream into the ring of the backend and
+ * playbin2 plays "appsrc://", fed from the ring. The capture goes on while
+ * paused, a seek restarts the playback from the ring at the new position.
+ *
+ * A live channel pre-tuned for a fast zap (paused at background priority) is
+ * captured the same way, into the PSI and GOP caches, while playbin2 stays
+ * stopped. Once swapped in, playbin2 plays "appsrc://" fed with the cached
+ * PAT, PMT and GOP, then with the capture, see pretune_start().
+ */
+
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlugin
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/interfaces/xoverlay.h>
+#include <umms.h>
+#include "umms-gst-backend.h"
+
+G_DEFINE_TYPE (UmmsGstBackend, umms_gst_backend, UMMS_TYPE_PLAYER_BACKEND);
+
+#define GET_PRIVATE(o) \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((o), UMMS_TYPE_GST_BACKEND, UmmsGstBackendPrivate))
+
+#define UMMS_GST_CONF_FILE   "/etc/umms.conf"
+#define STATE_CHANGE_TIMEOUT (10 * GST_SECOND)
+#define TS_PACKET_LEN        188
+#define TIMESHIFT_READ_SIZE  (TS_PACKET_LEN * 348)
+#define GOP_CACHE_SIZE       (4 * 1024 * 1024)
+
+//Request of an asynchronous transition, completed from the bus watch.
+typedef struct {
+  UmmsPlayerBackendCallback callback;
+  gpointer user_data;
+  GstState target;
+} Request;
+
+struct _UmmsGstBackendPrivate {
+  GstElement *pipeline;//playbin2
+  guint bus_watch;
+  UmmsGstQueueConf conf;
+
+  GstState target_state;//requested by client
+  gboolean buffering_paused;//paused by us until the queue2 refills, not announced
+  gint64   start_pos;//ms, seek to do once prerolled, -1 if none
+  gdouble  rate;
+
+  //Video output.
+  gulong   xid;
+  gboolean has_xid;
+  gboolean has_rect;
+  gint     x, y, w, h;
+  gint     scale_mode;
+  gint     target_type;
+
+  GstTagList *tags;//global ones, e.g. title and container
+
+  //Protected by lock.
+  GMutex  *lock;
+  GstElement *overlay;//the video sink which asked for a window
+  Request  state_req;
+  Request  seek_req;
+  gboolean seeking;//until the ASYNC_DONE of the flushing seek
+  GstPad  *source_pad;
+  gulong   probe_id;
+  FILE    *record_file;
+
+  //Only touched by the streaming thread of the source.
+  gint     is_ts;//-1 until the first buffer
+  guint8   carry[TS_PACKET_LEN];
+  guint    carry_len;
+
+  //Timeshift, set up and torn down with the control lock held, see ts_start().
+  GstElement    *capture;//source ! appsink writing the ring, NULL if not timeshifting
+  UmmsTimeshift *timeshift;//only used while the capture or playbin2 runs
+  GstClockTime   ts_start_time;//stream times of the ring are relative to it
+  gboolean timeshifting;//state lock
+  gboolean ts_restart;//state lock, playback restarting for a seek, the states are not announced
+  gint64   ts_base;//state lock, ring time in ms the playback started from
+  //Protected by ts_lock, the reader of the ring.
+  GMutex    *ts_lock;
+  GstAppSrc *ts_src;
+  gboolean   ts_starved;//the appsrc waits for data at the live edge
+
+  //Pre-tuned live channel, set up and torn down with the control lock held, see pretune_start().
+  gboolean pretuned;//the capture feeds the caches, playbin2 stopped
+  UmmsGopCache *gop;
+  //Protected by ts_lock.
+  gboolean pretune_live;//swapped in, the capture feeds the appsrc once there
+  guint    pmt_pid;//of the program, 0 until known
+  guint8   pat_packet[TS_PACKET_LEN];//last ones starting a section, zeroed if none yet
+  guint8   pmt_packet[TS_PACKET_LEN];
+};
+
+static UmmsGstQueueConf default_conf;
+static gboolean default_conf_loaded = FALSE;
+G_LOCK_DEFINE_STATIC (default_conf);
+
+static void
+conf_copy (UmmsGstQueueConf *dst, const UmmsGstQueueConf *src)
+{
+  *dst = *src;
+  dst->video_sink = g_strdup (src->video_sink);
+  dst->audio_sink = g_strdup (src->audio_sink);
+}
+
+void
+umms_gst_queue_conf_clear (UmmsGstQueueConf *conf)
+{
+  g_free (conf->video_sink);
+  g_free (conf->audio_sink);
+  conf->video_sink = conf->audio_sink = NULL;
+}
+
+gboolean
+umms_gst_queue_conf_preset (UmmsGstQueueConf *conf, const gchar *preset)
+{
+  g_return_val_if_fail (conf, FALSE);
+
+  conf->queue2_bytes = conf->queue2_time = -1;
+  conf->queue2_low_percent = conf->queue2_high_percent = -1;
+  conf->multiqueue_bytes = conf->multiqueue_buffers = conf->multiqueue_time = -1;
+
+  if (!preset || !g_strcmp0 (preset, "default"))
+    return TRUE;
+
+  if (!g_strcmp0 (preset, "low-latency")) {
+    //Start playing after 100ms of data, keep the demuxers from reading ahead.
+    conf->queue2_bytes = 256 * 1024;
+    conf->queue2_time = 200;
+    conf->queue2_low_percent = 10;
+    conf->queue2_high_percent = 50;
+    conf->multiqueue_bytes = 1024 * 1024;
+    conf->multiqueue_buffers = 0;
+    conf->multiqueue_time = 200;
+    return TRUE;
+  }
+
+  if (!g_strcmp0 (preset, "high-throughput")) {
+    conf->queue2_bytes = 32 * 1024 * 1024;
+    conf->queue2_time = 20000;
+    conf->queue2_low_percent = 10;
+    conf->queue2_high_percent = 99;
+    conf->multiqueue_bytes = 32 * 1024 * 1024;
+    conf->multiqueue_buffers = 0;
+    conf->multiqueue_time = 5000;
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+conf_get_int (GKeyFile *keyfile, const gchar *key, gint64 *val)
+{
+  GError *err = NULL;
+  gint v;
+
+  if (!g_key_file_has_key (keyfile, UMMS_GST_CONF_GROUP, key, NULL))
+    return;
+  v = g_key_file_get_integer (keyfile, UMMS_GST_CONF_GROUP, key, &err);
+  if (err) {
+    UMMS_WARNING ("%s: %s", key, err->message);
+    g_error_free (err);
+    return;
+  }
+  *val = v;
+}
+
+static void
+conf_get_string (GKeyFile *keyfile, const gchar *key, gchar **val)
+{
+  gchar *v = g_key_file_get_string (keyfile, UMMS_GST_CONF_GROUP, key, NULL);
+
+  if (v && *v) {
+    g_free (*val);
+    *val = v;
+  } else {
+    g_free (v);
+  }
+}
+
+//The preset, then the explicit keys override its values.
+static void
+conf_load (UmmsGstQueueConf *conf)
+{
+  const gchar *path = g_getenv (UMMS_GST_CONF_ENV);
+  GKeyFile *keyfile = g_key_file_new ();
+  gchar *preset = NULL;
+  gint64 percent;
+
+  memset (conf, 0, sizeof (UmmsGstQueueConf));
+  umms_gst_queue_conf_preset (conf, "default");
+  if (!path)
+    path = UMMS_GST_CONF_FILE;
+  if (!g_key_file_load_from_file (keyfile, path, G_KEY_FILE_NONE, NULL))
+    goto out;
+
+  preset = g_key_file_get_string (keyfile, UMMS_GST_CONF_GROUP, "preset", NULL);
+  if (preset && !umms_gst_queue_conf_preset (conf, preset))
+    UMMS_WARNING ("unknown preset \"%s\", using the defaults", preset);
+  g_free (preset);
+
+  conf_get_int (keyfile, "queue2-max-size-bytes", &conf->queue2_bytes);
+  conf_get_int (keyfile, "queue2-max-size-time", &conf->queue2_time);
+  percent = conf->queue2_low_percent;
+  conf_get_int (keyfile, "queue2-low-percent", &percent);
+  conf->queue2_low_percent = percent;
+  percent = conf->queue2_high_percent;
+  conf_get_int (keyfile, "queue2-high-percent", &percent);
+  conf->queue2_high_percent = percent;
+  conf_get_int (keyfile, "multiqueue-max-size-bytes", &conf->multiqueue_bytes);
+  conf_get_int (keyfile, "multiqueue-max-size-buffers", &conf->multiqueue_buffers);
+  conf_get_int (keyfile, "multiqueue-max-size-time", &conf->multiqueue_time);
+  conf_get_string (keyfile, "video-sink", &conf->video_sink);
+  conf_get_string (keyfile, "audio-sink", &conf->audio_sink);
+
+out:
+  g_key_file_free (keyfile);
+}
+
+void
+umms_gst_backend_set_default_conf (const UmmsGstQueueConf *conf)
+{
+  g_return_if_fail (conf);
+
+  G_LOCK (default_conf);
+  umms_gst_queue_conf_clear (&default_conf);
+  conf_copy (&default_conf, conf);
+  default_conf_loaded = TRUE;
+  G_UNLOCK (default_conf);
+}
+
+static void
+conf_get_default (UmmsGstQueueConf *conf)
+{
+  G_LOCK (default_conf);
+  if (!default_conf_loaded) {
+    conf_load (&default_conf);
+    default_conf_loaded = TRUE;
+  }
+  conf_copy (conf, &default_conf);
+  G_UNLOCK (default_conf);
+}
+
+static gboolean
+has_property (gpointer obj, const gchar *name)
+{
+  return g_object_class_find_property (G_OBJECT_GET_CLASS (obj), name) != NULL;
+}
+
+static const gchar *
+element_factory_name (GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory (element);
+
+  return factory ? gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)) : NULL;
+}
+
+static void
+apply_queue_limits (UmmsGstBackendPrivate *priv, GstElement *element)
+{
+  const UmmsGstQueueConf *conf = &priv->conf;
+  const gchar *name = element_factory_name (element);
+
+  if (!g_strcmp0 (name, "queue2")) {
+    if (conf->queue2_bytes >= 0)
+      g_object_set (element, "max-size-bytes", (guint)conf->queue2_bytes, NULL);
+    if (conf->queue2_time >= 0)
+      g_object_set (element, "max-size-time", (guint64)conf->queue2_time * GST_MSECOND, NULL);
+    if (conf->queue2_low_percent >= 0)
+      g_object_set (element, "low-percent", conf->queue2_low_percent, NULL);
+    if (conf->queue2_high_percent >= 0)
+      g_object_set (element, "high-percent", conf->queue2_high_percent, NULL);
+  } else if (!g_strcmp0 (name, "multiqueue")) {
+    if (conf->multiqueue_bytes >= 0)
+      g_object_set (element, "max-size-bytes", (guint)conf->multiqueue_bytes, NULL);
+    if (conf->multiqueue_buffers >= 0)
+      g_object_set (element, "max-size-buffers", (guint)conf->multiqueue_buffers, NULL);
+    if (conf->multiqueue_time >= 0)
+      g_object_set (element, "max-size-time", (guint64)conf->multiqueue_time * GST_MSECOND, NULL);
+  }
+}
+
+//uridecodebin also sets the queue2 limits from these, whichever comes last.
+static void
+apply_playbin_limits (UmmsGstBackendPrivate *priv)
+{
+  if (priv->conf.queue2_bytes >= 0 && has_property (priv->pipeline, "buffer-size"))
+    g_object_set (priv->pipeline, "buffer-size", (gint)priv->conf.queue2_bytes, NULL);
+  if (priv->conf.queue2_time >= 0 && has_property (priv->pipeline, "buffer-duration"))
+    g_object_set (priv->pipeline, "buffer-duration", (gint64)priv->conf.queue2_time * GST_MSECOND, NULL);
+}
+
+static void
+element_added_cb (GstBin *bin, GstElement *element, UmmsGstBackend *self)
+{
+  //The queues are created deep in uridecodebin and decodebin2.
+  if (GST_IS_BIN (element))
+    g_signal_connect (element, "element-added", G_CALLBACK (element_added_cb), self);
+  apply_queue_limits (self->priv, element);
+}
+
+//func is called with each element of the pipeline, recursively.
+static void
+foreach_element (UmmsGstBackendPrivate *priv, GFunc func, gpointer user_data)
+{
+  GstIterator *it = gst_bin_iterate_recurse (GST_BIN (priv->pipeline));
+  gpointer item;
+  gboolean done = FALSE;
+
+  while (!done) {
+    switch (gst_iterator_next (it, &item)) {
+      case GST_ITERATOR_OK:
+        func (item, user_data);
+        gst_object_unref (item);
+        break;
+      case GST_ITERATOR_RESYNC:
+        gst_iterator_resync (it);
+        break;
+      default:
+        done = TRUE;
+        break;
+    }
+  }
+  gst_iterator_free (it);
+}
+
+static void
+apply_queue_limits_func (gpointer element, gpointer user_data)
+{
+  apply_queue_limits (user_data, element);
+}
+
+static GstElement *
+make_sink (const gchar *desc)
+{
+  GError *err = NULL;
+  GstElement *sink;
+
+  sink = gst_parse_bin_from_description (desc, TRUE, &err);
+  if (!sink) {
+    UMMS_WARNING ("can't make sink \"%s\": %s", desc, err ? err->message : "unknown error");
+  }
+  if (err)
+    g_error_free (err);
+  return sink;
+}
+
+static PlayerState
+state_from_gst (GstState state)
+{
+  switch (state) {
+    case GST_STATE_PLAYING:
+      return PlayerStatePlaying;
+    case GST_STATE_PAUSED:
+      return PlayerStatePaused;
+    default:
+      return PlayerStateStopped;
+  }
+}
+
+static void
+set_player_state (UmmsPlayerBackend *self, PlayerState state)
+{
+  PlayerState old;
+
+  umms_player_backend_state_lock (self);
+  old = self->player_state;
+  self->player_state = state;
+  umms_player_backend_state_unlock (self);
+
+  if (old != state)
+    umms_player_backend_emit_player_state_changed (self, old, state);
+}
+
+static void
+request_set (UmmsPlayerBackend *self, Request *req, GstState target, UmmsPlayerBackendCallback callback,
+             gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  Request old;
+
+  g_mutex_lock (priv->lock);
+  old = *req;
+  req->callback = callback;
+  req->user_data = user_data;
+  req->target = target;
+  g_mutex_unlock (priv->lock);
+
+  //Superseded by the new request, the former one didn't fail.
+  if (old.callback)
+    old.callback (self, TRUE, NULL, old.user_data);
+}
+
+static void
+request_done (UmmsPlayerBackend *self, Request *req, gboolean success, const GError *err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  Request old;
+
+  g_mutex_lock (priv->lock);
+  old = *req;
+  req->callback = NULL;
+  g_mutex_unlock (priv->lock);
+
+  if (old.callback)
+    old.callback (self, success, err, old.user_data);
+}
+
+static void
+state_request_reached (UmmsPlayerBackend *self, GstState state)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gboolean reached;
+
+  g_mutex_lock (priv->lock);
+  reached = priv->state_req.callback && priv->state_req.target == state;
+  g_mutex_unlock (priv->lock);
+
+  if (reached)
+    request_done (self, &priv->state_req, TRUE, NULL);
+}
+
+static gboolean
+pipeline_is_stopped (UmmsGstBackendPrivate *priv)
+{
+  GstState state = GST_STATE_NULL;
+
+  gst_element_get_state (priv->pipeline, &state, NULL, 0);
+  return state <= GST_STATE_READY;
+}
+
+//The proxy set by the client, on the source of playbin2 or of the capture.
+static void
+source_set_proxy (UmmsPlayerBackend *self, GstElement *source)
+{
+  if (!self->proxy_uri || !has_property (source, "proxy"))
+    return;
+  g_object_set (source, "proxy", self->proxy_uri, NULL);
+  if (self->proxy_id && has_property (source, "proxy-id"))
+    g_object_set (source, "proxy-id", self->proxy_id, NULL);
+  if (self->proxy_pw && has_property (source, "proxy-pw"))
+    g_object_set (source, "proxy-pw", self->proxy_pw, NULL);
+}
+
+//With ts_lock held: pushes the next chunk of the ring, or waits for the capture at the live edge.
+static void
+ts_feed (UmmsGstBackendPrivate *priv)
+{
+  GstBuffer *buffer = gst_buffer_new_and_alloc (TIMESHIFT_READ_SIZE);
+  GError *err = NULL;
+  gssize len;
+
+  len = umms_timeshift_read (priv->timeshift, GST_BUFFER_DATA (buffer), TIMESHIFT_READ_SIZE, &err);
+  if (len <= 0) {
+    if (len < 0) {
+      UMMS_WARNING ("timeshift read failed: %s", err->message);
+      g_error_free (err);
+    }
+    gst_buffer_unref (buffer);
+    priv->ts_starved = TRUE;
+    return;
+  }
+  GST_BUFFER_SIZE (buffer) = len;
+  priv->ts_starved = FALSE;
+  gst_app_src_push_buffer (priv->ts_src, buffer);
+}
+
+//On the streaming thread of the appsrc.
+static void
+ts_need_data (GstAppSrc *src, guint length, gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (user_data)->priv;
+
+  g_mutex_lock (priv->ts_lock);
+  //A swapped in pre-tuned channel is pushed by its capture.
+  if (src == priv->ts_src && priv->timeshift)
+    ts_feed (priv);
+  g_mutex_unlock (priv->ts_lock);
+}
+
+static void
+ts_set_src (UmmsGstBackendPrivate *priv, GstElement *src)
+{
+  GstAppSrc *old;
+
+  g_mutex_lock (priv->ts_lock);
+  old = priv->ts_src;
+  priv->ts_src = src ? GST_APP_SRC (gst_object_ref (src)) : NULL;
+  priv->ts_starved = FALSE;
+  g_mutex_unlock (priv->ts_lock);
+
+  if (old)
+    gst_object_unref (old);
+}
+
+//On the streaming thread of the capture.
+static GstFlowReturn
+ts_capture_buffer (GstAppSink *sink, gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (user_data)->priv;
+  GstBuffer *buffer = gst_app_sink_pull_buffer (sink);
+  GError *err = NULL;
+  gint64 time;
+
+  if (!buffer)
+    return GST_FLOW_UNEXPECTED;
+
+  //The running time of the capture, the PCR/PTS of the stream may wrap.
+  time = (gst_util_get_timestamp () - priv->ts_start_time) / GST_MSECOND;
+  if (!umms_timeshift_write (priv->timeshift, time, GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer), &err)) {
+    UMMS_WARNING ("timeshift write failed: %s", err->message);
+    g_error_free (err);
+    gst_buffer_unref (buffer);
+    gst_element_post_message (priv->pipeline,
+                              gst_message_new_application (GST_OBJECT (priv->pipeline),
+                                  gst_structure_new ("timeshift-failed", NULL)));
+    return GST_FLOW_UNEXPECTED;
+  }
+  gst_buffer_unref (buffer);
+
+  g_mutex_lock (priv->ts_lock);
+  if (priv->ts_starved && priv->ts_src)
+    ts_feed (priv);
+  g_mutex_unlock (priv->ts_lock);
+  return GST_FLOW_OK;
+}
+
+//The errors of the capture go to the bus watch of playbin2.
+static GstBusSyncReply
+ts_capture_bus_sync (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = user_data;
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR)
+    gst_element_post_message (priv->pipeline, gst_message_ref (msg));
+  return GST_BUS_DROP;
+}
+
+//source ! appsink of the uri, its buffers given to new_buffer. NULL if it can't be captured.
+static GstElement *
+capture_new (UmmsPlayerBackend *self, const gchar *name,
+             GstFlowReturn (*new_buffer) (GstAppSink *sink, gpointer user_data))
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstAppSinkCallbacks callbacks = {0,};
+  GstElement *capture, *source, *sink;
+  GstBus *bus;
+
+  source = gst_element_make_from_uri (GST_URI_SRC, self->uri, NULL);
+  sink = gst_element_factory_make ("appsink", NULL);
+  if (!source || !sink) {
+    UMMS_WARNING ("can't capture \"%s\"", self->uri);
+    if (source)
+      gst_object_unref (source);
+    if (sink)
+      gst_object_unref (sink);
+    return NULL;
+  }
+  source_set_proxy (self, source);
+  //The consumer paces the playback, the capture takes the data as it comes.
+  g_object_set (sink, "sync", FALSE, NULL);
+  callbacks.new_buffer = new_buffer;
+  gst_app_sink_set_callbacks (GST_APP_SINK (sink), &callbacks, self, NULL);
+
+  capture = gst_pipeline_new (name);
+  gst_bin_add (GST_BIN (capture), source);
+  gst_bin_add (GST_BIN (capture), sink);
+  //Sources with sometimes pads (e.g. rtspsrc) aren't captured.
+  if (!gst_element_link (source, sink)) {
+    UMMS_WARNING ("can't link the source of \"%s\"", self->uri);
+    gst_object_unref (capture);
+    return NULL;
+  }
+  bus = gst_pipeline_get_bus (GST_PIPELINE (capture));
+  gst_bus_set_sync_handler (bus, ts_capture_bus_sync, priv);
+  gst_object_unref (bus);
+
+  return capture;
+}
+
+/*
+ * On the way out of READY, with the control lock held: for a live uri and
+ * timeshift enabled, starts the ring and the capture, then points playbin2 to
+ * appsrc://. FALSE if the uri is played directly.
+ */
+static gboolean
+ts_start (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstElement *capture;
+  GError *err = NULL;
+
+  if (!umms_player_backend_has_timeshift (self) || !umms_player_backend_is_live_uri (self->uri))
+    return FALSE;
+
+  if (!(capture = capture_new (self, "timeshift-capture", ts_capture_buffer))) {
+    UMMS_WARNING ("not timeshifting \"%s\"", self->uri);
+    return FALSE;
+  }
+
+  if (!umms_player_backend_start_timeshift (self, &err)) {
+    UMMS_WARNING ("%s, not timeshifting", err->message);
+    g_error_free (err);
+    gst_object_unref (capture);
+    return FALSE;
+  }
+  priv->timeshift = umms_player_backend_get_timeshift (self);
+  priv->ts_start_time = gst_util_get_timestamp ();
+  if (gst_element_set_state (capture, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    UMMS_WARNING ("capture of \"%s\" failed, not timeshifting", self->uri);
+    gst_element_set_state (capture, GST_STATE_NULL);
+    gst_object_unref (capture);
+    priv->timeshift = NULL;
+    umms_player_backend_stop_timeshift (self);
+    return FALSE;
+  }
+
+  priv->capture = capture;
+  umms_player_backend_state_lock (self);
+  priv->timeshifting = TRUE;
+  priv->ts_restart = FALSE;
+  priv->ts_base = 0;
+  umms_player_backend_state_unlock (self);
+  g_object_set (priv->pipeline, "uri", "appsrc://", NULL);
+  return TRUE;
+}
+
+/*
+ * With the control lock held and playbin2 stopped, so that nothing reads the
+ * ring any more. Stops the capture of a pre-tuned channel too.
+ */
+static void
+ts_stop (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (!priv->capture)
+    return;
+
+  gst_element_set_state (priv->capture, GST_STATE_NULL);
+  gst_object_unref (priv->capture);
+  priv->capture = NULL;
+  ts_set_src (priv, NULL);
+  g_mutex_lock (priv->ts_lock);
+  priv->pretune_live = FALSE;
+  g_mutex_unlock (priv->ts_lock);
+  priv->pretuned = FALSE;
+  umms_gop_cache_reset (priv->gop, UMMS_GOP_CACHE_NO_PID);
+  if (priv->timeshift) {
+    priv->timeshift = NULL;
+    umms_player_backend_stop_timeshift (self);
+  }
+  umms_player_backend_state_lock (self);
+  priv->timeshifting = FALSE;
+  priv->ts_restart = FALSE;
+  umms_player_backend_state_unlock (self);
+  g_object_set (priv->pipeline, "uri", self->uri, NULL);
+}
+
+/*
+ * The appsrc can't seek: the playback restarts from the ring at the new
+ * position, completed by the ASYNC_DONE of the preroll like a flushing seek.
+ */
+static gboolean
+ts_seek (UmmsPlayerBackend *self, gint64 pos, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gint64 earliest, latest, time;
+  GstState target;
+
+  if (!umms_timeshift_get_window (priv->timeshift, &earliest, &latest)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "nothing received yet");
+    return FALSE;
+  }
+
+  umms_player_backend_state_lock (self);
+  priv->ts_restart = TRUE;
+  target = priv->target_state;
+  umms_player_backend_state_unlock (self);
+  gst_element_set_state (priv->pipeline, GST_STATE_READY);
+
+  g_mutex_lock (priv->ts_lock);
+  priv->ts_starved = FALSE;
+  time = umms_timeshift_seek (priv->timeshift, pos);
+  g_mutex_unlock (priv->ts_lock);
+  umms_player_backend_state_lock (self);
+  priv->ts_base = time;
+  umms_player_backend_state_unlock (self);
+
+  g_mutex_lock (priv->lock);
+  priv->seeking = TRUE;
+  g_mutex_unlock (priv->lock);
+  if (gst_element_set_state (priv->pipeline, target) == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "restart at %" G_GINT64_FORMAT " ms failed", pos);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+//Pre-tuned, the packets needed to show the channel at once are kept too.
+static void
+feed_packet (UmmsPlayerBackend *self, const guint8 *packet, gboolean pretuned)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  guint pid = (packet[1] & 0x1F) << 8 | packet[2];
+
+  umms_psi_cache_push_packet (umms_player_backend_get_psi_cache (self), packet);
+  if (!pretuned)
+    return;
+  //A PAT or PMT longer than a packet isn't kept, the demuxer then waits for the next one.
+  if (packet[1] & 0x40) {
+    if (pid == 0)
+      memcpy (priv->pat_packet, packet, TS_PACKET_LEN);
+    else if (pid == priv->pmt_pid)
+      memcpy (priv->pmt_packet, packet, TS_PACKET_LEN);
+  }
+  umms_gop_cache_push_packet (priv->gop, packet);
+}
+
+/*
+ * The packets are fed as they come, a packet split between two buffers is
+ * carried over. By the source of playbin2, or with ts_lock held by the
+ * capture of a pre-tuned channel.
+ */
+static void
+feed_psi (UmmsPlayerBackend *self, const guint8 *data, gsize len, gboolean pretuned)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gsize n;
+
+  if (priv->is_ts < 0) {
+    if (len < 2 * TS_PACKET_LEN + 1)
+      return;
+    priv->is_ts = data[0] == 0x47 && data[TS_PACKET_LEN] == 0x47 && data[2 * TS_PACKET_LEN] == 0x47;
+  }
+  if (!priv->is_ts)
+    return;
+
+  if (priv->carry_len) {
+    n = MIN (TS_PACKET_LEN - priv->carry_len, len);
+    memcpy (priv->carry + priv->carry_len, data, n);
+    priv->carry_len += n;
+    data += n;
+    len -= n;
+    if (priv->carry_len < TS_PACKET_LEN)
+      return;
+    if (priv->carry[0] == 0x47)
+      feed_packet (self, priv->carry, pretuned);
+    priv->carry_len = 0;
+  }
+
+  while (len >= TS_PACKET_LEN) {
+    if (data[0] != 0x47) {
+      data++;
+      len--;
+      continue;
+    }
+    feed_packet (self, data, pretuned);
+    data += TS_PACKET_LEN;
+    len -= TS_PACKET_LEN;
+  }
+  memcpy (priv->carry, data, len);
+  priv->carry_len = len;
+}
+
+static guint
+entry_get_uint (GHashTable *entry, const gchar *key)
+{
+  return g_value_get_uint (g_hash_table_lookup (entry, key));
+}
+
+static void
+entries_free (GPtrArray *entries)
+{
+  g_ptr_array_foreach (entries, (GFunc)g_hash_table_unref, NULL);
+  g_ptr_array_free (entries, TRUE);
+}
+
+//With ts_lock held: once the PAT and PMT are in, keeps the PMT and the GOP of the first video stream.
+static void
+pretune_follow_program (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  UmmsPsiCache *cache = umms_player_backend_get_psi_cache (self);
+  GPtrArray *pat, *streams;
+  guint program_num = 0, pcr_pid, pmt_pid = 0, video_pid = 0, type, i;
+
+  if (!umms_psi_cache_get_pat (cache, &pat))
+    return;
+  //The program of the uri, else the first one.
+  if (!umms_psi_cache_get_pmt (cache, &program_num, &pcr_pid, &streams)) {
+    for (i = 0; i < pat->len && !program_num; i++)
+      program_num = entry_get_uint (g_ptr_array_index (pat, i), "program-number");
+    if (!program_num || !umms_psi_cache_get_pmt (cache, &program_num, &pcr_pid, &streams)) {
+      entries_free (pat);
+      return;
+    }
+  }
+  for (i = 0; i < pat->len && !pmt_pid; i++) {
+    if (entry_get_uint (g_ptr_array_index (pat, i), "program-number") == program_num)
+      pmt_pid = entry_get_uint (g_ptr_array_index (pat, i), "pid");
+  }
+  for (i = 0; i < streams->len && !video_pid; i++) {
+    type = entry_get_uint (g_ptr_array_index (streams, i), "stream-type");
+    if (type == 0x01 || type == 0x02 || type == 0x1B || type == 0x24)
+      video_pid = entry_get_uint (g_ptr_array_index (streams, i), "pid");
+  }
+  entries_free (pat);
+  entries_free (streams);
+
+  if (!pmt_pid || !video_pid)
+    return;
+  priv->pmt_pid = pmt_pid;
+  umms_gop_cache_reset (priv->gop, video_pid);
+  UMMS_DEBUG ("pre-tuned program %u, PMT PID %u, video PID %u", program_num, pmt_pid, video_pid);
+}
+
+//On the streaming thread of the capture of a pre-tuned channel.
+static GstFlowReturn
+pretune_capture_buffer (GstAppSink *sink, gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstBuffer *buffer = gst_app_sink_pull_buffer (sink);
+  gboolean playing;
+
+  if (!buffer)
+    return GST_FLOW_UNEXPECTED;
+
+  umms_player_backend_state_lock (self);
+  playing = (priv->target_state == GST_STATE_PLAYING);
+  umms_player_backend_state_unlock (self);
+
+  g_mutex_lock (priv->ts_lock);
+  if (priv->pretune_live && priv->ts_src) {
+    //Paused, the live stream is dropped as it comes. The demuxer times the stream.
+    if (playing) {
+      buffer = gst_buffer_make_metadata_writable (buffer);
+      GST_BUFFER_TIMESTAMP (buffer) = GST_CLOCK_TIME_NONE;
+      gst_app_src_push_buffer (priv->ts_src, buffer);
+      buffer = NULL;
+    }
+  } else {
+    feed_psi (self, GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer), TRUE);
+    if (!priv->pmt_pid)
+      pretune_follow_program (self);
+  }
+  g_mutex_unlock (priv->ts_lock);
+
+  if (buffer)
+    gst_buffer_unref (buffer);
+  return GST_FLOW_OK;
+}
+
+//With ts_lock held, once the appsrc of a swapped in channel is there: the PAT, the PMT and the GOP kept.
+static void
+pretune_push_head (UmmsGstBackendPrivate *priv)
+{
+  GByteArray *head = g_byte_array_new ();
+  GByteArray *gop = NULL;
+  GstBuffer *buffer;
+
+  if (priv->pat_packet[0] == 0x47 && priv->pmt_packet[0] == 0x47) {
+    g_byte_array_append (head, priv->pat_packet, TS_PACKET_LEN);
+    g_byte_array_append (head, priv->pmt_packet, TS_PACKET_LEN);
+    if ((gop = umms_gop_cache_get (priv->gop))) {
+      g_byte_array_append (head, gop->data, gop->len);
+      g_byte_array_free (gop, TRUE);
+    }
+  }
+  UMMS_DEBUG ("swapped in with %u bytes of PSI and GOP", head->len);
+
+  if (head->len) {
+    buffer = gst_buffer_new_and_alloc (head->len);
+    memcpy (GST_BUFFER_DATA (buffer), head->data, head->len);
+    gst_app_src_push_buffer (priv->ts_src, buffer);
+  }
+  g_byte_array_free (head, TRUE);
+  //The source of playbin2 is fed from now on, its packets may not start on this buffer.
+  priv->carry_len = 0;
+}
+
+/*
+ * On the way out of READY to PAUSED, with the control lock held: a live
+ * source doesn't preroll, so a neighbour channel pre-tuned at background
+ * priority (see umms_media_player_set_zap_neighbours()) would show nothing
+ * until the next random access point once played. playbin2 stays stopped
+ * instead and a capture keeps the PAT, the PMT and the last GOP of the
+ * program. FALSE if not pre-tuning.
+ */
+static gboolean
+pretune_start (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstElement *capture;
+
+  if (umms_player_backend_get_priority (self) != ResourcePriorityBackground
+      || !umms_player_backend_is_live_uri (self->uri))
+    return FALSE;
+
+  if (!(capture = capture_new (self, "pretune-capture", pretune_capture_buffer)))
+    return FALSE;
+
+  g_mutex_lock (priv->ts_lock);
+  priv->pretune_live = FALSE;
+  priv->pmt_pid = 0;
+  memset (priv->pat_packet, 0, TS_PACKET_LEN);
+  memset (priv->pmt_packet, 0, TS_PACKET_LEN);
+  priv->is_ts = -1;
+  priv->carry_len = 0;
+  g_mutex_unlock (priv->ts_lock);
+  umms_gop_cache_reset (priv->gop, UMMS_GOP_CACHE_NO_PID);
+
+  if (gst_element_set_state (capture, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    UMMS_WARNING ("capture of \"%s\" failed, not pre-tuning", self->uri);
+    gst_element_set_state (capture, GST_STATE_NULL);
+    gst_object_unref (capture);
+    return FALSE;
+  }
+
+  priv->capture = capture;
+  priv->pretuned = TRUE;
+  g_object_set (priv->pipeline, "uri", "appsrc://", NULL);
+  set_player_state (self, PlayerStatePaused);
+  return TRUE;
+}
+
+//With the control lock held: playbin2 plays the pre-tuned channel, see pretune_push_head().
+static void
+pretune_swap_in (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  priv->pretuned = FALSE;
+  g_mutex_lock (priv->ts_lock);
+  priv->pretune_live = TRUE;
+  g_mutex_unlock (priv->ts_lock);
+}
+
+static GstStateChangeReturn
+change_state (UmmsPlayerBackend *self, GstState state)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstStateChangeReturn ret;
+  gboolean buffering_paused;
+
+  umms_player_backend_state_lock (self);
+  priv->target_state = state;
+  buffering_paused = priv->buffering_paused;
+  umms_player_backend_state_unlock (self);
+  //Resumed by the bus watch once the queue2 is refilled.
+  if (buffering_paused && state == GST_STATE_PLAYING)
+    return GST_STATE_CHANGE_SUCCESS;
+
+  if (state >= GST_STATE_PAUSED && !priv->capture && pipeline_is_stopped (priv)) {
+    if (state == GST_STATE_PAUSED && pretune_start (self))
+      return GST_STATE_CHANGE_SUCCESS;
+    ts_start (self);
+  }
+  //Pre-tuned, playbin2 starts once the channel is swapped in or played.
+  if (priv->pretuned) {
+    if (state == GST_STATE_PAUSED && umms_player_backend_get_priority (self) == ResourcePriorityBackground)
+      return GST_STATE_CHANGE_SUCCESS;
+    if (state >= GST_STATE_PAUSED)
+      pretune_swap_in (self);
+  }
+  ret = gst_element_set_state (priv->pipeline, state);
+  if (ret == GST_STATE_CHANGE_NO_PREROLL) {
+    umms_player_backend_state_lock (self);
+    self->is_live = TRUE;
+    umms_player_backend_state_unlock (self);
+  }
+  return ret;
+}
+
+static gboolean
+change_state_sync (UmmsPlayerBackend *self, GstState state, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstStateChangeReturn ret;
+
+  if (!self->uri) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "no uri set");
+    return FALSE;
+  }
+
+  ret = change_state (self, state);
+  if (ret == GST_STATE_CHANGE_ASYNC)
+    ret = gst_element_get_state (priv->pipeline, NULL, NULL, STATE_CHANGE_TIMEOUT);
+
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "pipeline failed to go to %s",
+                 gst_element_state_get_name (state));
+    return FALSE;
+  }
+  if (ret == GST_STATE_CHANGE_ASYNC) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "pipeline didn't reach %s in time",
+                 gst_element_state_get_name (state));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+change_state_async (UmmsPlayerBackend *self, GstState state, UmmsPlayerBackendCallback callback,
+                    gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstStateChangeReturn ret;
+  GError *err = NULL;
+
+  if (!self->uri) {
+    g_set_error (&err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "no uri set");
+    callback (self, FALSE, err, user_data);
+    g_error_free (err);
+    return;
+  }
+
+  request_set (self, &priv->state_req, state, callback, user_data);
+  ret = change_state (self, state);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (&err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "pipeline failed to go to %s",
+                 gst_element_state_get_name (state));
+    request_done (self, &priv->state_req, FALSE, err);
+    g_error_free (err);
+  } else if (ret != GST_STATE_CHANGE_ASYNC) {
+    request_done (self, &priv->state_req, TRUE, NULL);
+  }
+}
+
+static gboolean
+query_position (UmmsGstBackendPrivate *priv, gint64 *pos)
+{
+  GstFormat format = GST_FORMAT_TIME;
+  gint64 cur;
+
+  if (!gst_element_query_position (priv->pipeline, &format, &cur) || format != GST_FORMAT_TIME || cur < 0)
+    return FALSE;
+  *pos = cur / GST_MSECOND;
+  return TRUE;
+}
+
+static gboolean
+do_seek (UmmsPlayerBackend *self, gint64 pos, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstSeekFlags flags = GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT;
+  gdouble rate;
+  gboolean ret;
+
+  umms_player_backend_state_lock (self);
+  rate = priv->rate;
+  umms_player_backend_state_unlock (self);
+
+  //Backwards, the segment ends at the position.
+  if (rate >= 0)
+    ret = gst_element_seek (priv->pipeline, rate, GST_FORMAT_TIME, flags,
+                            GST_SEEK_TYPE_SET, pos * GST_MSECOND, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+  else
+    ret = gst_element_seek (priv->pipeline, rate, GST_FORMAT_TIME, flags,
+                            GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_SET, pos * GST_MSECOND);
+
+  if (!ret) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "seek to %" G_GINT64_FORMAT " ms failed", pos);
+    return FALSE;
+  }
+  g_mutex_lock (priv->lock);
+  priv->seeking = TRUE;
+  g_mutex_unlock (priv->lock);
+  return TRUE;
+}
+
+static void
+query_stream_info (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstFormat format = GST_FORMAT_TIME;
+  GstQuery *query;
+  gint64 duration = 0, total_bytes = 0;
+  gboolean seekable = FALSE;
+
+  if (!gst_element_query_duration (priv->pipeline, &format, &duration))
+    duration = 0;
+  format = GST_FORMAT_BYTES;
+  if (!gst_element_query_duration (priv->pipeline, &format, &total_bytes))
+    total_bytes = 0;
+
+  query = gst_query_new_seeking (GST_FORMAT_TIME);
+  if (gst_element_query (priv->pipeline, query))
+    gst_query_parse_seeking (query, NULL, &seekable, NULL, NULL);
+  gst_query_unref (query);
+
+  umms_player_backend_state_lock (self);
+  if (duration > 0)
+    self->duration = duration / GST_MSECOND;
+  if (total_bytes > 0)
+    self->total_bytes = total_bytes;
+  //Within the window of the ring.
+  self->seekable = seekable || priv->timeshifting;
+  if (umms_player_backend_is_live_uri (self->uri))
+    self->is_live = TRUE;
+  umms_player_backend_state_unlock (self);
+}
+
+/*
+ * Run on the main loop: if a transition holds the control lock, it decides the
+ * state itself, the next buffering message retries.
+ */
+static void
+handle_buffering (UmmsPlayerBackend *self, gint percent)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstState state = GST_STATE_VOID_PENDING;
+
+  umms_player_backend_state_lock (self);
+  self->buffer_percent = percent;
+  self->buffering = percent < 100;
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_emit_buffering (self, percent);
+
+  if (!umms_player_backend_trylock (self))
+    return;
+
+  umms_player_backend_state_lock (self);
+  //A live source can't be paused, the data would be lost.
+  if (!self->is_live && priv->target_state == GST_STATE_PLAYING) {
+    if (percent < 100 && !priv->buffering_paused) {
+      priv->buffering_paused = TRUE;
+      state = GST_STATE_PAUSED;
+    } else if (percent == 100 && priv->buffering_paused) {
+      priv->buffering_paused = FALSE;
+      state = GST_STATE_PLAYING;
+    }
+  }
+  umms_player_backend_state_unlock (self);
+
+  if (state != GST_STATE_VOID_PENDING)
+    gst_element_set_state (priv->pipeline, state);
+  umms_player_backend_unlock (self);
+}
+
+static void
+handle_tags (UmmsPlayerBackend *self, GstTagList *tags)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstTagList *merged;
+  gchar *str;
+
+  umms_player_backend_state_lock (self);
+  merged = gst_tag_list_merge (priv->tags, tags, GST_TAG_MERGE_REPLACE);
+  if (priv->tags)
+    gst_tag_list_free (priv->tags);
+  priv->tags = merged;
+
+  if (gst_tag_list_get_string (tags, GST_TAG_TITLE, &str)) {
+    g_free (self->title);
+    self->title = str;
+  }
+  if (gst_tag_list_get_string (tags, GST_TAG_ARTIST, &str)) {
+    g_free (self->artist);
+    self->artist = str;
+  }
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_emit_metadata_changed (self);
+}
+
+//On the main loop, takes the state lock only, see the threading contract in umms-player-backend.h.
+static gboolean
+bus_cb (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_STATE_CHANGED: {
+      GstState old, new, pending;
+      gint64 start_pos = -1;
+      gboolean buffering_paused, restarting, timeshifting;
+
+      if (GST_MESSAGE_SRC (msg) != GST_OBJECT (priv->pipeline))
+        break;
+      gst_message_parse_state_changed (msg, &old, &new, &pending);
+      UMMS_DEBUG ("%s => %s", gst_element_state_get_name (old), gst_element_state_get_name (new));
+
+      if (old == GST_STATE_READY && new == GST_STATE_PAUSED) {
+        query_stream_info (self);
+        umms_player_backend_state_lock (self);
+        start_pos = priv->start_pos;
+        priv->start_pos = -1;
+        timeshifting = priv->timeshifting;
+        umms_player_backend_state_unlock (self);
+        //The ring starts with the playback, there is nothing before.
+        if (start_pos >= 0 && !timeshifting)
+          do_seek (self, start_pos, NULL);
+      }
+      umms_player_backend_state_lock (self);
+      buffering_paused = priv->buffering_paused;
+      restarting = priv->ts_restart;
+      if (restarting && pending == GST_STATE_VOID_PENDING && new == priv->target_state)
+        priv->ts_restart = FALSE;
+      umms_player_backend_state_unlock (self);
+      //Back in the state it left for the seek, the trip through READY is not announced.
+      if (!buffering_paused && !restarting)
+        set_player_state (self, state_from_gst (new));
+      if (pending == GST_STATE_VOID_PENDING)
+        state_request_reached (self, new);
+      break;
+    }
+    case GST_MESSAGE_ASYNC_DONE: {
+      gboolean seeking;
+
+      g_mutex_lock (priv->lock);
+      seeking = priv->seeking;
+      priv->seeking = FALSE;
+      g_mutex_unlock (priv->lock);
+      if (seeking) {
+        request_done (self, &priv->seek_req, TRUE, NULL);
+        umms_player_backend_emit_seeked (self);
+      }
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      umms_player_backend_emit_eof (self);
+      break;
+    case GST_MESSAGE_ERROR: {
+      GError *err = NULL;
+      gchar *debug = NULL;
+
+      gst_message_parse_error (msg, &err, &debug);
+      UMMS_WARNING ("%s (%s)", err->message, debug ? debug : "");
+      request_done (self, &priv->state_req, FALSE, err);
+      request_done (self, &priv->seek_req, FALSE, err);
+      umms_player_backend_emit_error (self, UMMS_BACKEND_ERROR_FAILED, err->message);
+      g_error_free (err);
+      g_free (debug);
+      break;
+    }
+    case GST_MESSAGE_BUFFERING: {
+      gint percent = 0;
+
+      gst_message_parse_buffering (msg, &percent);
+      handle_buffering (self, percent);
+      break;
+    }
+    case GST_MESSAGE_TAG: {
+      GstTagList *tags = NULL;
+
+      //Those of the streams are read with get-*-tags.
+      if (GST_MESSAGE_SRC (msg) != GST_OBJECT (priv->pipeline))
+        break;
+      gst_message_parse_tag (msg, &tags);
+      handle_tags (self, tags);
+      gst_tag_list_free (tags);
+      break;
+    }
+    case GST_MESSAGE_DURATION:
+      query_stream_info (self);
+      break;
+    case GST_MESSAGE_APPLICATION: {
+      const GstStructure *s = gst_message_get_structure (msg);
+      gint channel = 0;
+
+      gst_structure_get_int (s, "channel", &channel);
+      if (gst_structure_has_name (s, "video-tags-changed"))
+        umms_player_backend_emit_video_tag_changed (self, channel);
+      else if (gst_structure_has_name (s, "audio-tags-changed"))
+        umms_player_backend_emit_audio_tag_changed (self, channel);
+      else if (gst_structure_has_name (s, "text-tags-changed"))
+        umms_player_backend_emit_text_tag_changed (self, channel);
+      else if (gst_structure_has_name (s, "record-failed"))
+        umms_player_backend_emit_error (self, UMMS_BACKEND_ERROR_FAILED, "recording failed to write");
+      else if (gst_structure_has_name (s, "timeshift-failed"))
+        umms_player_backend_emit_error (self, UMMS_BACKEND_ERROR_FAILED, "timeshift failed to write");
+      break;
+    }
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static void
+overlay_apply (UmmsGstBackendPrivate *priv)
+{
+  GstXOverlay *overlay;
+  gboolean keep_aspect;
+
+  g_mutex_lock (priv->lock);
+  if (!priv->overlay) {
+    g_mutex_unlock (priv->lock);
+    return;
+  }
+  overlay = GST_X_OVERLAY (priv->overlay);
+
+  if (priv->has_xid)
+    gst_x_overlay_set_xwindow_id (overlay, priv->xid);
+  if (priv->has_rect)
+    gst_x_overlay_set_render_rectangle (overlay, priv->x, priv->y, priv->w, priv->h);
+  if (has_property (priv->overlay, "force-aspect-ratio")) {
+    keep_aspect = priv->scale_mode == ScaleModeKeepAspectRatio || priv->scale_mode == ScaleModeFillKeepAspectRatio;
+    g_object_set (priv->overlay, "force-aspect-ratio", keep_aspect, NULL);
+  }
+  gst_x_overlay_expose (overlay);
+  g_mutex_unlock (priv->lock);
+}
+
+//Called from the streaming thread, the window must be set before the sink makes its own.
+static GstBusSyncReply
+bus_sync_handler (GstBus *bus, GstMessage *msg, gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (user_data)->priv;
+  const GstStructure *s;
+
+  if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_ELEMENT)
+    return GST_BUS_PASS;
+  s = gst_message_get_structure (msg);
+  if (!s || !gst_structure_has_name (s, "prepare-xwindow-id") || !GST_IS_X_OVERLAY (GST_MESSAGE_SRC (msg)))
+    return GST_BUS_PASS;
+
+  g_mutex_lock (priv->lock);
+  if (priv->overlay)
+    gst_object_unref (priv->overlay);
+  priv->overlay = GST_ELEMENT (gst_object_ref (GST_MESSAGE_SRC (msg)));
+  g_mutex_unlock (priv->lock);
+  overlay_apply (priv);
+  gst_message_unref (msg);
+  return GST_BUS_DROP;
+}
+
+static void
+post_tags_changed (GstElement *playbin, gint channel, const gchar *name)
+{
+  gst_element_post_message (playbin,
+                            gst_message_new_application (GST_OBJECT (playbin),
+                                gst_structure_new (name, "channel", G_TYPE_INT, channel, NULL)));
+}
+
+//Emitted from the streaming threads, the signals are emitted from the bus watch.
+static void
+video_tags_changed_cb (GstElement *playbin, gint channel, gpointer user_data)
+{
+  post_tags_changed (playbin, channel, "video-tags-changed");
+}
+
+static void
+audio_tags_changed_cb (GstElement *playbin, gint channel, gpointer user_data)
+{
+  post_tags_changed (playbin, channel, "audio-tags-changed");
+}
+
+static void
+text_tags_changed_cb (GstElement *playbin, gint channel, gpointer user_data)
+{
+  post_tags_changed (playbin, channel, "text-tags-changed");
+}
+
+static gboolean
+source_probe_cb (GstPad *pad, GstBuffer *buffer, gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  const guint8 *data = GST_BUFFER_DATA (buffer);
+  gsize len = GST_BUFFER_SIZE (buffer);
+  gboolean failed = FALSE;
+
+  g_mutex_lock (priv->lock);
+  if (priv->record_file && fwrite (data, 1, len, priv->record_file) != len) {
+    fclose (priv->record_file);
+    priv->record_file = NULL;
+    failed = TRUE;
+  }
+  g_mutex_unlock (priv->lock);
+
+  if (failed)
+    gst_element_post_message (priv->pipeline,
+                              gst_message_new_application (GST_OBJECT (priv->pipeline),
+                                  gst_structure_new ("record-failed", NULL)));
+  feed_psi (self, data, len, FALSE);
+  return TRUE;
+}
+
+static void
+source_probe_remove (UmmsGstBackendPrivate *priv)
+{
+  GstPad *pad;
+  gulong id;
+
+  g_mutex_lock (priv->lock);
+  pad = priv->source_pad;
+  id = priv->probe_id;
+  priv->source_pad = NULL;
+  g_mutex_unlock (priv->lock);
+
+  if (pad) {
+    gst_pad_remove_buffer_probe (pad, id);
+    gst_object_unref (pad);
+  }
+}
+
+static void
+source_changed_cb (GObject *playbin, GParamSpec *pspec, gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstElement *source = NULL;
+  GstPad *pad;
+
+  source_probe_remove (priv);
+  ts_set_src (priv, NULL);
+  g_object_get (playbin, "source", &source, NULL);
+  if (!source)
+    return;
+
+  source_set_proxy (self, source);
+  //Timeshifting, the appsrc plays the ring.
+  if (g_strcmp0 (element_factory_name (source), "appsrc") == 0) {
+    GstAppSrcCallbacks callbacks = {0,};
+
+    callbacks.need_data = ts_need_data;
+    gst_app_src_set_callbacks (GST_APP_SRC (source), &callbacks, self, NULL);
+    ts_set_src (priv, source);
+    g_mutex_lock (priv->ts_lock);
+    if (priv->pretune_live && priv->ts_src)
+      pretune_push_head (priv);
+    g_mutex_unlock (priv->ts_lock);
+  }
+
+  //Sources with sometimes pads (e.g. rtspsrc) can't be probed, no PSI nor recording then.
+  pad = gst_element_get_static_pad (source, "src");
+  if (pad) {
+    g_mutex_lock (priv->lock);
+    priv->source_pad = pad;
+    priv->probe_id = gst_pad_add_buffer_probe (pad, G_CALLBACK (source_probe_cb), self);
+    g_mutex_unlock (priv->lock);
+  }
+  gst_object_unref (source);
+}
+
+static gboolean
+record_stop (UmmsPlayerBackend *self)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  FILE *file;
+
+  g_mutex_lock (priv->lock);
+  file = priv->record_file;
+  priv->record_file = NULL;
+  g_mutex_unlock (priv->lock);
+
+  if (!file)
+    return FALSE;
+  fclose (file);
+  umms_player_backend_emit_record_stop (self);
+  return TRUE;
+}
+
+static GstFlowReturn
+appsink_new_buffer (GstAppSink *sink, gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  GstBuffer *buffer = gst_app_sink_pull_buffer (sink);
+  UmmsFrameInfo info = {0,};
+  gint width = 0, height = 0;
+
+  if (!buffer)
+    return GST_FLOW_UNEXPECTED;
+
+  if (GST_BUFFER_CAPS (buffer)) {
+    GstStructure *s = gst_caps_get_structure (GST_BUFFER_CAPS (buffer), 0);
+
+    gst_structure_get_int (s, "width", &width);
+    gst_structure_get_int (s, "height", &height);
+  }
+  info.size = GST_BUFFER_SIZE (buffer);
+  info.width = width;
+  info.height = height;
+  info.stride = GST_ROUND_UP_4 (width);
+  info.format = GST_MAKE_FOURCC ('I', '4', '2', '0');
+  info.pts = GST_BUFFER_TIMESTAMP_IS_VALID (buffer) ? (gint64)GST_BUFFER_TIMESTAMP (buffer) : -1;
+
+  //The ring drops the oldest frame if the client lags, the pipeline is never held back.
+  if (!umms_player_backend_push_frame (self, &info, GST_BUFFER_DATA (buffer)))
+    UMMS_DEBUG ("frame of %u bytes dropped", info.size);
+  gst_buffer_unref (buffer);
+  return GST_FLOW_OK;
+}
+
+static GstElement *
+make_data_copy_sink (UmmsPlayerBackend *self)
+{
+  GstAppSinkCallbacks callbacks = {0,};
+  GstElement *sink = gst_element_factory_make ("appsink", NULL);
+  GstCaps *caps;
+
+  if (!sink)
+    return NULL;
+  caps = gst_caps_new_simple ("video/x-raw-yuv", "format", GST_TYPE_FOURCC, GST_MAKE_FOURCC ('I', '4', '2', '0'),
+                              NULL);
+  gst_app_sink_set_caps (GST_APP_SINK (sink), caps);
+  gst_caps_unref (caps);
+  gst_app_sink_set_max_buffers (GST_APP_SINK (sink), 2);
+  gst_app_sink_set_drop (GST_APP_SINK (sink), TRUE);
+  callbacks.new_buffer = appsink_new_buffer;
+  gst_app_sink_set_callbacks (GST_APP_SINK (sink), &callbacks, self, NULL);
+  return sink;
+}
+
+/*
+ * For the setters on the main loop: the pipeline only moves with the control
+ * lock held, so keep it until the element is changed. FALSE without waiting
+ * if a transition is on its way or the pipeline is started.
+ */
+static gboolean
+pipeline_lock_stopped (UmmsPlayerBackend *self)
+{
+  if (!umms_player_backend_trylock (self))
+    return FALSE;
+  if (!pipeline_is_stopped (UMMS_GST_BACKEND (self)->priv)) {
+    umms_player_backend_unlock (self);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_uri (UmmsPlayerBackend *self, const gchar *uri, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (!gst_uri_is_valid (uri)) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "invalid uri \"%s\"", uri);
+    return FALSE;
+  }
+
+  record_stop (self);
+  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  ts_stop (self);
+  priv->is_ts = -1;
+  priv->carry_len = 0;
+  umms_player_backend_state_lock (self);
+  priv->target_state = GST_STATE_NULL;
+  priv->buffering_paused = FALSE;
+  priv->start_pos = -1;
+  priv->rate = 1.0;
+  if (priv->tags) {
+    gst_tag_list_free (priv->tags);
+    priv->tags = NULL;
+  }
+  self->seekable = 0;
+  self->is_live = FALSE;
+  self->duration = 0;
+  self->total_bytes = 0;
+  umms_player_backend_state_unlock (self);
+
+  g_object_set (priv->pipeline, "uri", uri, NULL);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_target (UmmsPlayerBackend *self, gint type, GHashTable *params, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstElement *sink = NULL;
+  GValue *val;
+
+  switch (type) {
+    case XWindow:
+      val = params ? g_hash_table_lookup (params, "window-id") : NULL;
+      if (!val || !(G_VALUE_HOLDS_INT (val) || G_VALUE_HOLDS_UINT (val))) {
+        g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "window-id is missing");
+        return FALSE;
+      }
+      priv->xid = G_VALUE_HOLDS_INT (val) ? (gulong)g_value_get_int (val) : g_value_get_uint (val);
+      priv->has_xid = TRUE;
+      if (priv->target_type == DataCopy) {
+        if (!pipeline_lock_stopped (self)) {
+          g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "can't change the sink while playing");
+          return FALSE;
+        }
+        if (priv->conf.video_sink)
+          sink = make_sink (priv->conf.video_sink);
+        g_object_set (priv->pipeline, "video-sink", sink, NULL);
+        umms_player_backend_unlock (self);
+      }
+      overlay_apply (priv);
+      break;
+    case DataCopy:
+      if (!pipeline_lock_stopped (self)) {
+        g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "can't change the sink while playing");
+        return FALSE;
+      }
+      if (!(sink = make_data_copy_sink (self))) {
+        umms_player_backend_unlock (self);
+        g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "appsink not available");
+        return FALSE;
+      }
+      g_object_set (priv->pipeline, "video-sink", sink, NULL);
+      umms_player_backend_unlock (self);
+      break;
+    default:
+      g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, "target type %d not supported",
+                   type);
+      return FALSE;
+  }
+
+  priv->target_type = type;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_play (UmmsPlayerBackend *self, GError **err)
+{
+  return change_state_sync (self, GST_STATE_PLAYING, err);
+}
+
+static gboolean
+umms_gst_backend_pause (UmmsPlayerBackend *self, GError **err)
+{
+  return change_state_sync (self, GST_STATE_PAUSED, err);
+}
+
+static void
+umms_gst_backend_play_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  change_state_async (self, GST_STATE_PLAYING, callback, user_data);
+}
+
+static void
+umms_gst_backend_pause_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  change_state_async (self, GST_STATE_PAUSED, callback, user_data);
+}
+
+static gboolean
+umms_gst_backend_stop (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  record_stop (self);
+  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  ts_stop (self);
+  umms_player_backend_state_lock (self);
+  priv->target_state = GST_STATE_NULL;
+  priv->buffering_paused = FALSE;
+  priv->start_pos = -1;
+  umms_player_backend_state_unlock (self);
+  //Cancelled by the client, they didn't fail.
+  request_done (self, &priv->state_req, TRUE, NULL);
+  request_done (self, &priv->seek_req, TRUE, NULL);
+  umms_player_backend_release_resource (self);
+
+  //The bus is flushed on the way to NULL, the state is announced here.
+  set_player_state (self, PlayerStateStopped);
+  umms_player_backend_emit_stopped (self);
+  return TRUE;
+}
+
+//Not prerolled yet, the seek is done once prerolled and *deferred is set.
+static gboolean
+set_position (UmmsPlayerBackend *self, gint64 pos, gboolean *deferred, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  *deferred = FALSE;
+  if (pos < 0) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "negative position");
+    return FALSE;
+  }
+  //A pre-tuned live channel, not timeshifted.
+  if (priv->capture && !priv->timeshift) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "live stream not seekable");
+    return FALSE;
+  }
+  if (pipeline_is_stopped (priv)) {
+    umms_player_backend_state_lock (self);
+    priv->start_pos = pos;
+    umms_player_backend_state_unlock (self);
+    *deferred = TRUE;
+    return TRUE;
+  }
+  if (priv->capture)
+    return ts_seek (self, pos, err);
+  return do_seek (self, pos, err);
+}
+
+static gboolean
+umms_gst_backend_set_position (UmmsPlayerBackend *self, gint64 pos, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gboolean deferred;
+
+  if (!set_position (self, pos, &deferred, err))
+    return FALSE;
+  if (!deferred && gst_element_get_state (priv->pipeline, NULL, NULL, STATE_CHANGE_TIMEOUT) == GST_STATE_CHANGE_FAILURE) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "seek failed");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+umms_gst_backend_set_position_async (UmmsPlayerBackend *self, gint64 pos, UmmsPlayerBackendCallback callback,
+                                     gpointer user_data)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GError *err = NULL;
+  gboolean deferred;
+
+  request_set (self, &priv->seek_req, GST_STATE_VOID_PENDING, callback, user_data);
+  if (!set_position (self, pos, &deferred, &err)) {
+    request_done (self, &priv->seek_req, FALSE, err);
+    g_error_free (err);
+  } else if (deferred) {
+    request_done (self, &priv->seek_req, TRUE, NULL);
+  }
+}
+
+static gboolean
+umms_gst_backend_get_position (UmmsPlayerBackend *self, gint64 *cur_time, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (self->suspended) {
+    *cur_time = self->pos;
+    return TRUE;
+  }
+  if (!query_position (priv, cur_time)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "position query failed");
+    return FALSE;
+  }
+  //The playback of the ring restarts from 0 at each seek.
+  umms_player_backend_state_lock (self);
+  if (priv->timeshifting)
+    *cur_time += priv->ts_base;
+  umms_player_backend_state_unlock (self);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_playback_rate (UmmsPlayerBackend *self, gdouble rate, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gint64 pos;
+
+  if (rate == 0.0) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "rate 0, use Pause");
+    return FALSE;
+  }
+  //The appsrc playing the ring can't seek, so neither change the rate.
+  if (priv->capture && rate != 1.0) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "playback rate not supported while timeshifting");
+    return FALSE;
+  }
+  umms_player_backend_state_lock (self);
+  priv->rate = rate;
+  umms_player_backend_state_unlock (self);
+  //Applied by the next seek if not prerolled yet.
+  if (pipeline_is_stopped (priv) || priv->capture || !query_position (priv, &pos))
+    return TRUE;
+  return do_seek (self, pos, err);
+}
+
+static gboolean
+umms_gst_backend_get_playback_rate (UmmsPlayerBackend *self, gdouble *out_rate, GError **err)
+{
+  *out_rate = UMMS_GST_BACKEND (self)->priv->rate;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_volume (UmmsPlayerBackend *self, gint vol, GError **err)
+{
+  g_object_set (UMMS_GST_BACKEND (self)->priv->pipeline, "volume", CLAMP (vol, 0, 100) / 100.0, NULL);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_volume (UmmsPlayerBackend *self, gint *vol, GError **err)
+{
+  gdouble volume = 0;
+
+  g_object_get (UMMS_GST_BACKEND (self)->priv->pipeline, "volume", &volume, NULL);
+  *vol = (gint)(volume * 100 + 0.5);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_mute (UmmsPlayerBackend *self, gint mute, GError **err)
+{
+  g_object_set (UMMS_GST_BACKEND (self)->priv->pipeline, "mute", mute ? TRUE : FALSE, NULL);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_is_mute (UmmsPlayerBackend *self, gint *mute, GError **err)
+{
+  gboolean muted = FALSE;
+
+  g_object_get (UMMS_GST_BACKEND (self)->priv->pipeline, "mute", &muted, NULL);
+  *mute = muted;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_video_size (UmmsPlayerBackend *self, guint x, guint y, guint w, guint h, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  priv->x = x;
+  priv->y = y;
+  priv->w = w;
+  priv->h = h;
+  priv->has_rect = TRUE;
+  overlay_apply (priv);
+  return TRUE;
+}
+
+static GstCaps *
+stream_caps (UmmsGstBackendPrivate *priv, const gchar *signal, gint channel)
+{
+  GstPad *pad = NULL;
+  GstCaps *caps = NULL;
+
+  g_signal_emit_by_name (priv->pipeline, signal, channel, &pad);
+  if (pad) {
+    caps = gst_pad_get_negotiated_caps (pad);
+    gst_object_unref (pad);
+  }
+  return caps;
+}
+
+static GstTagList *
+stream_tags (UmmsGstBackendPrivate *priv, const gchar *signal, gint channel)
+{
+  GstTagList *tags = NULL;
+
+  g_signal_emit_by_name (priv->pipeline, signal, channel, &tags);
+  return tags;
+}
+
+static gboolean
+umms_gst_backend_get_video_resolution (UmmsPlayerBackend *self, gint channel, gint *width, gint *height, GError **err)
+{
+  GstCaps *caps = stream_caps (UMMS_GST_BACKEND (self)->priv, "get-video-pad", channel);
+  gboolean ret = FALSE;
+
+  if (caps) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    ret = gst_structure_get_int (s, "width", width) && gst_structure_get_int (s, "height", height);
+    gst_caps_unref (caps);
+  }
+  if (!ret)
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no video stream %d negotiated", channel);
+  return ret;
+}
+
+static gboolean
+umms_gst_backend_get_video_size (UmmsPlayerBackend *self, guint *w, guint *h, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gint cur = 0, width, height;
+
+  if (priv->has_rect) {
+    *w = priv->w;
+    *h = priv->h;
+    return TRUE;
+  }
+  g_object_get (priv->pipeline, "current-video", &cur, NULL);
+  if (!umms_gst_backend_get_video_resolution (self, MAX (cur, 0), &width, &height, err))
+    return FALSE;
+  *w = width;
+  *h = height;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_video_framerate (UmmsPlayerBackend *self, gint channel, gint *num, gint *denom, GError **err)
+{
+  GstCaps *caps = stream_caps (UMMS_GST_BACKEND (self)->priv, "get-video-pad", channel);
+  gboolean ret = FALSE;
+
+  if (caps) {
+    ret = gst_structure_get_fraction (gst_caps_get_structure (caps, 0), "framerate", num, denom);
+    gst_caps_unref (caps);
+  }
+  if (!ret)
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no framerate for video stream %d", channel);
+  return ret;
+}
+
+static gboolean
+umms_gst_backend_get_video_aspect_ratio (UmmsPlayerBackend *self, gint channel, gint *num, gint *denom,
+                                         GError **err)
+{
+  GstCaps *caps = stream_caps (UMMS_GST_BACKEND (self)->priv, "get-video-pad", channel);
+  gint width = 0, height = 0, par_n = 1, par_d = 1, a, b, t;
+  gboolean ret = FALSE;
+
+  if (caps) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    ret = gst_structure_get_int (s, "width", &width) && gst_structure_get_int (s, "height", &height) && height;
+    gst_structure_get_fraction (s, "pixel-aspect-ratio", &par_n, &par_d);
+    gst_caps_unref (caps);
+  }
+  if (!ret) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no video stream %d negotiated", channel);
+    return FALSE;
+  }
+
+  //Display aspect ratio, reduced.
+  a = *num = width * par_n;
+  b = *denom = height * par_d;
+  while (b) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  *num /= a;
+  *denom /= a;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_audio_samplerate (UmmsPlayerBackend *self, gint channel, gint *sample_rate, GError **err)
+{
+  GstCaps *caps = stream_caps (UMMS_GST_BACKEND (self)->priv, "get-audio-pad", channel);
+  gboolean ret = FALSE;
+
+  if (caps) {
+    ret = gst_structure_get_int (gst_caps_get_structure (caps, 0), "rate", sample_rate);
+    gst_caps_unref (caps);
+  }
+  if (!ret)
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no audio stream %d negotiated", channel);
+  return ret;
+}
+
+static gboolean
+get_codec (UmmsPlayerBackend *self, const gchar *signal, const gchar *tag, gint channel, gchar **codec,
+           GError **err)
+{
+  GstTagList *tags = stream_tags (UMMS_GST_BACKEND (self)->priv, signal, channel);
+  gboolean ret = FALSE;
+
+  if (tags) {
+    ret = gst_tag_list_get_string (tags, tag, codec);
+    gst_tag_list_free (tags);
+  }
+  if (!ret)
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no codec known for stream %d", channel);
+  return ret;
+}
+
+static gboolean
+get_bitrate (UmmsPlayerBackend *self, const gchar *signal, gint channel, gint *bit_rate, GError **err)
+{
+  GstTagList *tags = stream_tags (UMMS_GST_BACKEND (self)->priv, signal, channel);
+  gboolean ret = FALSE;
+  guint rate = 0;
+
+  if (tags) {
+    ret = gst_tag_list_get_uint (tags, GST_TAG_BITRATE, &rate)
+          || gst_tag_list_get_uint (tags, GST_TAG_NOMINAL_BITRATE, &rate);
+    gst_tag_list_free (tags);
+  }
+  if (!ret) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "no bitrate known for stream %d", channel);
+    return FALSE;
+  }
+  *bit_rate = rate;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_video_codec (UmmsPlayerBackend *self, gint channel, gchar **codec, GError **err)
+{
+  return get_codec (self, "get-video-tags", GST_TAG_VIDEO_CODEC, channel, codec, err);
+}
+
+static gboolean
+umms_gst_backend_get_audio_codec (UmmsPlayerBackend *self, gint channel, gchar **codec, GError **err)
+{
+  return get_codec (self, "get-audio-tags", GST_TAG_AUDIO_CODEC, channel, codec, err);
+}
+
+static gboolean
+umms_gst_backend_get_video_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
+{
+  return get_bitrate (self, "get-video-tags", channel, bit_rate, err);
+}
+
+static gboolean
+umms_gst_backend_get_audio_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
+{
+  return get_bitrate (self, "get-audio-tags", channel, bit_rate, err);
+}
+
+static gboolean
+umms_gst_backend_get_encapsulation (UmmsPlayerBackend *self, gchar **encapsulation, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (!priv->tags || !gst_tag_list_get_string (priv->tags, GST_TAG_CONTAINER_FORMAT, encapsulation)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "container format not known yet");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+typedef struct {
+  const gchar *property;
+  guint64 total;
+  gboolean found;
+} QueueLevel;
+
+static void
+queue_level_func (gpointer element, gpointer user_data)
+{
+  QueueLevel *level = user_data;
+  guint64 val64 = 0;
+  guint val = 0;
+
+  if (g_strcmp0 (element_factory_name (element), "queue2"))
+    return;
+  level->found = TRUE;
+  if (!strcmp (level->property, "current-level-time")) {
+    g_object_get (element, level->property, &val64, NULL);
+    level->total += val64;
+  } else {
+    g_object_get (element, level->property, &val, NULL);
+    level->total += val;
+  }
+}
+
+//Data in the queue2 ahead of the playback, 0 for local files which have none.
+static gboolean
+umms_gst_backend_get_buffered_time (UmmsPlayerBackend *self, gint64 *depth, GError **err)
+{
+  QueueLevel level = {"current-level-time", 0, FALSE};
+
+  foreach_element (UMMS_GST_BACKEND (self)->priv, queue_level_func, &level);
+  *depth = level.total / GST_MSECOND;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_buffered_bytes (UmmsPlayerBackend *self, gint64 *depth, GError **err)
+{
+  QueueLevel level = {"current-level-bytes", 0, FALSE};
+
+  foreach_element (UMMS_GST_BACKEND (self)->priv, queue_level_func, &level);
+  *depth = level.total;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 buf_val, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (buf_val < 0) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "negative buffer depth");
+    return FALSE;
+  }
+  if (format == BufferFormatByTime) {
+    priv->conf.queue2_time = buf_val;
+  } else if (format == BufferFormatByBytes) {
+    priv->conf.queue2_bytes = buf_val;
+  } else {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "unknown buffer format %d", format);
+    return FALSE;
+  }
+
+  //To the queue2 of the current stream as well.
+  apply_playbin_limits (priv);
+  foreach_element (priv, apply_queue_limits_func, priv);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 *buf_val, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  gint64 val;
+
+  if (format == BufferFormatByTime) {
+    val = priv->conf.queue2_time;
+  } else if (format == BufferFormatByBytes) {
+    val = priv->conf.queue2_bytes;
+  } else {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "unknown buffer format %d", format);
+    return FALSE;
+  }
+  if (val < 0) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "buffer depth left to GStreamer");
+    return FALSE;
+  }
+  *buf_val = val;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_media_size_time (UmmsPlayerBackend *self, gint64 *size_time, GError **err)
+{
+  if (self->duration <= 0)
+    query_stream_info (self);
+  *size_time = self->duration;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_media_size_bytes (UmmsPlayerBackend *self, gint64 *size_bytes, GError **err)
+{
+  if (self->total_bytes <= 0)
+    query_stream_info (self);
+  *size_bytes = self->total_bytes;
+  return TRUE;
+}
+
+static gint
+get_int_property (UmmsPlayerBackend *self, const gchar *name)
+{
+  gint val = 0;
+
+  g_object_get (UMMS_GST_BACKEND (self)->priv->pipeline, name, &val, NULL);
+  return val;
+}
+
+static gboolean
+umms_gst_backend_has_video (UmmsPlayerBackend *self, gboolean *has_video, GError **err)
+{
+  *has_video = get_int_property (self, "n-video") > 0;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_has_audio (UmmsPlayerBackend *self, gboolean *has_audio, GError **err)
+{
+  *has_audio = get_int_property (self, "n-audio") > 0;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_is_streaming (UmmsPlayerBackend *self, gboolean *is_streaming, GError **err)
+{
+  *is_streaming = self->uri && !g_str_has_prefix (self->uri, "file://");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_is_seekable (UmmsPlayerBackend *self, gboolean *seekable, GError **err)
+{
+  *seekable = self->seekable > 0;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_support_fullscreen (UmmsPlayerBackend *self, gboolean *support_fullscreen, GError **err)
+{
+  *support_fullscreen = TRUE;
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_player_state (UmmsPlayerBackend *self, gint *state, GError **err)
+{
+  *state = self->player_state;
+  return TRUE;
+}
+
+static gboolean
+set_stream (UmmsPlayerBackend *self, const gchar *property, const gchar *count, gint stream, GError **err)
+{
+  if (stream < 0 || stream >= get_int_property (self, count)) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no stream %d", stream);
+    return FALSE;
+  }
+  g_object_set (UMMS_GST_BACKEND (self)->priv->pipeline, property, stream, NULL);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_current_video (UmmsPlayerBackend *self, gint *cur_video, GError **err)
+{
+  *cur_video = get_int_property (self, "current-video");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_current_audio (UmmsPlayerBackend *self, gint *cur_audio, GError **err)
+{
+  *cur_audio = get_int_property (self, "current-audio");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_current_subtitle (UmmsPlayerBackend *self, gint *cur_sub, GError **err)
+{
+  *cur_sub = get_int_property (self, "current-text");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_current_video (UmmsPlayerBackend *self, gint cur_video, GError **err)
+{
+  return set_stream (self, "current-video", "n-video", cur_video, err);
+}
+
+static gboolean
+umms_gst_backend_set_current_audio (UmmsPlayerBackend *self, gint cur_audio, GError **err)
+{
+  return set_stream (self, "current-audio", "n-audio", cur_audio, err);
+}
+
+static gboolean
+umms_gst_backend_set_current_subtitle (UmmsPlayerBackend *self, gint cur_sub, GError **err)
+{
+  return set_stream (self, "current-text", "n-text", cur_sub, err);
+}
+
+static gboolean
+umms_gst_backend_get_video_num (UmmsPlayerBackend *self, gint *video_num, GError **err)
+{
+  *video_num = get_int_property (self, "n-video");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_audio_num (UmmsPlayerBackend *self, gint *audio_num, GError **err)
+{
+  *audio_num = get_int_property (self, "n-audio");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_subtitle_num (UmmsPlayerBackend *self, gint *subtitle_num, GError **err)
+{
+  *subtitle_num = get_int_property (self, "n-text");
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_subtitle_uri (UmmsPlayerBackend *self, gchar *sub_uri, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  if (!pipeline_lock_stopped (self)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "subtitle uri must be set before playing");
+    return FALSE;
+  }
+  g_object_set (priv->pipeline, "suburi", sub_uri, NULL);
+  umms_player_backend_unlock (self);
+  return TRUE;
+}
+
+static void
+param_dup_string (GHashTable *params, const gchar *key, gchar **val)
+{
+  GValue *v = g_hash_table_lookup (params, key);
+
+  if (v && G_VALUE_HOLDS_STRING (v)) {
+    g_free (*val);
+    *val = g_value_dup_string (v);
+  }
+}
+
+//Applied to the source element when playbin2 creates it.
+static gboolean
+umms_gst_backend_set_proxy (UmmsPlayerBackend *self, GHashTable *params, GError **err)
+{
+  if (!params) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no proxy params");
+    return FALSE;
+  }
+  param_dup_string (params, "proxy-uri", &self->proxy_uri);
+  param_dup_string (params, "proxy-id", &self->proxy_id);
+  param_dup_string (params, "proxy-pw", &self->proxy_pw);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_set_scale_mode (UmmsPlayerBackend *self, gint scale_mode, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+
+  priv->scale_mode = scale_mode;
+  overlay_apply (priv);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_scale_mode (UmmsPlayerBackend *self, gint *scale_mode, GError **err)
+{
+  *scale_mode = UMMS_GST_BACKEND (self)->priv->scale_mode;
+  return TRUE;
+}
+
+//Release everything, the position is kept to resume from.
+static gboolean
+umms_gst_backend_suspend (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstState resume_state = priv->target_state;
+  gint64 pos;
+
+  if (self->suspended)
+    return TRUE;
+
+  if (!query_position (priv, &pos))
+    pos = 0;
+  record_stop (self);
+  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  //The tuner goes with the resources, restore starts a new ring.
+  ts_stop (self);
+  umms_player_backend_release_resource (self);
+  umms_player_backend_state_lock (self);
+  priv->target_state = resume_state;
+  priv->buffering_paused = FALSE;
+  self->pos = pos;
+  self->suspended = TRUE;
+  umms_player_backend_state_unlock (self);
+  set_player_state (self, PlayerStateStopped);
+  umms_player_backend_emit_suspended (self);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_restore (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstState state = priv->target_state == GST_STATE_PLAYING ? GST_STATE_PLAYING : GST_STATE_PAUSED;
+
+  if (!self->suspended)
+    return TRUE;
+
+  umms_player_backend_state_lock (self);
+  priv->start_pos = self->is_live ? -1 : self->pos;
+  umms_player_backend_state_unlock (self);
+  if (!change_state_sync (self, state, err))
+    return FALSE;
+  umms_player_backend_state_lock (self);
+  self->suspended = FALSE;
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_emit_restored (self);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_protocol_name (UmmsPlayerBackend *self, gchar **prot_name, GError **err)
+{
+  if (!self->uri) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "no uri set");
+    return FALSE;
+  }
+  *prot_name = gst_uri_get_protocol (self->uri);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_current_uri (UmmsPlayerBackend *self, gchar **uri, GError **err)
+{
+  *uri = g_strdup (self->uri);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_title (UmmsPlayerBackend *self, gchar **title, GError **err)
+{
+  *title = g_strdup (self->title);
+  return TRUE;
+}
+
+static gboolean
+umms_gst_backend_get_artist (UmmsPlayerBackend *self, gchar **artist, GError **err)
+{
+  *artist = g_strdup (self->artist);
+  return TRUE;
+}
+
+//The stream is written as received by the source, whatever its container.
+static gboolean
+umms_gst_backend_record (UmmsPlayerBackend *self, gboolean to_record, gchar *location, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  FILE *file;
+  gboolean probed;
+
+  if (!to_record) {
+    record_stop (self);
+    return TRUE;
+  }
+
+  if (!location || !*location) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no location to record to");
+    return FALSE;
+  }
+  g_mutex_lock (priv->lock);
+  probed = priv->source_pad != NULL;
+  g_mutex_unlock (priv->lock);
+  if (!probed) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "source not started or can't be recorded");
+    return FALSE;
+  }
+  if (!(file = fopen (location, "wb"))) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "can't open %s: %s", location,
+                 g_strerror (errno));
+    return FALSE;
+  }
+
+  record_stop (self);
+  g_mutex_lock (priv->lock);
+  priv->record_file = file;
+  g_mutex_unlock (priv->lock);
+  umms_player_backend_emit_record_start (self);
+  return TRUE;
+}
+
+//Back to the state of umms_gst_backend_init(), the pipeline is kept.
+static gboolean
+umms_gst_backend_reset (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (self)->priv;
+  GstElement *sink = NULL;
+  GstBus *bus;
+
+  record_stop (self);
+  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  ts_stop (self);
+  source_probe_remove (priv);
+  //The messages of the former user must not reach the next one.
+  bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
+  gst_bus_set_flushing (bus, TRUE);
+  gst_bus_set_flushing (bus, FALSE);
+  gst_object_unref (bus);
+  request_done (self, &priv->state_req, TRUE, NULL);
+  request_done (self, &priv->seek_req, TRUE, NULL);
+
+  priv->is_ts = -1;
+  priv->carry_len = 0;
+  g_object_set (priv->pipeline, "uri", NULL, NULL);
+  umms_player_backend_state_lock (self);
+  priv->target_state = GST_STATE_NULL;
+  priv->buffering_paused = FALSE;
+  priv->start_pos = -1;
+  priv->rate = 1.0;
+  if (priv->tags) {
+    gst_tag_list_free (priv->tags);
+    priv->tags = NULL;
+  }
+
+  //The appsink of DataCopy writes to the frame ring of the former user.
+  if (priv->target_type != XWindow) {
+    if (priv->conf.video_sink)
+      sink = make_sink (priv->conf.video_sink);
+    g_object_set (priv->pipeline, "video-sink", sink, NULL);
+  }
+  priv->target_type = XWindow;
+  priv->xid = 0;
+  priv->has_xid = FALSE;
+  priv->has_rect = FALSE;
+  priv->scale_mode = ScaleModeKeepAspectRatio;
+  umms_player_backend_state_unlock (self);
+  g_mutex_lock (priv->lock);
+  if (priv->overlay) {
+    gst_object_unref (priv->overlay);
+    priv->overlay = NULL;
+  }
+  g_mutex_unlock (priv->lock);
+
+  return TRUE;
+}
+
+static void
+umms_gst_backend_dispose (GObject *object)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (object)->priv;
+  GstBus *bus;
+
+  record_stop (UMMS_PLAYER_BACKEND (object));
+  if (priv->pipeline) {
+    if (priv->bus_watch)
+      g_source_remove (priv->bus_watch);
+    priv->bus_watch = 0;
+    gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+    ts_stop (UMMS_PLAYER_BACKEND (object));
+    source_probe_remove (priv);
+    bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
+    gst_bus_set_sync_handler (bus, NULL, NULL);
+    gst_object_unref (bus);
+    gst_object_unref (priv->pipeline);
+    priv->pipeline = NULL;
+  }
+  if (priv->overlay) {
+    gst_object_unref (priv->overlay);
+    priv->overlay = NULL;
+  }
+
+  G_OBJECT_CLASS (umms_gst_backend_parent_class)->dispose (object);
+}
+
+static void
+umms_gst_backend_finalize (GObject *object)
+{
+  UmmsGstBackendPrivate *priv = UMMS_GST_BACKEND (object)->priv;
+
+  if (priv->tags)
+    gst_tag_list_free (priv->tags);
+  umms_gst_queue_conf_clear (&priv->conf);
+  g_mutex_free (priv->lock);
+  g_mutex_free (priv->ts_lock);
+  umms_gop_cache_free (priv->gop);
+
+  G_OBJECT_CLASS (umms_gst_backend_parent_class)->finalize (object);
+}
+
+static void
+umms_gst_backend_class_init (UmmsGstBackendClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  UmmsPlayerBackendClass *backend_class = UMMS_PLAYER_BACKEND_CLASS (klass);
+
+  gst_init (NULL, NULL);
+  g_type_class_add_private (klass, sizeof (UmmsGstBackendPrivate));
+
+  object_class->dispose = umms_gst_backend_dispose;
+  object_class->finalize = umms_gst_backend_finalize;
+
+  backend_class->set_uri = umms_gst_backend_set_uri;
+  backend_class->set_target = umms_gst_backend_set_target;
+  backend_class->play = umms_gst_backend_play;
+  backend_class->pause = umms_gst_backend_pause;
+  backend_class->stop = umms_gst_backend_stop;
+  backend_class->set_position = umms_gst_backend_set_position;
+  backend_class->get_position = umms_gst_backend_get_position;
+  backend_class->set_playback_rate = umms_gst_backend_set_playback_rate;
+  backend_class->get_playback_rate = umms_gst_backend_get_playback_rate;
+  backend_class->set_volume = umms_gst_backend_set_volume;
+  backend_class->get_volume = umms_gst_backend_get_volume;
+  backend_class->set_video_size = umms_gst_backend_set_video_size;
+  backend_class->get_video_size = umms_gst_backend_get_video_size;
+  backend_class->get_buffered_bytes = umms_gst_backend_get_buffered_bytes;
+  backend_class->get_buffered_time = umms_gst_backend_get_buffered_time;
+  backend_class->get_media_size_time = umms_gst_backend_get_media_size_time;
+  backend_class->get_media_size_bytes = umms_gst_backend_get_media_size_bytes;
+  backend_class->has_audio = umms_gst_backend_has_audio;
+  backend_class->has_video = umms_gst_backend_has_video;
+  backend_class->is_streaming = umms_gst_backend_is_streaming;
+  backend_class->is_seekable = umms_gst_backend_is_seekable;
+  backend_class->support_fullscreen = umms_gst_backend_support_fullscreen;
+  backend_class->get_player_state = umms_gst_backend_get_player_state;
+  backend_class->get_current_video = umms_gst_backend_get_current_video;
+  backend_class->get_current_audio = umms_gst_backend_get_current_audio;
+  backend_class->set_current_video = umms_gst_backend_set_current_video;
+  backend_class->set_current_audio = umms_gst_backend_set_current_audio;
+  backend_class->get_video_num = umms_gst_backend_get_video_num;
+  backend_class->get_audio_num = umms_gst_backend_get_audio_num;
+  backend_class->set_proxy = umms_gst_backend_set_proxy;
+  backend_class->set_subtitle_uri = umms_gst_backend_set_subtitle_uri;
+  backend_class->get_subtitle_num = umms_gst_backend_get_subtitle_num;
+  backend_class->get_current_subtitle = umms_gst_backend_get_current_subtitle;
+  backend_class->set_current_subtitle = umms_gst_backend_set_current_subtitle;
+  backend_class->set_buffer_depth = umms_gst_backend_set_buffer_depth;
+  backend_class->get_buffer_depth = umms_gst_backend_get_buffer_depth;
+  backend_class->set_mute = umms_gst_backend_set_mute;
+  backend_class->is_mute = umms_gst_backend_is_mute;
+  backend_class->set_scale_mode = umms_gst_backend_set_scale_mode;
+  backend_class->get_scale_mode = umms_gst_backend_get_scale_mode;
+  backend_class->suspend = umms_gst_backend_suspend;
+  backend_class->restore = umms_gst_backend_restore;
+  backend_class->get_video_codec = umms_gst_backend_get_video_codec;
+  backend_class->get_audio_codec = umms_gst_backend_get_audio_codec;
+  backend_class->get_video_bitrate = umms_gst_backend_get_video_bitrate;
+  backend_class->get_audio_bitrate = umms_gst_backend_get_audio_bitrate;
+  backend_class->get_encapsulation = umms_gst_backend_get_encapsulation;
+  backend_class->get_audio_samplerate = umms_gst_backend_get_audio_samplerate;
+  backend_class->get_video_framerate = umms_gst_backend_get_video_framerate;
+  backend_class->get_video_resolution = umms_gst_backend_get_video_resolution;
+  backend_class->get_video_aspect_ratio = umms_gst_backend_get_video_aspect_ratio;
+  backend_class->get_protocol_name = umms_gst_backend_get_protocol_name;
+  backend_class->get_current_uri = umms_gst_backend_get_current_uri;
+  backend_class->get_title = umms_gst_backend_get_title;
+  backend_class->get_artist = umms_gst_backend_get_artist;
+  backend_class->record = umms_gst_backend_record;
+  backend_class->reset = umms_gst_backend_reset;
+  backend_class->play_async = umms_gst_backend_play_async;
+  backend_class->pause_async = umms_gst_backend_pause_async;
+  backend_class->set_position_async = umms_gst_backend_set_position_async;
+}
+
+static void
+umms_gst_backend_init (UmmsGstBackend *self)
+{
+  UmmsGstBackendPrivate *priv;
+  GstElement *sink;
+  GstBus *bus;
+
+  self->priv = priv = GET_PRIVATE (self);
+  priv->lock = g_mutex_new ();
+  priv->ts_lock = g_mutex_new ();
+  priv->gop = umms_gop_cache_new (UMMS_GOP_CACHE_NO_PID, GOP_CACHE_SIZE);
+  priv->rate = 1.0;
+  priv->start_pos = -1;
+  priv->is_ts = -1;
+  priv->scale_mode = ScaleModeKeepAspectRatio;
+  priv->target_type = XWindow;
+  conf_get_default (&priv->conf);
+
+  //Left NULL on failure, umms_gst_backend_new() then fails.
+  priv->pipeline = gst_element_factory_make ("playbin2", NULL);
+  if (!priv->pipeline) {
+    UMMS_WARNING ("playbin2 not available");
+    return;
+  }
+
+  if (priv->conf.video_sink && (sink = make_sink (priv->conf.video_sink)))
+    g_object_set (priv->pipeline, "video-sink", sink, NULL);
+  if (priv->conf.audio_sink && (sink = make_sink (priv->conf.audio_sink)))
+    g_object_set (priv->pipeline, "audio-sink", sink, NULL);
+  apply_playbin_limits (priv);
+
+  g_signal_connect (priv->pipeline, "element-added", G_CALLBACK (element_added_cb), self);
+  g_signal_connect (priv->pipeline, "notify::source", G_CALLBACK (source_changed_cb), self);
+  g_signal_connect (priv->pipeline, "video-tags-changed", G_CALLBACK (video_tags_changed_cb), self);
+  g_signal_connect (priv->pipeline, "audio-tags-changed", G_CALLBACK (audio_tags_changed_cb), self);
+  g_signal_connect (priv->pipeline, "text-tags-changed", G_CALLBACK (text_tags_changed_cb), self);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
+  priv->bus_watch = gst_bus_add_watch (bus, bus_cb, self);
+  gst_bus_set_sync_handler (bus, bus_sync_handler, self);
+  gst_object_unref (bus);
+}
+
+UmmsGstBackend *
+umms_gst_backend_new (void)
+{
+  UmmsGstBackend *self = g_object_new (UMMS_TYPE_GST_BACKEND, NULL);
+
+  if (!self->priv->pipeline) {
+    g_object_unref (self);
+    return NULL;
+  }
+  return self;
+}
+
+static gpointer
+backend_new (void)
+{
+  return umms_gst_backend_new ();
+}
+
+static const gchar *supported_uri_protocols[] = {NULL};
+//Tuning is left to a DVB backend.
+static const gchar *unsupported_uri_protocols[] = {"dvb", NULL};
+
+UmmsPlugin umms_plugin = {
+  UMMS_MAJOR_VERSION,
+  UMMS_MINOR_VERSION,
+  UMMS_PLUGIN_TYPE_PLAYER_BACKEND,
+  NULL,
+  "gst",
+  "Reference player backend on playbin2, with tunable queueing",
+  supported_uri_protocols,
+  unsupported_uri_protocols,
+  backend_new
+};
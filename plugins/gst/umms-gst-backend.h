@@ -0,0 +1,105 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _UMMS_GST_BACKEND_H
+#define _UMMS_GST_BACKEND_H
+
+#include <umms-player-backend.h>
+
+G_BEGIN_DECLS
+
+#define UMMS_TYPE_GST_BACKEND umms_gst_backend_get_type()
+
+#define UMMS_GST_BACKEND(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+  UMMS_TYPE_GST_BACKEND, UmmsGstBackend))
+
+#define UMMS_GST_BACKEND_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+  UMMS_TYPE_GST_BACKEND, UmmsGstBackendClass))
+
+#define UMMS_IS_GST_BACKEND(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+  UMMS_TYPE_GST_BACKEND))
+
+#define UMMS_IS_GST_BACKEND_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+  UMMS_TYPE_GST_BACKEND))
+
+#define UMMS_GST_BACKEND_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+  UMMS_TYPE_GST_BACKEND, UmmsGstBackendClass))
+
+typedef struct _UmmsGstBackend UmmsGstBackend;
+typedef struct _UmmsGstBackendClass UmmsGstBackendClass;
+typedef struct _UmmsGstBackendPrivate UmmsGstBackendPrivate;
+
+struct _UmmsGstBackend {
+  UmmsPlayerBackend parent;
+  UmmsGstBackendPrivate *priv;
+};
+
+struct _UmmsGstBackendClass {
+  UmmsPlayerBackendClass parent_class;
+};
+
+//Group of umms.conf read by the backend, the file can be overridden by this environment variable.
+#define UMMS_GST_CONF_GROUP "GStreamer Backend"
+#define UMMS_GST_CONF_ENV   "UMMS_GST_BACKEND_CONF"
+
+/*
+ * Queueing of the pipeline: limits of the queue2 buffering the network
+ * sources and of the multiqueues of the demuxers, applied as the elements
+ * are created. -1 leaves the GStreamer default. Times are in ms.
+ *
+ * Presets:
+ *  "low-latency":      small queues, playback starts and seeks land fast.
+ *  "high-throughput":  large queues, absorbs the jitter of the network and of
+ *                      the decoders at the cost of memory and start time.
+ */
+typedef struct _UmmsGstQueueConf {
+  gint64 queue2_bytes;
+  gint64 queue2_time;
+  gint   queue2_low_percent;
+  gint   queue2_high_percent;
+  gint64 multiqueue_bytes;
+  gint64 multiqueue_buffers;
+  gint64 multiqueue_time;
+  //Sinks as gst-launch descriptions, e.g. "fakesink sync=true" on a headless box. NULL for the auto sinks.
+  gchar  *video_sink;
+  gchar  *audio_sink;
+} UmmsGstQueueConf;
+
+GType umms_gst_backend_get_type (void) G_GNUC_CONST;
+UmmsGstBackend *umms_gst_backend_new (void);
+
+//Reset conf to a preset, "default" leaves all limits to GStreamer. FALSE if unknown.
+gboolean umms_gst_queue_conf_preset (UmmsGstQueueConf *conf, const gchar *preset);
+//Conf of the backends created from now on, the defaults come from umms.conf. conf is copied.
+void umms_gst_backend_set_default_conf (const UmmsGstQueueConf *conf);
+void umms_gst_queue_conf_clear (UmmsGstQueueConf *conf);
+
+G_END_DECLS
+
+#endif /* _UMMS_GST_BACKEND_H */
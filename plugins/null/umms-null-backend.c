@@ -0,0 +1,1285 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Null player backend, see umms-null-backend.h.
+ *
+ * The blocking vmethods sleep their delay in the calling thread, the async
+ * ones complete from a timeout on the default main context. Stop bumps a
+ * generation counter: a pending async op of an earlier generation still
+ * completes with success, but doesn't change the state any more.
+ */
+
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlugin
+
+#include <string.h>
+#include <time.h>
+#include <umms.h>
+#include "umms-null-backend.h"
+
+G_DEFINE_TYPE (UmmsNullBackend, umms_null_backend, UMMS_TYPE_PLAYER_BACKEND);
+
+#define GET_PRIVATE(o) \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((o), UMMS_TYPE_NULL_BACKEND, UmmsNullBackendPrivate))
+
+#define UMMS_NULL_CONF_FILE "/etc/umms.conf"
+#define NULL_PROGRAM        1
+#define NULL_PMT_PID        0x1000
+#define NULL_VIDEO_PID      0x100
+#define NULL_AUDIO_PID      0x101
+
+//Sleep the delay configured for the vmethod, e.g. DELAY ("set-uri") for the key delay-set-uri.
+#define DELAY(name) g_usleep (method_delay (name))
+
+typedef struct {
+  gint64 delay;//us, of the vmethods not listed in delays
+  gint64 jitter;//us, uniformly added to each delay
+  GHashTable *delays;//"set-uri" => us
+  gint64 duration;//ms, 0 for an endless stream
+  gint64 buffering_interval;//ms, 0 disables the signal
+  gint64 state_interval;
+  gint64 tag_interval;
+  gboolean async;
+} NullConf;
+
+typedef enum {
+  NULL_OP_PLAY,
+  NULL_OP_PAUSE,
+  NULL_OP_SEEK
+} NullOpType;
+
+typedef struct {
+  UmmsPlayerBackend *self;
+  NullOpType type;
+  gint64 pos;
+  guint generation;
+  UmmsPlayerBackendCallback callback;
+  gpointer user_data;
+} NullOp;
+
+struct _UmmsNullBackendPrivate {
+  GMutex  *lock;
+  PlayerState state;//of the clock, self->player_state is the one announced
+  gint64  base_pos;//ms at started
+  gint64  started;//us, monotonic
+  gdouble rate;
+  guint   generation;//bumped by stop, async ops of a former generation are dropped
+  guint   eof_id;
+  guint   buffering_id;
+  guint   state_id;
+  guint   tag_id;
+  gint    buffering_step;
+
+  gint    volume;
+  gint    mute;
+  gint    scale_mode;
+  guint   x, y, w, h;
+  gint    cur_video, cur_audio, cur_sub;
+  gint64  buffer_time, buffer_bytes;
+  gchar  *sub_uri;
+  gboolean recording;
+};
+
+static NullConf conf;
+
+static gint64
+now_usec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static gint64
+conf_get_int (GKeyFile *keyfile, const gchar *key, gint64 def)
+{
+  GError *err = NULL;
+  gint v;
+
+  if (!keyfile || !g_key_file_has_key (keyfile, UMMS_NULL_CONF_GROUP, key, NULL))
+    return def;
+  v = g_key_file_get_integer (keyfile, UMMS_NULL_CONF_GROUP, key, &err);
+  if (err) {
+    UMMS_WARNING ("%s: %s", key, err->message);
+    g_error_free (err);
+    return def;
+  }
+  return v;
+}
+
+static void
+conf_load (void)
+{
+  const gchar *path = g_getenv (UMMS_NULL_CONF_ENV);
+  GKeyFile *keyfile = g_key_file_new ();
+  gchar **keys;
+  gint i;
+
+  if (!g_key_file_load_from_file (keyfile, path ? path : UMMS_NULL_CONF_FILE, G_KEY_FILE_NONE, NULL)) {
+    g_key_file_free (keyfile);
+    keyfile = NULL;
+  }
+
+  conf.delay = conf_get_int (keyfile, "delay", 0);
+  conf.jitter = conf_get_int (keyfile, "jitter", 0);
+  conf.duration = conf_get_int (keyfile, "duration", 60000);
+  conf.buffering_interval = conf_get_int (keyfile, "buffering-interval", 0);
+  conf.state_interval = conf_get_int (keyfile, "state-interval", 0);
+  conf.tag_interval = conf_get_int (keyfile, "tag-interval", 0);
+  conf.async = !keyfile || !g_key_file_has_key (keyfile, UMMS_NULL_CONF_GROUP, "async", NULL)
+               || g_key_file_get_boolean (keyfile, UMMS_NULL_CONF_GROUP, "async", NULL);
+  conf.delays = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  if (!keyfile)
+    return;
+  keys = g_key_file_get_keys (keyfile, UMMS_NULL_CONF_GROUP, NULL, NULL);
+  for (i = 0; keys && keys[i]; i++) {
+    if (g_str_has_prefix (keys[i], "delay-"))
+      g_hash_table_insert (conf.delays, g_strdup (keys[i] + strlen ("delay-")),
+                           GINT_TO_POINTER ((gint)conf_get_int (keyfile, keys[i], 0)));
+  }
+  g_strfreev (keys);
+  g_key_file_free (keyfile);
+}
+
+static gulong
+method_delay (const gchar *name)
+{
+  gpointer val;
+  gint64 delay = conf.delay;
+
+  if (g_hash_table_lookup_extended (conf.delays, name, NULL, &val))
+    delay = GPOINTER_TO_INT (val);
+  if (conf.jitter > 0)
+    delay += g_random_int_range (0, conf.jitter + 1);
+  return delay;
+}
+
+//Called with the lock held.
+static gint64
+clock_position (UmmsNullBackendPrivate *priv)
+{
+  gint64 pos = priv->base_pos;
+
+  if (priv->state == PlayerStatePlaying)
+    pos += (now_usec () - priv->started) / 1000 * priv->rate;
+  if (conf.duration > 0)
+    pos = MIN (pos, conf.duration);
+  return MAX (pos, 0);
+}
+
+static void
+set_player_state (UmmsPlayerBackend *self, PlayerState state)
+{
+  PlayerState old;
+
+  umms_player_backend_state_lock (self);
+  old = self->player_state;
+  self->player_state = state;
+  umms_player_backend_state_unlock (self);
+
+  if (old != state)
+    umms_player_backend_emit_player_state_changed (self, old, state);
+}
+
+static void
+timer_remove (guint *id)
+{
+  if (*id)
+    g_source_remove (*id);
+  *id = 0;
+}
+
+/*
+ * The timers and the async ops run on the main loop, they take the state lock
+ * only, see the threading contract in umms-player-backend.h.
+ */
+static gboolean
+eof_cb (gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->eof_id = 0;
+  g_mutex_unlock (priv->lock);
+  umms_player_backend_emit_eof (self);
+  return FALSE;
+}
+
+static gboolean
+buffering_cb (gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+  gint percent;
+
+  g_mutex_lock (priv->lock);
+  priv->buffering_step = (priv->buffering_step + 1) % 6;
+  percent = priv->buffering_step * 20;
+  g_mutex_unlock (priv->lock);
+
+  umms_player_backend_state_lock (self);
+  self->buffer_percent = percent;
+  self->buffering = percent < 100;
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_emit_buffering (self, percent);
+  return TRUE;
+}
+
+//A stall, as when a network stream underruns.
+static gboolean
+state_cb (gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+
+  set_player_state (self, PlayerStatePaused);
+  set_player_state (self, PlayerStatePlaying);
+  return TRUE;
+}
+
+static gboolean
+tag_cb (gpointer user_data)
+{
+  UmmsPlayerBackend *self = user_data;
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+  gint video, audio, sub;
+
+  g_mutex_lock (priv->lock);
+  video = priv->cur_video;
+  audio = priv->cur_audio;
+  sub = priv->cur_sub;
+  g_mutex_unlock (priv->lock);
+
+  umms_player_backend_emit_video_tag_changed (self, video);
+  umms_player_backend_emit_audio_tag_changed (self, audio);
+  umms_player_backend_emit_text_tag_changed (self, sub);
+  umms_player_backend_emit_metadata_changed (self);
+  return TRUE;
+}
+
+//Called with the lock held, the timers run while playing.
+static void
+timers_update (UmmsPlayerBackend *self)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+  gint64 left;
+
+  timer_remove (&priv->eof_id);
+  timer_remove (&priv->buffering_id);
+  timer_remove (&priv->state_id);
+  timer_remove (&priv->tag_id);
+  if (priv->state != PlayerStatePlaying)
+    return;
+
+  if (conf.duration > 0 && priv->rate > 0) {
+    left = (conf.duration - clock_position (priv)) / priv->rate;
+    priv->eof_id = g_timeout_add (MAX (left, 0), eof_cb, self);
+  }
+  if (conf.buffering_interval > 0)
+    priv->buffering_id = g_timeout_add (conf.buffering_interval, buffering_cb, self);
+  if (conf.state_interval > 0)
+    priv->state_id = g_timeout_add (conf.state_interval, state_cb, self);
+  if (conf.tag_interval > 0)
+    priv->tag_id = g_timeout_add (conf.tag_interval, tag_cb, self);
+}
+
+static void
+clock_set_state (UmmsPlayerBackend *self, PlayerState state)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->base_pos = clock_position (priv);
+  priv->started = now_usec ();
+  priv->state = state;
+  if (state == PlayerStateStopped)
+    priv->base_pos = 0;
+  timers_update (self);
+  g_mutex_unlock (priv->lock);
+
+  if (state == PlayerStatePlaying || state == PlayerStatePaused) {
+    umms_player_backend_state_lock (self);
+    self->is_live = conf.duration <= 0;
+    umms_player_backend_state_unlock (self);
+  }
+  set_player_state (self, state);
+}
+
+static void
+clock_seek (UmmsPlayerBackend *self, gint64 pos)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->base_pos = conf.duration > 0 ? MIN (pos, conf.duration) : pos;
+  priv->started = now_usec ();
+  timers_update (self);
+  g_mutex_unlock (priv->lock);
+  umms_player_backend_emit_seeked (self);
+}
+
+static gboolean
+check_uri (UmmsPlayerBackend *self, GError **err)
+{
+  if (!self->uri) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "no uri set");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+op_done (gpointer user_data)
+{
+  NullOp *op = user_data;
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (op->self)->priv;
+  gboolean current;
+
+  //A Stop bumps the generation with the state lock held.
+  umms_player_backend_state_lock (op->self);
+  g_mutex_lock (priv->lock);
+  current = op->generation == priv->generation;
+  g_mutex_unlock (priv->lock);
+
+  //Cancelled by a Stop, it didn't fail.
+  if (current) {
+    if (op->type == NULL_OP_PLAY)
+      clock_set_state (op->self, PlayerStatePlaying);
+    else if (op->type == NULL_OP_PAUSE)
+      clock_set_state (op->self, PlayerStatePaused);
+    else
+      clock_seek (op->self, op->pos);
+  }
+  umms_player_backend_state_unlock (op->self);
+  op->callback (op->self, TRUE, NULL, op->user_data);
+  g_object_unref (op->self);
+  g_free (op);
+  return FALSE;
+}
+
+//The delay elapses on the main loop instead of blocking the caller.
+static void
+op_start (UmmsPlayerBackend *self, NullOpType type, const gchar *name, gint64 pos,
+          UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+  NullOp *op;
+  GError *err = NULL;
+
+  if (!check_uri (self, &err)) {
+    callback (self, FALSE, err, user_data);
+    g_error_free (err);
+    return;
+  }
+
+  op = g_new0 (NullOp, 1);
+  op->self = g_object_ref (self);
+  op->type = type;
+  op->pos = pos;
+  op->callback = callback;
+  op->user_data = user_data;
+  g_mutex_lock (priv->lock);
+  op->generation = priv->generation;
+  g_mutex_unlock (priv->lock);
+  g_timeout_add ((method_delay (name) + 999) / 1000, op_done, op);
+}
+
+static void
+push_psi (UmmsPlayerBackend *self)
+{
+  //One program, a video and an audio stream.
+  guint8 pat[] = {0x00, 0xB0, 13, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                  0x00, NULL_PROGRAM, 0xE0 | (NULL_PMT_PID >> 8), NULL_PMT_PID & 0xFF, 0, 0, 0, 0};
+  guint8 pmt[] = {0x02, 0xB0, 23, 0x00, NULL_PROGRAM, 0xC1, 0x00, 0x00,
+                  0xE0 | (NULL_VIDEO_PID >> 8), NULL_VIDEO_PID & 0xFF, 0xF0, 0x00,
+                  0x1B, 0xE0 | (NULL_VIDEO_PID >> 8), NULL_VIDEO_PID & 0xFF, 0xF0, 0x00,
+                  0x0F, 0xE0 | (NULL_AUDIO_PID >> 8), NULL_AUDIO_PID & 0xFF, 0xF0, 0x00, 0, 0, 0, 0};
+  UmmsPsiCache *cache = umms_player_backend_get_psi_cache (self);
+  guint32 crc;
+
+  crc = umms_psi_crc32 (pat, sizeof (pat) - 4);
+  pat[sizeof (pat) - 4] = crc >> 24;
+  pat[sizeof (pat) - 3] = crc >> 16;
+  pat[sizeof (pat) - 2] = crc >> 8;
+  pat[sizeof (pat) - 1] = crc;
+  crc = umms_psi_crc32 (pmt, sizeof (pmt) - 4);
+  pmt[sizeof (pmt) - 4] = crc >> 24;
+  pmt[sizeof (pmt) - 3] = crc >> 16;
+  pmt[sizeof (pmt) - 2] = crc >> 8;
+  pmt[sizeof (pmt) - 1] = crc;
+
+  umms_psi_cache_set_program (cache, NULL_PROGRAM);
+  umms_psi_cache_push_section (cache, pat, sizeof (pat));
+  umms_psi_cache_push_section (cache, pmt, sizeof (pmt));
+}
+
+static gboolean
+umms_null_backend_set_uri (UmmsPlayerBackend *self, const gchar *uri, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("set-uri");
+  umms_player_backend_state_lock (self);
+  g_mutex_lock (priv->lock);
+  priv->generation++;
+  priv->rate = 1.0;
+  g_mutex_unlock (priv->lock);
+  clock_set_state (self, PlayerStateStopped);
+
+  self->duration = conf.duration;
+  self->total_bytes = conf.duration * 1000;//8 Mbps
+  self->seekable = conf.duration > 0;
+  g_free (self->title);
+  self->title = g_strdup ("Null stream");
+  umms_player_backend_state_unlock (self);
+  push_psi (self);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_target (UmmsPlayerBackend *self, gint type, GHashTable *params, GError **err)
+{
+  DELAY ("set-target");
+  if (type != XWindow && type != DataCopy) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, "target type %d not supported",
+                 type);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_play (UmmsPlayerBackend *self, GError **err)
+{
+  DELAY ("play");
+  if (!check_uri (self, err))
+    return FALSE;
+  clock_set_state (self, PlayerStatePlaying);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_pause (UmmsPlayerBackend *self, GError **err)
+{
+  DELAY ("pause");
+  if (!check_uri (self, err))
+    return FALSE;
+  clock_set_state (self, PlayerStatePaused);
+  return TRUE;
+}
+
+static void
+umms_null_backend_play_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  op_start (self, NULL_OP_PLAY, "play", 0, callback, user_data);
+}
+
+static void
+umms_null_backend_pause_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  op_start (self, NULL_OP_PAUSE, "pause", 0, callback, user_data);
+}
+
+static gboolean
+umms_null_backend_stop (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("stop");
+  umms_player_backend_state_lock (self);
+  g_mutex_lock (priv->lock);
+  priv->generation++;
+  g_mutex_unlock (priv->lock);
+  clock_set_state (self, PlayerStateStopped);
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_release_resource (self);
+  umms_player_backend_emit_stopped (self);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_position (UmmsPlayerBackend *self, gint64 pos, GError **err)
+{
+  DELAY ("set-position");
+  if (!check_uri (self, err))
+    return FALSE;
+  if (pos < 0) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "negative position");
+    return FALSE;
+  }
+  clock_seek (self, pos);
+  return TRUE;
+}
+
+static void
+umms_null_backend_set_position_async (UmmsPlayerBackend *self, gint64 pos, UmmsPlayerBackendCallback callback,
+                                      gpointer user_data)
+{
+  GError *err = NULL;
+
+  if (pos < 0) {
+    g_set_error (&err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "negative position");
+    callback (self, FALSE, err, user_data);
+    g_error_free (err);
+    return;
+  }
+  op_start (self, NULL_OP_SEEK, "set-position", pos, callback, user_data);
+}
+
+static gboolean
+umms_null_backend_get_position (UmmsPlayerBackend *self, gint64 *cur_time, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("get-position");
+  g_mutex_lock (priv->lock);
+  *cur_time = self->suspended ? self->pos : clock_position (priv);
+  g_mutex_unlock (priv->lock);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_playback_rate (UmmsPlayerBackend *self, gdouble rate, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("set-playback-rate");
+  if (rate == 0.0) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "rate 0, use Pause");
+    return FALSE;
+  }
+  g_mutex_lock (priv->lock);
+  priv->base_pos = clock_position (priv);
+  priv->started = now_usec ();
+  priv->rate = rate;
+  timers_update (self);
+  g_mutex_unlock (priv->lock);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_playback_rate (UmmsPlayerBackend *self, gdouble *out_rate, GError **err)
+{
+  DELAY ("get-playback-rate");
+  *out_rate = UMMS_NULL_BACKEND (self)->priv->rate;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_volume (UmmsPlayerBackend *self, gint vol, GError **err)
+{
+  DELAY ("set-volume");
+  UMMS_NULL_BACKEND (self)->priv->volume = CLAMP (vol, 0, 100);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_volume (UmmsPlayerBackend *self, gint *vol, GError **err)
+{
+  DELAY ("get-volume");
+  *vol = UMMS_NULL_BACKEND (self)->priv->volume;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_video_size (UmmsPlayerBackend *self, guint x, guint y, guint w, guint h, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("set-video-size");
+  priv->x = x;
+  priv->y = y;
+  priv->w = w;
+  priv->h = h;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_size (UmmsPlayerBackend *self, guint *w, guint *h, GError **err)
+{
+  DELAY ("get-video-size");
+  *w = UMMS_NULL_BACKEND (self)->priv->w;
+  *h = UMMS_NULL_BACKEND (self)->priv->h;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_buffered_time (UmmsPlayerBackend *self, gint64 *depth, GError **err)
+{
+  DELAY ("get-buffered-time");
+  *depth = UMMS_NULL_BACKEND (self)->priv->buffer_time;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_buffered_bytes (UmmsPlayerBackend *self, gint64 *depth, GError **err)
+{
+  DELAY ("get-buffered-bytes");
+  *depth = UMMS_NULL_BACKEND (self)->priv->buffer_bytes;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_media_size_time (UmmsPlayerBackend *self, gint64 *size_time, GError **err)
+{
+  DELAY ("get-media-size-time");
+  *size_time = self->duration;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_media_size_bytes (UmmsPlayerBackend *self, gint64 *size_bytes, GError **err)
+{
+  DELAY ("get-media-size-bytes");
+  *size_bytes = self->total_bytes;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_has_video (UmmsPlayerBackend *self, gboolean *has_video, GError **err)
+{
+  DELAY ("has-video");
+  *has_video = TRUE;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_has_audio (UmmsPlayerBackend *self, gboolean *has_audio, GError **err)
+{
+  DELAY ("has-audio");
+  *has_audio = TRUE;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_is_streaming (UmmsPlayerBackend *self, gboolean *is_streaming, GError **err)
+{
+  DELAY ("is-streaming");
+  *is_streaming = self->uri && !g_str_has_prefix (self->uri, "file://");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_is_seekable (UmmsPlayerBackend *self, gboolean *seekable, GError **err)
+{
+  DELAY ("is-seekable");
+  *seekable = self->seekable > 0;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_support_fullscreen (UmmsPlayerBackend *self, gboolean *support_fullscreen, GError **err)
+{
+  DELAY ("support-fullscreen");
+  *support_fullscreen = TRUE;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_player_state (UmmsPlayerBackend *self, gint *state, GError **err)
+{
+  DELAY ("get-player-state");
+  *state = self->player_state;
+  return TRUE;
+}
+
+//Two audio streams and one of each other kind.
+static gboolean
+check_stream (gint stream, gint n, GError **err)
+{
+  if (stream < 0 || stream >= n) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no stream %d", stream);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_current_video (UmmsPlayerBackend *self, gint *cur_video, GError **err)
+{
+  DELAY ("get-current-video");
+  *cur_video = UMMS_NULL_BACKEND (self)->priv->cur_video;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_current_audio (UmmsPlayerBackend *self, gint *cur_audio, GError **err)
+{
+  DELAY ("get-current-audio");
+  *cur_audio = UMMS_NULL_BACKEND (self)->priv->cur_audio;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_current_video (UmmsPlayerBackend *self, gint cur_video, GError **err)
+{
+  DELAY ("set-current-video");
+  if (!check_stream (cur_video, 1, err))
+    return FALSE;
+  UMMS_NULL_BACKEND (self)->priv->cur_video = cur_video;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_current_audio (UmmsPlayerBackend *self, gint cur_audio, GError **err)
+{
+  DELAY ("set-current-audio");
+  if (!check_stream (cur_audio, 2, err))
+    return FALSE;
+  UMMS_NULL_BACKEND (self)->priv->cur_audio = cur_audio;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_num (UmmsPlayerBackend *self, gint *video_num, GError **err)
+{
+  DELAY ("get-video-num");
+  *video_num = 1;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_audio_num (UmmsPlayerBackend *self, gint *audio_num, GError **err)
+{
+  DELAY ("get-audio-num");
+  *audio_num = 2;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_proxy (UmmsPlayerBackend *self, GHashTable *params, GError **err)
+{
+  DELAY ("set-proxy");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_subtitle_uri (UmmsPlayerBackend *self, gchar *sub_uri, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("set-subtitle-uri");
+  g_free (priv->sub_uri);
+  priv->sub_uri = g_strdup (sub_uri);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_subtitle_num (UmmsPlayerBackend *self, gint *subtitle_num, GError **err)
+{
+  DELAY ("get-subtitle-num");
+  *subtitle_num = 1;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_current_subtitle (UmmsPlayerBackend *self, gint *cur_sub, GError **err)
+{
+  DELAY ("get-current-subtitle");
+  *cur_sub = UMMS_NULL_BACKEND (self)->priv->cur_sub;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_current_subtitle (UmmsPlayerBackend *self, gint cur_sub, GError **err)
+{
+  DELAY ("set-current-subtitle");
+  if (!check_stream (cur_sub, 1, err))
+    return FALSE;
+  UMMS_NULL_BACKEND (self)->priv->cur_sub = cur_sub;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 buf_val, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("set-buffer-depth");
+  if (format == BufferFormatByTime) {
+    priv->buffer_time = buf_val;
+  } else if (format == BufferFormatByBytes) {
+    priv->buffer_bytes = buf_val;
+  } else {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "unknown buffer format %d", format);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 *buf_val, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("get-buffer-depth");
+  if (format == BufferFormatByTime) {
+    *buf_val = priv->buffer_time;
+  } else if (format == BufferFormatByBytes) {
+    *buf_val = priv->buffer_bytes;
+  } else {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "unknown buffer format %d", format);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_mute (UmmsPlayerBackend *self, gint mute, GError **err)
+{
+  DELAY ("set-mute");
+  UMMS_NULL_BACKEND (self)->priv->mute = mute;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_is_mute (UmmsPlayerBackend *self, gint *mute, GError **err)
+{
+  DELAY ("is-mute");
+  *mute = UMMS_NULL_BACKEND (self)->priv->mute;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_set_scale_mode (UmmsPlayerBackend *self, gint scale_mode, GError **err)
+{
+  DELAY ("set-scale-mode");
+  UMMS_NULL_BACKEND (self)->priv->scale_mode = scale_mode;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_scale_mode (UmmsPlayerBackend *self, gint *scale_mode, GError **err)
+{
+  DELAY ("get-scale-mode");
+  *scale_mode = UMMS_NULL_BACKEND (self)->priv->scale_mode;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_suspend (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("suspend");
+  if (self->suspended)
+    return TRUE;
+  umms_player_backend_state_lock (self);
+  g_mutex_lock (priv->lock);
+  self->pos = clock_position (priv);
+  g_mutex_unlock (priv->lock);
+  self->suspended = TRUE;
+  umms_player_backend_state_unlock (self);
+  clock_set_state (self, PlayerStateStopped);
+  umms_player_backend_release_resource (self);
+  umms_player_backend_emit_suspended (self);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_restore (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("restore");
+  if (!self->suspended)
+    return TRUE;
+  umms_player_backend_state_lock (self);
+  g_mutex_lock (priv->lock);
+  priv->base_pos = self->pos;
+  g_mutex_unlock (priv->lock);
+  self->suspended = FALSE;
+  umms_player_backend_state_unlock (self);
+  clock_set_state (self, PlayerStatePlaying);
+  umms_player_backend_emit_restored (self);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_codec (UmmsPlayerBackend *self, gint channel, gchar **video_codec, GError **err)
+{
+  DELAY ("get-video-codec");
+  if (!check_stream (channel, 1, err))
+    return FALSE;
+  *video_codec = g_strdup ("H.264");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_audio_codec (UmmsPlayerBackend *self, gint channel, gchar **audio_codec, GError **err)
+{
+  DELAY ("get-audio-codec");
+  if (!check_stream (channel, 2, err))
+    return FALSE;
+  *audio_codec = g_strdup (channel ? "AC-3" : "MPEG-4 AAC");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
+{
+  DELAY ("get-video-bitrate");
+  if (!check_stream (channel, 1, err))
+    return FALSE;
+  *bit_rate = 7680000;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_audio_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
+{
+  DELAY ("get-audio-bitrate");
+  if (!check_stream (channel, 2, err))
+    return FALSE;
+  *bit_rate = channel ? 384000 : 128000;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_encapsulation (UmmsPlayerBackend *self, gchar **encapsulation, GError **err)
+{
+  DELAY ("get-encapsulation");
+  *encapsulation = g_strdup ("MPEG-2 Transport Stream");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_audio_samplerate (UmmsPlayerBackend *self, gint channel, gint *sample_rate, GError **err)
+{
+  DELAY ("get-audio-samplerate");
+  if (!check_stream (channel, 2, err))
+    return FALSE;
+  *sample_rate = 48000;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_framerate (UmmsPlayerBackend *self, gint channel, gint *num, gint *denom, GError **err)
+{
+  DELAY ("get-video-framerate");
+  if (!check_stream (channel, 1, err))
+    return FALSE;
+  *num = 25;
+  *denom = 1;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_resolution (UmmsPlayerBackend *self, gint channel, gint *width, gint *height,
+                                        GError **err)
+{
+  DELAY ("get-video-resolution");
+  if (!check_stream (channel, 1, err))
+    return FALSE;
+  *width = 1920;
+  *height = 1080;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_video_aspect_ratio (UmmsPlayerBackend *self, gint channel, gint *num, gint *denom,
+                                          GError **err)
+{
+  DELAY ("get-video-aspect-ratio");
+  if (!check_stream (channel, 1, err))
+    return FALSE;
+  *num = 16;
+  *denom = 9;
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_protocol_name (UmmsPlayerBackend *self, gchar **prot_name, GError **err)
+{
+  const gchar *sep;
+
+  DELAY ("get-protocol-name");
+  if (!check_uri (self, err))
+    return FALSE;
+  sep = strstr (self->uri, "://");
+  *prot_name = sep ? g_strndup (self->uri, sep - self->uri) : g_strdup ("");
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_current_uri (UmmsPlayerBackend *self, gchar **uri, GError **err)
+{
+  DELAY ("get-current-uri");
+  *uri = g_strdup (self->uri);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_title (UmmsPlayerBackend *self, gchar **title, GError **err)
+{
+  DELAY ("get-title");
+  *title = g_strdup (self->title);
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_artist (UmmsPlayerBackend *self, gchar **artist, GError **err)
+{
+  DELAY ("get-artist");
+  *artist = g_strdup (self->artist);
+  return TRUE;
+}
+
+//Nothing is written, only the signals.
+static gboolean
+umms_null_backend_record (UmmsPlayerBackend *self, gboolean to_record, gchar *location, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  DELAY ("record");
+  if (to_record && (!location || !*location)) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no location to record to");
+    return FALSE;
+  }
+  if (to_record == priv->recording)
+    return TRUE;
+  priv->recording = to_record;
+  if (to_record)
+    umms_player_backend_emit_record_start (self);
+  else
+    umms_player_backend_emit_record_stop (self);
+  return TRUE;
+}
+
+//The tables were put in the PSI cache by set_uri, the core asks the cache first.
+static gboolean
+umms_null_backend_get_pat (UmmsPlayerBackend *self, GPtrArray **pat, GError **err)
+{
+  DELAY ("get-pat");
+  if (!umms_psi_cache_get_pat (umms_player_backend_get_psi_cache (self), pat)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "no uri set");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_pmt (UmmsPlayerBackend *self, guint *program_num, guint *pcr_pid, GPtrArray **stream_info,
+                           GError **err)
+{
+  DELAY ("get-pmt");
+  if (!umms_psi_cache_get_pmt (umms_player_backend_get_psi_cache (self), program_num, pcr_pid, stream_info)) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "no program %u", *program_num);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static gboolean
+umms_null_backend_get_associated_data_channel (UmmsPlayerBackend *self, gchar **ip, gint *port, GError **err)
+{
+  DELAY ("get-associated-data-channel");
+  *ip = g_strdup ("127.0.0.1");
+  *port = 0;
+  return TRUE;
+}
+
+//Back to the state of umms_null_backend_init(), the media player applies its settings again.
+static gboolean
+umms_null_backend_reset (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (self)->priv;
+
+  umms_player_backend_state_lock (self);
+  g_mutex_lock (priv->lock);
+  //Drops the async ops still on their way.
+  priv->generation++;
+  priv->state = PlayerStateStopped;
+  priv->base_pos = 0;
+  priv->rate = 1.0;
+  priv->buffering_step = 0;
+  timers_update (self);
+  priv->volume = 50;
+  priv->mute = 0;
+  priv->scale_mode = ScaleModeKeepAspectRatio;
+  priv->x = priv->y = 0;
+  priv->w = 1920;
+  priv->h = 1080;
+  priv->cur_video = priv->cur_audio = priv->cur_sub = 0;
+  priv->buffer_time = 2000;
+  priv->buffer_bytes = 2 * 1024 * 1024;
+  g_free (priv->sub_uri);
+  priv->sub_uri = NULL;
+  priv->recording = FALSE;
+  g_mutex_unlock (priv->lock);
+  umms_player_backend_state_unlock (self);
+
+  return TRUE;
+}
+
+static void
+umms_null_backend_dispose (GObject *object)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (object)->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->state = PlayerStateStopped;
+  timers_update (UMMS_PLAYER_BACKEND (object));
+  g_mutex_unlock (priv->lock);
+
+  G_OBJECT_CLASS (umms_null_backend_parent_class)->dispose (object);
+}
+
+static void
+umms_null_backend_finalize (GObject *object)
+{
+  UmmsNullBackendPrivate *priv = UMMS_NULL_BACKEND (object)->priv;
+
+  g_free (priv->sub_uri);
+  g_mutex_free (priv->lock);
+
+  G_OBJECT_CLASS (umms_null_backend_parent_class)->finalize (object);
+}
+
+static void
+umms_null_backend_class_init (UmmsNullBackendClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  UmmsPlayerBackendClass *backend_class = UMMS_PLAYER_BACKEND_CLASS (klass);
+
+  conf_load ();
+  g_type_class_add_private (klass, sizeof (UmmsNullBackendPrivate));
+
+  object_class->dispose = umms_null_backend_dispose;
+  object_class->finalize = umms_null_backend_finalize;
+
+  backend_class->set_uri = umms_null_backend_set_uri;
+  backend_class->set_target = umms_null_backend_set_target;
+  backend_class->play = umms_null_backend_play;
+  backend_class->pause = umms_null_backend_pause;
+  backend_class->stop = umms_null_backend_stop;
+  backend_class->set_position = umms_null_backend_set_position;
+  backend_class->get_position = umms_null_backend_get_position;
+  backend_class->set_playback_rate = umms_null_backend_set_playback_rate;
+  backend_class->get_playback_rate = umms_null_backend_get_playback_rate;
+  backend_class->set_volume = umms_null_backend_set_volume;
+  backend_class->get_volume = umms_null_backend_get_volume;
+  backend_class->set_video_size = umms_null_backend_set_video_size;
+  backend_class->get_video_size = umms_null_backend_get_video_size;
+  backend_class->get_buffered_bytes = umms_null_backend_get_buffered_bytes;
+  backend_class->get_buffered_time = umms_null_backend_get_buffered_time;
+  backend_class->get_media_size_time = umms_null_backend_get_media_size_time;
+  backend_class->get_media_size_bytes = umms_null_backend_get_media_size_bytes;
+  backend_class->has_audio = umms_null_backend_has_audio;
+  backend_class->has_video = umms_null_backend_has_video;
+  backend_class->is_streaming = umms_null_backend_is_streaming;
+  backend_class->is_seekable = umms_null_backend_is_seekable;
+  backend_class->support_fullscreen = umms_null_backend_support_fullscreen;
+  backend_class->get_player_state = umms_null_backend_get_player_state;
+  backend_class->get_current_video = umms_null_backend_get_current_video;
+  backend_class->get_current_audio = umms_null_backend_get_current_audio;
+  backend_class->set_current_video = umms_null_backend_set_current_video;
+  backend_class->set_current_audio = umms_null_backend_set_current_audio;
+  backend_class->get_video_num = umms_null_backend_get_video_num;
+  backend_class->get_audio_num = umms_null_backend_get_audio_num;
+  backend_class->set_proxy = umms_null_backend_set_proxy;
+  backend_class->set_subtitle_uri = umms_null_backend_set_subtitle_uri;
+  backend_class->get_subtitle_num = umms_null_backend_get_subtitle_num;
+  backend_class->get_current_subtitle = umms_null_backend_get_current_subtitle;
+  backend_class->set_current_subtitle = umms_null_backend_set_current_subtitle;
+  backend_class->set_buffer_depth = umms_null_backend_set_buffer_depth;
+  backend_class->get_buffer_depth = umms_null_backend_get_buffer_depth;
+  backend_class->set_mute = umms_null_backend_set_mute;
+  backend_class->is_mute = umms_null_backend_is_mute;
+  backend_class->set_scale_mode = umms_null_backend_set_scale_mode;
+  backend_class->get_scale_mode = umms_null_backend_get_scale_mode;
+  backend_class->suspend = umms_null_backend_suspend;
+  backend_class->restore = umms_null_backend_restore;
+  backend_class->get_video_codec = umms_null_backend_get_video_codec;
+  backend_class->get_audio_codec = umms_null_backend_get_audio_codec;
+  backend_class->get_video_bitrate = umms_null_backend_get_video_bitrate;
+  backend_class->get_audio_bitrate = umms_null_backend_get_audio_bitrate;
+  backend_class->get_encapsulation = umms_null_backend_get_encapsulation;
+  backend_class->get_audio_samplerate = umms_null_backend_get_audio_samplerate;
+  backend_class->get_video_framerate = umms_null_backend_get_video_framerate;
+  backend_class->get_video_resolution = umms_null_backend_get_video_resolution;
+  backend_class->get_video_aspect_ratio = umms_null_backend_get_video_aspect_ratio;
+  backend_class->get_protocol_name = umms_null_backend_get_protocol_name;
+  backend_class->get_current_uri = umms_null_backend_get_current_uri;
+  backend_class->get_title = umms_null_backend_get_title;
+  backend_class->get_artist = umms_null_backend_get_artist;
+  backend_class->record = umms_null_backend_record;
+  backend_class->get_pat = umms_null_backend_get_pat;
+  backend_class->get_pmt = umms_null_backend_get_pmt;
+  backend_class->get_associated_data_channel = umms_null_backend_get_associated_data_channel;
+  backend_class->reset = umms_null_backend_reset;
+  //Without them, the core falls back to the blocking vmethods.
+  if (conf.async) {
+    backend_class->play_async = umms_null_backend_play_async;
+    backend_class->pause_async = umms_null_backend_pause_async;
+    backend_class->set_position_async = umms_null_backend_set_position_async;
+  }
+}
+
+static void
+umms_null_backend_init (UmmsNullBackend *self)
+{
+  UmmsNullBackendPrivate *priv;
+
+  self->priv = priv = GET_PRIVATE (self);
+  priv->lock = g_mutex_new ();
+  priv->state = PlayerStateStopped;
+  priv->rate = 1.0;
+  priv->volume = 50;
+  priv->scale_mode = ScaleModeKeepAspectRatio;
+  priv->w = 1920;
+  priv->h = 1080;
+  priv->buffer_time = 2000;
+  priv->buffer_bytes = 2 * 1024 * 1024;
+}
+
+UmmsNullBackend *
+umms_null_backend_new (void)
+{
+  return g_object_new (UMMS_TYPE_NULL_BACKEND, NULL);
+}
+
+static gpointer
+backend_new (void)
+{
+  return umms_null_backend_new ();
+}
+
+//Only null:// by default, map other protocols to it in [Player Plugin Preference].
+static const gchar *supported_uri_protocols[] = {"null", NULL};
+static const gchar *unsupported_uri_protocols[] = {NULL};
+
+UmmsPlugin umms_plugin = {
+  UMMS_MAJOR_VERSION,
+  UMMS_MINOR_VERSION,
+  UMMS_PLUGIN_TYPE_PLAYER_BACKEND,
+  NULL,
+  "null",
+  "Synthetic player backend with configurable delays, to benchmark umms-server",
+  supported_uri_protocols,
+  unsupported_uri_protocols,
+  backend_new
+};
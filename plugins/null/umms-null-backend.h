@@ -0,0 +1,85 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _UMMS_NULL_BACKEND_H
+#define _UMMS_NULL_BACKEND_H
+
+#include <umms-player-backend.h>
+
+G_BEGIN_DECLS
+
+#define UMMS_TYPE_NULL_BACKEND umms_null_backend_get_type()
+
+#define UMMS_NULL_BACKEND(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+  UMMS_TYPE_NULL_BACKEND, UmmsNullBackend))
+
+#define UMMS_NULL_BACKEND_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+  UMMS_TYPE_NULL_BACKEND, UmmsNullBackendClass))
+
+#define UMMS_IS_NULL_BACKEND(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+  UMMS_TYPE_NULL_BACKEND))
+
+#define UMMS_IS_NULL_BACKEND_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+  UMMS_TYPE_NULL_BACKEND))
+
+#define UMMS_NULL_BACKEND_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+  UMMS_TYPE_NULL_BACKEND, UmmsNullBackendClass))
+
+typedef struct _UmmsNullBackend UmmsNullBackend;
+typedef struct _UmmsNullBackendClass UmmsNullBackendClass;
+typedef struct _UmmsNullBackendPrivate UmmsNullBackendPrivate;
+
+/*
+ * Synthetic player backend, no media is touched. Each vmethod takes the
+ * delay configured for it and the playback is a clock, so that benchmarks
+ * measure umms-server itself. While playing, buffering, state stalls and tag
+ * changes are emitted at the configured intervals, and Eof at the end of the
+ * configured duration.
+ *
+ * Configured by the [Null Backend] group of umms.conf, see there. The file
+ * can be overridden by the UMMS_NULL_BACKEND_CONF environment variable.
+ */
+struct _UmmsNullBackend {
+  UmmsPlayerBackend parent;
+  UmmsNullBackendPrivate *priv;
+};
+
+struct _UmmsNullBackendClass {
+  UmmsPlayerBackendClass parent_class;
+};
+
+#define UMMS_NULL_CONF_GROUP "Null Backend"
+#define UMMS_NULL_CONF_ENV   "UMMS_NULL_BACKEND_CONF"
+
+GType umms_null_backend_get_type (void) G_GNUC_CONST;
+UmmsNullBackend *umms_null_backend_new (void);
+
+G_END_DECLS
+
+#endif /* _UMMS_NULL_BACKEND_H */
@@ -21,6 +21,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define UMMS_LOG_CATEGORY UmmsLogCategoryBackendFactory
+
 #include "umms-server.h"
 #include "umms-debug.h"
 #include "umms-player-backend.h"
@@ -28,6 +30,7 @@
 #include "umms-video-output-backend.h"
 #include "umms-plugin.h"
 #include "umms-utils.h"
+#include "umms-metrics.h"
 
 typedef enum _HintType {
   HintTypeFileName,
@@ -78,17 +81,25 @@ get_player_plugin_filename_by_configure (GKeyFile *umms_conf, const gchar *prot)
   return filename;
 }
 
+static gint plugin_metric (UmmsPlugin *plugin);
+
 static UmmsPlayerBackend *
 make_backend_from_plugin (UmmsPlugin *plugin)
 {
   gpointer backend = NULL;
+  gint metric;
+  gint64 start;
 
   if (!plugin->backend_new_func) {
     UMMS_WARNING ("backend_new_func is NULL");
     return NULL;
   }
 
+  metric = plugin_metric (plugin);
+  start = umms_metrics_now ();
   backend = plugin->backend_new_func ();
+  umms_metrics_record (metric, umms_metrics_now () - start);
+
   if (backend && UMMS_IS_PLAYER_BACKEND (backend))
     umms_player_backend_set_plugin (UMMS_PLAYER_BACKEND (backend), plugin);
 
@@ -157,14 +168,185 @@ gpointer umms_backend_factory_make (UmmsPluginType type)
   return backend;
 }
 
-UmmsPlayerBackend *
-umms_player_backend_make_from_uri (const gchar *uri)
+static UmmsPlugin *
+query_player_plugin_by_conf (const gchar *prot)
 {
-  gchar *prot = NULL;
-  gchar *base = NULL;
   gchar *filename = NULL;
   UmmsPlugin *plugin = NULL;
-  UmmsPlayerBackend *backend = NULL;
+
+  /* Firstly, check configure for plugins preference */
+  if (filename = get_player_plugin_filename_by_configure (umms_ctx->conf, prot)) {
+    plugin = query_plugin (umms_ctx->plugins, filename, HintTypeFileName);
+  }
+
+  if (!plugin)
+    plugin = query_plugin (umms_ctx->plugins, prot, HintTypeProtocol);
+
+  if (filename)
+    g_free (filename);
+
+  return plugin;
+}
+
+/*
+ * Protocol ==> plugin dispatch index, so that the configured preference and the
+ * white/black lists of plugins are resolved once per protocol instead of on
+ * every lookup. Protocols not seen at build time are resolved on first use.
+ */
+#define MAX_INDEX_SIZE 256
+
+typedef struct _PluginIndex {
+  GHashTable *table;//protocol ==> UmmsPlugin *, or &no_plugin if none handles it
+  gchar      **pref_keys;//keys of PLAYER_PLUGIN_GROUP, in configured order
+  gchar      **pref_files;//plugin filename of each key
+} PluginIndex;
+
+static GStaticMutex index_lock = G_STATIC_MUTEX_INIT;
+static PluginIndex *plugin_index = NULL;
+static gint no_plugin;
+//UmmsPlugin * ==> id of its "backend-new.<plugin>" histogram, under index_lock, kept across rebuilds.
+static GHashTable *plugin_metrics = NULL;
+
+//Called with index_lock held.
+static gint
+plugin_metric_locked (UmmsPlugin *plugin)
+{
+  gpointer value;
+  gchar *name;
+  gint id;
+
+  if (!plugin_metrics)
+    plugin_metrics = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  if (g_hash_table_lookup_extended (plugin_metrics, plugin, NULL, &value))
+    return GPOINTER_TO_INT (value);
+
+  name = g_strdup_printf ("backend-new.%s", plugin->filename ? plugin->filename : plugin->name);
+  id = umms_metrics_register (name, UmmsMetricHistogram);
+  g_free (name);
+  g_hash_table_insert (plugin_metrics, plugin, GINT_TO_POINTER (id));
+
+  return id;
+}
+
+//Registered when the index is built, only a plugin used before that registers on its first backend.
+static gint
+plugin_metric (UmmsPlugin *plugin)
+{
+  gint id;
+
+  g_static_mutex_lock (&index_lock);
+  id = plugin_metric_locked (plugin);
+  g_static_mutex_unlock (&index_lock);
+
+  return id;
+}
+
+//Same precedence rules as get_player_plugin_filename_by_configure().
+static UmmsPlugin *
+plugin_index_resolve (PluginIndex *index, const gchar *prot)
+{
+  gint i;
+  UmmsPlugin *plugin = NULL;
+
+  for (i = 0; index->pref_keys[i]; i++) {
+    if (g_strrstr (prot, index->pref_keys[i]) || g_strrstr ("all", index->pref_keys[i])) {
+      if (index->pref_files[i]) {
+        plugin = query_plugin (umms_ctx->plugins, index->pref_files[i], HintTypeFileName);
+        break;
+      }
+    }
+  }
+
+  if (!plugin)
+    plugin = query_plugin (umms_ctx->plugins, (gpointer)prot, HintTypeProtocol);
+
+  return plugin;
+}
+
+static void
+plugin_index_add (PluginIndex *index, const gchar *prot)
+{
+  UmmsPlugin *plugin;
+
+  if (!prot || prot[0] == '\0' || g_hash_table_lookup (index->table, prot))
+    return;
+
+  plugin = plugin_index_resolve (index, prot);
+  g_hash_table_insert (index->table, g_strdup (prot), plugin ? (gpointer)plugin : (gpointer)&no_plugin);
+}
+
+static void
+plugin_index_free (PluginIndex *index)
+{
+  if (!index)
+    return;
+
+  g_hash_table_destroy (index->table);
+  g_strfreev (index->pref_keys);
+  g_strfreev (index->pref_files);
+  g_free (index);
+}
+
+void
+umms_backend_factory_build_index (GKeyFile *conf)
+{
+  PluginIndex *index;
+  PluginIndex *old;
+  UmmsPlugin *plugin;
+  GList *g;
+  gsize len = 0;
+  gint i;
+
+  index = g_new0 (PluginIndex, 1);
+  index->table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  if (conf)
+    index->pref_keys = g_key_file_get_keys (conf, PLAYER_PLUGIN_GROUP, &len, NULL);
+  if (!index->pref_keys) {
+    index->pref_keys = g_new0 (gchar *, 1);
+    len = 0;
+  }
+  index->pref_files = g_new0 (gchar *, len + 1);
+  for (i = 0; i < len; i++)
+    index->pref_files[i] = g_key_file_get_string (conf, PLAYER_PLUGIN_GROUP, index->pref_keys[i], NULL);
+
+  /* Pre-resolve all the protocols we know about. */
+  for (i = 0; i < len; i++) {
+    if (g_strcmp0 (index->pref_keys[i], "all"))
+      plugin_index_add (index, index->pref_keys[i]);
+  }
+
+  for (g = umms_ctx->plugins; g; g = g->next) {
+    plugin = (UmmsPlugin *)g->data;
+    if (!plugin || plugin->type != UMMS_PLUGIN_TYPE_PLAYER_BACKEND || !plugin->supported_uri_protocols)
+      continue;
+    for (i = 0; plugin->supported_uri_protocols[i]; i++) {
+      if (g_strcmp0 (plugin->supported_uri_protocols[i], "all"))
+        plugin_index_add (index, plugin->supported_uri_protocols[i]);
+    }
+  }
+
+  UMMS_DEBUG ("plugin dispatch index built, %u protocols", g_hash_table_size (index->table));
+
+  g_static_mutex_lock (&index_lock);
+  for (g = umms_ctx->plugins; g; g = g->next) {
+    if (g->data)
+      plugin_metric_locked ((UmmsPlugin *)g->data);
+  }
+  old = plugin_index;
+  plugin_index = index;
+  g_static_mutex_unlock (&index_lock);
+
+  plugin_index_free (old);
+}
+
+static UmmsPlugin *
+query_player_plugin_by_uri (const gchar *uri)
+{
+  gchar *prot = NULL;
+  gpointer value;
+  UmmsPlugin *plugin = NULL;
 
   g_return_val_if_fail (uri_is_valid (uri), NULL);
 
@@ -174,25 +356,210 @@ umms_player_backend_make_from_uri (const gchar *uri)
     return NULL;
   }
 
-  /* Firstly, check configure for plugins preference */
-  if (filename = get_player_plugin_filename_by_configure (umms_ctx->conf, prot)) {
-    plugin = query_plugin (umms_ctx->plugins, filename, HintTypeFileName);
+  g_static_mutex_lock (&index_lock);
+  if (plugin_index) {
+    if (!(value = g_hash_table_lookup (plugin_index->table, prot))) {
+      value = plugin_index_resolve (plugin_index, prot);
+      if (!value)
+        value = &no_plugin;
+      //Don't let arbitrary client supplied protocols grow the index unbounded.
+      if (g_hash_table_size (plugin_index->table) < MAX_INDEX_SIZE)
+        g_hash_table_insert (plugin_index->table, g_strdup (prot), value);
+    }
+    plugin = (value == &no_plugin) ? NULL : (UmmsPlugin *)value;
+    g_static_mutex_unlock (&index_lock);
+  } else {
+    g_static_mutex_unlock (&index_lock);
+    plugin = query_player_plugin_by_conf (prot);
   }
 
-  if (!plugin)
-    plugin = query_plugin (umms_ctx->plugins, prot, HintTypeProtocol);
+  g_free (prot);
+  return plugin;
+}
 
-  if (plugin)
+UmmsPlugin *
+umms_backend_factory_query_player_plugin (const gchar *uri)
+{
+  return query_player_plugin_by_uri (uri);
+}
+
+UmmsPlayerBackend *
+umms_player_backend_make_from_uri (const gchar *uri)
+{
+  UmmsPlugin *plugin = NULL;
+  UmmsPlayerBackend *backend = NULL;
+
+  if ((plugin = query_player_plugin_by_uri (uri)))
     backend = make_backend_from_plugin (plugin);
 
-  if (prot)
-    g_free (prot);
-  if (filename)
-    g_free (filename);
+  if (backend) {
+    UMMS_DEBUG ("created backend (%p) from plugin (%p)", backend, plugin);
+    umms_plugin_info (plugin);
+  }
+  return backend;
+}
+
+/*
+ * Pool of pre-instantiated player backends, one per player plugin.
+ */
+typedef struct _BackendPool {
+  UmmsPlugin *plugin;
+  guint      capacity;
+  GQueue     idle;
+} BackendPool;
+
+static GStaticMutex pool_lock = G_STATIC_MUTEX_INIT;
+static GHashTable *backend_pools = NULL;//UmmsPlugin * ==> BackendPool *
+static guint pool_hits = 0;
+static guint pool_misses = 0;
+
+static guint
+get_pool_capacity_from_conf (GKeyFile *conf, UmmsPlugin *plugin)
+{
+  gint num;
+  GError *err = NULL;
+
+  if (!conf || !plugin->filename)
+    return 0;
+
+  num = g_key_file_get_integer (conf, BACKEND_POOL_GROUP, plugin->filename, &err);
+  if (err) {
+    g_clear_error (&err);
+    num = g_key_file_get_integer (conf, BACKEND_POOL_GROUP, "all", &err);
+    if (err) {
+      g_error_free (err);
+      return 0;
+    }
+  }
+
+  return num > 0 ? num : 0;
+}
+
+void
+umms_backend_pool_init (GKeyFile *conf)
+{
+  GList *g;
+  UmmsPlugin *plugin;
+  BackendPool *pool;
+  UmmsPlayerBackend *backend;
+  guint capacity;
+
+  g_static_mutex_lock (&pool_lock);
+  if (!backend_pools)
+    backend_pools = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (g = umms_ctx->plugins; g; g = g->next) {
+    plugin = (UmmsPlugin *)g->data;
+    if (!plugin || plugin->type != UMMS_PLUGIN_TYPE_PLAYER_BACKEND)
+      continue;
+    if (!(capacity = get_pool_capacity_from_conf (conf, plugin)))
+      continue;
+
+    pool = g_new0 (BackendPool, 1);
+    pool->plugin = plugin;
+    pool->capacity = capacity;
+    g_queue_init (&pool->idle);
+    g_hash_table_insert (backend_pools, plugin, pool);
+
+    while (pool->idle.length < capacity) {
+      if (!(backend = make_backend_from_plugin (plugin))) {
+        UMMS_WARNING ("failed to pre-warm backend of plugin \"%s\"", plugin->filename);
+        break;
+      }
+      //A pooled backend goes from one player to another, the plugin must wipe its state in between.
+      if (!UMMS_PLAYER_BACKEND_GET_CLASS (backend)->reset) {
+        UMMS_WARNING ("plugin \"%s\" can't reset its backends, they are not pooled", plugin->filename);
+        g_object_unref (backend);
+        pool->capacity = 0;
+        break;
+      }
+      g_queue_push_tail (&pool->idle, backend);
+    }
+    UMMS_DEBUG ("pre-warmed %u backends of plugin \"%s\"", pool->idle.length, plugin->filename);
+  }
+  g_static_mutex_unlock (&pool_lock);
+}
+
+UmmsPlayerBackend *
+umms_player_backend_acquire_from_uri (const gchar *uri, gboolean *recycled)
+{
+  UmmsPlugin *plugin;
+  BackendPool *pool = NULL;
+  UmmsPlayerBackend *backend = NULL;
+
+  if (recycled)
+    *recycled = FALSE;
+
+  if (!(plugin = query_player_plugin_by_uri (uri)))
+    return NULL;
+
+  g_static_mutex_lock (&pool_lock);
+  if (backend_pools && (pool = g_hash_table_lookup (backend_pools, plugin)))
+    backend = g_queue_pop_head (&pool->idle);
+  if (backend)
+    pool_hits++;
+  else
+    pool_misses++;
+  g_static_mutex_unlock (&pool_lock);
 
   if (backend) {
+    UMMS_DEBUG ("took pooled backend (%p) of plugin (%p)", backend, plugin);
+    if (recycled)
+      *recycled = TRUE;
+    return backend;
+  }
+
+  if ((backend = make_backend_from_plugin (plugin))) {
     UMMS_DEBUG ("created backend (%p) from plugin (%p)", backend, plugin);
     umms_plugin_info (plugin);
   }
   return backend;
 }
+
+void
+umms_player_backend_recycle (UmmsPlayerBackend *backend)
+{
+  BackendPool *pool = NULL;
+  gboolean pooled = FALSE;
+  gboolean room;
+  GError *err = NULL;
+
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (backend));
+
+  g_static_mutex_lock (&pool_lock);
+  room = backend_pools && (pool = g_hash_table_lookup (backend_pools, backend->plugin))
+         && pool->idle.length < pool->capacity;
+  g_static_mutex_unlock (&pool_lock);
+
+  //Not reused if the plugin can't wipe it.
+  if (room && !umms_player_backend_reset (backend, &err)) {
+    UMMS_WARNING ("failed to reset backend (%p): %s", backend, err->message);
+    g_error_free (err);
+    room = FALSE;
+  }
+
+  if (room) {
+    g_static_mutex_lock (&pool_lock);
+    if (pool->idle.length < pool->capacity) {
+      g_queue_push_tail (&pool->idle, backend);
+      pooled = TRUE;
+    }
+    g_static_mutex_unlock (&pool_lock);
+  }
+
+  if (pooled)
+    UMMS_DEBUG ("backend (%p) back to pool", backend);
+  else
+    g_object_unref (backend);
+}
+
+void
+umms_backend_pool_get_stats (guint *hits, guint *misses)
+{
+  g_static_mutex_lock (&pool_lock);
+  if (hits)
+    *hits = pool_hits;
+  if (misses)
+    *misses = pool_misses;
+  g_static_mutex_unlock (&pool_lock);
+}
@@ -40,6 +40,49 @@ G_BEGIN_DECLS
  */
 UmmsPlayerBackend *umms_player_backend_make_from_uri (const gchar *uri);
 
+/*
+ * conf:            umms configure
+ *
+ * (Re)build the protocol ==> plugin dispatch index from [Player Plugin Preference]
+ * and the protocols declared by the loaded plugins. Must be called after all
+ * plugins loaded, and again whenever the configure is reloaded. Before the
+ * first build, lookups scan the configure and plugin list every time.
+ */
+void umms_backend_factory_build_index (GKeyFile *conf);
+
+/*
+ * Returns:         The player plugin which handles this uri, NULL if none.
+ */
+UmmsPlugin *umms_backend_factory_query_player_plugin (const gchar *uri);
+
+/*
+ * conf:            umms configure, [Backend Pool] group specifies the number of
+ *                  backends pre-instantiated for each player plugin.
+ *
+ * Must be called after all plugins loaded.
+ */
+void umms_backend_pool_init (GKeyFile *conf);
+
+/*
+ * uri:             uri to play
+ * recycled:        set to TRUE if the backend was taken from the pool, in that
+ *                  case it may keep settings of its former user.
+ *
+ * Returns:         A UmmsPlayerBackend, taken from the pool of the plugin which
+ *                  handles this uri if possible, created otherwise.
+ *                  NULL if failed
+ */
+UmmsPlayerBackend *umms_player_backend_acquire_from_uri (const gchar *uri, gboolean *recycled);
+
+/*
+ * Reset a stopped backend, see umms_player_backend_reset(), and give it back
+ * to the pool. Finalize it if the pool is full or the reset failed. Takes the
+ * ownership of backend.
+ */
+void umms_player_backend_recycle (UmmsPlayerBackend *backend);
+
+void umms_backend_pool_get_stats (guint *hits, guint *misses);
+
 G_END_DECLS
 
 #endif /* _UMMS_BACKEND_FACTORY_H */
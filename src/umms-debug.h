@@ -24,13 +24,20 @@
 #ifndef _UMMS_DEBUG_H
 #define _UMMS_DEBUG_H
 
+#include "umms-log.h"
+
 #define UMMS_ENABLE_DEBUG
 
+//Category of the records of a source file, define it before including any header.
+#ifndef UMMS_LOG_CATEGORY
+#define UMMS_LOG_CATEGORY UmmsLogCategoryCore
+#endif
+
 #ifdef UMMS_ENABLE_DEBUG
 #define UMMS_DEBUG(format, ...) \
-    g_debug (G_STRLOC " :%s(): " format, G_STRFUNC, ##__VA_ARGS__)
+    UMMS_LOG (UMMS_LOG_CATEGORY, UmmsLogLevelDebug, format, ##__VA_ARGS__)
 #define UMMS_WARNING(format, ...) \
-    g_debug (G_STRLOC " Warning :%s(): " format, G_STRFUNC, ##__VA_ARGS__)
+    UMMS_LOG (UMMS_LOG_CATEGORY, UmmsLogLevelWarning, format, ##__VA_ARGS__)
 
 #else
 #define UMMS_DEBUG(format, ...)
@@ -0,0 +1,413 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "umms-frame-ring.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#define RING_MAGIC   0x52464d55 //"UMFR"
+#define RING_VERSION 1
+#define CACHE_LINE   64
+#define ALIGN_UP(x, a) (((x) + (a) - 1) & ~((gsize)(a) - 1))
+
+/*
+ * Shared layout: RingHeader, n_slots SlotHeader, then n_slots data slots.
+ *
+ * Frame f (counted from 1) goes to slot f % n_slots. The slot seq is 2f - 1
+ * while the writer fills it and 2f once it is complete, write_seq is the last
+ * complete frame.
+ */
+typedef struct _RingHeader {
+  guint32       magic;
+  guint32       version;
+  guint32       n_slots;
+  guint32       slot_size;
+  guint32       data_offset;
+  volatile gint write_seq;
+} RingHeader;
+
+typedef struct _SlotHeader {
+  volatile gint seq;
+  UmmsFrameInfo info;
+} SlotHeader;
+
+/*
+ * The geometry is kept here, the shared header is only read once by the
+ * reader to check it: the writer never trusts what a client can map.
+ */
+struct _UmmsFrameRing {
+  gint        fd;
+  gint        event_fd;
+  gboolean    writer;
+  gsize       size;
+  guint       n_slots;
+  guint       slot_size;
+  guint8      *base;
+  RingHeader  *header;
+  guint8      *slots;//SlotHeader array, each CACHE_LINE aligned
+  guint8      *data;
+  guint32     write_seq;//writer only, last complete frame
+  guint32     last_read;
+  guint       dropped;
+};
+
+#define SLOT_HEADER_SIZE ALIGN_UP (sizeof (SlotHeader), CACHE_LINE)
+#define SLOT_HEADER(ring, f) ((SlotHeader *)((ring)->slots + ((f) % (ring)->n_slots) * SLOT_HEADER_SIZE))
+#define SLOT_DATA(ring, f) ((ring)->data + (gsize)((f) % (ring)->n_slots) * (ring)->slot_size)
+
+static gsize
+ring_size (guint n_slots, guint slot_size, guint *data_offset)
+{
+  gsize offset = ALIGN_UP (sizeof (RingHeader), CACHE_LINE) + n_slots * SLOT_HEADER_SIZE;
+
+  offset = ALIGN_UP (offset, getpagesize ());
+  *data_offset = offset;
+  return offset + (gsize)n_slots * slot_size;
+}
+
+static void
+set_errno_error (GError **err, const gchar *what)
+{
+  gint saved = errno;
+
+  g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (saved), "%s: %s", what, g_strerror (saved));
+}
+
+static gint
+create_shm_fd (gsize size, GError **err)
+{
+  gint fd = -1;
+  gchar *path;
+
+#ifdef __NR_memfd_create
+  fd = syscall (__NR_memfd_create, "umms-frame-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+
+  //Kernel without memfd, fall back to an unlinked file on tmpfs.
+  if (fd < 0) {
+    path = g_strdup ("/dev/shm/umms-frame-ring-XXXXXX");
+    if ((fd = mkstemp (path)) >= 0) {
+      unlink (path);
+      fcntl (fd, F_SETFD, FD_CLOEXEC);
+    }
+    g_free (path);
+  }
+
+  if (fd < 0) {
+    set_errno_error (err, "failed to create shared memory");
+    return -1;
+  }
+
+  if (ftruncate (fd, size) < 0) {
+    set_errno_error (err, "failed to size shared memory");
+    close (fd);
+    return -1;
+  }
+
+#ifdef F_ADD_SEALS
+  //Readers must not be able to shrink it under our feet.
+  fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+#endif
+
+  return fd;
+}
+
+static void
+ring_setup (UmmsFrameRing *ring, guint n_slots, guint slot_size, guint data_offset)
+{
+  ring->n_slots = n_slots;
+  ring->slot_size = slot_size;
+  ring->header = (RingHeader *)ring->base;
+  ring->slots = ring->base + ALIGN_UP (sizeof (RingHeader), CACHE_LINE);
+  ring->data = ring->base + data_offset;
+}
+
+UmmsFrameRing *
+umms_frame_ring_new (guint n_slots, guint slot_size, GError **err)
+{
+  UmmsFrameRing *ring;
+  guint data_offset;
+
+  g_return_val_if_fail (n_slots > 1 && slot_size > 0, NULL);
+
+  ring = g_new0 (UmmsFrameRing, 1);
+  ring->writer = TRUE;
+  ring->fd = ring->event_fd = -1;
+  ring->size = ring_size (n_slots, slot_size, &data_offset);
+
+  if ((ring->fd = create_shm_fd (ring->size, err)) < 0)
+    goto failed;
+
+  if ((ring->event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    set_errno_error (err, "failed to create eventfd");
+    goto failed;
+  }
+
+  ring->base = mmap (NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+  if (ring->base == MAP_FAILED) {
+    ring->base = NULL;
+    set_errno_error (err, "failed to map shared memory");
+    goto failed;
+  }
+
+  ring->header = (RingHeader *)ring->base;
+  ring->header->n_slots = n_slots;
+  ring->header->slot_size = slot_size;
+  ring->header->data_offset = data_offset;
+  ring->header->version = RING_VERSION;
+  ring_setup (ring, n_slots, slot_size, data_offset);
+  //Publish the magic last, a reader checks it first.
+  g_atomic_int_set ((volatile gint *)&ring->header->magic, RING_MAGIC);
+
+  return ring;
+
+failed:
+  umms_frame_ring_free (ring);
+  return NULL;
+}
+
+gpointer
+umms_frame_ring_begin_write (UmmsFrameRing *ring)
+{
+  guint32 f;
+
+  g_return_val_if_fail (ring && ring->writer, NULL);
+
+  f = ring->write_seq + 1;
+  //Odd seq, readers holding this slot see it is being overwritten.
+  g_atomic_int_set (&SLOT_HEADER (ring, f)->seq, (gint)(2 * f - 1));
+  return SLOT_DATA (ring, f);
+}
+
+void
+umms_frame_ring_commit (UmmsFrameRing *ring, const UmmsFrameInfo *info)
+{
+  SlotHeader *slot;
+  guint32 f;
+  guint64 one = 1;
+
+  g_return_if_fail (ring && ring->writer && info);
+  g_return_if_fail (info->size <= ring->slot_size);
+
+  f = ++ring->write_seq;
+  slot = SLOT_HEADER (ring, f);
+  slot->info = *info;
+  g_atomic_int_set (&slot->seq, (gint)(2 * f));
+  g_atomic_int_set (&ring->header->write_seq, (gint)f);
+
+  //The counter only overflows if nobody reads, then the reader is woken anyway.
+  if (write (ring->event_fd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+    g_warning ("failed to signal frame: %s", g_strerror (errno));
+}
+
+gboolean
+umms_frame_ring_write (UmmsFrameRing *ring, const UmmsFrameInfo *info, gconstpointer data)
+{
+  gpointer slot;
+
+  g_return_val_if_fail (ring && info && data, FALSE);
+
+  if (info->size > ring->slot_size) {
+    g_warning ("frame of %u bytes doesn't fit in the slot of %u bytes", info->size, ring->slot_size);
+    return FALSE;
+  }
+
+  slot = umms_frame_ring_begin_write (ring);
+  memcpy (slot, data, info->size);
+  umms_frame_ring_commit (ring, info);
+  return TRUE;
+}
+
+UmmsFrameRing *
+umms_frame_ring_open (gint fd, gint event_fd, GError **err)
+{
+  UmmsFrameRing *ring;
+  RingHeader header;
+  struct stat st;
+  guint data_offset;
+
+  ring = g_new0 (UmmsFrameRing, 1);
+  ring->fd = fd;
+  ring->event_fd = event_fd;
+
+  if (fstat (fd, &st) < 0) {
+    set_errno_error (err, "failed to stat shared memory");
+    goto failed;
+  }
+  if (st.st_size < sizeof (RingHeader) || pread (fd, &header, sizeof (header), 0) != sizeof (header)
+      || header.magic != RING_MAGIC || header.version != RING_VERSION || header.n_slots < 2
+      || ring_size (header.n_slots, header.slot_size, &data_offset) != st.st_size
+      || header.data_offset != data_offset) {
+    g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_INVAL, "not a frame ring");
+    goto failed;
+  }
+
+  ring->size = st.st_size;
+  ring->base = mmap (NULL, ring->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (ring->base == MAP_FAILED) {
+    ring->base = NULL;
+    set_errno_error (err, "failed to map shared memory");
+    goto failed;
+  }
+  ring_setup (ring, header.n_slots, header.slot_size, data_offset);
+  ring->last_read = (guint32)g_atomic_int_get (&ring->header->write_seq);
+
+  return ring;
+
+failed:
+  umms_frame_ring_free (ring);
+  return NULL;
+}
+
+gboolean
+umms_frame_ring_wait (UmmsFrameRing *ring, gint timeout)
+{
+  struct pollfd pfd;
+  guint64 count;
+
+  g_return_val_if_fail (ring, FALSE);
+
+  if ((guint32)g_atomic_int_get (&ring->header->write_seq) != ring->last_read)
+    return TRUE;
+
+  pfd.fd = ring->event_fd;
+  pfd.events = POLLIN;
+  if (poll (&pfd, 1, timeout) <= 0)
+    return FALSE;
+
+  //Drain the counter, acquire() picks the newest frame anyway.
+  if (read (ring->event_fd, &count, sizeof (count)) < 0 && errno != EAGAIN)
+    return FALSE;
+
+  return TRUE;
+}
+
+gboolean
+umms_frame_ring_acquire (UmmsFrameRing *ring, UmmsFrame *frame)
+{
+  SlotHeader *slot;
+  guint32 f;
+
+  g_return_val_if_fail (ring && frame, FALSE);
+
+  //Retry if the writer laps us while reading the slot header.
+  do {
+    f = (guint32)g_atomic_int_get (&ring->header->write_seq);
+    if (f == ring->last_read)
+      return FALSE;
+
+    slot = SLOT_HEADER (ring, f);
+    frame->info = slot->info;
+  } while ((guint32)g_atomic_int_get (&slot->seq) != 2 * f);
+
+  ring->dropped += f - ring->last_read - 1;
+  ring->last_read = f;
+  frame->seq = f;
+  frame->data = SLOT_DATA (ring, f);
+
+  return TRUE;
+}
+
+gboolean
+umms_frame_ring_frame_valid (UmmsFrameRing *ring, const UmmsFrame *frame)
+{
+  g_return_val_if_fail (ring && frame, FALSE);
+
+  return (guint32)g_atomic_int_get (&SLOT_HEADER (ring, frame->seq)->seq) == 2 * frame->seq;
+}
+
+guint
+umms_frame_ring_get_dropped (UmmsFrameRing *ring)
+{
+  g_return_val_if_fail (ring, 0);
+  return ring->dropped;
+}
+
+void
+umms_frame_ring_free (UmmsFrameRing *ring)
+{
+  if (!ring)
+    return;
+
+  if (ring->base)
+    munmap (ring->base, ring->size);
+  if (ring->fd >= 0)
+    close (ring->fd);
+  if (ring->event_fd >= 0)
+    close (ring->event_fd);
+  g_free (ring);
+}
+
+gint
+umms_frame_ring_get_fd (UmmsFrameRing *ring)
+{
+  g_return_val_if_fail (ring, -1);
+  return ring->fd;
+}
+
+gint
+umms_frame_ring_get_event_fd (UmmsFrameRing *ring)
+{
+  g_return_val_if_fail (ring, -1);
+  return ring->event_fd;
+}
+
+guint
+umms_frame_ring_get_slot_size (UmmsFrameRing *ring)
+{
+  g_return_val_if_fail (ring, 0);
+  return ring->slot_size;
+}
+
+gint
+umms_frame_ring_open_reader_fd (UmmsFrameRing *ring, GError **err)
+{
+  gchar *path;
+  gint fd;
+
+  g_return_val_if_fail (ring && ring->writer, -1);
+
+  //A new open file description, so that it is read-only unlike ours.
+  path = g_strdup_printf ("/proc/self/fd/%d", ring->fd);
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  g_free (path);
+  if (fd < 0)
+    set_errno_error (err, "failed to reopen shared memory read-only");
+  return fd;
+}
@@ -0,0 +1,96 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_FRAME_RING_H
+#define _UMMS_FRAME_RING_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Shared memory ring of decoded frames, for the DataCopy target type.
+ *
+ * The backend (writer) owns a sealed memfd holding n_slots frame slots, and an
+ * eventfd which is signaled on each new frame. The client (reader) gets a
+ * read-only fd of the memfd, maps it and reads the frames in place. Each slot is guarded by a
+ * sequence number, so the reader can tell whether a frame was overwritten
+ * while it was using it. The reader always takes the newest frame, older
+ * ones are dropped.
+ */
+
+//Keys of the SetTarget params for DataCopy.
+#define UMMS_FRAME_RING_PARAM_SLOTS     "frame-slots"
+#define UMMS_FRAME_RING_PARAM_SLOT_SIZE "frame-slot-size"
+
+#define UMMS_FRAME_RING_DEFAULT_SLOTS     4
+#define UMMS_FRAME_RING_DEFAULT_SLOT_SIZE (1920 * 1080 * 4)
+
+typedef struct _UmmsFrameRing UmmsFrameRing;
+
+typedef struct _UmmsFrameInfo {
+  guint32 size;//bytes used in the slot
+  guint32 width;
+  guint32 height;
+  guint32 stride;
+  guint32 format;//fourcc
+  guint32 reserved;
+  gint64  pts;//ns
+} UmmsFrameInfo;
+
+typedef struct _UmmsFrame {
+  guint32       seq;
+  UmmsFrameInfo info;
+  gconstpointer data;//points into the shared memory, valid until overwritten
+} UmmsFrame;
+
+//Writer side.
+UmmsFrameRing *umms_frame_ring_new (guint n_slots, guint slot_size, GError **err);
+gpointer umms_frame_ring_begin_write (UmmsFrameRing *ring);
+void umms_frame_ring_commit (UmmsFrameRing *ring, const UmmsFrameInfo *info);
+gboolean umms_frame_ring_write (UmmsFrameRing *ring, const UmmsFrameInfo *info, gconstpointer data);
+
+/*
+ * Reader side, takes the ownership of both fds.
+ *
+ * umms_frame_ring_wait:        Wait up to timeout ms (-1 for ever) for a new frame.
+ * umms_frame_ring_acquire:     Get the newest frame not read yet, FALSE if none.
+ * umms_frame_ring_frame_valid: Whether the frame was not overwritten meanwhile,
+ *                              check it after using frame->data.
+ */
+UmmsFrameRing *umms_frame_ring_open (gint fd, gint event_fd, GError **err);
+gboolean umms_frame_ring_wait (UmmsFrameRing *ring, gint timeout);
+gboolean umms_frame_ring_acquire (UmmsFrameRing *ring, UmmsFrame *frame);
+gboolean umms_frame_ring_frame_valid (UmmsFrameRing *ring, const UmmsFrame *frame);
+guint umms_frame_ring_get_dropped (UmmsFrameRing *ring);
+
+void umms_frame_ring_free (UmmsFrameRing *ring);
+gint umms_frame_ring_get_fd (UmmsFrameRing *ring);
+gint umms_frame_ring_get_event_fd (UmmsFrameRing *ring);
+guint umms_frame_ring_get_slot_size (UmmsFrameRing *ring);
+//Writer side, a read-only fd of the memory to hand out to a reader, -1 on error.
+gint umms_frame_ring_open_reader_fd (UmmsFrameRing *ring, GError **err);
+
+G_END_DECLS
+
+#endif /* _UMMS_FRAME_RING_H */
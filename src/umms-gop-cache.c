@@ -0,0 +1,141 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <string.h>
+#include "umms-gop-cache.h"
+
+#define TS_PACKET_SIZE 188
+
+struct _UmmsGopCache {
+  GMutex     *lock;
+  volatile gint pid;
+  gsize      max_size;
+  GByteArray *gop;//empty until a random access point was seen, or after an overflow
+  guint64    gops;
+  guint64    overflows;
+};
+
+UmmsGopCache *
+umms_gop_cache_new (guint pid, gsize max_size)
+{
+  UmmsGopCache *cache = g_new0 (UmmsGopCache, 1);
+
+  cache->lock = g_mutex_new ();
+  cache->pid = pid;
+  cache->max_size = MAX (max_size, TS_PACKET_SIZE);
+  cache->gop = g_byte_array_new ();
+
+  return cache;
+}
+
+void
+umms_gop_cache_free (UmmsGopCache *cache)
+{
+  if (!cache)
+    return;
+
+  g_byte_array_free (cache->gop, TRUE);
+  g_mutex_free (cache->lock);
+  g_free (cache);
+}
+
+void
+umms_gop_cache_reset (UmmsGopCache *cache, guint pid)
+{
+  g_return_if_fail (cache);
+
+  g_mutex_lock (cache->lock);
+  g_atomic_int_set (&cache->pid, pid);
+  g_byte_array_set_size (cache->gop, 0);
+  g_mutex_unlock (cache->lock);
+}
+
+//random_access_indicator, in the adaptation field.
+static inline gboolean
+packet_is_rap (const guint8 *pkt)
+{
+  return (pkt[3] & 0x20) && pkt[4] > 0 && (pkt[5] & 0x40);
+}
+
+void
+umms_gop_cache_push_packet (UmmsGopCache *cache, const guint8 *pkt)
+{
+  guint pid = (pkt[1] & 0x1F) << 8 | pkt[2];
+
+  g_return_if_fail (cache && pkt);
+
+  //Lockless check, a PID changed meanwhile only costs one packet.
+  if (pid != (guint)g_atomic_int_get (&cache->pid))
+    return;
+  if (pkt[0] != 0x47 || (pkt[1] & 0x80))
+    return;
+
+  g_mutex_lock (cache->lock);
+  if (packet_is_rap (pkt)) {
+    g_byte_array_set_size (cache->gop, 0);
+    cache->gops++;
+  } else if (cache->gop->len == 0) {
+    //Waiting for a random access point.
+    g_mutex_unlock (cache->lock);
+    return;
+  }
+
+  if (cache->gop->len + TS_PACKET_SIZE > cache->max_size) {
+    g_byte_array_set_size (cache->gop, 0);
+    cache->overflows++;
+  } else {
+    g_byte_array_append (cache->gop, pkt, TS_PACKET_SIZE);
+  }
+  g_mutex_unlock (cache->lock);
+}
+
+GByteArray *
+umms_gop_cache_get (UmmsGopCache *cache)
+{
+  GByteArray *copy = NULL;
+
+  g_return_val_if_fail (cache, NULL);
+
+  g_mutex_lock (cache->lock);
+  if (cache->gop->len) {
+    copy = g_byte_array_sized_new (cache->gop->len);
+    g_byte_array_append (copy, cache->gop->data, cache->gop->len);
+  }
+  g_mutex_unlock (cache->lock);
+
+  return copy;
+}
+
+void
+umms_gop_cache_get_stats (UmmsGopCache *cache, guint64 *gops, guint64 *overflows)
+{
+  g_return_if_fail (cache);
+
+  g_mutex_lock (cache->lock);
+  if (gops)
+    *gops = cache->gops;
+  if (overflows)
+    *overflows = cache->overflows;
+  g_mutex_unlock (cache->lock);
+}
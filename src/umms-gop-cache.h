@@ -0,0 +1,73 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _UMMS_GOP_CACHE_H
+#define _UMMS_GOP_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Latest GOP of a video PID, kept by a backend pre-tuned to a channel: once
+ * swapped in, it decodes from the last random access point instead of waiting
+ * for the next one, and the first frame is out at once.
+ *
+ * The packets of the PID are kept from the last one having the
+ * random_access_indicator set, up to max_size bytes. A longer GOP is dropped
+ * until the next random access point. Packets of the other PIDs are ignored,
+ * the PAT and PMT of the channel are in the UmmsPsiCache of the backend.
+ *
+ * Thread safe: fed from the streaming thread, read when the backend is
+ * swapped in.
+ */
+
+typedef struct _UmmsGopCache UmmsGopCache;
+
+//PID to give until the video PID is known from the PMT.
+#define UMMS_GOP_CACHE_NO_PID 0x2000
+
+UmmsGopCache *umms_gop_cache_new (guint pid, gsize max_size);
+void umms_gop_cache_free (UmmsGopCache *cache);
+//Forget the GOP, and follow another PID.
+void umms_gop_cache_reset (UmmsGopCache *cache, guint pid);
+
+//Feed one 188 byte TS packet, any PID.
+void umms_gop_cache_push_packet (UmmsGopCache *cache, const guint8 *packet);
+
+/*
+ * Copy of the packets of the GOP, starting with the random access point.
+ * NULL if there is no complete start of GOP cached.
+ */
+GByteArray *umms_gop_cache_get (UmmsGopCache *cache);
+
+/*
+ * gops:            Random access points seen.
+ * overflows:       GOPs dropped for being longer than max_size.
+ */
+void umms_gop_cache_get_stats (UmmsGopCache *cache, guint64 *gops, guint64 *overflows);
+
+G_END_DECLS
+
+#endif /* _UMMS_GOP_CACHE_H */
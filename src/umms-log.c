@@ -0,0 +1,320 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "umms-server.h"
+#include "umms-log.h"
+
+gint umms_log_levels[UmmsLogCategoryNum] = {
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning
+};
+
+static const gchar *category_names[UmmsLogCategoryNum] = {
+  "core", "player", "backend-factory", "resource", "object-manager", "plugin"
+};
+static const gchar *level_names[] = {"none", "warning", "debug"};
+
+//Printed levels, umms_log_levels also covers the ring level.
+static gint print_levels[UmmsLogCategoryNum] = {
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning,
+  UmmsLogLevelWarning
+};
+static gint saved_levels[UmmsLogCategoryNum];//before the debug toggle
+static volatile gint debug_toggled = FALSE;
+
+//Set up by umms_log_init() only.
+static UmmsLogRecord *ring = NULL;
+static guint ring_size = 0;
+static gint ring_level = UmmsLogLevelWarning;
+static gchar *ring_dump = NULL;
+static volatile gint ring_next = 0;
+
+//Async-signal-safe.
+static void
+update_levels (void)
+{
+  gint i;
+
+  for (i = 0; i < UmmsLogCategoryNum; i++)
+    umms_log_levels[i] = ring ? MAX (print_levels[i], ring_level) : print_levels[i];
+}
+
+static gint
+parse_level (const gchar *name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (level_names); i++) {
+    if (!g_ascii_strcasecmp (name, level_names[i]))
+      return i;
+  }
+  return -1;
+}
+
+gboolean
+umms_log_set_level (const gchar *category, const gchar *level)
+{
+  gint l, i;
+
+  g_return_val_if_fail (category && level, FALSE);
+
+  if ((l = parse_level (level)) < 0)
+    return FALSE;
+
+  for (i = 0; i < UmmsLogCategoryNum; i++) {
+    if (!strcmp (category, "all") || !strcmp (category, category_names[i])) {
+      print_levels[i] = l;
+      if (strcmp (category, "all"))
+        break;
+    }
+  }
+  if (i == UmmsLogCategoryNum && strcmp (category, "all"))
+    return FALSE;
+
+  //An explicit level ends the toggle, there is nothing to switch back to.
+  debug_toggled = FALSE;
+  update_levels ();
+  return TRUE;
+}
+
+UmmsLogLevel
+umms_log_get_level (UmmsLogCategory category)
+{
+  g_return_val_if_fail (category < UmmsLogCategoryNum, UmmsLogLevelNone);
+  return print_levels[category];
+}
+
+const gchar *
+umms_log_category_name (UmmsLogCategory category)
+{
+  g_return_val_if_fail (category < UmmsLogCategoryNum, NULL);
+  return category_names[category];
+}
+
+const gchar *
+umms_log_level_name (UmmsLogLevel level)
+{
+  g_return_val_if_fail (level < G_N_ELEMENTS (level_names), NULL);
+  return level_names[level];
+}
+
+//"debug" or "player:debug,resource:warning".
+static void
+set_levels_from_string (const gchar *spec)
+{
+  gchar **items, **item, *colon;
+  gboolean ok;
+
+  items = g_strsplit (spec, ",", -1);
+  for (item = items; *item; item++) {
+    g_strstrip (*item);
+    if (!**item)
+      continue;
+    if ((colon = strchr (*item, ':'))) {
+      *colon = '\0';
+      ok = umms_log_set_level (*item, colon + 1);
+    } else {
+      ok = umms_log_set_level ("all", *item);
+    }
+    if (!ok)
+      g_warning ("invalid log level '%s'", *item);
+  }
+  g_strfreev (items);
+}
+
+void
+umms_log_init (GKeyFile *conf)
+{
+  gchar *value;
+  const gchar *env;
+  gint size = 0;
+  gint i, l;
+
+  if (conf) {
+    if ((value = g_key_file_get_string (conf, LOG_GROUP, "level", NULL))) {
+      if (!umms_log_set_level ("all", value))
+        g_warning ("invalid log level '%s'", value);
+      g_free (value);
+    }
+    for (i = 0; i < UmmsLogCategoryNum; i++) {
+      if ((value = g_key_file_get_string (conf, LOG_GROUP, category_names[i], NULL))) {
+        if (!umms_log_set_level (category_names[i], value))
+          g_warning ("invalid log level '%s' for '%s'", value, category_names[i]);
+        g_free (value);
+      }
+    }
+
+    size = g_key_file_get_integer (conf, LOG_GROUP, "ring-size", NULL);
+    if ((value = g_key_file_get_string (conf, LOG_GROUP, "ring-level", NULL))) {
+      if ((l = parse_level (value)) >= 0)
+        ring_level = l;
+      else
+        g_warning ("invalid ring log level '%s'", value);
+      g_free (value);
+    }
+    if (!ring_dump)
+      ring_dump = g_key_file_get_string (conf, LOG_GROUP, "ring-dump", NULL);
+  }
+
+  if ((env = g_getenv ("UMMS_LOG")))
+    set_levels_from_string (env);
+
+  if (size > 0 && !ring) {
+    ring = g_new0 (UmmsLogRecord, size);
+    ring_size = size;
+  }
+  if (!ring_dump)
+    ring_dump = g_strdup (LOG_RING_DUMP_DEFAULT);
+
+  update_levels ();
+}
+
+//Formats straight into the slot, no allocation.
+static void
+ring_put (UmmsLogCategory category, UmmsLogLevel level, const gchar *location, const gchar *func,
+          const gchar *format, va_list args)
+{
+  guint pos = (guint)g_atomic_int_exchange_and_add (&ring_next, 1);
+  UmmsLogRecord *rec = &ring[pos % ring_size];
+  struct timespec ts;
+  gint n;
+
+  //A writer lapped by the others may still mix two records in a slot, the seq tells the last one.
+  g_atomic_int_set (&rec->seq, 0);
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  rec->time = (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+  rec->category = category;
+  rec->level = level;
+  n = g_snprintf (rec->msg, sizeof (rec->msg), "%s :%s(): ", location, func);
+  if (n < (gint)sizeof (rec->msg))
+    g_vsnprintf (rec->msg + n, sizeof (rec->msg) - n, format, args);
+  g_atomic_int_set (&rec->seq, (gint)(pos + 1));
+}
+
+void
+umms_log_write (UmmsLogCategory category, UmmsLogLevel level, const gchar *location, const gchar *func,
+                const gchar *format, ...)
+{
+  va_list args;
+  gchar *msg;
+
+  if (ring && (gint)level <= ring_level) {
+    va_start (args, format);
+    ring_put (category, level, location, func, format, args);
+    va_end (args);
+  }
+
+  if ((gint)level <= print_levels[category]) {
+    va_start (args, format);
+    msg = g_strdup_vprintf (format, args);
+    va_end (args);
+    g_debug ("%s%s :%s(): %s", location, level == UmmsLogLevelWarning ? " Warning" : "", func, msg);
+    g_free (msg);
+  }
+}
+
+void
+umms_log_toggle_debug (void)
+{
+  gint i;
+
+  for (i = 0; i < UmmsLogCategoryNum; i++) {
+    if (!debug_toggled) {
+      saved_levels[i] = print_levels[i];
+      print_levels[i] = UmmsLogLevelDebug;
+    } else {
+      print_levels[i] = saved_levels[i];
+    }
+  }
+  debug_toggled = !debug_toggled;
+  update_levels ();
+}
+
+gboolean
+umms_log_dump_ring (void)
+{
+  gsize len, done = 0;
+  gssize n;
+  gint fd;
+
+  if (!ring || !ring_dump)
+    return FALSE;
+
+  if ((fd = open (ring_dump, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    return FALSE;
+
+  len = ring_size * sizeof (UmmsLogRecord);
+  while (done < len && (n = write (fd, (const gchar *)ring + done, len - done)) > 0)
+    done += n;
+  close (fd);
+
+  return done == len;
+}
+
+static gint
+record_compare (gconstpointer a, gconstpointer b)
+{
+  guint32 sa = ((const UmmsLogRecord *)a)->seq;
+  guint32 sb = ((const UmmsLogRecord *)b)->seq;
+
+  return sa < sb ? -1 : sa > sb;
+}
+
+gchar **
+umms_log_ring_lines (void)
+{
+  UmmsLogRecord *copy;
+  GPtrArray *lines = g_ptr_array_new ();
+  guint i;
+
+  if (ring) {
+    copy = g_memdup (ring, ring_size * sizeof (UmmsLogRecord));
+    qsort (copy, ring_size, sizeof (UmmsLogRecord), record_compare);
+    for (i = 0; i < ring_size; i++) {
+      if (!copy[i].seq)
+        continue;
+      copy[i].msg[sizeof (copy[i].msg) - 1] = '\0';
+      g_ptr_array_add (lines, g_strdup_printf ("%" G_GINT64_FORMAT ".%06" G_GINT64_FORMAT " %s %s %s",
+                                               copy[i].time / G_USEC_PER_SEC, copy[i].time % G_USEC_PER_SEC,
+                                               umms_log_category_name (copy[i].category),
+                                               umms_log_level_name (copy[i].level), copy[i].msg));
+    }
+    g_free (copy);
+  }
+  g_ptr_array_add (lines, NULL);
+
+  return (gchar **)g_ptr_array_free (lines, FALSE);
+}
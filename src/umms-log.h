@@ -0,0 +1,123 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_LOG_H
+#define _UMMS_LOG_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Logging by category, with a level per category changeable at runtime.
+ *
+ * UMMS_LOG() only tests the level of the category before calling
+ * umms_log_write(), so a disabled record costs a load and a branch, its
+ * arguments are neither evaluated nor formatted. A source file picks its
+ * category by defining UMMS_LOG_CATEGORY before its first include, see
+ * umms-debug.h.
+ *
+ * The records may also be kept in a ring of fixed size slots, to be dumped
+ * after a crash. The ring has its own level, warning by default, so that it
+ * can keep the debug records while only the warnings are printed. The level
+ * tested by UMMS_LOG() is the higher of both, so a ring at debug has every
+ * debug record formatted.
+ *
+ * The server exports its symbols, so that the plugins, which link libumms,
+ * share its levels and ring rather than those of the library.
+ */
+
+typedef enum {
+  UmmsLogCategoryCore,
+  UmmsLogCategoryPlayer,
+  UmmsLogCategoryBackendFactory,
+  UmmsLogCategoryResource,
+  UmmsLogCategoryObjectManager,
+  UmmsLogCategoryPlugin,
+  UmmsLogCategoryNum
+} UmmsLogCategory;
+
+typedef enum {
+  UmmsLogLevelNone,
+  UmmsLogLevelWarning,
+  UmmsLogLevelDebug
+} UmmsLogLevel;
+
+//Highest level to record per category, printed or kept in the ring. Read only, use umms_log_set_level().
+extern gint umms_log_levels[UmmsLogCategoryNum];
+
+#define UMMS_LOG(category, level, format, ...) \
+  G_STMT_START { \
+    if (G_UNLIKELY ((level) <= umms_log_levels[category])) \
+      umms_log_write (category, level, G_STRLOC, G_STRFUNC, format, ##__VA_ARGS__); \
+  } G_STMT_END
+
+/*
+ * A ring slot as dumped, in host byte order. The slots are dumped in ring
+ * order, sort them by seq, 0 for an unused slot or one being written.
+ */
+#define UMMS_LOG_RECORD_SIZE 256
+
+typedef struct _UmmsLogRecord {
+  gint32  seq;
+  guint8  category;
+  guint8  level;
+  guint16 reserved;
+  gint64  time;//monotonic us
+  gchar   msg[UMMS_LOG_RECORD_SIZE - 16];//NUL terminated, truncated
+} UmmsLogRecord;
+
+/*
+ * Reads the "Log" group of conf, may be NULL, then the UMMS_LOG environment
+ * variable, e.g. "debug" or "player:debug,resource:debug". Call it before
+ * the threads are started.
+ */
+void umms_log_init (GKeyFile *conf);
+
+void umms_log_write (UmmsLogCategory category, UmmsLogLevel level, const gchar *location, const gchar *func,
+                     const gchar *format, ...) G_GNUC_PRINTF (5, 6);
+
+/*
+ * category:        Name of a category, or "all".
+ * level:           "none", "warning" or "debug".
+ * Returns:         FALSE if either is unknown.
+ */
+gboolean umms_log_set_level (const gchar *category, const gchar *level);
+UmmsLogLevel umms_log_get_level (UmmsLogCategory category);
+const gchar *umms_log_category_name (UmmsLogCategory category);
+const gchar *umms_log_level_name (UmmsLogLevel level);
+
+/*
+ * Both are async-signal-safe, for the signal handlers. The toggle switches
+ * every category to debug and back to the levels set before.
+ */
+void umms_log_toggle_debug (void);
+//Writes the ring to the "ring-dump" file of the conf. FALSE if there is no ring or it can't be written.
+gboolean umms_log_dump_ring (void);
+
+//The records of the ring, oldest first, as text. g_strfreev() it.
+gchar **umms_log_ring_lines (void);
+
+G_END_DECLS
+
+#endif /* _UMMS_LOG_H */
@@ -21,6 +21,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlayer
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
 #include <dbus/dbus-glib.h>
 #include "umms-server.h"
 #include "umms-debug.h"
@@ -31,6 +36,9 @@
 #include "umms-media-player.h"
 #include "umms-backend-factory.h"
 #include "umms-player-backend.h"
+#include "umms-worker-pool.h"
+#include "umms-metrics.h"
+#include "umms-stats.h"
 
 G_DEFINE_TYPE (UmmsMediaPlayer, umms_media_player, G_TYPE_OBJECT)
 
@@ -50,6 +58,20 @@ G_DEFINE_TYPE (UmmsMediaPlayer, umms_media_player, G_TYPE_OBJECT)
     }\
   }while(0)
 
+/*
+ * Hold a reference on the backend for the duration of the call, so that a
+ * worker thread tearing the backend down can't free it under our feet.
+ */
+#define BACKEND_VMETHOD_CALL(player, e, func, ...) \
+  do {\
+    gboolean _ret;\
+    UmmsPlayerBackend *_backend = umms_media_player_ref_backend (player);\
+    CHECK_BACKEND(_backend, FALSE, e);\
+    _ret = func (_backend, ##__VA_ARGS__, e);\
+    g_object_unref (_backend);\
+    return _ret;\
+  }while(0)
+
 #define   DEFAULT_SCALE_MODE  ScaleModeKeepAspectRatio
 #define   DEFAULT_VOLUME 50
 #define   DEFAULT_MUTE   FALSE
@@ -58,10 +80,14 @@ G_DEFINE_TYPE (UmmsMediaPlayer, umms_media_player, G_TYPE_OBJECT)
 #define   DEFAULT_WIDTH  0
 #define   DEFAULT_HIGHT  0
 
+//Lower bound of the PositionChanged interval, in ms.
+#define   MIN_PROGRESS_INTERVAL 50
+
 enum {
   PROP_0,
   PROP_NAME,
   PROP_ATTENDED,
+  PROP_HEARTBEAT,
   PROP_LAST
 };
 
@@ -85,17 +111,33 @@ enum {
   SIGNAL_MEDIA_PLAYER_MetadataChanged,
   SIGNAL_MEDIA_PLAYER_RecordStart,
   SIGNAL_MEDIA_PLAYER_RecordStop,
+  SIGNAL_MEDIA_PLAYER_PositionChanged,
+  SIGNAL_MEDIA_PLAYER_PsiChanged,
+  SIGNAL_MEDIA_PLAYER_Zapped,
   N_MEDIA_PLAYER_SIGNALS
 };
 
 static guint umms_media_player_signals[N_MEDIA_PLAYER_SIGNALS] = {0};
+static gint zap_metric = -1;
+static gint zap_pretuned_metric = -1;
 
 struct _UmmsMediaPlayerPrivate {
+  /*
+   * backend is only replaced by the thread running the state transitions
+   * (the bound worker, or the main loop if no worker), always under lock.
+   * Other threads must take a reference under lock before using it.
+   */
+  GMutex   *lock;
   UmmsPlayerBackend *backend;
+  UmmsWorker *worker;
   gchar    *name;
   gboolean attended;
+  gboolean heartbeat;
 
-  /*Parameters need to be cached due to the unavailable of underlying player.*/
+  /*
+   * Parameters need to be cached due to the unavailable of underlying player.
+   * Most are kept up to date, a pre-tuned backend swapped in takes them too.
+   */
   gchar    *uri;
   gboolean uri_dirty;
   gchar    *sub_uri;
@@ -111,6 +153,7 @@ struct _UmmsMediaPlayerPrivate {
   gint        target_type;
   GHashTable *target_params;
   GHashTable *http_proxy_params;
+  gboolean share_multiplex;
 
   //For client existence checking.
   guint    no_reply_time;
@@ -118,17 +161,96 @@ struct _UmmsMediaPlayerPrivate {
 
   //Media player "snapshot", for suspend/restore operation.
   gint64   position;
+
+  //Resource arbitration, under lock.
+  gboolean preempted;//suspended to give the resources to a higher priority player
+  gint     target_state;//last requested state, re-applied once resources are available
+
+  //PositionChanged notification, under lock.
+  GHashTable *progress_subscribers;//sender ==> interval
+  guint    progress_interval;//shortest interval of the subscribers, 0 if none
+  guint    progress_id;
+  gint     state;//last state reported by backend
+  gint64   last_position;
+  gint64   last_duration;
+  gint64   last_buffered;
+
+  //Fast channel change, only touched by the thread running the state transitions.
+  gchar    **zap_uris;//neighbours of the current channel, from SetZapNeighbours
+  GList    *zap_entries;//ZapEntry, backends pre-tuned to some of zap_uris
+
+  //Zap time, from SetUri to playing, under lock.
+  gint64   zap_start;//monotonic us, 0 if no zap pending
+  gboolean zap_fast;//a pre-tuned backend was swapped in
 };
 
+//A backend paused on a neighbour channel, ready to be swapped in.
+typedef struct _ZapEntry {
+  UmmsMediaPlayer   *player;
+  gchar             *uri;
+  UmmsPlayerBackend *backend;
+  volatile gint     preempted;//its resources were taken, it must be dropped
+} ZapEntry;
+
+typedef enum {
+  PLAYER_CALL_PLAY,
+  PLAYER_CALL_PAUSE,
+  PLAYER_CALL_STOP,
+  PLAYER_CALL_SET_POSITION,
+  PLAYER_CALL_SET_PLAYBACK_RATE,
+  PLAYER_CALL_SUSPEND,
+  PLAYER_CALL_RESTORE,
+  PLAYER_CALL_RECORD,
+  PLAYER_CALL_SET_ZAP_NEIGHBOURS,
+  PLAYER_CALL_ZAP_REFRESH
+} PlayerCallType;
+
+//D-Bus method call queued to the worker of the media player.
+typedef struct _PlayerCall {
+  UmmsMediaPlayer *player;
+  PlayerCallType  type;
+  gint64          pos;
+  gdouble         rate;
+  gboolean        to_record;
+  gchar           *location;
+  gchar           **uris;
+  DBusGMethodInvocation *context;
+} PlayerCall;
+
+static UmmsPlayerBackend *
+umms_media_player_ref_backend (UmmsMediaPlayer *self)
+{
+  UmmsMediaPlayerPrivate *priv = self->priv;
+  UmmsPlayerBackend *backend = NULL;
+
+  g_mutex_lock (priv->lock);
+  if (priv->backend)
+    backend = g_object_ref (priv->backend);
+  g_mutex_unlock (priv->lock);
+
+  return backend;
+}
+
+static void progress_timer_update (UmmsMediaPlayer *player);
+
 static void
 umms_media_player_reset_backend (UmmsMediaPlayer *self)
 {
   UmmsMediaPlayerPrivate *priv = self->priv;
+  UmmsPlayerBackend *backend;
 
-  if (priv->backend) {
-    umms_player_backend_stop (priv->backend, NULL);
-    g_object_unref (priv->backend);
-    priv->backend = NULL;
+  g_mutex_lock (priv->lock);
+  backend = priv->backend;
+  priv->backend = NULL;
+  priv->state = PlayerStateNull;
+  progress_timer_update (self);
+  g_mutex_unlock (priv->lock);
+  umms_stats_player_state (priv->name, PlayerStateNull);
+
+  if (backend) {
+    umms_player_backend_stop (backend, NULL);
+    g_signal_handlers_disconnect_matched (backend, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, self);
+    umms_player_backend_recycle (backend);
   }
 }
 
@@ -170,12 +292,100 @@ buffered_cb (UmmsPlayerBackend *iface, UmmsMediaPlayer *player)
   g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Buffered], 0);
 }
 
+static gboolean progress_timeout (gpointer data);
+
+/*
+ * Keep one timer per player, running only while playing and subscribed.
+ * Called with lock held.
+ */
+static void
+progress_timer_update (UmmsMediaPlayer *player)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  gboolean wanted = (priv->state == PlayerStatePlaying && priv->progress_interval > 0);
+
+  if (priv->progress_id) {
+    g_source_remove (priv->progress_id);
+    priv->progress_id = 0;
+  }
+
+  if (wanted) {
+    priv->last_position = priv->last_duration = priv->last_buffered = -1;
+    //Removed from the worker threads too, the timer keeps the player alive until then.
+    priv->progress_id = g_timeout_add_full (G_PRIORITY_DEFAULT, priv->progress_interval, progress_timeout,
+                                            g_object_ref (player), g_object_unref);
+  }
+}
+
+//Query the backend once per tick, whatever the number of subscribers.
+static gboolean
+progress_timeout (gpointer data)
+{
+  UmmsMediaPlayer *player = (UmmsMediaPlayer *)data;
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend;
+  gint64 pos = 0, duration = 0, buffered = 0;
+  gboolean changed;
+
+  if (!(backend = umms_media_player_ref_backend (player)))
+    return TRUE;
+
+  umms_player_backend_get_position (backend, &pos, NULL);
+  umms_player_backend_get_media_size_time (backend, &duration, NULL);
+  umms_player_backend_get_buffered_time (backend, &buffered, NULL);
+  g_object_unref (backend);
+
+  g_mutex_lock (priv->lock);
+  changed = (pos != priv->last_position || duration != priv->last_duration || buffered != priv->last_buffered);
+  priv->last_position = pos;
+  priv->last_duration = duration;
+  priv->last_buffered = buffered;
+  g_mutex_unlock (priv->lock);
+
+  if (changed)
+    g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_PositionChanged], 0, pos, duration, buffered);
+
+  return TRUE;
+}
+
+static gint64
+zap_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
 static void
 player_state_changed_cb (UmmsPlayerBackend *iface, gint old_state, gint new_state, UmmsMediaPlayer *player)
 {
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  gboolean zapped = FALSE;
+  gboolean zap_fast = FALSE;
+  gint64 zap_time = 0;
+
+  g_mutex_lock (priv->lock);
+  priv->state = new_state;
+  progress_timer_update (player);
+  //The first frame of the new uri is out once playing.
+  if (new_state == PlayerStatePlaying && priv->zap_start) {
+    zapped = TRUE;
+    zap_time = zap_now () - priv->zap_start;
+    zap_fast = priv->zap_fast;
+    priv->zap_start = 0;
+  }
+  g_mutex_unlock (priv->lock);
+  umms_stats_player_state (priv->name, new_state);
+
   g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_PlayerStateChanged], 0, old_state, new_state);
   if (new_state == PlayerStatePaused && old_state < PlayerStatePaused)
     g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Initialized], 0);
+  if (zapped) {
+    UMMS_DEBUG ("player '%s' zapped in %" G_GINT64_FORMAT " us%s", priv->name, zap_time, zap_fast ? ", pre-tuned" : "");
+    umms_metrics_record (zap_fast ? zap_pretuned_metric : zap_metric, zap_time);
+    g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Zapped], 0, zap_time, zap_fast);
+  }
 }
 
 static void
@@ -237,6 +447,72 @@ record_stop_cb (UmmsPlayerBackend *iface, UmmsMediaPlayer *player)
   g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_RecordStop], 0);
 }
 
+static gboolean player_call_dispatch (UmmsMediaPlayer *player, PlayerCallType type, PlayerCall *call,
+                                      DBusGMethodInvocation *context);
+
+/*
+ * The resource manager is locked while these are emitted, possibly on another
+ * player's thread, so bounce the suspend/restore to the main loop, which then
+ * queues it to the worker of this player.
+ */
+static gboolean
+preempted_idle (gpointer data)
+{
+  UmmsMediaPlayer *player = (UmmsMediaPlayer *)data;
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->preempted = TRUE;
+  g_mutex_unlock (priv->lock);
+
+  UMMS_DEBUG ("player '%s' preempted, suspend it", priv->name);
+  player_call_dispatch (player, PLAYER_CALL_SUSPEND, g_new0 (PlayerCall, 1), NULL);
+  return FALSE;
+}
+
+static gboolean
+resource_available_idle (gpointer data)
+{
+  UmmsMediaPlayer *player = (UmmsMediaPlayer *)data;
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  gboolean preempted;
+  gint target_state;
+
+  g_mutex_lock (priv->lock);
+  preempted = priv->preempted;
+  priv->preempted = FALSE;
+  target_state = priv->target_state;
+  g_mutex_unlock (priv->lock);
+
+  if (preempted) {
+    UMMS_DEBUG ("resource available, restore player '%s'", priv->name);
+    player_call_dispatch (player, PLAYER_CALL_RESTORE, g_new0 (PlayerCall, 1), NULL);
+  } else if (target_state == PlayerStatePlaying || target_state == PlayerStatePaused) {
+    UMMS_DEBUG ("resource available, retry player '%s' to state %d", priv->name, target_state);
+    player_call_dispatch (player, target_state == PlayerStatePlaying ? PLAYER_CALL_PLAY : PLAYER_CALL_PAUSE,
+                          g_new0 (PlayerCall, 1), NULL);
+  }
+  return FALSE;
+}
+
+static void
+preempted_cb (UmmsPlayerBackend *iface, gint type, UmmsMediaPlayer *player)
+{
+  g_idle_add_full (G_PRIORITY_HIGH_IDLE, preempted_idle, g_object_ref (player), g_object_unref);
+}
+
+static void
+resource_available_cb (UmmsPlayerBackend *iface, gint type, UmmsMediaPlayer *player)
+{
+  g_idle_add_full (G_PRIORITY_HIGH_IDLE, resource_available_idle, g_object_ref (player), g_object_unref);
+}
+
+static void
+psi_changed_cb (UmmsPlayerBackend *iface, guint table_id, guint program_num, guint version, UmmsMediaPlayer *player)
+{
+  g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_PsiChanged], 0, table_id, program_num, version);
+}
+
 static void
 connect_signals(UmmsMediaPlayer *player, UmmsPlayerBackend *backend)
 {
@@ -304,6 +580,18 @@ connect_signals(UmmsMediaPlayer *player, UmmsPlayerBackend *backend)
                            G_CALLBACK (record_stop_cb),
                            player,
                            0);
+  g_signal_connect_object (backend, "preempted",
+                           G_CALLBACK (preempted_cb),
+                           player,
+                           0);
+  g_signal_connect_object (backend, "resource-available",
+                           G_CALLBACK (resource_available_cb),
+                           player,
+                           0);
+  g_signal_connect_object (backend, "psi-changed",
+                           G_CALLBACK (psi_changed_cb),
+                           player,
+                           0);
 }
 
 static gboolean
@@ -335,52 +623,338 @@ umms_media_player_reply (UmmsMediaPlayer *player, GError **err)
   return TRUE;
 }
 
+static void
+set_timeshift_from_conf (UmmsPlayerBackend *backend)
+{
+  gchar *dir = NULL;
+  gint size = 0;
+
+  if (umms_ctx->conf) {
+    size = g_key_file_get_integer (umms_ctx->conf, TIMESHIFT_GROUP, "size", NULL);
+    dir = g_key_file_get_string (umms_ctx->conf, TIMESHIFT_GROUP, "directory", NULL);
+  }
+  umms_player_backend_set_timeshift (backend, dir ? g_strstrip (dir) : TIMESHIFT_DIR_DEFAULT,
+                                     (guint64)MAX (size, 0) * 1024 * 1024);
+  g_free (dir);
+}
+
 /*
- * Create inner player backend which can handle this uri.
+ * Set the cached properties but the uri and the subtitle on a backend becoming
+ * the one of this player. Called without lock, the backend is locked by each
+ * call and may emit signals whose handlers take ours.
+ */
+static void
+apply_cached_params (UmmsMediaPlayer *player, UmmsPlayerBackend *backend, gboolean set_video_size)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  gint volume, mute, scale_mode;
+  gint x, y;
+  guint w, h;
+  gint target_type;
+  GHashTable *target_params;
+  GHashTable *proxy_params;
+  gboolean share_multiplex;
+
+  g_mutex_lock (priv->lock);
+  volume = priv->volume;
+  mute = priv->mute;
+  scale_mode = priv->scale_mode;
+  x = priv->x;
+  y = priv->y;
+  w = priv->w;
+  h = priv->h;
+  set_video_size = set_video_size || priv->video_size_cached;
+  priv->video_size_cached = FALSE;
+
+  if (umms_ctx->proxy_uri && umms_ctx->proxy_uri[0] != '\0') {
+    if (priv->http_proxy_params)
+      g_hash_table_unref (priv->http_proxy_params);
+    priv->http_proxy_params = param_table_create ("proxy-uri", G_TYPE_STRING, umms_ctx->proxy_uri,
+                              "proxy-id", G_TYPE_STRING, umms_ctx->proxy_id,
+                              "proxy-pw", G_TYPE_STRING, umms_ctx->proxy_pw,
+                              NULL);
+  }
+  proxy_params = priv->http_proxy_params ? g_hash_table_ref (priv->http_proxy_params) : NULL;
+  target_type = priv->target_type;
+  target_params = priv->target_params ? g_hash_table_ref (priv->target_params) : NULL;
+  share_multiplex = priv->share_multiplex;
+  g_mutex_unlock (priv->lock);
+
+  umms_player_backend_set_share_multiplex (backend, share_multiplex);
+  umms_player_backend_set_volume (backend, volume, NULL);
+  umms_player_backend_set_mute (backend, mute, NULL);
+  umms_player_backend_set_scale_mode (backend, scale_mode, NULL);
+  set_timeshift_from_conf (backend);
+
+  if (set_video_size)
+    umms_player_backend_set_video_size (backend, x, y, w, h, NULL);
+
+  if (proxy_params) {
+    umms_player_backend_set_proxy (backend, proxy_params, NULL);
+    g_hash_table_unref (proxy_params);
+  }
+
+  if (target_params) {
+    umms_player_backend_set_target (backend, target_type, target_params, NULL);
+    g_hash_table_unref (target_params);
+  }
+}
+
+/*
+ * Take a pooled backend, or create one, which can handle this uri.
  * Connect signals if needed. Set all the cached properties.
  */
 static gboolean
 umms_media_player_load_backend (UmmsMediaPlayer *player, const gchar *uri)
 {
   UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend;
+  gboolean recycled;
+  gchar *cur_uri;
+  gchar *sub_uri;
 
   g_assert (priv->backend == NULL);
-  if (!(priv->backend = umms_player_backend_make_from_uri (uri))) {
+  //Creating the backend may be slow, don't hold the lock meanwhile.
+  if (!(backend = umms_player_backend_acquire_from_uri (uri, &recycled))) {
     UMMS_WARNING ("Failed to create backend");
     return FALSE;
   }
 
-  connect_signals (player, priv->backend);
+  connect_signals (player, backend);
+  //Attended players are in front of the user, they win the resources.
+  umms_player_backend_set_priority (backend, priv->attended ? ResourcePriorityForeground : ResourcePriorityNormal);
 
-  /* Set all the cached property. */
-  umms_player_backend_set_uri (priv->backend, priv->uri, NULL);
+  g_mutex_lock (priv->lock);
+  priv->backend = backend;
+  cur_uri = g_strdup (priv->uri);
+  sub_uri = g_strdup (priv->sub_uri);
   priv->uri_dirty = FALSE;
-  umms_player_backend_set_volume (priv->backend, priv->volume, NULL);
-  umms_player_backend_set_mute (priv->backend, priv->mute, NULL);
-  umms_player_backend_set_scale_mode (priv->backend, priv->scale_mode, NULL);
+  g_mutex_unlock (priv->lock);
 
-  if (priv->video_size_cached)
-    umms_player_backend_set_video_size (priv->backend, priv->x, priv->y, priv->w, priv->h, NULL);
-  priv->video_size_cached = FALSE;
+  /* Set all the cached property, see the threading contract in umms-player-backend.h. */
+  umms_player_backend_set_uri (backend, cur_uri, NULL);
+  //A pooled backend keeps the video size of its former user.
+  apply_cached_params (player, backend, recycled);
+  if (sub_uri)
+    umms_player_backend_set_subtitle_uri (backend, sub_uri, NULL);
+  g_free (cur_uri);
+  g_free (sub_uri);
 
-  if (umms_ctx->proxy_uri && umms_ctx->proxy_uri[0] != '\0') {
-    if (priv->http_proxy_params)
-      g_hash_table_unref (priv->http_proxy_params);
-    priv->http_proxy_params = param_table_create ("proxy-uri", G_TYPE_STRING, umms_ctx->proxy_uri,
-                              "proxy-id", G_TYPE_STRING, umms_ctx->proxy_id,
-                              "proxy-pw", G_TYPE_STRING, umms_ctx->proxy_pw,
-                              NULL);
+  return TRUE;
+}
+
+//Max number of backends pre-tuned per player, 0 disables the fast channel change.
+static gint
+zap_max_neighbours (void)
+{
+  gint n = 0;
+
+  if (umms_ctx->conf)
+    n = g_key_file_get_integer (umms_ctx->conf, FAST_ZAP_GROUP, "neighbours", NULL);
+  return MAX (n, 0);
+}
+
+//Whether uri is one of the first max neighbours, the current channel aside.
+static gboolean
+zap_wanted (UmmsMediaPlayer *player, const gchar *uri, const gchar *current, gint max)
+{
+  gchar **u;
+
+  if (!uri || !g_strcmp0 (uri, current) || !player->priv->zap_uris)
+    return FALSE;
+  for (u = player->priv->zap_uris; *u && max > 0; u++) {
+    if (!g_strcmp0 (*u, current))
+      continue;
+    if (!g_strcmp0 (*u, uri))
+      return TRUE;
+    max--;
   }
+  return FALSE;
+}
 
-  if (priv->http_proxy_params)
-    umms_player_backend_set_proxy (priv->backend, priv->http_proxy_params, NULL);
+static gboolean
+zap_refresh_idle (gpointer data)
+{
+  player_call_dispatch ((UmmsMediaPlayer *)data, PLAYER_CALL_ZAP_REFRESH, g_new0 (PlayerCall, 1), NULL);
+  return FALSE;
+}
 
-  if (priv->target_params)
-    umms_player_backend_set_target (priv->backend, priv->target_type, priv->target_params, NULL);
-  if (priv->sub_uri)
-    umms_player_backend_set_subtitle_uri (priv->backend, priv->sub_uri, NULL);
+//Emitted with the resource manager locked, see preempted_cb().
+static void
+zap_preempted_cb (UmmsPlayerBackend *backend, gint type, ZapEntry *entry)
+{
+  g_atomic_int_set (&entry->preempted, 1);
+  g_idle_add_full (G_PRIORITY_HIGH_IDLE, zap_refresh_idle, g_object_ref (entry->player), g_object_unref);
+}
 
-  return TRUE;
+/*
+ * Keep a backend aside for a neighbour channel. It only takes the resources
+ * which are free and gives them back to any other request.
+ */
+static ZapEntry *
+zap_entry_new (UmmsMediaPlayer *player, UmmsPlayerBackend *backend, const gchar *uri)
+{
+  ZapEntry *entry = g_new0 (ZapEntry, 1);
+
+  entry->player = player;
+  entry->uri = g_strdup (uri);
+  entry->backend = backend;
+  umms_player_backend_set_priority (backend, ResourcePriorityBackground);
+  umms_player_backend_set_mute (backend, TRUE, NULL);
+  umms_player_backend_set_timeshift (backend, NULL, 0);
+  g_signal_connect (backend, "preempted", G_CALLBACK (zap_preempted_cb), entry);
+
+  return entry;
+}
+
+static void
+zap_entry_free (ZapEntry *entry)
+{
+  g_signal_handlers_disconnect_matched (entry->backend, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, entry);
+  umms_player_backend_stop (entry->backend, NULL);
+  umms_player_backend_recycle (entry->backend);
+  g_free (entry->uri);
+  g_free (entry);
+}
+
+static void
+zap_pretune (UmmsMediaPlayer *player, const gchar *uri)
+{
+  UmmsPlayerBackend *backend;
+  ZapEntry *entry;
+  gboolean recycled;
+  GError *err = NULL;
+
+  if (!(backend = umms_player_backend_acquire_from_uri (uri, &recycled)))
+    return;
+
+  //Prerolled, so that the channel shows up as soon as it plays.
+  entry = zap_entry_new (player, backend, uri);
+  if (!umms_player_backend_set_uri (backend, uri, &err) || !umms_player_backend_pause (backend, &err)) {
+    UMMS_DEBUG ("can't pre-tune '%s': %s", uri, err ? err->message : "no resource");
+    if (err)
+      g_error_free (err);
+    zap_entry_free (entry);
+    return;
+  }
+  UMMS_DEBUG ("player '%s' pre-tuned '%s'", player->priv->name, uri);
+  player->priv->zap_entries = g_list_append (player->priv->zap_entries, entry);
+}
+
+/*
+ * Make the pre-tuned backends follow the neighbours of the current channel:
+ * drop those preempted or no longer wanted, pre-tune the missing ones.
+ * Only called by the thread running the state transitions.
+ */
+static void
+zap_refresh (UmmsMediaPlayer *player)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  gint max = zap_max_neighbours ();
+  gchar *current;
+  gchar **u;
+  GList *l, *next;
+  ZapEntry *entry;
+
+  g_mutex_lock (priv->lock);
+  current = g_strdup (priv->uri);
+  g_mutex_unlock (priv->lock);
+
+  for (l = priv->zap_entries; l; l = next) {
+    next = l->next;
+    entry = (ZapEntry *)l->data;
+    if (g_atomic_int_get (&entry->preempted) || !priv->backend || !zap_wanted (player, entry->uri, current, max)) {
+      priv->zap_entries = g_list_delete_link (priv->zap_entries, l);
+      zap_entry_free (entry);
+    }
+  }
+
+  //Nothing to zap from while stopped.
+  for (u = priv->zap_uris; priv->backend && u && *u; u++) {
+    if (!zap_wanted (player, *u, current, max))
+      continue;
+    for (l = priv->zap_entries; l; l = l->next) {
+      if (!g_strcmp0 (((ZapEntry *)l->data)->uri, *u))
+        break;
+    }
+    if (!l)
+      zap_pretune (player, *u);
+  }
+
+  g_free (current);
+}
+
+//Take the pre-tuned backend of uri, if any.
+static ZapEntry *
+zap_take (UmmsMediaPlayer *player, const gchar *uri)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  ZapEntry *entry;
+  GList *l;
+
+  for (l = priv->zap_entries; l; l = l->next) {
+    entry = (ZapEntry *)l->data;
+    if (!g_atomic_int_get (&entry->preempted) && !g_strcmp0 (entry->uri, uri)) {
+      priv->zap_entries = g_list_delete_link (priv->zap_entries, l);
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Put the pre-tuned backend of entry in front. The former backend takes its
+ * place if its channel is a neighbour too, so that zapping back is fast as
+ * well, else it is recycled.
+ */
+static void
+zap_swap (UmmsMediaPlayer *player, ZapEntry *entry)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend = entry->backend;
+  UmmsPlayerBackend *old;
+  gchar *old_uri = NULL;
+  gchar **u;
+  gint state = PlayerStatePaused;
+
+  g_signal_handlers_disconnect_matched (backend, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, entry);
+  g_free (entry->uri);
+  g_free (entry);
+
+  connect_signals (player, backend);
+  umms_player_backend_set_priority (backend, priv->attended ? ResourcePriorityForeground : ResourcePriorityNormal);
+  umms_player_backend_get_player_state (backend, &state, NULL);
+
+  g_mutex_lock (priv->lock);
+  old = priv->backend;
+  priv->backend = backend;
+  priv->state = state;
+  progress_timer_update (player);
+  g_mutex_unlock (priv->lock);
+  apply_cached_params (player, backend, TRUE);
+  umms_stats_player_state (priv->name, state);
+
+  if (!old)
+    return;
+
+  g_signal_handlers_disconnect_matched (old, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, player);
+  for (u = priv->zap_uris; old->uri && u && *u && !old_uri; u++) {
+    if (!g_strcmp0 (*u, old->uri))
+      old_uri = g_strdup (old->uri);
+  }
+
+  if (old_uri) {
+    entry = zap_entry_new (player, old, old_uri);
+    if (umms_player_backend_pause (old, NULL)) {
+      priv->zap_entries = g_list_append (priv->zap_entries, entry);
+    } else {
+      zap_entry_free (entry);
+    }
+    g_free (old_uri);
+  } else {
+    umms_player_backend_stop (old, NULL);
+    umms_player_backend_recycle (old);
+  }
 }
 
 gboolean
@@ -396,70 +970,142 @@ umms_media_player_set_uri (UmmsMediaPlayer *player,
     return FALSE;
   }
 
+  g_mutex_lock (priv->lock);
   if (priv->uri) {
     g_free (priv->uri);
   }
 
   priv->uri = g_strdup (uri);
   priv->uri_dirty = TRUE;
+  priv->zap_start = zap_now ();
+  priv->zap_fast = FALSE;
+  g_mutex_unlock (priv->lock);
   UMMS_DEBUG ("URI: %s", uri);
   return TRUE;
 }
 
+void
+umms_media_player_set_share_multiplex (UmmsMediaPlayer *player, gboolean share)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  g_mutex_lock (priv->lock);
+  priv->share_multiplex = share;
+  g_mutex_unlock (priv->lock);
+}
+
 gboolean
 umms_media_player_set_target (UmmsMediaPlayer *player, gint type, GHashTable *params, GError **err)
 {
   gboolean ret = TRUE;
   UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend = NULL;
 
-  if (priv->backend) {
-    ret = umms_player_backend_set_target (priv->backend, type, params, err);
-  } else {
-    priv->target_type = type;
-    if (priv->target_params)
-      g_hash_table_unref (priv->target_params);
-    priv->target_params = g_hash_table_ref (params);
+  g_mutex_lock (priv->lock);
+  priv->target_type = type;
+  if (priv->target_params)
+    g_hash_table_unref (priv->target_params);
+  priv->target_params = g_hash_table_ref (params);
+  if (priv->backend)
+    backend = g_object_ref (priv->backend);
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_target (backend, type, params, err);
+    g_object_unref (backend);
   }
 
   return ret;
 }
 
-gboolean umms_media_player_activate (UmmsMediaPlayer *player, PlayerState state, GError **err)
+/*
+ * Load a backend which supports the current uri, and apply the uri if it changed.
+ * Only called by the thread running the state transitions.
+ */
+static gboolean
+umms_media_player_prepare_backend (UmmsMediaPlayer *player, GError **err)
 {
   gchar *prot = NULL;
+  gchar *uri = NULL;
+  gboolean uri_dirty;
   gboolean ret = TRUE;
+  ZapEntry *entry;
   UmmsMediaPlayerPrivate *priv = player->priv;
 
-  UMMS_DEBUG ("setting backend to state: %d ", state);
-  if (!priv->uri) {
+  g_mutex_lock (priv->lock);
+  uri = g_strdup (priv->uri);
+  uri_dirty = priv->uri_dirty;
+  g_mutex_unlock (priv->lock);
+
+  if (!uri) {
     UMMS_DEBUG ("No URI specified");
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "No URI specified");
     return FALSE;
   }
 
+  //Zap to a pre-tuned neighbour, no teardown and no wait for the stream to start.
+  if (uri_dirty && (entry = zap_take (player, uri))) {
+    zap_swap (player, entry);
+    uri_dirty = FALSE;
+    g_mutex_lock (priv->lock);
+    if (!g_strcmp0 (priv->uri, uri))
+      priv->uri_dirty = FALSE;
+    priv->zap_fast = TRUE;
+    g_mutex_unlock (priv->lock);
+  }
+
   if (priv->backend) {
-    prot = uri_get_protocol (priv->uri);
+    prot = uri_get_protocol (uri);
     if (!umms_player_backend_support_prot (priv->backend, prot)) {
       umms_media_player_reset_backend (player);
     }
+    g_free (prot);
   }
 
   if (!priv->backend) {
-    if (!umms_media_player_load_backend (player, priv->uri)) {
+    //umms_media_player_load_backend() sets the cached uri.
+    uri_dirty = FALSE;
+    if (!umms_media_player_load_backend (player, uri)) {
       g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "failed to load backend");
-      return FALSE;
+      ret = FALSE;
+      goto out;
     }
   }
 
-  if (priv->uri_dirty) {
+  if (uri_dirty) {
     //we have a new uri, stop the backend firstly.
-    if (!umms_player_backend_stop (priv->backend, err))
-      return FALSE;
+    if (!umms_player_backend_stop (priv->backend, err) ||
+        !umms_player_backend_set_uri (priv->backend, uri, err)) {
+      ret = FALSE;
+      goto out;
+    }
 
-    if (!umms_player_backend_set_uri (priv->backend, priv->uri, err))
-      return FALSE;
-    priv->uri_dirty = FALSE;
+    //SetUri may have been called again meanwhile, keep that one dirty.
+    g_mutex_lock (priv->lock);
+    if (!g_strcmp0 (priv->uri, uri))
+      priv->uri_dirty = FALSE;
+    g_mutex_unlock (priv->lock);
   }
 
+out:
+  g_free (uri);
+  return ret;
+}
+
+gboolean umms_media_player_activate (UmmsMediaPlayer *player, PlayerState state, GError **err)
+{
+  gboolean ret;
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  UMMS_DEBUG ("setting backend to state: %d ", state);
+
+  g_mutex_lock (priv->lock);
+  priv->target_state = state;
+  g_mutex_unlock (priv->lock);
+
+  if (!umms_media_player_prepare_backend (player, err))
+    return FALSE;
+
   switch (state) {
   case PlayerStatePaused:
     ret = umms_player_backend_pause (priv->backend, err);
@@ -472,9 +1118,71 @@ gboolean umms_media_player_activate (UmmsMediaPlayer *player, PlayerState state,
     ret = FALSE;
     break;
   }
+
   return ret;
 }
 
+/*
+ * Completion of the asynchronous transitions, success is announced by the
+ * PlayerStateChanged/Seeked signals of the backend, failure by the Error signal.
+ */
+static void
+async_done_cb (UmmsPlayerBackend *backend, gboolean success, const GError *err, gpointer user_data)
+{
+  UmmsMediaPlayer *player = (UmmsMediaPlayer *)user_data;
+
+  if (!success) {
+    UMMS_DEBUG ("async transition failed: %s", err ? err->message : "unknown error");
+    g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Error], 0,
+                   err ? err->code : UMMS_BACKEND_ERROR_FAILED,
+                   err ? err->message : "Operation failed");
+  }
+  g_object_unref (player);
+}
+
+static gboolean
+umms_media_player_activate_async (UmmsMediaPlayer *player, PlayerState state, GError **err)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  UMMS_DEBUG ("setting backend to state: %d asynchronously", state);
+
+  if (state != PlayerStatePaused && state != PlayerStatePlaying) {
+    UMMS_DEBUG ("Invalid target state: %d", state);
+    return FALSE;
+  }
+
+  g_mutex_lock (priv->lock);
+  priv->target_state = state;
+  g_mutex_unlock (priv->lock);
+
+  if (!umms_media_player_prepare_backend (player, err))
+    return FALSE;
+
+  if (state == PlayerStatePaused)
+    umms_player_backend_pause_async (priv->backend, async_done_cb, g_object_ref (player));
+  else
+    umms_player_backend_play_async (priv->backend, async_done_cb, g_object_ref (player));
+
+  //Once the channel is on its way, get its neighbours ready.
+  if (priv->zap_uris)
+    zap_refresh (player);
+
+  return TRUE;
+}
+
+static gboolean
+umms_media_player_set_position_async (UmmsMediaPlayer *player, gint64 pos, GError **err)
+{
+  UmmsPlayerBackend *backend = umms_media_player_ref_backend (player);
+
+  CHECK_BACKEND (backend, FALSE, err);
+  umms_player_backend_set_position_async (backend, pos, async_done_cb, g_object_ref (player));
+  g_object_unref (backend);
+
+  return TRUE;
+}
+
 gboolean
 umms_media_player_play (UmmsMediaPlayer *player,
                    GError **err)
@@ -493,7 +1201,29 @@ gboolean
 umms_media_player_stop (UmmsMediaPlayer *player,
                    GError **err)
 {
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  //Stopped by the client, don't bring it back when resources are available.
+  g_mutex_lock (priv->lock);
+  priv->target_state = PlayerStateStopped;
+  priv->preempted = FALSE;
+  priv->zap_start = 0;
+  g_mutex_unlock (priv->lock);
+
   umms_media_player_reset_backend (player);
+  //Drops the pre-tuned backends, there is nothing to zap from.
+  zap_refresh (player);
+  return TRUE;
+}
+
+gboolean
+umms_media_player_set_zap_neighbours (UmmsMediaPlayer *player, gchar **uris, GError **err)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  g_strfreev (priv->zap_uris);
+  priv->zap_uris = g_strdupv (uris);
+  zap_refresh (player);
   return TRUE;
 }
 
@@ -506,20 +1236,27 @@ umms_media_player_set_video_size(UmmsMediaPlayer *player,
                             GError **err)
 {
   UmmsMediaPlayerPrivate *priv = player->priv;
-  UmmsPlayerBackend *backend = priv->backend;
+  UmmsPlayerBackend *backend = NULL;
 
   UMMS_DEBUG ("rectangle=\"%u,%u,%u,%u\"", in_x, in_y, in_w, in_h );
 
-  if (backend) {
-    umms_player_backend_set_video_size (priv->backend, in_x, in_y, in_w, in_h, err);
+  g_mutex_lock (priv->lock);
+  priv->x = in_x;
+  priv->y = in_y;
+  priv->w = in_w;
+  priv->h = in_h;
+  if (priv->backend) {
+    backend = g_object_ref (priv->backend);
   } else {
     UMMS_DEBUG ("Cache the video size parameters since pipe backend has not been loaded");
-    priv->x = in_x;
-    priv->y = in_y;
-    priv->w = in_w;
-    priv->h = in_h;
     priv->video_size_cached = TRUE;
   }
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    umms_player_backend_set_video_size (backend, in_x, in_y, in_w, in_h, err);
+    g_object_unref (backend);
+  }
   return TRUE;
 }
 
@@ -528,16 +1265,14 @@ gboolean
 umms_media_player_get_video_size(UmmsMediaPlayer *player, guint *w, guint *h,
                             GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_size (player->priv->backend, w, h, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_size, w, h);
 }
 
 
 gboolean
 umms_media_player_is_seekable(UmmsMediaPlayer *player, gboolean *is_seekable, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_is_seekable (player->priv->backend, is_seekable, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_is_seekable, is_seekable);
 }
 
 gboolean
@@ -545,16 +1280,14 @@ umms_media_player_set_position(UmmsMediaPlayer *player,
                           gint64                 in_pos,
                           GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_position (player->priv->backend, in_pos, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_position, in_pos);
 }
 
 gboolean
 umms_media_player_get_position(UmmsMediaPlayer *player, gint64 *pos,
                           GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_position (player->priv->backend, pos, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_position, pos);
 }
 
 gboolean
@@ -562,8 +1295,7 @@ umms_media_player_set_playback_rate (UmmsMediaPlayer *player,
                                 gdouble          in_rate,
                                 GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_playback_rate (player->priv->backend, in_rate, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_playback_rate, in_rate);
 }
 
 gboolean
@@ -571,8 +1303,7 @@ umms_media_player_get_playback_rate (UmmsMediaPlayer *player,
                                 gdouble *rate,
                                 GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_playback_rate (player->priv->backend, rate, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_playback_rate, rate);
 }
 
 gboolean
@@ -581,16 +1312,23 @@ umms_media_player_set_volume (UmmsMediaPlayer *player,
                          GError **err)
 {
   UmmsMediaPlayerPrivate *priv = player->priv;
-  UmmsPlayerBackend *backend = priv->backend;
+  UmmsPlayerBackend *backend = NULL;
   gboolean ret = TRUE;
 
   UMMS_DEBUG ("set volume to %d",  volume);
 
-  if (backend) {
-    ret = umms_player_backend_set_volume (backend, volume, err);
+  g_mutex_lock (priv->lock);
+  priv->volume = volume;
+  if (priv->backend) {
+    backend = g_object_ref (priv->backend);
   } else {
     UMMS_DEBUG ("UmmsMediaPlayer not ready, cache the volume.");
-    priv->volume = volume;
+  }
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_volume (backend, volume, err);
+    g_object_unref (backend);
   }
 
   return ret;
@@ -601,8 +1339,7 @@ umms_media_player_get_volume (UmmsMediaPlayer *player,
                          gint *vol,
                          GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_volume (player->priv->backend, vol, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_volume, vol);
 }
 
 gboolean
@@ -610,8 +1347,7 @@ umms_media_player_get_media_size_time (UmmsMediaPlayer *player,
                                   gint64 *duration,
                                   GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_media_size_time(player->priv->backend, duration, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_media_size_time, duration);
 }
 
 gboolean
@@ -619,8 +1355,7 @@ umms_media_player_get_media_size_bytes (UmmsMediaPlayer *player,
                                    gint64 *size_bytes,
                                    GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_media_size_bytes (player->priv->backend, size_bytes, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_media_size_bytes, size_bytes);
 }
 
 gboolean
@@ -628,8 +1363,7 @@ umms_media_player_has_video (UmmsMediaPlayer *player,
                         gboolean *has_video,
                         GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_has_video (player->priv->backend, has_video, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_has_video, has_video);
 }
 
 gboolean
@@ -637,8 +1371,7 @@ umms_media_player_has_audio (UmmsMediaPlayer *player,
                         gboolean *has_audio,
                         GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_has_audio (player->priv->backend, has_audio, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_has_audio, has_audio);
 }
 
 gboolean
@@ -646,8 +1379,7 @@ umms_media_player_support_fullscreen (UmmsMediaPlayer *player,
                                  gboolean *support_fullscreen,
                                  GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_support_fullscreen (player->priv->backend, support_fullscreen, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_support_fullscreen, support_fullscreen);
 }
 
 gboolean
@@ -655,71 +1387,61 @@ umms_media_player_is_streaming (UmmsMediaPlayer *player,
                            gboolean *is_streaming,
                            GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_is_streaming (player->priv->backend, is_streaming, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_is_streaming, is_streaming);
 }
 
 gboolean
 umms_media_player_get_player_state(UmmsMediaPlayer *player, gint *state, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_player_state (player->priv->backend, state, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_player_state, state);
 }
 
 gboolean
 umms_media_player_get_buffered_bytes (UmmsMediaPlayer *player, gint64 *bytes, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_buffered_bytes (player->priv->backend, bytes, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_buffered_bytes, bytes);
 }
 
 gboolean
 umms_media_player_get_buffered_time (UmmsMediaPlayer *player, gint64 *size_time, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_buffered_time (player->priv->backend, size_time, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_buffered_time, size_time);
 }
 
 gboolean
 umms_media_player_get_current_video (UmmsMediaPlayer *player, gint *cur_video, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_current_video(player->priv->backend, cur_video, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_current_video, cur_video);
 }
 
 gboolean
 umms_media_player_get_current_audio (UmmsMediaPlayer *player, gint *cur_audio, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_current_audio(player->priv->backend, cur_audio, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_current_audio, cur_audio);
 }
 
 gboolean
 umms_media_player_set_current_video (UmmsMediaPlayer *player, gint cur_video, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_current_video(player->priv->backend, cur_video, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_current_video, cur_video);
 }
 
 gboolean
 umms_media_player_set_current_audio (UmmsMediaPlayer *player, gint cur_audio, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_current_audio(player->priv->backend, cur_audio, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_current_audio, cur_audio);
 }
 
 gboolean
 umms_media_player_get_video_num (UmmsMediaPlayer *player, gint *video_num, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_num(player->priv->backend, video_num, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_num, video_num);
 }
 
 gboolean
 umms_media_player_get_audio_num (UmmsMediaPlayer *player, gint *audio_num, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_audio_num(player->priv->backend, audio_num, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_audio_num, audio_num);
 }
 
 gboolean
@@ -729,13 +1451,19 @@ umms_media_player_set_proxy (UmmsMediaPlayer *player,
 {
   gboolean ret = TRUE;
   UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend = NULL;
 
-  if (priv->backend) {
-    ret = umms_player_backend_set_proxy (priv->backend, params, err);
-  } else {
-    if (priv->http_proxy_params)
-      g_hash_table_unref (priv->http_proxy_params);
-    priv->http_proxy_params = g_hash_table_ref (params);
+  g_mutex_lock (priv->lock);
+  if (priv->http_proxy_params)
+    g_hash_table_unref (priv->http_proxy_params);
+  priv->http_proxy_params = g_hash_table_ref (params);
+  if (priv->backend)
+    backend = g_object_ref (priv->backend);
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_proxy (backend, params, err);
+    g_object_unref (backend);
   }
 
   return ret;
@@ -746,8 +1474,7 @@ gboolean
 umms_media_player_suspend(UmmsMediaPlayer *player,
                      GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_suspend (player->priv->backend, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_suspend);
 }
 
 gboolean
@@ -755,15 +1482,23 @@ umms_media_player_set_subtitle_uri (UmmsMediaPlayer *player, gchar *sub_uri, GEr
 {
   gboolean ret = TRUE;
   UmmsMediaPlayerPrivate *priv = player->priv;
+  UmmsPlayerBackend *backend = NULL;
 
   UMMS_DEBUG ("Want to set the suburi to %s", sub_uri);
+  g_mutex_lock (priv->lock);
   if (priv->backend) {
-    ret = umms_player_backend_set_subtitle_uri (priv->backend, sub_uri, err);
+    backend = g_object_ref (priv->backend);
   } else {
     RESET_STR (priv->sub_uri);
     UMMS_DEBUG ("cache the suburi %s", sub_uri);
     priv->sub_uri = g_strdup (sub_uri);
   }
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_subtitle_uri (backend, sub_uri, err);
+    g_object_unref (backend);
+  }
 
   return ret;
 }
@@ -772,59 +1507,60 @@ gboolean
 umms_media_player_restore (UmmsMediaPlayer *player,
                       GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_restore (player->priv->backend, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_restore);
 }
 
 gboolean
 umms_media_player_get_subtitle_num (UmmsMediaPlayer *player, gint *sub_num, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_subtitle_num(player->priv->backend, sub_num, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_subtitle_num, sub_num);
 }
 
 gboolean
 umms_media_player_get_current_subtitle (UmmsMediaPlayer *player, gint *cur_sub, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_current_subtitle(player->priv->backend, cur_sub, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_current_subtitle, cur_sub);
 }
 
 gboolean
 umms_media_player_set_current_subtitle (UmmsMediaPlayer *player, gint cur_sub, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_current_subtitle(player->priv->backend, cur_sub, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_current_subtitle, cur_sub);
 }
 
 gboolean
 umms_media_player_set_buffer_depth (UmmsMediaPlayer *player, gint format, gint64 buf_val, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_set_buffer_depth(player->priv->backend, format, buf_val, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_set_buffer_depth, format, buf_val);
 }
 
 gboolean
 umms_media_player_get_buffer_depth (UmmsMediaPlayer *player, gint format, gint64 *buf_val, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_buffer_depth(player->priv->backend, format, buf_val, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_buffer_depth, format, buf_val);
 }
 
 gboolean
 umms_media_player_set_mute (UmmsMediaPlayer *player, gint mute, GError **err)
 {
   UmmsMediaPlayerPrivate *priv = player->priv;
-  UmmsPlayerBackend *backend = priv->backend;
+  UmmsPlayerBackend *backend = NULL;
   gboolean ret = TRUE;
 
   UMMS_DEBUG ("will set mute to %d", mute);
 
-  if (backend) {
-    ret = umms_player_backend_set_mute(priv->backend, mute, err);
+  g_mutex_lock (priv->lock);
+  priv->mute = mute;
+  if (priv->backend) {
+    backend = g_object_ref (priv->backend);
   } else {
     UMMS_DEBUG ("UmmsMediaPlayer not ready, cache the mute.");
-    priv->mute = mute;
+  }
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_mute(backend, mute, err);
+    g_object_unref (backend);
   }
   return ret;
 }
@@ -832,23 +1568,29 @@ umms_media_player_set_mute (UmmsMediaPlayer *player, gint mute, GError **err)
 gboolean
 umms_media_player_is_mute (UmmsMediaPlayer *player, gint *mute, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_is_mute (player->priv->backend, mute, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_is_mute, mute);
 }
 
 gboolean
 umms_media_player_set_scale_mode (UmmsMediaPlayer *player, gint scale_mode, GError **err)
 {
   UmmsMediaPlayerPrivate *priv = player->priv;
-  UmmsPlayerBackend *backend = priv->backend;
+  UmmsPlayerBackend *backend = NULL;
   gboolean ret = TRUE;
 
   UMMS_DEBUG ("setting scale mode to %d", scale_mode);
-  if (backend) {
-    ret = umms_player_backend_set_scale_mode (priv->backend, scale_mode, err);
+  g_mutex_lock (priv->lock);
+  priv->scale_mode = scale_mode;
+  if (priv->backend) {
+    backend = g_object_ref (priv->backend);
   } else {
     UMMS_DEBUG ("UmmsMediaPlayer not ready, cache the scale mode.");
-    priv->scale_mode = scale_mode;
+  }
+  g_mutex_unlock (priv->lock);
+
+  if (backend) {
+    ret = umms_player_backend_set_scale_mode (backend, scale_mode, err);
+    g_object_unref (backend);
   }
   return ret;
 }
@@ -856,136 +1598,554 @@ umms_media_player_set_scale_mode (UmmsMediaPlayer *player, gint scale_mode, GErr
 gboolean
 umms_media_player_get_scale_mode (UmmsMediaPlayer *player, gint *scale_mode, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_scale_mode(player->priv->backend, scale_mode, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_scale_mode, scale_mode);
 }
 
 gboolean
 umms_media_player_get_video_codec (UmmsMediaPlayer *player, gint channel, gchar **video_codec, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_codec(player->priv->backend, channel, video_codec, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_codec, channel, video_codec);
 }
 
 gboolean
 umms_media_player_get_audio_codec (UmmsMediaPlayer *player, gint channel, gchar **audio_codec, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_audio_codec(player->priv->backend, channel, audio_codec, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_audio_codec, channel, audio_codec);
 }
 
 gboolean
 umms_media_player_get_video_bitrate (UmmsMediaPlayer *player, gint channel, gint *bit_rate, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_bitrate(player->priv->backend, channel, bit_rate, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_bitrate, channel, bit_rate);
 }
 
 gboolean
 umms_media_player_get_audio_bitrate (UmmsMediaPlayer *player, gint channel, gint *bit_rate, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_audio_bitrate(player->priv->backend, channel, bit_rate, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_audio_bitrate, channel, bit_rate);
 }
 
 gboolean
 umms_media_player_get_encapsulation (UmmsMediaPlayer *player, gchar **encapsulation, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_encapsulation(player->priv->backend, encapsulation, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_encapsulation, encapsulation);
 }
 
 gboolean
 umms_media_player_get_audio_samplerate (UmmsMediaPlayer *player, gint channel, gint *sample_rate, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_audio_samplerate(player->priv->backend, channel, sample_rate, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_audio_samplerate, channel, sample_rate);
 }
 
 gboolean
 umms_media_player_get_video_framerate (UmmsMediaPlayer *player, gint channel,
                                   gint * frame_rate_num, gint * frame_rate_denom, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_framerate(player->priv->backend, channel, frame_rate_num, frame_rate_denom, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_framerate, channel, frame_rate_num, frame_rate_denom);
 }
 
 gboolean
 umms_media_player_get_video_resolution (UmmsMediaPlayer *player, gint channel,
                                    gint * width, gint * height, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_resolution(player->priv->backend, channel, width, height, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_resolution, channel, width, height);
 }
 
 gboolean
 umms_media_player_get_video_aspect_ratio (UmmsMediaPlayer *player, gint channel,
                                      gint * ratio_num, gint * ratio_denom, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_video_aspect_ratio(player->priv->backend, channel, ratio_num, ratio_denom, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_video_aspect_ratio, channel, ratio_num, ratio_denom);
 }
 
 gboolean
 umms_media_player_get_protocol_name (UmmsMediaPlayer *player, gchar **protocol_name, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_protocol_name(player->priv->backend, protocol_name, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_protocol_name, protocol_name);
 }
 
 gboolean
 umms_media_player_get_current_uri (UmmsMediaPlayer *player, gchar **uri, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_current_uri(player->priv->backend, uri, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_current_uri, uri);
 }
 
 gboolean
 umms_media_player_get_title (UmmsMediaPlayer *player, gchar **title, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_title(player->priv->backend, title, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_title, title);
 }
 
 gboolean
 umms_media_player_get_artist (UmmsMediaPlayer *player, gchar **artist, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_artist(player->priv->backend, artist, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_artist, artist);
 }
 
 gboolean
 umms_media_player_record (UmmsMediaPlayer *player, gboolean to_record, gchar *location, GError **err)
 {
   gboolean ret;
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  ret = umms_player_backend_record (player->priv->backend, to_record, location, err);
+  UmmsPlayerBackend *backend = umms_media_player_ref_backend (player);
+
+  CHECK_BACKEND(backend, FALSE, err);
+  ret = umms_player_backend_record (backend, to_record, location, err);
   if (!ret) {
     g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "Record failed");
   }
+  g_object_unref (backend);
   return ret;
 }
 
 gboolean
 umms_media_player_get_pat (UmmsMediaPlayer *player, GPtrArray **pat, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_pat (player->priv->backend, pat, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_pat, pat);
 }
 
 gboolean
 umms_media_player_get_pmt (UmmsMediaPlayer *player, guint *program_num, guint *pcr_pid, GPtrArray **stream_info,
                       GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_pmt (player->priv->backend, program_num, pcr_pid, stream_info, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_pmt, program_num, pcr_pid, stream_info);
 }
 
 gboolean
 umms_media_player_get_associated_data_channel (UmmsMediaPlayer *player, gchar **ip, gint *port, GError **err)
 {
-  CHECK_BACKEND(player->priv->backend, FALSE, err);
-  return umms_player_backend_get_associated_data_channel (player->priv->backend, ip, port, err);
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_associated_data_channel, ip, port);
+}
+
+typedef gboolean (*IntGetter) (UmmsPlayerBackend *self, gint *val, GError **err);
+typedef gboolean (*Int64Getter) (UmmsPlayerBackend *self, gint64 *val, GError **err);
+typedef gboolean (*DoubleGetter) (UmmsPlayerBackend *self, gdouble *val, GError **err);
+typedef gboolean (*BooleanGetter) (UmmsPlayerBackend *self, gboolean *val, GError **err);
+typedef gboolean (*StringGetter) (UmmsPlayerBackend *self, gchar **val, GError **err);
+
+//Properties served by GetProperties, value type decides the getter signature.
+static const struct {
+  const gchar *name;
+  GType       type;
+  GCallback   getter;
+} player_props[] = {
+  {"Position",          G_TYPE_INT64,   G_CALLBACK (umms_player_backend_get_position)},
+  {"PlaybackRate",      G_TYPE_DOUBLE,  G_CALLBACK (umms_player_backend_get_playback_rate)},
+  {"Volume",            G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_volume)},
+  {"Mute",              G_TYPE_INT,     G_CALLBACK (umms_player_backend_is_mute)},
+  {"ScaleMode",         G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_scale_mode)},
+  {"PlayerState",       G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_player_state)},
+  {"BufferedTime",      G_TYPE_INT64,   G_CALLBACK (umms_player_backend_get_buffered_time)},
+  {"BufferedBytes",     G_TYPE_INT64,   G_CALLBACK (umms_player_backend_get_buffered_bytes)},
+  {"MediaSizeTime",     G_TYPE_INT64,   G_CALLBACK (umms_player_backend_get_media_size_time)},
+  {"MediaSizeBytes",    G_TYPE_INT64,   G_CALLBACK (umms_player_backend_get_media_size_bytes)},
+  {"HasVideo",          G_TYPE_BOOLEAN, G_CALLBACK (umms_player_backend_has_video)},
+  {"HasAudio",          G_TYPE_BOOLEAN, G_CALLBACK (umms_player_backend_has_audio)},
+  {"IsStreaming",       G_TYPE_BOOLEAN, G_CALLBACK (umms_player_backend_is_streaming)},
+  {"IsSeekable",        G_TYPE_BOOLEAN, G_CALLBACK (umms_player_backend_is_seekable)},
+  {"SupportFullscreen", G_TYPE_BOOLEAN, G_CALLBACK (umms_player_backend_support_fullscreen)},
+  {"CurrentVideo",      G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_current_video)},
+  {"CurrentAudio",      G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_current_audio)},
+  {"CurrentSubtitle",   G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_current_subtitle)},
+  {"VideoNum",          G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_video_num)},
+  {"AudioNum",          G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_audio_num)},
+  {"SubtitleNum",       G_TYPE_INT,     G_CALLBACK (umms_player_backend_get_subtitle_num)},
+  {"Encapsulation",     G_TYPE_STRING,  G_CALLBACK (umms_player_backend_get_encapsulation)},
+  {"ProtocolName",      G_TYPE_STRING,  G_CALLBACK (umms_player_backend_get_protocol_name)},
+  {"CurrentUri",        G_TYPE_STRING,  G_CALLBACK (umms_player_backend_get_current_uri)},
+  {"Title",             G_TYPE_STRING,  G_CALLBACK (umms_player_backend_get_title)},
+  {"Artist",            G_TYPE_STRING,  G_CALLBACK (umms_player_backend_get_artist)},
+};
+
+static gint
+player_prop_lookup (const gchar *name)
+{
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (player_props); i++) {
+    if (!g_strcmp0 (player_props[i].name, name))
+      return i;
+  }
+  return -1;
+}
+
+//Query one property from backend, return NULL if the backend failed.
+static GValue *
+player_prop_get (UmmsPlayerBackend *backend, gint index)
+{
+  GValue *val;
+  GError *err = NULL;
+  gboolean ret = FALSE;
+  gint i_val = 0;
+  gint64 l_val = 0;
+  gdouble d_val = 0;
+  gboolean b_val = FALSE;
+  gchar *s_val = NULL;
+
+  switch (player_props[index].type) {
+  case G_TYPE_INT:
+    ret = ((IntGetter)player_props[index].getter) (backend, &i_val, &err);
+    break;
+  case G_TYPE_INT64:
+    ret = ((Int64Getter)player_props[index].getter) (backend, &l_val, &err);
+    break;
+  case G_TYPE_DOUBLE:
+    ret = ((DoubleGetter)player_props[index].getter) (backend, &d_val, &err);
+    break;
+  case G_TYPE_BOOLEAN:
+    ret = ((BooleanGetter)player_props[index].getter) (backend, &b_val, &err);
+    break;
+  case G_TYPE_STRING:
+    ret = ((StringGetter)player_props[index].getter) (backend, &s_val, &err);
+    break;
+  default:
+    g_assert_not_reached ();
+  }
+
+  if (!ret) {
+    UMMS_DEBUG ("failed to get '%s': %s", player_props[index].name, err ? err->message : "unknown error");
+    if (err)
+      g_error_free (err);
+    g_free (s_val);
+    return NULL;
+  }
+
+  val = g_new0 (GValue, 1);
+  g_value_init (val, player_props[index].type);
+  switch (player_props[index].type) {
+  case G_TYPE_INT:
+    g_value_set_int (val, i_val);
+    break;
+  case G_TYPE_INT64:
+    g_value_set_int64 (val, l_val);
+    break;
+  case G_TYPE_DOUBLE:
+    g_value_set_double (val, d_val);
+    break;
+  case G_TYPE_BOOLEAN:
+    g_value_set_boolean (val, b_val);
+    break;
+  case G_TYPE_STRING:
+    g_value_take_string (val, s_val ? s_val : g_strdup (""));
+    break;
+  }
+
+  return val;
+}
+
+/*
+ * Serves the UI polling in one round trip, the backend is referenced once and
+ * the getters are called directly.
+ */
+gboolean
+umms_media_player_get_properties (UmmsMediaPlayer *player, gchar **names, GHashTable **properties, GError **err)
+{
+  UmmsPlayerBackend *backend;
+  GValue *val;
+  gint *indexes;
+  gint n_names;
+  gint i;
+
+  backend = umms_media_player_ref_backend (player);
+  CHECK_BACKEND (backend, FALSE, err);
+
+  n_names = names ? g_strv_length (names) : 0;
+  indexes = g_new (gint, MAX (n_names, G_N_ELEMENTS (player_props)));
+
+  if (n_names) {
+    for (i = 0; i < n_names; i++) {
+      if ((indexes[i] = player_prop_lookup (names[i])) < 0) {
+        g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "Unknown property '%s'", names[i]);
+        g_free (indexes);
+        g_object_unref (backend);
+        return FALSE;
+      }
+    }
+  } else {
+    for (i = 0; i < G_N_ELEMENTS (player_props); i++)
+      indexes[i] = i;
+    n_names = G_N_ELEMENTS (player_props);
+  }
+
+  *properties = param_table_create (NULL);
+  for (i = 0; i < n_names; i++) {
+    if ((val = player_prop_get (backend, indexes[i])))
+      g_hash_table_insert (*properties, (gpointer)player_props[indexes[i]].name, val);
+  }
+
+  g_object_unref (backend);
+  g_free (indexes);
+  return TRUE;
+}
+
+gboolean
+umms_media_player_get_frame_ring (UmmsMediaPlayer *player, gint *fd, gint *event_fd, GError **err)
+{
+  UmmsPlayerBackend *backend;
+  gboolean ret;
+
+  backend = umms_media_player_ref_backend (player);
+  CHECK_BACKEND (backend, FALSE, err);
+
+  ret = umms_player_backend_open_frame_ring (backend, fd, event_fd, err);
+  g_object_unref (backend);
+  return ret;
+}
+
+gboolean
+umms_media_player_get_timeshift_window (UmmsMediaPlayer *player, gint64 *earliest, gint64 *latest, GError **err)
+{
+  BACKEND_VMETHOD_CALL (player, err, umms_player_backend_get_timeshift_window, earliest, latest);
+}
+
+void
+umms_media_player_invoke (UmmsMediaPlayer *player, GSourceFunc func, gpointer data, GDestroyNotify notify)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+
+  if (priv->worker) {
+    umms_worker_invoke (priv->worker, func, data, notify);
+  } else {
+    func (data);
+    if (notify)
+      notify (data);
+  }
+}
+
+static void
+player_call_free (gpointer data)
+{
+  PlayerCall *call = (PlayerCall *)data;
+
+  g_object_unref (call->player);
+  g_free (call->location);
+  g_strfreev (call->uris);
+  g_free (call);
+}
+
+static gboolean
+player_call_run (gpointer data)
+{
+  PlayerCall *call = (PlayerCall *)data;
+  UmmsMediaPlayer *player = call->player;
+  GError *err = NULL;
+  gboolean ret = FALSE;
+
+  switch (call->type) {
+  case PLAYER_CALL_PLAY:
+    ret = umms_media_player_activate_async (player, PlayerStatePlaying, &err);
+    break;
+  case PLAYER_CALL_PAUSE:
+    ret = umms_media_player_activate_async (player, PlayerStatePaused, &err);
+    break;
+  case PLAYER_CALL_STOP:
+    ret = umms_media_player_stop (player, &err);
+    break;
+  case PLAYER_CALL_SET_POSITION:
+    ret = umms_media_player_set_position_async (player, call->pos, &err);
+    break;
+  case PLAYER_CALL_SET_PLAYBACK_RATE:
+    ret = umms_media_player_set_playback_rate (player, call->rate, &err);
+    break;
+  case PLAYER_CALL_SUSPEND:
+    ret = umms_media_player_suspend (player, &err);
+    break;
+  case PLAYER_CALL_RESTORE:
+    ret = umms_media_player_restore (player, &err);
+    break;
+  case PLAYER_CALL_RECORD:
+    ret = umms_media_player_record (player, call->to_record, call->location, &err);
+    break;
+  case PLAYER_CALL_SET_ZAP_NEIGHBOURS:
+    ret = umms_media_player_set_zap_neighbours (player, call->uris, &err);
+    break;
+  case PLAYER_CALL_ZAP_REFRESH:
+    zap_refresh (player);
+    ret = TRUE;
+    break;
+  default:
+    UMMS_WARNING ("Unknown call type %d", call->type);
+    break;
+  }
+
+  if (!ret && !err)
+    g_set_error (&err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "Operation failed");
+
+  if (!call->context) {
+    //Already replied when queued, report the failure by signal.
+    if (!ret)
+      g_signal_emit (player, umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Error], 0, err->code, err->message);
+  } else if (ret) {
+    umms_stats_async_reply (call->context);
+    dbus_g_method_return (call->context);
+  } else {
+    umms_stats_async_reply (call->context);
+    dbus_g_method_return_error (call->context, err);
+  }
+
+  if (err)
+    g_error_free (err);
+  return FALSE;
+}
+
+/*
+ * Queue a state transition to the worker of this player, the D-Bus reply is
+ * sent from there once the backend returns. Without worker, run it in place.
+ */
+static gboolean
+player_call_dispatch (UmmsMediaPlayer *player, PlayerCallType type, PlayerCall *call, DBusGMethodInvocation *context)
+{
+  call->player = g_object_ref (player);
+  call->type = type;
+  call->context = context;
+
+  umms_media_player_invoke (player, player_call_run, call, player_call_free);
+  return TRUE;
+}
+
+/*
+ * Reply as soon as the transition is queued, completion is reported by the
+ * PlayerStateChanged/Seeked signals, failure by the Error signal.
+ */
+static gboolean
+player_call_queue (UmmsMediaPlayer *player, PlayerCallType type, PlayerCall *call, DBusGMethodInvocation *context)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  GError *err = NULL;
+  gboolean has_uri;
+
+  if (type == PLAYER_CALL_PLAY || type == PLAYER_CALL_PAUSE) {
+    g_mutex_lock (priv->lock);
+    has_uri = (priv->uri != NULL);
+    g_mutex_unlock (priv->lock);
+
+    if (!has_uri) {
+      g_set_error (&err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "No URI specified");
+      umms_stats_async_reply (context);
+      dbus_g_method_return_error (context, err);
+      g_error_free (err);
+      g_free (call);
+      return TRUE;
+    }
+  }
+
+  umms_stats_async_reply (context);
+  dbus_g_method_return (context);
+  return player_call_dispatch (player, type, call, NULL);
+}
+
+gboolean
+umms_media_player_dbus_play (UmmsMediaPlayer *player, DBusGMethodInvocation *context)
+{
+  return player_call_queue (player, PLAYER_CALL_PLAY, g_new0 (PlayerCall, 1), context);
+}
+
+gboolean
+umms_media_player_dbus_pause (UmmsMediaPlayer *player, DBusGMethodInvocation *context)
+{
+  return player_call_queue (player, PLAYER_CALL_PAUSE, g_new0 (PlayerCall, 1), context);
+}
+
+gboolean
+umms_media_player_dbus_stop (UmmsMediaPlayer *player, DBusGMethodInvocation *context)
+{
+  return player_call_dispatch (player, PLAYER_CALL_STOP, g_new0 (PlayerCall, 1), context);
+}
+
+gboolean
+umms_media_player_dbus_set_position (UmmsMediaPlayer *player, gint64 pos, DBusGMethodInvocation *context)
+{
+  PlayerCall *call = g_new0 (PlayerCall, 1);
+
+  call->pos = pos;
+  return player_call_queue (player, PLAYER_CALL_SET_POSITION, call, context);
+}
+
+gboolean
+umms_media_player_dbus_set_playback_rate (UmmsMediaPlayer *player, gdouble rate, DBusGMethodInvocation *context)
+{
+  PlayerCall *call = g_new0 (PlayerCall, 1);
+
+  call->rate = rate;
+  return player_call_dispatch (player, PLAYER_CALL_SET_PLAYBACK_RATE, call, context);
+}
+
+gboolean
+umms_media_player_dbus_suspend (UmmsMediaPlayer *player, DBusGMethodInvocation *context)
+{
+  return player_call_dispatch (player, PLAYER_CALL_SUSPEND, g_new0 (PlayerCall, 1), context);
+}
+
+gboolean
+umms_media_player_dbus_restore (UmmsMediaPlayer *player, DBusGMethodInvocation *context)
+{
+  return player_call_dispatch (player, PLAYER_CALL_RESTORE, g_new0 (PlayerCall, 1), context);
+}
+
+gboolean
+umms_media_player_dbus_record (UmmsMediaPlayer *player, gboolean to_record, gchar *location, DBusGMethodInvocation *context)
+{
+  PlayerCall *call = g_new0 (PlayerCall, 1);
+
+  call->to_record = to_record;
+  call->location = g_strdup (location);
+  return player_call_dispatch (player, PLAYER_CALL_RECORD, call, context);
+}
+
+gboolean
+umms_media_player_dbus_set_zap_neighbours (UmmsMediaPlayer *player, gchar **uris, DBusGMethodInvocation *context)
+{
+  PlayerCall *call = g_new0 (PlayerCall, 1);
+
+  call->uris = g_strdupv (uris);
+  return player_call_dispatch (player, PLAYER_CALL_SET_ZAP_NEIGHBOURS, call, context);
+}
+
+static void
+progress_interval_min (gpointer key, gpointer value, gpointer user_data)
+{
+  guint *min = (guint *)user_data;
+  guint interval = GPOINTER_TO_UINT (value);
+
+  if (*min == 0 || interval < *min)
+    *min = interval;
+}
+
+void
+umms_media_player_set_progress_interval (UmmsMediaPlayer *player, const gchar *subscriber, guint interval)
+{
+  UmmsMediaPlayerPrivate *priv = player->priv;
+  guint min = 0;
+
+  g_return_if_fail (subscriber);
+
+  if (interval > 0 && interval < MIN_PROGRESS_INTERVAL)
+    interval = MIN_PROGRESS_INTERVAL;
+
+  g_mutex_lock (priv->lock);
+  if (interval)
+    g_hash_table_insert (priv->progress_subscribers, g_strdup (subscriber), GUINT_TO_POINTER (interval));
+  else
+    g_hash_table_remove (priv->progress_subscribers, subscriber);
+
+  g_hash_table_foreach (priv->progress_subscribers, progress_interval_min, &min);
+  UMMS_DEBUG ("'%s' progress interval: %u ms, player interval: %u ms", subscriber, interval, min);
+  if (min != priv->progress_interval) {
+    priv->progress_interval = min;
+    progress_timer_update (player);
+  }
+  g_mutex_unlock (priv->lock);
+}
+
+gboolean
+umms_media_player_dbus_set_progress_interval (UmmsMediaPlayer *player, guint interval, DBusGMethodInvocation *context)
+{
+  gchar *sender = dbus_g_method_get_sender (context);
+
+  umms_media_player_set_progress_interval (player, sender, interval);
+  g_free (sender);
+  umms_stats_async_reply (context);
+  dbus_g_method_return (context);
+  return TRUE;
 }
 
 static void
@@ -1003,6 +2163,9 @@ umms_media_player_get_property (GObject    *object,
   case PROP_ATTENDED:
     g_value_set_boolean (value, priv->attended);
     break;
+  case PROP_HEARTBEAT:
+    g_value_set_boolean (value, priv->heartbeat);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -1025,6 +2188,9 @@ umms_media_player_set_property (GObject      *object,
   case PROP_ATTENDED:
     priv->attended = g_value_get_boolean (value);
     break;
+  case PROP_HEARTBEAT:
+    priv->heartbeat = g_value_get_boolean (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
   }
@@ -1035,13 +2201,24 @@ umms_media_player_dispose (GObject *object)
 {
   UmmsMediaPlayerPrivate *priv = GET_PRIVATE (object);
 
+  //Break the reference held by the progress timer, and don't start it again.
+  g_mutex_lock (priv->lock);
+  priv->progress_interval = 0;
+  progress_timer_update (UMMS_MEDIA_PLAYER (object));
+  g_mutex_unlock (priv->lock);
+
+  umms_stats_player_removed (priv->name);
   RESET_STR (priv->name);
   RESET_STR (priv->uri);
   RESET_STR (priv->sub_uri);
-  if (priv->http_proxy_params)
+  if (priv->http_proxy_params) {
     g_hash_table_unref (priv->http_proxy_params);
-  if (priv->target_params)
+    priv->http_proxy_params = NULL;
+  }
+  if (priv->target_params) {
     g_hash_table_unref (priv->target_params);
+    priv->target_params = NULL;
+  }
 
   G_OBJECT_CLASS (umms_media_player_parent_class)->dispose (object);
 }
@@ -1051,13 +2228,20 @@ umms_media_player_finalize (GObject *object)
 {
   UmmsMediaPlayerPrivate *priv = GET_PRIVATE (object);
 
-  if (priv->backend)
-    g_object_unref (G_OBJECT (priv->backend));
+  umms_media_player_reset_backend (UMMS_MEDIA_PLAYER (object));
+  g_list_foreach (priv->zap_entries, (GFunc)zap_entry_free, NULL);
+  g_list_free (priv->zap_entries);
+  g_strfreev (priv->zap_uris);
+  g_hash_table_destroy (priv->progress_subscribers);
 
-  if (priv->attended && priv->timeout_id > 0) {
+  if (priv->timeout_id > 0) {
     g_source_remove (priv->timeout_id);
   }
 
+  if (priv->worker)
+    umms_worker_pool_release (priv->worker);
+  g_mutex_free (priv->lock);
+
   G_OBJECT_CLASS (umms_media_player_parent_class)->finalize (object);
 }
 
@@ -1066,9 +2250,15 @@ umms_media_player_constructed (GObject *player)
 {
   UmmsMediaPlayerPrivate *priv = GET_PRIVATE (player);
 
-  if (priv->attended) {
+  //Client liveness is tracked by its bus name, the NeedReply ping is for legacy clients only.
+  if (priv->attended && priv->heartbeat) {
     priv->timeout_id = g_timeout_add (CHECK_INTERVAL, (GSourceFunc)client_existence_check, player);
   }
+
+  //NULL if the worker pool is disabled, then all requests are served by the main loop.
+  priv->worker = umms_worker_pool_acquire ();
+
+  umms_stats_player_state (priv->name, PlayerStateNull);
 }
 
 static void
@@ -1092,6 +2282,10 @@ umms_media_player_class_init (UmmsMediaPlayerClass *klass)
                                    g_param_spec_boolean ("attended", "Attended", "Flag to indicate whether this execution is attended",
                                        TRUE, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (object_class, PROP_HEARTBEAT,
+                                   g_param_spec_boolean ("heartbeat", "Heartbeat", "Flag to indicate whether the client is pinged by NeedReply",
+                                       FALSE, G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Initialized] =
     g_signal_new ("initialized",
                   G_OBJECT_CLASS_TYPE (klass),
@@ -1289,6 +2483,47 @@ umms_media_player_class_init (UmmsMediaPlayerClass *klass)
                   g_cclosure_marshal_VOID__VOID,
                   G_TYPE_NONE,
                   0);
+
+  umms_media_player_signals[SIGNAL_MEDIA_PLAYER_PositionChanged] =
+    g_signal_new ("position-changed",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  umms_marshal_VOID__INT64_INT64_INT64,
+                  G_TYPE_NONE,
+                  3,
+                  G_TYPE_INT64,
+                  G_TYPE_INT64,
+                  G_TYPE_INT64);
+
+  umms_media_player_signals[SIGNAL_MEDIA_PLAYER_PsiChanged] =
+    g_signal_new ("psi-changed",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  umms_marshal_VOID__UINT_UINT_UINT,
+                  G_TYPE_NONE,
+                  3,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT);
+
+  umms_media_player_signals[SIGNAL_MEDIA_PLAYER_Zapped] =
+    g_signal_new ("zapped",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  umms_marshal_VOID__INT64_BOOLEAN,
+                  G_TYPE_NONE,
+                  2,
+                  G_TYPE_INT64,
+                  G_TYPE_BOOLEAN);
+
+  zap_metric = umms_metrics_register ("zap", UmmsMetricHistogram);
+  zap_pretuned_metric = umms_metrics_register ("zap.pretuned", UmmsMetricHistogram);
 }
 
 static void
@@ -1297,11 +2532,14 @@ umms_media_player_init (UmmsMediaPlayer *player)
   UmmsMediaPlayerPrivate *priv;
   priv = player->priv = PLAYER_PRIVATE (player);
 
+  priv->lock = g_mutex_new ();
   priv->backend = NULL;
+  priv->worker  = NULL;
   priv->uri     = NULL;
   priv->uri_dirty = FALSE;
   priv->sub_uri = NULL;
   priv->target_params = NULL;
+  priv->progress_subscribers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
   umms_media_player_set_default_params (player);
 }
 
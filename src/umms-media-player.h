@@ -25,6 +25,7 @@
 #define _UMMS_MEDIA_PLAYER_H
 
 #include <glib-object.h>
+#include <dbus/dbus-glib.h>
 
 G_BEGIN_DECLS
 
@@ -140,7 +141,68 @@ gboolean umms_media_player_get_pmt (UmmsMediaPlayer *player, guint *program_num,
                                GError **err);
 gboolean umms_media_player_get_associated_data_channel (UmmsMediaPlayer *player, gchar **ip, gint *port, GError **err);
 
+/*
+ * Query several properties in one call, names are the getter method names
+ * without the "Get" prefix (e.g. "Position", "PlayerState", "IsMute" is "Mute"),
+ * see umms-media-player.c for the list. An empty list queries all of them.
+ * Properties the backend failed to provide are left out of the result.
+ */
+gboolean umms_media_player_get_properties (UmmsMediaPlayer *player, gchar **names, GHashTable **properties, GError **err);
+
+/*
+ * Duplicated fds of the frame ring set up by SetTarget(DataCopy), the caller
+ * owns and must close them.
+ */
+gboolean umms_media_player_get_frame_ring (UmmsMediaPlayer *player, gint *fd, gint *event_fd, GError **err);
+gboolean umms_media_player_get_timeshift_window (UmmsMediaPlayer *player, gint64 *earliest, gint64 *latest, GError **err);
+
 gboolean umms_media_player_activate (UmmsMediaPlayer *player, PlayerState state, GError **err);
+
+/*
+ * Fast channel change: the uris are the channels the user is likely to zap to
+ * next, e.g. the previous and next ones. Up to "neighbours" of them ([Fast Zap]
+ * in umms.conf) are kept pre-tuned and paused by spare backends, with what the
+ * resource manager has free, and SetUri to one of them swaps its backend in.
+ * The Zapped signal reports the time from SetUri to playing. Only called by
+ * the thread running the state transitions.
+ */
+gboolean umms_media_player_set_zap_neighbours (UmmsMediaPlayer *player, gchar **uris, GError **err);
+
+/*
+ * For the scheduled recorders: share the tuner with the other players
+ * recording the same multiplex, see umms_player_backend_set_share_multiplex().
+ */
+void umms_media_player_set_share_multiplex (UmmsMediaPlayer *player, gboolean share);
+
+/*
+ * Run func on the worker thread bound to this player, or in place if the
+ * worker pool is disabled.
+ */
+void umms_media_player_invoke (UmmsMediaPlayer *player, GSourceFunc func, gpointer data, GDestroyNotify notify);
+
+/*
+ * D-Bus entry points of the methods which may block on the pipeline.
+ * The request is queued to the worker and the reply is sent from there.
+ * Play, Pause and SetPosition are replied once queued, the completion is
+ * reported by the PlayerStateChanged/Seeked signals, failure by Error.
+ */
+gboolean umms_media_player_dbus_play (UmmsMediaPlayer *player, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_pause (UmmsMediaPlayer *player, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_stop (UmmsMediaPlayer *player, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_set_position (UmmsMediaPlayer *player, gint64 pos, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_set_playback_rate (UmmsMediaPlayer *player, gdouble rate, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_suspend (UmmsMediaPlayer *player, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_restore (UmmsMediaPlayer *player, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_record (UmmsMediaPlayer *player, gboolean to_record, gchar *location, DBusGMethodInvocation *context);
+gboolean umms_media_player_dbus_set_zap_neighbours (UmmsMediaPlayer *player, gchar **uris, DBusGMethodInvocation *context);
+
+/*
+ * PositionChanged is emitted every interval ms while playing, 0 unsubscribes.
+ * Each subscriber (D-Bus sender) has its own interval, the player runs one
+ * timer at the shortest of them.
+ */
+gboolean umms_media_player_dbus_set_progress_interval (UmmsMediaPlayer *player, guint interval, DBusGMethodInvocation *context);
+void umms_media_player_set_progress_interval (UmmsMediaPlayer *player, const gchar *subscriber, guint interval);
 G_END_DECLS
 
 #endif /* _UMMS_MEDIA_PLAYER_H */
@@ -0,0 +1,231 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include <string.h>
+#include <time.h>
+#include "umms-debug.h"
+#include "umms-metrics.h"
+
+typedef struct _MetricValue {
+  guint64 count;
+  gint64  sum;
+  guint64 buckets[UMMS_METRICS_BUCKETS];
+} MetricValue;
+
+//Only written by its thread.
+typedef struct _MetricBlock {
+  MetricValue values[UMMS_METRICS_MAX];
+} MetricBlock;
+
+static GStaticMutex metrics_lock = G_STATIC_MUTEX_INIT;
+static GStaticPrivate block_key = G_STATIC_PRIVATE_INIT;
+
+//Registry, under lock. An entry is filled before n_metrics covers it.
+static gchar *names[UMMS_METRICS_MAX];
+static UmmsMetricType types[UMMS_METRICS_MAX];
+static volatile gint n_metrics = 0;
+
+//Under lock.
+static GSList *blocks = NULL;//of the live threads
+static MetricBlock *retired = NULL;//values of the exited threads
+static MetricBlock *baseline = NULL;//values at the last reset
+
+static void
+block_add (MetricBlock *dest, const MetricBlock *src, guint n)
+{
+  guint i, j;
+
+  for (i = 0; i < n; i++) {
+    dest->values[i].count += src->values[i].count;
+    dest->values[i].sum += src->values[i].sum;
+    for (j = 0; j < UMMS_METRICS_BUCKETS; j++)
+      dest->values[i].buckets[j] += src->values[i].buckets[j];
+  }
+}
+
+//A thread exits, keep what it recorded.
+static void
+block_retire (gpointer data)
+{
+  MetricBlock *block = data;
+
+  g_static_mutex_lock (&metrics_lock);
+  blocks = g_slist_remove (blocks, block);
+  if (!retired)
+    retired = g_new0 (MetricBlock, 1);
+  block_add (retired, block, g_atomic_int_get (&n_metrics));
+  g_static_mutex_unlock (&metrics_lock);
+
+  g_free (block);
+}
+
+static inline MetricBlock *
+thread_block (void)
+{
+  MetricBlock *block = g_static_private_get (&block_key);
+
+  if (G_UNLIKELY (!block)) {
+    block = g_new0 (MetricBlock, 1);
+    g_static_mutex_lock (&metrics_lock);
+    blocks = g_slist_prepend (blocks, block);
+    g_static_mutex_unlock (&metrics_lock);
+    g_static_private_set (&block_key, block, block_retire);
+  }
+
+  return block;
+}
+
+gint
+umms_metrics_register (const gchar *name, UmmsMetricType type)
+{
+  gint n, i;
+
+  g_return_val_if_fail (name, -1);
+
+  g_static_mutex_lock (&metrics_lock);
+  n = g_atomic_int_get (&n_metrics);
+  for (i = 0; i < n; i++) {
+    if (!strcmp (names[i], name))
+      break;
+  }
+  if (i == n) {
+    if (n < UMMS_METRICS_MAX) {
+      names[n] = g_strdup (name);
+      types[n] = type;
+      g_atomic_int_set (&n_metrics, n + 1);
+    } else {
+      UMMS_WARNING ("too many metrics, '%s' dropped", name);
+      i = -1;
+    }
+  }
+  g_static_mutex_unlock (&metrics_lock);
+
+  return i;
+}
+
+void
+umms_metrics_count (gint id, gint64 delta)
+{
+  if (id < 0)
+    return;
+  thread_block ()->values[id].count += delta;
+}
+
+void
+umms_metrics_record (gint id, gint64 usec)
+{
+  MetricValue *v;
+
+  if (id < 0)
+    return;
+
+  v = &thread_block ()->values[id];
+  v->count++;
+  v->sum += usec;
+  v->buckets[usec > 0 ? MIN (g_bit_storage (usec), UMMS_METRICS_BUCKETS - 1) : 0]++;
+}
+
+gint64
+umms_metrics_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+//Called with lock held.
+static MetricBlock *
+total_locked (guint n)
+{
+  MetricBlock *total = g_new0 (MetricBlock, 1);
+  GSList *g;
+
+  for (g = blocks; g; g = g->next)
+    block_add (total, g->data, n);
+  if (retired)
+    block_add (total, retired, n);
+
+  return total;
+}
+
+UmmsMetricSnapshot *
+umms_metrics_snapshot (guint *n_out)
+{
+  UmmsMetricSnapshot *snapshot;
+  MetricBlock *total;
+  MetricValue *v, *base;
+  guint n, i, j;
+
+  g_static_mutex_lock (&metrics_lock);
+  n = g_atomic_int_get (&n_metrics);
+  total = total_locked (n);
+  snapshot = g_new0 (UmmsMetricSnapshot, MAX (n, 1));
+  for (i = 0; i < n; i++) {
+    v = &total->values[i];
+    base = baseline ? &baseline->values[i] : NULL;
+    snapshot[i].name = names[i];
+    snapshot[i].type = types[i];
+    snapshot[i].count = v->count - (base ? base->count : 0);
+    snapshot[i].sum = v->sum - (base ? base->sum : 0);
+    for (j = 0; j < UMMS_METRICS_BUCKETS; j++)
+      snapshot[i].buckets[j] = v->buckets[j] - (base ? base->buckets[j] : 0);
+  }
+  g_static_mutex_unlock (&metrics_lock);
+
+  g_free (total);
+  *n_out = n;
+  return snapshot;
+}
+
+//The blocks belong to their threads, so a reset only moves the baseline.
+void
+umms_metrics_reset (void)
+{
+  g_static_mutex_lock (&metrics_lock);
+  g_free (baseline);
+  baseline = total_locked (g_atomic_int_get (&n_metrics));
+  g_static_mutex_unlock (&metrics_lock);
+}
+
+gint64
+umms_metrics_percentile (const UmmsMetricSnapshot *snapshot, gdouble percent)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  g_return_val_if_fail (snapshot, 0);
+
+  if (!snapshot->count)
+    return 0;
+
+  rank = (guint64)(snapshot->count * percent / 100.0 + 0.5);
+  for (i = 0; i < UMMS_METRICS_BUCKETS; i++) {
+    seen += snapshot->buckets[i];
+    if (seen >= MAX (rank, 1))
+      break;
+  }
+
+  return i ? (gint64)1 << MIN (i, UMMS_METRICS_BUCKETS - 1) : 0;
+}
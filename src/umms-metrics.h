@@ -0,0 +1,84 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _UMMS_METRICS_H
+#define _UMMS_METRICS_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Server wide counters and latency histograms, exported by com.UMMS.Stats.
+ *
+ * A metric is registered once by name and then recorded by its id. Each
+ * thread records into its own block of values, without lock or atomic
+ * operation, the blocks are only summed up when a snapshot is taken. So a
+ * snapshot may miss the records in flight, and on 32 bit hosts a value being
+ * written may be read torn.
+ *
+ * The histograms are log2 bucketed: bucket 0 counts the 0 us samples and
+ * bucket i the samples in [2^(i-1), 2^i) us, the last one all the larger.
+ */
+
+#define UMMS_METRICS_MAX     256
+#define UMMS_METRICS_BUCKETS 24
+
+typedef enum {
+  UmmsMetricCounter,
+  UmmsMetricHistogram
+} UmmsMetricType;
+
+typedef struct _UmmsMetricSnapshot {
+  const gchar    *name;//valid as long as the process
+  UmmsMetricType type;
+  guint64        count;//samples, or the value of a counter
+  gint64         sum;//us, of the samples
+  guint64        buckets[UMMS_METRICS_BUCKETS];
+} UmmsMetricSnapshot;
+
+/*
+ * Returns:         The id of the metric, the same for the same name, -1 if
+ *                  UMMS_METRICS_MAX metrics are already registered. Takes a
+ *                  lock, register once rather than on each record.
+ */
+gint umms_metrics_register (const gchar *name, UmmsMetricType type);
+
+//Both are no-op on id -1.
+void umms_metrics_count (gint id, gint64 delta);
+void umms_metrics_record (gint id, gint64 usec);
+
+//Monotonic us, to measure what is recorded.
+gint64 umms_metrics_now (void);
+
+//Values since the last reset, g_free() the array.
+UmmsMetricSnapshot *umms_metrics_snapshot (guint *n_metrics);
+void umms_metrics_reset (void);
+
+//Upper bound of the bucket holding the percentile (0-100) of a histogram, in us.
+gint64 umms_metrics_percentile (const UmmsMetricSnapshot *snapshot, gdouble percent);
+
+G_END_DECLS
+
+#endif /* _UMMS_METRICS_H */
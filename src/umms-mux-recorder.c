@@ -0,0 +1,394 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib-object.h>
+#include "umms-debug.h"
+#include "umms-mux-recorder.h"
+#include "umms-psi-cache.h"
+
+#define TS_SYNC_BYTE    0x47
+#define TS_PID_NUM      8192
+#define TS_PID_PAT      0x0000
+#define TS_PID_NULL     0x1FFF
+#define OUT_BUF_PACKETS 1024 //packets buffered per recording between writes
+
+typedef struct _Service {
+  gint     fd;//-1 if the slot is free
+  gchar    *location;
+  guint    program_num;
+  guint16  pmt_pid;
+  guint16  *pids;//PMT, PCR and streams, the bits set in pid_mask
+  guint    n_pids;
+  guint8   pat_cc;//continuity counter of our PAT
+  guint8   *buf;
+  guint    buf_len;//bytes
+  guint64  bytes;
+} Service;
+
+struct _UmmsMuxRecorder {
+  guint32  pid_mask[TS_PID_NUM];//bit n set: the PID goes to service n
+  Service  services[UMMS_MUX_RECORDER_MAX_SERVICES];
+  guint    n_services;
+  guint16  ts_id;//transport_stream_id of the input PAT
+  guint8   carry[UMMS_TS_PACKET_SIZE];//partial packet of the last push
+  guint    carry_len;
+  guint64  dropped;
+};
+
+static void
+set_errno_error (GError **err, const gchar *what, const gchar *path)
+{
+  gint saved_errno = errno;
+
+  g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+               "%s '%s': %s", what, path, g_strerror (saved_errno));
+}
+
+UmmsMuxRecorder *
+umms_mux_recorder_new (void)
+{
+  UmmsMuxRecorder *rec;
+  gint i;
+
+  rec = g_new0 (UmmsMuxRecorder, 1);
+  for (i = 0; i < UMMS_MUX_RECORDER_MAX_SERVICES; i++)
+    rec->services[i].fd = -1;
+  rec->ts_id = 1;
+
+  return rec;
+}
+
+void
+umms_mux_recorder_free (UmmsMuxRecorder *rec)
+{
+  gint i;
+
+  if (!rec)
+    return;
+
+  for (i = 0; i < UMMS_MUX_RECORDER_MAX_SERVICES; i++) {
+    if (rec->services[i].fd >= 0)
+      umms_mux_recorder_remove_service (rec, i, NULL);
+  }
+  g_free (rec);
+}
+
+static gboolean
+service_flush (Service *svc, GError **err)
+{
+  const guint8 *p = svc->buf;
+  gssize n;
+
+  while (svc->buf_len > 0) {
+    if ((n = write (svc->fd, p, svc->buf_len)) < 0) {
+      if (errno == EINTR)
+        continue;
+      set_errno_error (err, "Failed to write recording", svc->location);
+      return FALSE;
+    }
+    p += n;
+    svc->buf_len -= n;
+  }
+  return TRUE;
+}
+
+static inline gboolean
+service_put (Service *svc, const guint8 *packet, GError **err)
+{
+  memcpy (svc->buf + svc->buf_len, packet, UMMS_TS_PACKET_SIZE);
+  svc->buf_len += UMMS_TS_PACKET_SIZE;
+  svc->bytes += UMMS_TS_PACKET_SIZE;
+
+  if (svc->buf_len == OUT_BUF_PACKETS * UMMS_TS_PACKET_SIZE)
+    return service_flush (svc, err);
+  return TRUE;
+}
+
+//Single program PAT of the service.
+static gboolean
+service_put_pat (UmmsMuxRecorder *rec, Service *svc, GError **err)
+{
+  guint8 pkt[UMMS_TS_PACKET_SIZE];
+  guint8 *s = pkt + 5;
+  guint32 crc;
+
+  memset (pkt, 0xFF, sizeof (pkt));
+  pkt[0] = TS_SYNC_BYTE;
+  pkt[1] = 0x40;//payload_unit_start, PID 0
+  pkt[2] = 0x00;
+  pkt[3] = 0x10 | (svc->pat_cc++ & 0x0F);//payload only
+  pkt[4] = 0x00;//pointer_field
+
+  s[0] = 0x00;//table_id
+  s[1] = 0xB0;//section_syntax_indicator, section_length of 13
+  s[2] = 13;
+  s[3] = rec->ts_id >> 8;
+  s[4] = rec->ts_id & 0xFF;
+  s[5] = 0xC1;//version 0, current_next
+  s[6] = 0x00;//section_number
+  s[7] = 0x00;//last_section_number
+  s[8] = svc->program_num >> 8;
+  s[9] = svc->program_num & 0xFF;
+  s[10] = 0xE0 | (svc->pmt_pid >> 8);
+  s[11] = svc->pmt_pid & 0xFF;
+  crc = umms_psi_crc32 (s, 12);
+  s[12] = crc >> 24;
+  s[13] = (crc >> 16) & 0xFF;
+  s[14] = (crc >> 8) & 0xFF;
+  s[15] = crc & 0xFF;
+
+  return service_put (svc, pkt, err);
+}
+
+static void
+service_clear (UmmsMuxRecorder *rec, gint service)
+{
+  Service *svc = &rec->services[service];
+  guint32 bit = 1u << service;
+  guint i;
+
+  for (i = 0; i < svc->n_pids; i++)
+    rec->pid_mask[svc->pids[i]] &= ~bit;
+
+  if (svc->fd >= 0)
+    close (svc->fd);
+  g_free (svc->pids);
+  g_free (svc->buf);
+  g_free (svc->location);
+  memset (svc, 0, sizeof (Service));
+  svc->fd = -1;
+  rec->n_services--;
+}
+
+gint
+umms_mux_recorder_add_service_pids (UmmsMuxRecorder *rec, guint program_num, guint pmt_pid,
+                                    const guint16 *pids, guint n_pids, const gchar *location, GError **err)
+{
+  Service *svc;
+  gint service;
+  guint i;
+
+  g_return_val_if_fail (rec && location, -1);
+
+  if (pmt_pid == TS_PID_PAT || pmt_pid >= TS_PID_NULL) {
+    g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Invalid PMT PID %u", pmt_pid);
+    return -1;
+  }
+  for (service = 0; service < UMMS_MUX_RECORDER_MAX_SERVICES; service++) {
+    if (rec->services[service].fd < 0)
+      break;
+  }
+  if (service == UMMS_MUX_RECORDER_MAX_SERVICES) {
+    g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_NOSPC, "Already recording %d services",
+                 UMMS_MUX_RECORDER_MAX_SERVICES);
+    return -1;
+  }
+
+  svc = &rec->services[service];
+  if ((svc->fd = open (location, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+    set_errno_error (err, "Failed to open recording", location);
+    return -1;
+  }
+  rec->n_services++;
+  svc->location = g_strdup (location);
+  svc->program_num = program_num;
+  svc->pmt_pid = pmt_pid;
+  svc->buf = g_malloc (OUT_BUF_PACKETS * UMMS_TS_PACKET_SIZE);
+
+  //The PAT is ours, the null packets are stuffing.
+  svc->pids = g_new (guint16, n_pids + 1);
+  svc->pids[svc->n_pids++] = pmt_pid;
+  for (i = 0; i < n_pids; i++) {
+    if (pids[i] != TS_PID_PAT && pids[i] < TS_PID_NULL)
+      svc->pids[svc->n_pids++] = pids[i];
+  }
+  for (i = 0; i < svc->n_pids; i++)
+    rec->pid_mask[svc->pids[i]] |= 1u << service;
+
+  //Players can start on the first packets.
+  if (!service_put_pat (rec, svc, err)) {
+    service_clear (rec, service);
+    return -1;
+  }
+
+  UMMS_DEBUG ("recording program %u (%u PIDs) into '%s'", program_num, svc->n_pids, location);
+  return service;
+}
+
+gint
+umms_mux_recorder_add_service (UmmsMuxRecorder *rec, guint program_num, guint pmt_pid, guint pcr_pid,
+                               GPtrArray *stream_info, const gchar *location, GError **err)
+{
+  guint16 *pids;
+  guint n_pids = 0;
+  GValue *val;
+  gint service;
+  guint i;
+
+  pids = g_new (guint16, 1 + (stream_info ? stream_info->len : 0));
+  pids[n_pids++] = pcr_pid;
+  for (i = 0; stream_info && i < stream_info->len; i++) {
+    val = g_hash_table_lookup ((GHashTable *)g_ptr_array_index (stream_info, i), "pid");
+    if (val && G_VALUE_HOLDS_UINT (val))
+      pids[n_pids++] = g_value_get_uint (val);
+  }
+
+  service = umms_mux_recorder_add_service_pids (rec, program_num, pmt_pid, pids, n_pids, location, err);
+  g_free (pids);
+
+  return service;
+}
+
+gboolean
+umms_mux_recorder_remove_service (UmmsMuxRecorder *rec, gint service, GError **err)
+{
+  Service *svc;
+  gboolean ret;
+
+  g_return_val_if_fail (rec && service >= 0 && service < UMMS_MUX_RECORDER_MAX_SERVICES, FALSE);
+
+  svc = &rec->services[service];
+  g_return_val_if_fail (svc->fd >= 0, FALSE);
+
+  ret = service_flush (svc, err);
+  UMMS_DEBUG ("recording of program %u done, %" G_GUINT64_FORMAT " bytes", svc->program_num, svc->bytes);
+  service_clear (rec, service);
+
+  return ret;
+}
+
+static gboolean
+filter_packet (UmmsMuxRecorder *rec, const guint8 *pkt, GError **err)
+{
+  guint pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+  guint32 mask = rec->pid_mask[pid];
+  gboolean ret = TRUE;
+  gint service;
+
+  //Each recording gets its own PAT where the input carries one.
+  if (G_UNLIKELY (pid == TS_PID_PAT)) {
+    //Payload only, start of section: pointer_field then table_id, length, transport_stream_id.
+    if ((pkt[1] & 0x40) && (pkt[3] & 0x30) == 0x10 && pkt[4] < UMMS_TS_PACKET_SIZE - 10)
+      rec->ts_id = (pkt[5 + pkt[4] + 3] << 8) | pkt[5 + pkt[4] + 4];
+    mask = 0;
+    for (service = 0; service < UMMS_MUX_RECORDER_MAX_SERVICES; service++) {
+      if (rec->services[service].fd >= 0)
+        mask |= 1u << service;
+    }
+    while (mask) {
+      service = g_bit_nth_lsf (mask, -1);
+      mask &= mask - 1;
+      if (!service_put_pat (rec, &rec->services[service], ret ? err : NULL)) {
+        service_clear (rec, service);
+        ret = FALSE;
+      }
+    }
+    return ret;
+  }
+
+  while (mask) {
+    service = g_bit_nth_lsf (mask, -1);
+    mask &= mask - 1;
+    if (!service_put (&rec->services[service], pkt, ret ? err : NULL)) {
+      service_clear (rec, service);
+      ret = FALSE;
+    }
+  }
+
+  return ret;
+}
+
+gboolean
+umms_mux_recorder_push (UmmsMuxRecorder *rec, gconstpointer data, gsize len, GError **err)
+{
+  const guint8 *p = data;
+  const guint8 *end = p + len;
+  gboolean ret = TRUE;
+  gsize n;
+
+  g_return_val_if_fail (rec, FALSE);
+
+  //Complete the packet left by the former call.
+  if (rec->carry_len) {
+    n = MIN ((gsize)(UMMS_TS_PACKET_SIZE - rec->carry_len), len);
+    memcpy (rec->carry + rec->carry_len, p, n);
+    rec->carry_len += n;
+    p += n;
+    if (rec->carry_len < UMMS_TS_PACKET_SIZE)
+      return TRUE;
+    rec->carry_len = 0;
+    if (rec->carry[0] == TS_SYNC_BYTE)
+      ret = filter_packet (rec, rec->carry, err) && ret;
+    else
+      rec->dropped += UMMS_TS_PACKET_SIZE;
+  }
+
+  while (end - p >= UMMS_TS_PACKET_SIZE) {
+    if (G_UNLIKELY (p[0] != TS_SYNC_BYTE)) {
+      const guint8 *sync = memchr (p + 1, TS_SYNC_BYTE, end - p - 1);
+
+      n = sync ? sync - p : end - p;
+      rec->dropped += n;
+      p += n;
+      continue;
+    }
+    if (!filter_packet (rec, p, ret ? err : NULL))
+      ret = FALSE;
+    p += UMMS_TS_PACKET_SIZE;
+  }
+
+  if (p < end) {
+    rec->carry_len = end - p;
+    memcpy (rec->carry, p, rec->carry_len);
+  }
+
+  return ret;
+}
+
+guint
+umms_mux_recorder_get_n_services (UmmsMuxRecorder *rec)
+{
+  g_return_val_if_fail (rec, 0);
+
+  return rec->n_services;
+}
+
+guint64
+umms_mux_recorder_get_bytes (UmmsMuxRecorder *rec, gint service)
+{
+  g_return_val_if_fail (rec && service >= 0 && service < UMMS_MUX_RECORDER_MAX_SERVICES, 0);
+
+  return rec->services[service].bytes;
+}
+
+guint64
+umms_mux_recorder_get_dropped (UmmsMuxRecorder *rec)
+{
+  g_return_val_if_fail (rec, 0);
+
+  return rec->dropped;
+}
@@ -0,0 +1,91 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_MUX_RECORDER_H
+#define _UMMS_MUX_RECORDER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Records several services of one multiplex at once, out of a single
+ * transport stream input (one tuner, one demux).
+ *
+ * Each service is written to its own file as a single program transport
+ * stream: the PMT, PCR and elementary stream PIDs of the program are copied,
+ * and the PAT is replaced by one listing only this program. The PID filter
+ * is a table of 8192 bitmasks, one bit per service, so the cost per packet
+ * doesn't depend on the number of services.
+ *
+ * The backend owning the tuner pushes the stream with
+ * umms_mux_recorder_push(), in chunks of any size. The tuner itself is
+ * requested once for all the services, see share_key in ResourceRequest.
+ * Not thread safe, all calls must come from the thread pushing the stream.
+ */
+
+#define UMMS_MUX_RECORDER_MAX_SERVICES 32
+#define UMMS_TS_PACKET_SIZE            188
+
+typedef struct _UmmsMuxRecorder UmmsMuxRecorder;
+
+UmmsMuxRecorder *umms_mux_recorder_new (void);
+//Flush and close the recordings still in progress.
+void umms_mux_recorder_free (UmmsMuxRecorder *rec);
+
+/*
+ * Start recording a program into location, from the next packet pushed.
+ *
+ * program_num, pmt_pid:  A "program-number", "pid" entry of get_pat.
+ * pcr_pid, stream_info:  As returned by get_pmt for this program, the "pid"
+ *                        of each stream is recorded.
+ * Returns:               Service id, -1 on error.
+ */
+gint umms_mux_recorder_add_service (UmmsMuxRecorder *rec, guint program_num, guint pmt_pid, guint pcr_pid,
+                                    GPtrArray *stream_info, const gchar *location, GError **err);
+//Same with the PIDs to record (PCR and elementary streams) given directly.
+gint umms_mux_recorder_add_service_pids (UmmsMuxRecorder *rec, guint program_num, guint pmt_pid,
+                                         const guint16 *pids, guint n_pids, const gchar *location, GError **err);
+
+//Flush and close the recording of a service.
+gboolean umms_mux_recorder_remove_service (UmmsMuxRecorder *rec, gint service, GError **err);
+
+/*
+ * Filter a chunk of the multiplex into the recordings. A partial packet at
+ * the end is kept for the next call, the input is resynchronized on 0x47
+ * after garbage.
+ *
+ * Returns:         FALSE if writing a recording failed, that service is
+ *                  stopped and the others go on.
+ */
+gboolean umms_mux_recorder_push (UmmsMuxRecorder *rec, gconstpointer data, gsize len, GError **err);
+
+guint umms_mux_recorder_get_n_services (UmmsMuxRecorder *rec);
+//Bytes written so far for a service, including the buffered ones.
+guint64 umms_mux_recorder_get_bytes (UmmsMuxRecorder *rec, gint service);
+//Input bytes skipped to regain the packet sync.
+guint64 umms_mux_recorder_get_dropped (UmmsMuxRecorder *rec);
+
+G_END_DECLS
+
+#endif /* _UMMS_MUX_RECORDER_H */
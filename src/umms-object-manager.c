@@ -21,14 +21,24 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define UMMS_LOG_CATEGORY UmmsLogCategoryObjectManager
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dbus/dbus-glib-lowlevel.h>
 #include <dbus/dbus-glib.h>
 
 #include "umms-server.h"
 #include "umms-debug.h"
 #include "umms-types.h"
+#include "umms-error.h"
 #include "umms-object-manager.h"
 #include "umms-media-player.h"
+#include "umms-backend-factory.h"
+#include "umms-scheduler.h"
+#include "umms-schedule-journal.h"
+#include "umms-stats.h"
 #include "./glue/umms-media-player-glue.h"
 
 
@@ -40,19 +50,28 @@ G_DEFINE_TYPE (UmmsObjectManager, umms_object_manager, G_TYPE_OBJECT)
 
 
 #define OBJ_NAME_PREFIX "/com/UMMS/MediaPlayer"
+#define TOKEN_BYTES 16 //hex encoded in the token string
 
-static void player_list_free (GList *player_list);
-static gint find_player_by_name (gconstpointer player_in, gconstpointer  name);
-static gboolean stop_execution(gpointer data);
+static void player_entry_free (gpointer data);
+static void client_watch_free (gpointer data);
+static DBusHandlerResult name_owner_filter (DBusConnection *conn, DBusMessage *msg, void *user_data);
+static DBusHandlerResult frame_ring_filter (DBusConnection *conn, DBusMessage *msg, void *user_data);
+static void stop_execution(gpointer data);
 static void dump_player (gpointer a, gpointer b);
 static void dump_player_list (GList *players);
 static UmmsMediaPlayer *gen_media_player (UmmsObjectManager *mngr, gboolean attended);
 static gboolean remove_media_player (UmmsMediaPlayer *player);
-static gboolean start_record (gpointer data);
-static gboolean stop_record (gpointer data);
+static void start_record (gpointer data);
+static gboolean schedule_recorder (UmmsObjectManager *self, gint64 start_time, gint64 stop_time, const gchar *uri,
+                                   const gchar *location, const UmmsScheduleEntry *restored, gchar **token,
+                                   gchar **object_path, GError **error);
+static void stop_record (gpointer data);
+static const gchar *execution_register (UmmsObjectManagerPrivate *priv, UmmsMediaPlayer *player, const gchar *token,
+                                        gint64 start_time, gint64 stop_time, GError **error);
 
 enum {
   SIGNAL_PLAYER_ADDED,
+  SIGNAL_PLAYER_REMOVED,
   N_SIGNALS
 };
 
@@ -64,19 +83,70 @@ enum PROPTYPE {
 
 static guint signals[N_SIGNALS] = {0};
 
+/*
+ * Player registry, hashed by object path and by id for O(1) lookup and removal.
+ * players keeps the insertion order for umms_object_manager_get_player_list().
+ */
 struct _UmmsObjectManagerPrivate {
-  GList *player_list;
+  GQueue     players;
+  GHashTable *players_by_path;//object path ==> PlayerEntry
+  GHashTable *players_by_id;//id ==> PlayerEntry
   gint  cur_player_id;
+
+  /*
+   * Liveness of the clients owning attended players, one NameOwnerChanged
+   * match rule per client instead of a heartbeat per player.
+   */
+  GHashTable *clients;//unique bus name ==> ClientWatch
+  DBusConnection *bus;//NULL until the first player is created
+  DBusGProxy *bus_proxy;
+  gboolean   heartbeat;//legacy NeedReply/Reply ping, opt-in
+
+  //Absolute time events: recording start/stop, unattended execution deadlines.
+  UmmsScheduler *scheduler;
+  UmmsScheduleJournal *journal;//NULL if the schedule isn't persisted
+
+  //Unattended executions and recordings, hashed by the token given to the client.
+  GHashTable *executions;//token ==> PlayerEntry
+  gint       random_fd;//-1 if /dev/urandom can't be opened
 };
 
+typedef struct _ClientWatch {
+  gchar       *name;
+  gchar       *rule;
+  GList       *players;
+} ClientWatch;
+
+typedef struct _PlayerEntry {
+  UmmsMediaPlayer *player;
+  gint        id;
+  gchar       *path;
+  GList       *link;//node of this player in priv->players
+  ClientWatch *client;//NULL if not bound to a client
+  gchar       *token;//execution token, NULL for attended players
+  gint64      start_time;//us since the Epoch
+  gint64      stop_time;
+} PlayerEntry;
+
+#define PLAYER_ENTRY_KEY "umms-player-entry"
+
 typedef struct _RecordItem {
   UmmsMediaPlayer *recorder;
   gchar       *location;
-  gdouble     duration;
-  guint       delay_timer_id;
-  guint       duration_timer_id;
+  gint64      start_time;//us since the Epoch
+  gint64      stop_time;
+  guint       start_event;//scheduler event ids
+  guint       stop_event;
+  guint64     journal_id;//0 once finished or if not journaled
 } RecordItem;
 
+//Record request run on the worker thread of the recorder.
+typedef struct _RecordCall {
+  UmmsMediaPlayer *recorder;
+  gboolean    to_record;
+  gchar       *location;
+} RecordCall;
+
 typedef struct _PlayerCtx {
 
   void (*free_func) (void *);
@@ -116,7 +186,34 @@ static void
 umms_object_manager_dispose (GObject *object)
 {
   UmmsObjectManagerPrivate *priv = GET_PRIVATE (object);
-  player_list_free (priv->player_list);
+  UmmsMediaPlayer *player;
+
+  //Pending events refer to the players.
+  umms_scheduler_free (priv->scheduler);
+  priv->scheduler = NULL;
+  //Closed first, so that the recordings are kept for the next start.
+  umms_schedule_journal_close (priv->journal);
+  priv->journal = NULL;
+  g_hash_table_remove_all (priv->executions);
+  g_hash_table_remove_all (priv->players_by_id);
+  g_hash_table_remove_all (priv->players_by_path);
+  while ((player = g_queue_pop_head (&priv->players)))
+    g_object_unref (player);
+  g_hash_table_remove_all (priv->clients);
+
+  if (priv->bus) {
+    dbus_connection_remove_filter (priv->bus, name_owner_filter, object);
+    dbus_connection_remove_filter (priv->bus, frame_ring_filter, object);
+    priv->bus = NULL;
+  }
+  if (priv->bus_proxy) {
+    g_object_unref (priv->bus_proxy);
+    priv->bus_proxy = NULL;
+  }
+  if (priv->random_fd >= 0) {
+    close (priv->random_fd);
+    priv->random_fd = -1;
+  }
 
   G_OBJECT_CLASS (umms_object_manager_parent_class)->dispose (object);
 }
@@ -124,6 +221,13 @@ umms_object_manager_dispose (GObject *object)
 static void
 umms_object_manager_finalize (GObject *object)
 {
+  UmmsObjectManagerPrivate *priv = GET_PRIVATE (object);
+
+  g_hash_table_destroy (priv->executions);
+  g_hash_table_destroy (priv->players_by_id);
+  g_hash_table_destroy (priv->players_by_path);
+  g_hash_table_destroy (priv->clients);
+
   G_OBJECT_CLASS (umms_object_manager_parent_class)->finalize (object);
 }
 
@@ -148,17 +252,116 @@ umms_object_manager_class_init (UmmsObjectManagerClass *klass)
                   g_cclosure_marshal_VOID__OBJECT,
                   G_TYPE_NONE,
                   1, UMMS_TYPE_MEDIA_PLAYER);
+
+  signals[SIGNAL_PLAYER_REMOVED] =
+    g_signal_new ("player-removed",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST,
+                  0,
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__OBJECT,
+                  G_TYPE_NONE,
+                  1, UMMS_TYPE_MEDIA_PLAYER);
+}
+
+//Recreate the recorders of the journal once the main loop runs.
+static gboolean
+schedule_restore (gpointer data)
+{
+  UmmsObjectManager *self = (UmmsObjectManager *)data;
+  UmmsObjectManagerPrivate *priv = self->priv;
+  GList *entries, *g;
+  gint64 now;
+  GError *err = NULL;
+
+  if (!priv->journal || !priv->scheduler)
+    return FALSE;
+
+  now = umms_scheduler_now (priv->scheduler);
+  entries = umms_schedule_journal_get_entries (priv->journal);
+  for (g = entries; g; g = g->next) {
+    UmmsScheduleEntry *entry = (UmmsScheduleEntry *)g->data;
+    gchar *token = NULL;
+    gchar *object_path = NULL;
+
+    //Missed while the server was down.
+    if (entry->stop_time <= now) {
+      UMMS_DEBUG ("recording %" G_GUINT64_FORMAT " of '%s' missed", entry->id, entry->uri);
+      umms_schedule_journal_finished (priv->journal, entry->id);
+      continue;
+    }
+
+    //One which should be in progress starts at once and stops at its stop time.
+    if (!schedule_recorder (self, entry->start_time, entry->stop_time, entry->uri, entry->location,
+                            entry, &token, &object_path, &err)) {
+      UMMS_WARNING ("Failed to restore recording of '%s': %s", entry->uri, err->message);
+      g_clear_error (&err);
+      continue;
+    }
+    UMMS_DEBUG ("recording of '%s' restored as '%s'%s", entry->uri, object_path,
+                entry->start_time <= now ? ", resumed" : "");
+    g_free (token);
+    g_free (object_path);
+  }
+  g_list_free (entries);
+
+  return FALSE;
+}
+
+static void
+schedule_journal_open (UmmsObjectManager *self)
+{
+  UmmsObjectManagerPrivate *priv = self->priv;
+  gchar *path = NULL;
+  gint sync_interval = SCHEDULE_SYNC_INTERVAL_DEFAULT;
+  GError *err = NULL;
+
+  if (umms_ctx && umms_ctx->conf) {
+    path = g_key_file_get_string (umms_ctx->conf, SCHEDULE_GROUP, "journal", NULL);
+    if (g_key_file_has_key (umms_ctx->conf, SCHEDULE_GROUP, "sync-interval", NULL))
+      sync_interval = MAX (0, g_key_file_get_integer (umms_ctx->conf, SCHEDULE_GROUP, "sync-interval", NULL));
+  }
+  if (!path)
+    path = g_strdup (SCHEDULE_JOURNAL_DEFAULT);
+
+  //An empty path disables the journal.
+  g_strstrip (path);
+  if (path[0]) {
+    if ((priv->journal = umms_schedule_journal_open (path, sync_interval, &err))) {
+      g_idle_add (schedule_restore, self);
+    } else {
+      UMMS_WARNING ("Scheduled recordings won't be persisted: %s", err->message);
+      g_error_free (err);
+    }
+  }
+  g_free (path);
 }
 
 static void
 umms_object_manager_init (UmmsObjectManager *self)
 {
   UmmsObjectManagerPrivate *priv;
+  GError *err = NULL;
 
   self->priv = MANAGER_PRIVATE (self);
   priv = self->priv;
-  priv->player_list = NULL;
+  g_queue_init (&priv->players);
+  //players_by_path owns the entries, both tables share them.
+  priv->players_by_path = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, player_entry_free);
+  priv->players_by_id = g_hash_table_new (g_direct_hash, g_direct_equal);
+  priv->clients = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, client_watch_free);
+  priv->executions = g_hash_table_new (g_str_hash, g_str_equal);
+  if ((priv->random_fd = open ("/dev/urandom", O_RDONLY | O_CLOEXEC)) < 0)
+    UMMS_WARNING ("Failed to open /dev/urandom: %s, no unattended execution can be requested", g_strerror (errno));
+  if (!(priv->scheduler = umms_scheduler_new (UMMS_SCHEDULER_CLOCK_REALTIME, &err))) {
+    UMMS_WARNING ("Failed to create scheduler: %s", err->message);
+    g_error_free (err);
+  } else {
+    schedule_journal_open (self);
+  }
 
+  if (umms_ctx && umms_ctx->conf)
+    priv->heartbeat = g_key_file_get_boolean (umms_ctx->conf, CLIENT_LIVENESS_GROUP, "heartbeat", NULL);
 }
 
 static UmmsObjectManager *mngr_global = NULL;
@@ -179,28 +382,232 @@ static void client_no_reply_cb (UmmsMediaPlayer *player, gpointer user_data)
 }
 
 
+static void
+client_watch_free (gpointer data)
+{
+  ClientWatch *watch = (ClientWatch *)data;
+
+  if (mngr_global && mngr_global->priv->bus)
+    dbus_bus_remove_match (mngr_global->priv->bus, watch->rule, NULL);
+  g_list_free (watch->players);
+  g_free (watch->rule);
+  g_free (watch->name);
+  g_free (watch);
+}
+
+//Remove all the players of a client which left the bus.
+static void
+client_vanished (UmmsObjectManager *self, const gchar *name)
+{
+  ClientWatch *watch;
+  GList *players, *g;
+
+  if (!(watch = g_hash_table_lookup (self->priv->clients, name)))
+    return;
+
+  UMMS_DEBUG ("client '%s' disconnected, removing its players", name);
+  //The last remove_media_player() frees the watch.
+  players = g_list_copy (watch->players);
+  for (g = players; g; g = g->next)
+    remove_media_player ((UmmsMediaPlayer *)g->data);
+  g_list_free (players);
+}
+
+static DBusHandlerResult
+name_owner_filter (DBusConnection *conn, DBusMessage *msg, void *user_data)
+{
+  UmmsObjectManager *self = (UmmsObjectManager *)user_data;
+  const char *name, *old_owner, *new_owner;
+
+  if (!dbus_message_is_signal (msg, DBUS_INTERFACE_DBUS, "NameOwnerChanged"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  if (dbus_message_get_args (msg, NULL,
+                             DBUS_TYPE_STRING, &name,
+                             DBUS_TYPE_STRING, &old_owner,
+                             DBUS_TYPE_STRING, &new_owner,
+                             DBUS_TYPE_INVALID) && new_owner[0] == '\0')
+    client_vanished (self, name);
+
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+//The client may have left before the match rule was added.
+static void
+name_has_owner_reply (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+  gchar *name = (gchar *)user_data;
+  gboolean has_owner = TRUE;
+  GError *err = NULL;
+
+  if (!dbus_g_proxy_end_call (proxy, call, &err, G_TYPE_BOOLEAN, &has_owner, G_TYPE_INVALID)) {
+    UMMS_DEBUG ("NameHasOwner failed: %s", err->message);
+    g_error_free (err);
+    return;
+  }
+
+  if (!has_owner && mngr_global)
+    client_vanished (mngr_global, name);
+}
+
+/*
+ * GetFrameRing, out: (h memfd, h eventfd) of the DataCopy frame ring.
+ * dbus-glib can't marshal unix fds, so it is served by a low-level filter.
+ */
+static DBusHandlerResult
+frame_ring_filter (DBusConnection *conn, DBusMessage *msg, void *user_data)
+{
+  UmmsObjectManager *self = (UmmsObjectManager *)user_data;
+  UmmsMediaPlayer *player;
+  PlayerEntry *entry;
+  DBusMessage *reply;
+  const char *sender;
+  gint fd = -1, event_fd = -1;
+  GError *error = NULL;
+
+  if (!dbus_message_is_method_call (msg, MEDIA_PLAYER_INTERFACE_NAME, "GetFrameRing"))
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+  sender = dbus_message_get_sender (msg);
+  if (!(player = umms_object_manager_lookup_player_by_path (self, dbus_message_get_path (msg)))) {
+    reply = dbus_message_new_error (msg, DBUS_ERROR_UNKNOWN_OBJECT, "No such media player");
+  } else if (!(entry = g_object_get_data (G_OBJECT (player), PLAYER_ENTRY_KEY)) || !entry->client
+             || g_strcmp0 (sender, entry->client->name)) {
+    //The decoded frames only go to the client which requested the player.
+    reply = dbus_message_new_error (msg, DBUS_ERROR_ACCESS_DENIED, "Not the owner of this media player");
+  } else if (!dbus_connection_can_send_type (conn, DBUS_TYPE_UNIX_FD)) {
+    reply = dbus_message_new_error (msg, DBUS_ERROR_NOT_SUPPORTED, "Bus can't pass unix fds");
+  } else if (!umms_media_player_get_frame_ring (player, &fd, &event_fd, &error)) {
+    UMMS_GERROR ("GetFrameRing failed", error);
+    reply = dbus_message_new_error (msg, DBUS_ERROR_FAILED, error->message);
+    g_error_free (error);
+  } else {
+    reply = dbus_message_new_method_return (msg);
+    //The message dups the fds.
+    dbus_message_append_args (reply,
+                              DBUS_TYPE_UNIX_FD, &fd,
+                              DBUS_TYPE_UNIX_FD, &event_fd,
+                              DBUS_TYPE_INVALID);
+    close (fd);
+    close (event_fd);
+  }
+
+  dbus_connection_send (conn, reply, NULL);
+  dbus_message_unref (reply);
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+//Low-level connection for the filters, set up once.
+static DBusConnection *
+manager_bus_get (UmmsObjectManager *self)
+{
+  UmmsObjectManagerPrivate *priv = self->priv;
+  DBusGConnection *connection;
+  GError *err = NULL;
+
+  if (priv->bus)
+    return priv->bus;
+
+  if (!(connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &err))) {
+    UMMS_WARNING ("Failed to open connection to DBus: %s", err->message);
+    g_error_free (err);
+    return NULL;
+  }
+  priv->bus = dbus_g_connection_get_connection (connection);
+  dbus_connection_add_filter (priv->bus, name_owner_filter, self, NULL);
+  dbus_connection_add_filter (priv->bus, frame_ring_filter, self, NULL);
+  priv->bus_proxy = dbus_g_proxy_new_for_name (connection, DBUS_SERVICE_DBUS, DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS);
+
+  return priv->bus;
+}
+
+static ClientWatch *
+client_watch_get (UmmsObjectManager *self, const gchar *name)
+{
+  UmmsObjectManagerPrivate *priv = self->priv;
+  ClientWatch *watch;
+
+  if ((watch = g_hash_table_lookup (priv->clients, name)))
+    return watch;
+
+  if (!manager_bus_get (self))
+    return NULL;
+
+  watch = g_new0 (ClientWatch, 1);
+  watch->name = g_strdup (name);
+  watch->rule = g_strdup_printf ("type='signal',sender='" DBUS_SERVICE_DBUS "',interface='" DBUS_INTERFACE_DBUS "',"
+                                 "member='NameOwnerChanged',arg0='%s'", name);
+  //No error pointer, so that we don't block on the reply.
+  dbus_bus_add_match (priv->bus, watch->rule, NULL);
+  g_hash_table_insert (priv->clients, watch->name, watch);
+
+  dbus_g_proxy_begin_call (priv->bus_proxy, "NameHasOwner", name_has_owner_reply,
+                           g_strdup (name), g_free,
+                           G_TYPE_STRING, name, G_TYPE_INVALID);
+
+  UMMS_DEBUG ("watching client '%s'", name);
+  return watch;
+}
+
 gboolean
-umms_object_manager_request_media_player(UmmsObjectManager *self, gchar **object_path, GError **error)
+umms_object_manager_request_media_player(UmmsObjectManager *self, const gchar *owner, gchar **object_path, GError **error)
 {
+  UmmsObjectManagerPrivate *priv = self->priv;
   UmmsMediaPlayer *player;
+  PlayerEntry *entry;
+  ClientWatch *watch;
 
-  UMMS_DEBUG("request attended media player");
+  UMMS_DEBUG("request attended media player, owner = '%s'", owner);
 
   player = gen_media_player (self, TRUE);
-  g_signal_connect_object (player, "client-no-reply", G_CALLBACK(client_no_reply_cb), NULL, 0);
+  if (!player) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Failed to create media player");
+    return FALSE;
+  }
+
+  if (owner && (watch = client_watch_get (self, owner))) {
+    entry = g_object_get_data (G_OBJECT (player), PLAYER_ENTRY_KEY);
+    entry->client = watch;
+    watch->players = g_list_prepend (watch->players, player);
+  }
+
+  if (priv->heartbeat)
+    g_signal_connect_object (player, "client-no-reply", G_CALLBACK(client_no_reply_cb), NULL, 0);
   g_object_get(G_OBJECT(player), "name", object_path, NULL);
-  dump_player_list (self->priv->player_list);
+  dump_player_list (priv->players.head);
+
+  return TRUE;
+}
+
+gboolean
+umms_object_manager_dbus_request_media_player(UmmsObjectManager *self, DBusGMethodInvocation *context)
+{
+  gchar *sender = dbus_g_method_get_sender (context);
+  gchar *object_path = NULL;
+  GError *err = NULL;
+  gboolean ret;
+
+  ret = umms_object_manager_request_media_player (self, sender, &object_path, &err);
+  umms_stats_async_reply (context);
+  if (ret) {
+    dbus_g_method_return (context, object_path);
+  } else {
+    dbus_g_method_return_error (context, err);
+    g_error_free (err);
+  }
 
+  g_free (object_path);
+  g_free (sender);
   return TRUE;
 }
 
 static void
-timer_source_free (void *data)
+scheduler_event_free (void *data)
 {
-  guint source_id = (guint) data;
+  guint event_id = GPOINTER_TO_UINT (data);
 
-  if (source_id)
-    g_source_remove(source_id);
+  if (event_id && mngr_global && mngr_global->priv->scheduler)
+    umms_scheduler_cancel (mngr_global->priv->scheduler, event_id);
 
   return;
 }
@@ -212,21 +619,36 @@ umms_object_manager_request_media_player_unattended(UmmsObjectManager *self,
     gchar **object_path,
     GError **error)
 {
+  UmmsObjectManagerPrivate *priv = self->priv;
   UmmsMediaPlayer *player;
+  gint64 now, deadline;
 
   UMMS_DEBUG("request unattened media player, time_to_execution = '%lf' seconds", time_to_execution);
 
+  if (!priv->scheduler) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Scheduler not available");
+    return FALSE;
+  }
+
   player = gen_media_player (self, FALSE);
-  g_object_get(G_OBJECT(player), "name", object_path, NULL);
-  //FIXME: return a unique ID token for this execution
+  if (!player) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Failed to create media player");
+    return FALSE;
+  }
   //Ref: Unified Multi Media Service, Section 7, Transparency, Attended and Non Attended execution
-  *token = g_strdup ("Dummy ID token");
+  now = umms_scheduler_now (priv->scheduler);
+  deadline = now + (gint64)(time_to_execution * G_USEC_PER_SEC);
+  if (!(*token = g_strdup (execution_register (priv, player, NULL, now, deadline, error)))) {
+    remove_media_player (player);
+    return FALSE;
+  }
+  g_object_get(G_OBJECT(player), "name", object_path, NULL);
 
   UMMS_DEBUG("object_path returned to client = '%s', token = '%s'", *object_path, *token);
   PlayerCtx *ctx;
   ctx = (PlayerCtx *)g_malloc0(sizeof (PlayerCtx));
-  ctx->free_func = timer_source_free;
-  ctx->data = (void *)g_timeout_add ((time_to_execution * 1000), stop_execution, player);
+  ctx->free_func = scheduler_event_free;
+  ctx->data = GUINT_TO_POINTER (umms_scheduler_add (priv->scheduler, deadline, stop_execution, player, NULL));
   g_object_set_data (G_OBJECT (player), "ctx", ctx);
 
   return TRUE;
@@ -237,10 +659,15 @@ record_item_free (void *data)
 {
   RecordItem *item = (RecordItem *)data;
 
-  if (item->delay_timer_id)
-    g_source_remove(item->delay_timer_id);
-  if (item->duration_timer_id)
-    g_source_remove(item->duration_timer_id);
+  if (mngr_global && mngr_global->priv->scheduler) {
+    if (item->start_event)
+      umms_scheduler_cancel (mngr_global->priv->scheduler, item->start_event);
+    if (item->stop_event)
+      umms_scheduler_cancel (mngr_global->priv->scheduler, item->stop_event);
+  }
+  //Removed before it finished.
+  if (item->journal_id && mngr_global && mngr_global->priv->journal)
+    umms_schedule_journal_cancel (mngr_global->priv->journal, item->journal_id);
 
   g_free (item->location);
   g_free (item);
@@ -248,135 +675,391 @@ record_item_free (void *data)
   return;
 }
 
-gboolean
-umms_object_manager_request_scheduled_recorder(UmmsObjectManager *self,
-    gdouble start_time,
-    gdouble duration,
-    gchar *uri,
-    gchar *location,
-    gchar **token,
-    gchar **object_path,
-    GError **error)
+/*
+ * restored:        The journal entry of a restored recording, which keeps its
+ *                  token. NULL for a new one which is added to the journal.
+ */
+static gboolean
+schedule_recorder (UmmsObjectManager *self, gint64 start_time, gint64 stop_time, const gchar *uri, const gchar *location,
+                   const UmmsScheduleEntry *restored, gchar **token, gchar **object_path, GError **error)
 {
+  UmmsObjectManagerPrivate *priv = self->priv;
   UmmsMediaPlayer *player;
   RecordItem *record_item;
   PlayerCtx *ctx;
+  guint64 journal_id = restored ? restored->id : 0;
+
+  if (!priv->scheduler) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Scheduler not available");
+    return FALSE;
+  }
+  if (stop_time <= start_time) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "Recording stops before it starts");
+    return FALSE;
+  }
 
   player = gen_media_player (self, FALSE);
+  if (!player) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Failed to create media player");
+    return FALSE;
+  }
+  if (!(*token = g_strdup (execution_register (priv, player, restored ? restored->token : NULL, start_time, stop_time,
+                                               error)))) {
+    remove_media_player (player);
+    return FALSE;
+  }
   g_object_get(G_OBJECT(player), "name", object_path, NULL);
 
-  *token = g_strdup ("Dummy ID token");
+  //Recordings of the same multiplex take one tuner.
+  umms_media_player_set_share_multiplex (player, TRUE);
+  umms_media_player_set_uri (player, (gchar *)uri, NULL);
 
-  umms_media_player_set_uri (player, uri, NULL);
+  if (!journal_id && priv->journal)
+    journal_id = umms_schedule_journal_add (priv->journal, start_time, stop_time, uri, location, *token);
 
   record_item = g_malloc0 (sizeof (RecordItem));
+  record_item->journal_id = journal_id;
   record_item->recorder = player;
   record_item->location = g_strdup (location);
-  record_item->duration = duration;
+  record_item->start_time = start_time;
+  record_item->stop_time = stop_time;
 
   ctx = g_malloc0 (sizeof (PlayerCtx));
   ctx->data = record_item;
   ctx->free_func = record_item_free;
   g_object_set_data (G_OBJECT(player), "ctx", ctx);
 
-  //FIXME: start_time is relative to current time, is a absolute time more appropriate?
-  record_item->delay_timer_id = g_timeout_add ((start_time* 1000), start_record, record_item);
+  record_item->start_event = umms_scheduler_add (priv->scheduler, start_time, start_record, record_item, NULL);
 
   return TRUE;
 }
 
+gboolean
+umms_object_manager_request_scheduled_recorder(UmmsObjectManager *self,
+    gdouble start_time,
+    gdouble duration,
+    gchar *uri,
+    gchar *location,
+    gchar **token,
+    gchar **object_path,
+    GError **error)
+{
+  gint64 start;
+
+  //Relative to now, turned into an absolute time right away so that it doesn't drift.
+  start = (self->priv->scheduler ? umms_scheduler_now (self->priv->scheduler) : 0) + (gint64)(start_time * G_USEC_PER_SEC);
 
+  return schedule_recorder (self, start, start + (gint64)(duration * G_USEC_PER_SEC),
+                            uri, location, NULL, token, object_path, error);
+}
+
+gboolean
+umms_object_manager_request_scheduled_recorder_at(UmmsObjectManager *self,
+    gdouble start_time,
+    gdouble stop_time,
+    gchar *uri,
+    gchar *location,
+    gchar **token,
+    gchar **object_path,
+    GError **error)
+{
+  return schedule_recorder (self, (gint64)(start_time * G_USEC_PER_SEC), (gint64)(stop_time * G_USEC_PER_SEC),
+                            uri, location, NULL, token, object_path, error);
+}
 
 gboolean
 umms_object_manager_remove_media_player(UmmsObjectManager *self, gchar *object_path, GError **error)
 {
-  UmmsObjectManagerPrivate *priv;
-  GList *ele;
+  UmmsMediaPlayer *player;
 
   UMMS_DEBUG("removing '%s'", object_path);
 
-  priv = self->priv;
-  ele = g_list_find_custom (priv->player_list, object_path, find_player_by_name);
-  g_return_val_if_fail (ele, FALSE);
-  remove_media_player ((UmmsMediaPlayer *)(ele->data));
+  player = umms_object_manager_lookup_player_by_path (self, object_path);
+  g_return_val_if_fail (player, FALSE);
+  remove_media_player (player);
 
   return TRUE;
 }
 
-static void player_list_free (GList *player_list)
+static PlayerEntry *
+execution_lookup (UmmsObjectManager *self, const gchar *token, GError **error)
 {
-  GList *g;
+  PlayerEntry *entry = NULL;
 
-  for (g = player_list; g; g = g->next) {
-    UmmsMediaPlayer *player = (UmmsMediaPlayer *) (g->data);
-    g_object_unref (player);
+  if (!token || !(entry = g_hash_table_lookup (self->priv->executions, token)))
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "No execution with this token");
+
+  return entry;
+}
+
+gboolean
+umms_object_manager_cancel_execution(UmmsObjectManager *self, gchar *token, GError **error)
+{
+  PlayerEntry *entry;
+  PlayerCtx *ctx;
+  RecordItem *record_item;
+
+  if (!(entry = execution_lookup (self, token, error)))
+    return FALSE;
+
+  UMMS_DEBUG ("canceling execution of '%s'", entry->path);
+  ctx = g_object_get_data (G_OBJECT (entry->player), "ctx");
+  //A recording in progress is stopped, and kept, as if it reached its stop time.
+  if (ctx && ctx->free_func == record_item_free) {
+    record_item = (RecordItem *)ctx->data;
+    if (!record_item->start_event) {
+      if (record_item->stop_event)
+        umms_scheduler_cancel (self->priv->scheduler, record_item->stop_event);
+      stop_record (record_item);
+      return TRUE;
+    }
   }
-  g_list_free (player_list);
+  remove_media_player (entry->player);
 
-  return;
+  return TRUE;
 }
 
-static gint
-find_player_by_name (gconstpointer player_in, gconstpointer  name)
+gboolean
+umms_object_manager_query_execution(UmmsObjectManager *self, gchar *token, gchar **object_path, gint *state,
+                                    gdouble *start_time, gdouble *stop_time, GError **error)
 {
-  gchar *src, *dest;
-  gint  res;
-  UmmsMediaPlayer *player;
+  PlayerEntry *entry;
+
+  if (!self->priv->scheduler) {
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "Scheduler not available");
+    return FALSE;
+  }
+  if (!(entry = execution_lookup (self, token, error)))
+    return FALSE;
+
+  *object_path = g_strdup (entry->path);
+  *state = umms_scheduler_now (self->priv->scheduler) < entry->start_time ?
+           ExecutionStatePending : ExecutionStateRunning;
+  *start_time = (gdouble)entry->start_time / G_USEC_PER_SEC;
+  *stop_time = (gdouble)entry->stop_time / G_USEC_PER_SEC;
+
+  return TRUE;
+}
+
+gboolean
+umms_object_manager_get_backend_pool_stats(UmmsObjectManager *self, guint *hits, guint *misses, GError **error)
+{
+  umms_backend_pool_get_stats (hits, misses);
+  return TRUE;
+}
 
-  g_return_val_if_fail (player_in, 1);
-  g_return_val_if_fail (name, 1);
+UmmsMediaPlayer *
+umms_object_manager_lookup_player_by_path (UmmsObjectManager *self, const gchar *object_path)
+{
+  PlayerEntry *entry;
+
+  g_return_val_if_fail (object_path, NULL);
+
+  entry = g_hash_table_lookup (self->priv->players_by_path, object_path);
+  return entry ? entry->player : NULL;
+}
+
+UmmsMediaPlayer *
+umms_object_manager_lookup_player_by_id (UmmsObjectManager *self, gint id)
+{
+  PlayerEntry *entry;
+
+  entry = g_hash_table_lookup (self->priv->players_by_id, GINT_TO_POINTER (id));
+  return entry ? entry->player : NULL;
+}
+
+static void
+player_entry_free (gpointer data)
+{
+  PlayerEntry *entry = (PlayerEntry *)data;
+
+  g_free (entry->path);
+  g_free (entry->token);
+  g_free (entry);
+}
+
+static void
+register_player (UmmsObjectManagerPrivate *priv, UmmsMediaPlayer *player, gint id, const gchar *object_path)
+{
+  PlayerEntry *entry = g_new0 (PlayerEntry, 1);
+
+  entry->player = player;
+  entry->id = id;
+  entry->path = g_strdup (object_path);
+  g_queue_push_tail (&priv->players, player);
+  entry->link = priv->players.tail;
+
+  g_hash_table_insert (priv->players_by_path, entry->path, entry);
+  g_hash_table_insert (priv->players_by_id, GINT_TO_POINTER (id), entry);
+  g_object_set_data (G_OBJECT (player), PLAYER_ENTRY_KEY, entry);
+}
+
+static gboolean
+random_read (gint fd, guint8 *buf, gsize len)
+{
+  gssize n;
+
+  while (len > 0) {
+    if ((n = read (fd, buf, len)) <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    buf += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+//Unguessable, so that a client can't query or cancel the executions of others, NULL if no entropy.
+static gchar *
+execution_token_new (UmmsObjectManagerPrivate *priv, GError **error)
+{
+  static const gchar hex[] = "0123456789abcdef";
+  guint8 bytes[TOKEN_BYTES];
+  gchar *token;
+  gint i;
+
+  if (priv->random_fd < 0 || !random_read (priv->random_fd, bytes, TOKEN_BYTES)) {
+    UMMS_DEBUG ("failed to read /dev/urandom, no token issued");
+    g_set_error (error, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_CREATING_OBJ_FAILED, "No entropy for the execution token");
+    return NULL;
+  }
+
+  token = g_malloc (2 * TOKEN_BYTES + 1);
+  for (i = 0; i < TOKEN_BYTES; i++) {
+    token[2 * i] = hex[bytes[i] >> 4];
+    token[2 * i + 1] = hex[bytes[i] & 0xF];
+  }
+  token[2 * TOKEN_BYTES] = '\0';
+
+  return token;
+}
+
+/*
+ * Index an unattended player by a token, which goes away with the player when
+ * its execution ends or is canceled.
+ *
+ * token:           Token of a restored execution, NULL to draw a new one.
+ * Returns:         The token, owned by the registry. NULL if none could be
+ *                  drawn, the player is then left unregistered.
+ */
+static const gchar *
+execution_register (UmmsObjectManagerPrivate *priv, UmmsMediaPlayer *player, const gchar *token,
+                    gint64 start_time, gint64 stop_time, GError **error)
+{
+  PlayerEntry *entry = g_object_get_data (G_OBJECT (player), PLAYER_ENTRY_KEY);
+
+  if (token && token[0] && !g_hash_table_lookup (priv->executions, token)) {
+    entry->token = g_strdup (token);
+  } else {
+    do {
+      g_free (entry->token);
+      if (!(entry->token = execution_token_new (priv, error)))
+        return NULL;
+    } while (g_hash_table_lookup (priv->executions, entry->token));
+  }
+  entry->start_time = start_time;
+  entry->stop_time = stop_time;
+  g_hash_table_insert (priv->executions, entry->token, entry);
 
-  dest = (gchar *)name;
-  player = (UmmsMediaPlayer *)player_in;
+  return entry->token;
+}
 
-  g_object_get (G_OBJECT(player), "name", &src, NULL);
-  res = g_strcmp0 (src, dest);
-  g_free (src);
+static void
+unregister_player (UmmsObjectManagerPrivate *priv, UmmsMediaPlayer *player)
+{
+  PlayerEntry *entry = g_object_get_data (G_OBJECT (player), PLAYER_ENTRY_KEY);
 
-  return res;
+  g_return_if_fail (entry);
+
+  g_object_set_data (G_OBJECT (player), PLAYER_ENTRY_KEY, NULL);
+  if (entry->client) {
+    entry->client->players = g_list_remove (entry->client->players, player);
+    //Last player of this client, stop watching it.
+    if (!entry->client->players)
+      g_hash_table_remove (priv->clients, entry->client->name);
+  }
+  if (entry->token)
+    g_hash_table_remove (priv->executions, entry->token);
+  g_queue_delete_link (&priv->players, entry->link);
+  g_hash_table_remove (priv->players_by_id, GINT_TO_POINTER (entry->id));
+  g_hash_table_remove (priv->players_by_path, entry->path);
 }
 
-static gboolean stop_execution(gpointer data)
+static void stop_execution(gpointer data)
 {
   UmmsMediaPlayer *player = (UmmsMediaPlayer *)data;
 
   UMMS_DEBUG ("Stop unattended execution!");
   remove_media_player (player);
+}
+
+static void
+record_call_free (gpointer data)
+{
+  RecordCall *call = (RecordCall *)data;
+
+  g_object_unref (call->recorder);
+  g_free (call->location);
+  g_free (call);
+}
+
+static gboolean
+record_call_run (gpointer data)
+{
+  RecordCall *call = (RecordCall *)data;
+
+  if (call->to_record) {
+    /*
+     * Before invoking umms_media_player_record(), we should load internal player engine.
+     * Setting the target state to PlayerStateNull means we just load the engine and do nothing to construct the pipeline.
+     */
+    umms_media_player_activate (call->recorder, PlayerStateNull, NULL);
+  }
+  umms_media_player_record (call->recorder, call->to_record, call->location, NULL);
+
   return FALSE;
 }
 
-static gboolean stop_record (gpointer data)
+static void
+record_call_dispatch (UmmsMediaPlayer *player, gboolean to_record, const gchar *location)
+{
+  RecordCall *call = g_new0 (RecordCall, 1);
+
+  call->recorder = g_object_ref (player);
+  call->to_record = to_record;
+  call->location = g_strdup (location);
+  umms_media_player_invoke (player, record_call_run, call, record_call_free);
+}
+
+static void stop_record (gpointer data)
 {
   RecordItem *record_item = (RecordItem *)data;
   UmmsMediaPlayer *player = record_item->recorder;
 
   UMMS_DEBUG ("Stop record!");
-  record_item->duration_timer_id = 0;
-  umms_media_player_record (player, FALSE, NULL, NULL);
+  record_item->stop_event = 0;
+  if (record_item->journal_id && mngr_global->priv->journal)
+    umms_schedule_journal_finished (mngr_global->priv->journal, record_item->journal_id);
+  record_item->journal_id = 0;
+  record_call_dispatch (player, FALSE, NULL);
   remove_media_player (player);
-
-  return FALSE;
 }
 
-static gboolean start_record (gpointer data)
+static void start_record (gpointer data)
 {
-  GError *err = NULL;
   RecordItem *record_item = (RecordItem *)data;
   UmmsMediaPlayer *player = record_item->recorder;
-  gboolean ret;
 
   UMMS_DEBUG ("Start record!");
-  /*
-   * Before invoking umms_media_player_record(), we should load internal player engine.
-   * Setting the target state to PlayerStateNull means we just load the engine and do nothing to construct the pipeline.
-   */
-  umms_media_player_activate (player, PlayerStateNull, NULL);
-  umms_media_player_record (player, TRUE, record_item->location, NULL);
-
-  record_item->delay_timer_id = 0;
-  record_item->duration_timer_id = g_timeout_add ((record_item->duration * 1000), stop_record, record_item);
+  record_call_dispatch (player, TRUE, record_item->location);
 
-  return FALSE;
+  record_item->start_event = 0;
+  if (record_item->journal_id && mngr_global->priv->journal)
+    umms_schedule_journal_started (mngr_global->priv->journal, record_item->journal_id);
+  record_item->stop_event = umms_scheduler_add (mngr_global->priv->scheduler, record_item->stop_time,
+                                                stop_record, record_item, NULL);
 }
 
 static void dump_player (gpointer a, gpointer b)
@@ -416,14 +1099,15 @@ gen_media_player (UmmsObjectManager *mngr, gboolean attended)
   object_path = g_strdup_printf (OBJ_NAME_PREFIX"%d", id);
   UMMS_DEBUG("object_path='%s' ", object_path);
 
-  dbus_g_object_type_install_info (UMMS_TYPE_MEDIA_PLAYER, &dbus_glib_umms_media_player_object_info);
+  umms_stats_install_info (UMMS_TYPE_MEDIA_PLAYER, &dbus_glib_umms_media_player_object_info);
   /*create a media player instance*/
   player = (UmmsMediaPlayer *)g_object_new (UMMS_TYPE_MEDIA_PLAYER,
                                         "name", object_path,
                                         "attended", attended,
+                                        "heartbeat", attended && priv->heartbeat,
                                         NULL);
 
-  priv->player_list = g_list_append (priv->player_list, player);
+  register_player (priv, player, id, object_path);
 
   //register object with connection
   connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &err);
@@ -435,6 +1119,7 @@ gen_media_player (UmmsObjectManager *mngr, gboolean attended)
   dbus_g_connection_register_g_object (connection,
                                        object_path,
                                        G_OBJECT (player));
+  manager_bus_get (mngr);
 
   g_signal_emit (mngr, signals[SIGNAL_PLAYER_ADDED], 0, player);
 
@@ -444,8 +1129,10 @@ out:
   return player;
 
 get_connection_failed:
-  if (player)
+  if (player) {
+    unregister_player (priv, player);
     g_object_unref (player);
+  }
   player = NULL;
   goto out;
 }
@@ -473,8 +1160,9 @@ remove_media_player (UmmsMediaPlayer *player)
   dbus_g_connection_unregister_g_object (connection,
                                          G_OBJECT (player));
 
-  //remove from player list
-  priv->player_list = g_list_remove (priv->player_list, player);
+  //remove from player registry
+  unregister_player (priv, player);
+  g_signal_emit (mngr_global, signals[SIGNAL_PLAYER_REMOVED], 0, player);
 
   //destory extra ctx
   ctx = g_object_get_data (G_OBJECT(player), "ctx");
@@ -484,7 +1172,8 @@ remove_media_player (UmmsMediaPlayer *player)
     g_free (ctx);
   }
 
-  //distory player
+  //distory player, dispose drops the references held by its own timers
+  g_object_run_dispose (G_OBJECT (player));
   g_object_unref (player);
 
   return TRUE;
@@ -494,5 +1183,5 @@ remove_media_player (UmmsMediaPlayer *player)
 GList *umms_object_manager_get_player_list (UmmsObjectManager *self)
 {
   UmmsObjectManagerPrivate *priv = GET_PRIVATE (self);
-  return priv->player_list;
+  return priv->players.head;
 }
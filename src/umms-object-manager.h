@@ -25,6 +25,7 @@
 #define _UMMS_OBJECT_MANAGER_H
 
 #include <glib-object.h>
+#include "umms-media-player.h"
 
 G_BEGIN_DECLS
 
@@ -67,13 +68,43 @@ struct _UmmsObjectManagerClass {
 
 GType umms_object_manager_get_type (void) G_GNUC_CONST;
 UmmsObjectManager *umms_object_manager_new (void);
-gboolean umms_object_manager_request_media_player(UmmsObjectManager *self, gchar **object_path, GError **error);
+/*
+ * owner:           Unique bus name of the client, the player is removed once it
+ *                  disconnects. NULL if the player isn't bound to a client.
+ */
+gboolean umms_object_manager_request_media_player(UmmsObjectManager *self, const gchar *owner, gchar **object_path, GError **error);
+gboolean umms_object_manager_dbus_request_media_player(UmmsObjectManager *self, DBusGMethodInvocation *context);
 gboolean umms_object_manager_request_media_player_unattended(UmmsObjectManager *self, gdouble time_to_execution,
     gchar **token, gchar **object_path, GError **error);
 gboolean umms_object_manager_request_scheduled_recorder(UmmsObjectManager *self, gdouble start_time, gdouble duration,
     gchar *uri, gchar *location, gchar **token, gchar **object_path, GError **error);
+/*
+ * start_time, stop_time: Seconds since the Epoch, the recording follows the
+ *                        wall clock across suspend and clock changes.
+ */
+gboolean umms_object_manager_request_scheduled_recorder_at(UmmsObjectManager *self, gdouble start_time, gdouble stop_time,
+    gchar *uri, gchar *location, gchar **token, gchar **object_path, GError **error);
 gboolean umms_object_manager_remove_media_player(UmmsObjectManager *self, gchar *object_path, GError **error);
+/*
+ * Cancel the unattended execution or the recording a token was returned for,
+ * a recording in progress is stopped and its file kept.
+ */
+gboolean umms_object_manager_cancel_execution(UmmsObjectManager *self, gchar *token, GError **error);
+/*
+ * state:           ExecutionState.
+ * start_time, stop_time: Seconds since the Epoch, stop_time is the deadline of
+ *                        an unattended execution.
+ */
+gboolean umms_object_manager_query_execution(UmmsObjectManager *self, gchar *token, gchar **object_path, gint *state,
+    gdouble *start_time, gdouble *stop_time, GError **error);
+gboolean umms_object_manager_get_backend_pool_stats(UmmsObjectManager *self, guint *hits, guint *misses, GError **error);
+/*
+ * Returns:         Players in creation order, owned by the object manager,
+ *                  must not be modified.
+ */
 GList *umms_object_manager_get_player_list (UmmsObjectManager *self);
+UmmsMediaPlayer *umms_object_manager_lookup_player_by_path (UmmsObjectManager *self, const gchar *object_path);
+UmmsMediaPlayer *umms_object_manager_lookup_player_by_id (UmmsObjectManager *self, gint id);
 
 G_END_DECLS
 
@@ -1,10 +1,18 @@
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlayer
+
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "umms-debug.h"
 #include "umms-plugin.h"
 #include "umms-error.h"
 #include "umms-utils.h"
 #include "umms-player-backend.h"
 #include "umms-marshals.h"
+#include "umms-frame-ring.h"
+#include "umms-timeshift.h"
+#include "umms-psi-cache.h"
 
 G_DEFINE_TYPE (UmmsPlayerBackend, umms_player_backend, G_TYPE_OBJECT);
 
@@ -18,9 +26,45 @@ static gchar *live_src_uri[] = {"mms://", "mmsh://", "rtsp://",
                                };
 
 struct _UmmsPlayerBackendPrivate {
-  gint dummy;
+  gint priority;//ResourcePriority
+  UmmsFrameRing *frame_ring;//DataCopy target, swapped with ring_lock held
+  GStaticMutex  ring_lock;//not the backend locks, the streaming thread pushes frames
+  UmmsTimeshift *timeshift;//ring of the live stream, NULL if not timeshifting
+  gchar   *timeshift_dir;
+  guint64 timeshift_size;//0 disables timeshift
+  UmmsPsiCache  *psi_cache;//answers get_pat/get_pmt once the backend fed the tables
+  GStaticRecMutex lock;//held across the transitions, see umms_player_backend_lock()
+  GStaticRecMutex state_lock;//short, see umms_player_backend_state_lock()
+  gboolean share_multiplex;//a recorder, see umms_player_backend_set_share_multiplex()
+  gchar   *share_key;//of the multiplex of uri if share_multiplex, state lock
 };
 
+#define BACKEND_LOCKED_CALL(lock, unlock, func, ...)                             \
+  UMMS_DEBUG ("calling");                                                      \
+  if (!self) {                                                                 \
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_NOT_LOADED, get_mesg_str (MSG_BACKEND_NOT_LOADED));\
+    return FALSE;                                                              \
+  }                                                                            \
+  if (UMMS_PLAYER_BACKEND_GET_CLASS (self)->func) {                            \
+    gboolean ret;                                                              \
+    lock (self);                                                               \
+    ret = UMMS_PLAYER_BACKEND_GET_CLASS (self)->func (self, ##__VA_ARGS__);    \
+    unlock (self);                                                             \
+    return ret;                                                                \
+  } else {                                                                     \
+    g_warning ("%s: %s\n", __FUNCTION__, get_mesg_str (MSG_NOT_IMPLEMENTED));  \
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, get_mesg_str (MSG_NOT_IMPLEMENTED));\
+    return FALSE;                                                              \
+  }
+
+//The transitions, run by the worker of the media player, may block.
+#define BACKEND_VMETHOD_CALL(func, ...) \
+  BACKEND_LOCKED_CALL (umms_player_backend_lock, umms_player_backend_unlock, func, ##__VA_ARGS__)
+
+//The queries and the light setters, run on the main loop, must not block.
+#define BACKEND_QUERY_CALL(func, ...) \
+  BACKEND_LOCKED_CALL (umms_player_backend_state_lock, umms_player_backend_state_unlock, func, ##__VA_ARGS__)
+
 enum {
   SIGNAL_UMMS_PLAYER_BACKEND_Initialized,
   SIGNAL_UMMS_PLAYER_BACKEND_Eof,
@@ -41,6 +85,9 @@ enum {
   SIGNAL_UMMS_PLAYER_BACKEND_MetadataChanged,
   SIGNAL_UMMS_PLAYER_BACKEND_RecordStart,
   SIGNAL_UMMS_PLAYER_BACKEND_RecordStop,
+  SIGNAL_UMMS_PLAYER_BACKEND_Preempted,
+  SIGNAL_UMMS_PLAYER_BACKEND_ResourceAvailable,
+  SIGNAL_UMMS_PLAYER_BACKEND_PsiChanged,
   N_UMMS_PLAYER_BACKEND_SIGNALS
 };
 
@@ -62,12 +109,21 @@ umms_player_backend_finalize (GObject *object)
   UmmsPlayerBackend *self = UMMS_PLAYER_BACKEND (object);
 
   umms_player_backend_release_resource (self);
+  umms_resource_manager_forget_owner (self->res_mngr, self);
+  umms_frame_ring_free (self->priv->frame_ring);
+  g_static_mutex_free (&self->priv->ring_lock);
+  umms_timeshift_free (self->priv->timeshift);
+  g_free (self->priv->timeshift_dir);
+  umms_psi_cache_free (self->priv->psi_cache);
+  g_free (self->priv->share_key);
   RESET_STR(self->uri);
   RESET_STR(self->title);
   RESET_STR(self->artist);
   RESET_STR(self->proxy_uri);
   RESET_STR(self->proxy_id);
   RESET_STR(self->proxy_pw);
+  g_static_rec_mutex_free (&self->priv->lock);
+  g_static_rec_mutex_free (&self->priv->state_lock);
 
   G_OBJECT_CLASS (umms_player_backend_parent_class)->finalize (object);
 }
@@ -281,25 +337,213 @@ umms_player_backend_class_init (UmmsPlayerBackendClass *klass)
                   g_cclosure_marshal_VOID__VOID,
                   G_TYPE_NONE,
                   0);
+
+  umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_Preempted] =
+    g_signal_new ("preempted",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_INT);
+
+  umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_ResourceAvailable] =
+    g_signal_new ("resource-available",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE,
+                  1,
+                  G_TYPE_INT);
+
+  umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_PsiChanged] =
+    g_signal_new ("psi-changed",
+                  G_OBJECT_CLASS_TYPE (klass),
+                  G_SIGNAL_RUN_LAST | G_SIGNAL_DETAILED,
+                  0,
+                  NULL, NULL,
+                  umms_marshal_VOID__UINT_UINT_UINT,
+                  G_TYPE_NONE,
+                  3,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT,
+                  G_TYPE_UINT);
+}
+
+static void
+psi_changed_cb (UmmsPsiCache *cache, guint table_id, guint program_num, guint version, gpointer user_data)
+{
+  g_signal_emit (user_data,
+                 umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_PsiChanged],
+                 0, table_id, program_num, version);
 }
 
 static void
 umms_player_backend_init (UmmsPlayerBackend *self)
 {
   self->priv = UMMS_PLAYER_BACKEND_GET_PRIVATE (self);
+  self->priv->priority = ResourcePriorityNormal;
+  self->priv->psi_cache = umms_psi_cache_new (psi_changed_cb, self);
+  g_static_rec_mutex_init (&self->priv->lock);
+  g_static_rec_mutex_init (&self->priv->state_lock);
+  g_static_mutex_init (&self->priv->ring_lock);
   self->res_mngr = umms_resource_manager_new ();
 }
 
+void
+umms_player_backend_lock (UmmsPlayerBackend *self)
+{
+  g_static_rec_mutex_lock (&self->priv->lock);
+}
+
+void
+umms_player_backend_unlock (UmmsPlayerBackend *self)
+{
+  g_static_rec_mutex_unlock (&self->priv->lock);
+}
+
+gboolean
+umms_player_backend_trylock (UmmsPlayerBackend *self)
+{
+  return g_static_rec_mutex_trylock (&self->priv->lock);
+}
+
+void
+umms_player_backend_state_lock (UmmsPlayerBackend *self)
+{
+  g_static_rec_mutex_lock (&self->priv->state_lock);
+}
+
+void
+umms_player_backend_state_unlock (UmmsPlayerBackend *self)
+{
+  g_static_rec_mutex_unlock (&self->priv->state_lock);
+}
+
+//"program-number" parameter of a dvb uri, 0 if none.
+static guint
+uri_get_program_num (const gchar *uri)
+{
+  const gchar *p;
+
+  if (!uri || !(p = strstr (uri, "program-number=")))
+    return 0;
+  return strtoul (p + strlen ("program-number="), NULL, 10);
+}
+
+//The services of a multiplex only differ by program-number, NULL if uri has none.
+static gchar *
+uri_get_multiplex (const gchar *uri)
+{
+  const gchar *p, *end;
+  GString *key;
+
+  if (!uri || !(p = strstr (uri, "program-number=")))
+    return NULL;
+
+  key = g_string_new_len (uri, p - uri);
+  if ((end = strchr (p, '&')))
+    g_string_append (key, end + 1);
+  while (key->len && (key->str[key->len - 1] == '&' || key->str[key->len - 1] == '?'))
+    g_string_truncate (key, key->len - 1);
+  return g_string_free (key, FALSE);
+}
+
 gboolean
 umms_player_backend_set_uri (UmmsPlayerBackend *self,
                              const gchar *uri, GError **err)
 {
+  gboolean ret = FALSE;
+  UmmsPlayerBackendClass *klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
+  UmmsTimeshift *timeshift;
+
   UMMS_DEBUG ("old = \"%s\", new = \"%s\"", self->uri, uri);
+  umms_player_backend_lock (self);
+  umms_player_backend_state_lock (self);
   if (self->uri) {
     g_free (self->uri);
   }
+  //The ring holds the former stream, freed once the plugin stopped writing it.
+  timeshift = self->priv->timeshift;
+  self->priv->timeshift = NULL;
   self->uri = g_strdup (uri);
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_uri, self->uri, err);
+  g_free (self->priv->share_key);
+  self->priv->share_key = self->priv->share_multiplex ? uri_get_multiplex (uri) : NULL;
+  umms_psi_cache_reset (self->priv->psi_cache);
+  umms_psi_cache_set_program (self->priv->psi_cache, uri_get_program_num (uri));
+  umms_player_backend_state_unlock (self);
+
+  if (klass->set_uri) {
+    ret = klass->set_uri (self, self->uri, err);
+  } else {
+    UMMS_WARNING ("%s: %s\n", __FUNCTION__, get_mesg_str (MSG_NOT_IMPLEMENTED));
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, get_mesg_str (MSG_NOT_IMPLEMENTED));
+  }
+  umms_timeshift_free (timeshift);
+  umms_player_backend_unlock (self);
+
+  return ret;
+}
+
+static guint
+param_get_uint (GHashTable *params, const gchar *key, guint def)
+{
+  GValue *val = params ? g_hash_table_lookup (params, key) : NULL;
+
+  if (!val)
+    return def;
+  if (G_VALUE_HOLDS_UINT (val))
+    return g_value_get_uint (val);
+  if (G_VALUE_HOLDS_INT (val) && g_value_get_int (val) > 0)
+    return g_value_get_int (val);
+  return def;
+}
+
+//Put ring in place, the former one is freed once no frame is written to it.
+static void
+frame_ring_swap (UmmsPlayerBackend *self, UmmsFrameRing *ring)
+{
+  UmmsFrameRing *old;
+
+  g_static_mutex_lock (&self->priv->ring_lock);
+  old = self->priv->frame_ring;
+  self->priv->frame_ring = ring;
+  g_static_mutex_unlock (&self->priv->ring_lock);
+
+  umms_frame_ring_free (old);
+}
+
+/*
+ * (Re)create the frame ring with the geometry given by client, the fds are
+ * handed out by umms_player_backend_open_frame_ring().
+ */
+static gboolean
+frame_ring_setup (UmmsPlayerBackend *self, GHashTable *params, GError **err)
+{
+  UmmsFrameRing *ring;
+  guint n_slots = param_get_uint (params, UMMS_FRAME_RING_PARAM_SLOTS, UMMS_FRAME_RING_DEFAULT_SLOTS);
+  guint slot_size = param_get_uint (params, UMMS_FRAME_RING_PARAM_SLOT_SIZE, UMMS_FRAME_RING_DEFAULT_SLOT_SIZE);
+  GError *ring_err = NULL;
+
+  if (n_slots < 2) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM, "At least 2 frame slots are needed");
+    return FALSE;
+  }
+
+  if (!(ring = umms_frame_ring_new (n_slots, slot_size, &ring_err))) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "Failed to create frame ring: %s", ring_err->message);
+    g_error_free (ring_err);
+    frame_ring_swap (self, NULL);
+    return FALSE;
+  }
+  frame_ring_swap (self, ring);
+
+  UMMS_DEBUG ("frame ring created, %u slots of %u bytes", n_slots, slot_size);
+  return TRUE;
 }
 
 gboolean
@@ -309,6 +553,13 @@ umms_player_backend_set_target (UmmsPlayerBackend *self,
   gboolean ret = FALSE;
   UmmsPlayerBackendClass *klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
 
+  umms_player_backend_state_lock (self);
+  //Set up the frame ring before the backend starts to push frames.
+  if (type == DataCopy && !frame_ring_setup (self, params, err)) {
+    umms_player_backend_state_unlock (self);
+    return FALSE;
+  }
+
   if (klass->set_target) {
     ret = klass->set_target (self, type, params, err);
   } else {
@@ -316,338 +567,558 @@ umms_player_backend_set_target (UmmsPlayerBackend *self,
     g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, get_mesg_str (MSG_NOT_IMPLEMENTED));
   }
 
+  if (!ret && type == DataCopy)
+    frame_ring_swap (self, NULL);
+  umms_player_backend_state_unlock (self);
+
+  return ret;
+}
+
+gboolean
+umms_player_backend_open_frame_ring (UmmsPlayerBackend *self, gint *fd, gint *event_fd, GError **err)
+{
+  UmmsPlayerBackendPrivate *priv;
+  GError *ring_err = NULL;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+  priv = self->priv;
+
+  g_static_mutex_lock (&priv->ring_lock);
+  if (!priv->frame_ring) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "No DataCopy target set");
+    goto out;
+  }
+  //The client must not be able to write the memory the backend writes frames to.
+  if ((*fd = umms_frame_ring_open_reader_fd (priv->frame_ring, &ring_err)) < 0) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "%s", ring_err->message);
+    g_error_free (ring_err);
+    goto out;
+  }
+  if ((*event_fd = dup (umms_frame_ring_get_event_fd (priv->frame_ring))) < 0) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "dup failed: %s", g_strerror (errno));
+    close (*fd);
+    goto out;
+  }
+  ret = TRUE;
+
+out:
+  g_static_mutex_unlock (&priv->ring_lock);
+  return ret;
+}
+
+gboolean
+umms_player_backend_push_frame (UmmsPlayerBackend *self, const UmmsFrameInfo *info, gconstpointer data)
+{
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+
+  g_static_mutex_lock (&self->priv->ring_lock);
+  if (self->priv->frame_ring)
+    ret = umms_frame_ring_write (self->priv->frame_ring, info, data);
+  g_static_mutex_unlock (&self->priv->ring_lock);
+
   return ret;
 }
 
+void
+umms_player_backend_set_timeshift (UmmsPlayerBackend *self, const gchar *dir, guint64 size)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  g_free (self->priv->timeshift_dir);
+  self->priv->timeshift_dir = g_strdup (dir);
+  self->priv->timeshift_size = size;
+}
+
+gboolean
+umms_player_backend_start_timeshift (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsPlayerBackendPrivate *priv = self->priv;
+  UmmsTimeshift *timeshift;
+  GError *ts_err = NULL;
+
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+
+  if (!umms_player_backend_has_timeshift (self)) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "Timeshift not enabled");
+    return FALSE;
+  }
+  if (!(timeshift = umms_timeshift_new (priv->timeshift_dir, priv->timeshift_size, &ts_err))) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_FAILED, "Failed to create timeshift ring: %s", ts_err->message);
+    g_error_free (ts_err);
+    return FALSE;
+  }
+
+  umms_player_backend_stop_timeshift (self);
+  umms_player_backend_state_lock (self);
+  priv->timeshift = timeshift;
+  umms_player_backend_state_unlock (self);
+
+  return TRUE;
+}
+
+void
+umms_player_backend_stop_timeshift (UmmsPlayerBackend *self)
+{
+  UmmsTimeshift *timeshift;
+
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  umms_player_backend_state_lock (self);
+  timeshift = self->priv->timeshift;
+  self->priv->timeshift = NULL;
+  umms_player_backend_state_unlock (self);
+  umms_timeshift_free (timeshift);
+}
+
+gboolean
+umms_player_backend_has_timeshift (UmmsPlayerBackend *self)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+
+  return self->priv->timeshift_size && self->priv->timeshift_dir;
+}
+
+UmmsTimeshift *
+umms_player_backend_get_timeshift (UmmsPlayerBackend *self)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), NULL);
+
+  return self->priv->timeshift;
+}
+
+gboolean
+umms_player_backend_get_timeshift_window (UmmsPlayerBackend *self, gint64 *earliest, gint64 *latest, GError **err)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+
+  //Called on the main loop while the worker may drop the ring.
+  umms_player_backend_state_lock (self);
+  if (!self->priv->timeshift) {
+    umms_player_backend_state_unlock (self);
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_INVALID_STATE, "Not timeshifting");
+    return FALSE;
+  }
+  //Nothing received yet, the window is the current position.
+  if (!umms_timeshift_get_window (self->priv->timeshift, earliest, latest))
+    *earliest = *latest = 0;
+  umms_player_backend_state_unlock (self);
+
+  return TRUE;
+}
+
 gboolean
 umms_player_backend_play (UmmsPlayerBackend *self, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, play, err);
+  BACKEND_VMETHOD_CALL (play, err);
 }
 
 gboolean
 umms_player_backend_pause (UmmsPlayerBackend *self, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, pause, err);
+  BACKEND_VMETHOD_CALL (pause, err);
 }
 
 gboolean
 umms_player_backend_stop (UmmsPlayerBackend *self, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, stop, err);
+  BACKEND_VMETHOD_CALL (stop, err);
 }
 
 gboolean
 umms_player_backend_set_position (UmmsPlayerBackend *self,
                                   gint64 in_pos, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_position, in_pos, err);
+  BACKEND_VMETHOD_CALL (set_position, in_pos, err);
 }
 
 gboolean
 umms_player_backend_get_position (UmmsPlayerBackend *self, gint64 *cur_time, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_position, cur_time, err);
+  BACKEND_QUERY_CALL (get_position, cur_time, err);
 }
 
 gboolean
 umms_player_backend_set_playback_rate (UmmsPlayerBackend *self,
                                        gdouble in_rate, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_playback_rate, in_rate, err);
+  BACKEND_VMETHOD_CALL (set_playback_rate, in_rate, err);
 }
 
 gboolean
 umms_player_backend_get_playback_rate (UmmsPlayerBackend *self, gdouble *out_rate, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_playback_rate, out_rate, err);
+  BACKEND_QUERY_CALL (get_playback_rate, out_rate, err);
 }
 
 gboolean
 umms_player_backend_set_volume (UmmsPlayerBackend *self,
                                 gint in_volume, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_volume, in_volume, err);
+  BACKEND_QUERY_CALL (set_volume, in_volume, err);
 }
 
 gboolean
 umms_player_backend_get_volume (UmmsPlayerBackend *self, gint *vol, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_volume, vol, err);
+  BACKEND_QUERY_CALL (get_volume, vol, err);
 }
 
 gboolean
 umms_player_backend_set_video_size (UmmsPlayerBackend *self, guint x, guint y, guint w, guint h, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_video_size, x, y, w, h, err);
+  BACKEND_QUERY_CALL (set_video_size, x, y, w, h, err);
 }
 
 gboolean
 umms_player_backend_get_video_size (UmmsPlayerBackend *self, guint *w, guint *h, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_size, w, h, err);
+  BACKEND_QUERY_CALL (get_video_size, w, h, err);
 }
 
 gboolean
 umms_player_backend_get_buffered_time (UmmsPlayerBackend *self, gint64 *buffered_time, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_buffered_time, buffered_time, err);
+  BACKEND_QUERY_CALL (get_buffered_time, buffered_time, err);
 }
 
 gboolean
 umms_player_backend_get_buffered_bytes (UmmsPlayerBackend *self, gint64 *buffered_time, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_buffered_bytes, buffered_time, err);
+  BACKEND_QUERY_CALL (get_buffered_bytes, buffered_time, err);
 }
 
 gboolean
 umms_player_backend_get_media_size_time (UmmsPlayerBackend *self, gint64 *media_size_time, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_media_size_time, media_size_time, err);
+  BACKEND_QUERY_CALL (get_media_size_time, media_size_time, err);
 }
 
 gboolean
 umms_player_backend_get_media_size_bytes (UmmsPlayerBackend *self, gint64 *media_size_bytes, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_media_size_bytes, media_size_bytes, err);
+  BACKEND_QUERY_CALL (get_media_size_bytes, media_size_bytes, err);
 }
 
 gboolean
 umms_player_backend_has_video (UmmsPlayerBackend *self, gboolean *has_video, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, has_video, has_video, err);
+  BACKEND_QUERY_CALL (has_video, has_video, err);
 }
 
 gboolean
 umms_player_backend_has_audio (UmmsPlayerBackend *self, gboolean *has_audio, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, has_audio, has_audio, err);
+  BACKEND_QUERY_CALL (has_audio, has_audio, err);
 }
 
 gboolean
 umms_player_backend_is_streaming (UmmsPlayerBackend *self, gboolean *is_streaming, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, is_streaming, is_streaming, err);
+  BACKEND_QUERY_CALL (is_streaming, is_streaming, err);
 }
 
 gboolean
 umms_player_backend_is_seekable (UmmsPlayerBackend *self, gboolean *seekable, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, is_seekable, seekable, err);
+  BACKEND_QUERY_CALL (is_seekable, seekable, err);
 }
 
 gboolean
 umms_player_backend_support_fullscreen (UmmsPlayerBackend *self, gboolean *support_fullscreen, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, support_fullscreen, support_fullscreen, err);
+  BACKEND_QUERY_CALL (support_fullscreen, support_fullscreen, err);
 }
 
 gboolean
 umms_player_backend_get_player_state (UmmsPlayerBackend *self, gint *state, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_player_state, state, err);
+  BACKEND_QUERY_CALL (get_player_state, state, err);
 }
 
 gboolean
 umms_player_backend_get_current_video (UmmsPlayerBackend *self, gint *cur_video, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_current_video, cur_video, err);
+  BACKEND_QUERY_CALL (get_current_video, cur_video, err);
 }
 
 gboolean
 umms_player_backend_get_current_audio (UmmsPlayerBackend *self, gint *cur_audio, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_current_audio, cur_audio, err);
+  BACKEND_QUERY_CALL (get_current_audio, cur_audio, err);
 }
 
 gboolean
 umms_player_backend_set_current_video (UmmsPlayerBackend *self, gint cur_video, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_current_video, cur_video, err);
+  BACKEND_QUERY_CALL (set_current_video, cur_video, err);
 }
 
 gboolean
 umms_player_backend_set_current_audio (UmmsPlayerBackend *self, gint cur_audio, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_current_audio, cur_audio, err);
+  BACKEND_QUERY_CALL (set_current_audio, cur_audio, err);
 }
 
 gboolean
 umms_player_backend_get_video_num (UmmsPlayerBackend *self, gint *video_num, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_num, video_num, err);
+  BACKEND_QUERY_CALL (get_video_num, video_num, err);
 }
 
 gboolean
 umms_player_backend_get_audio_num (UmmsPlayerBackend *self, gint *audio_num, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_audio_num, audio_num, err);
+  BACKEND_QUERY_CALL (get_audio_num, audio_num, err);
 }
 
 umms_player_backend_set_proxy (UmmsPlayerBackend *self,
                                GHashTable *params, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_proxy, params, err);
+  BACKEND_QUERY_CALL (set_proxy, params, err);
 }
 
 gboolean
 umms_player_backend_set_subtitle_uri (UmmsPlayerBackend *self, gchar *sub_uri, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_subtitle_uri, sub_uri, err);
+  BACKEND_QUERY_CALL (set_subtitle_uri, sub_uri, err);
 }
 
 gboolean
 umms_player_backend_get_subtitle_num (UmmsPlayerBackend *self, gint *sub_num, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_subtitle_num, sub_num, err);
+  BACKEND_QUERY_CALL (get_subtitle_num, sub_num, err);
 }
 
 gboolean
 umms_player_backend_get_current_subtitle (UmmsPlayerBackend *self, gint *cur_sub, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_current_subtitle, cur_sub, err);
+  BACKEND_QUERY_CALL (get_current_subtitle, cur_sub, err);
 }
 
 gboolean
 umms_player_backend_set_current_subtitle (UmmsPlayerBackend *self, gint cur_sub, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_current_subtitle, cur_sub, err);
+  BACKEND_QUERY_CALL (set_current_subtitle, cur_sub, err);
 }
 
 gboolean
 umms_player_backend_set_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 buf_val, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_buffer_depth, format, buf_val, err);
+  BACKEND_QUERY_CALL (set_buffer_depth, format, buf_val, err);
 }
 
 gboolean
 umms_player_backend_get_buffer_depth (UmmsPlayerBackend *self, gint format, gint64 *buf_val, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_buffer_depth, format, buf_val, err);
+  BACKEND_QUERY_CALL (get_buffer_depth, format, buf_val, err);
 }
 
 gboolean
 umms_player_backend_set_mute (UmmsPlayerBackend *self, gint mute, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_mute, mute, err);
+  BACKEND_QUERY_CALL (set_mute, mute, err);
 }
 
 gboolean
 umms_player_backend_is_mute (UmmsPlayerBackend *self, gint *mute, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, is_mute, mute, err);
+  BACKEND_QUERY_CALL (is_mute, mute, err);
 }
 
 gboolean umms_player_backend_set_scale_mode (UmmsPlayerBackend *self, gint scale_mode, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, set_scale_mode, scale_mode, err);
+  BACKEND_QUERY_CALL (set_scale_mode, scale_mode, err);
 }
 
 gboolean umms_player_backend_get_scale_mode (UmmsPlayerBackend *self, gint *scale_mode, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_scale_mode, scale_mode, err);
+  BACKEND_QUERY_CALL (get_scale_mode, scale_mode, err);
 }
 
 gboolean umms_player_backend_suspend (UmmsPlayerBackend *self, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, suspend, err);
+  BACKEND_VMETHOD_CALL (suspend, err);
 }
 
 gboolean umms_player_backend_restore (UmmsPlayerBackend *self, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, restore, err);
+  BACKEND_VMETHOD_CALL (restore, err);
 }
 
 gboolean umms_player_backend_get_video_codec (UmmsPlayerBackend *self, gint channel, gchar **video_codec, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_codec, channel, video_codec, err);
+  BACKEND_QUERY_CALL (get_video_codec, channel, video_codec, err);
 }
 
 gboolean umms_player_backend_get_audio_codec (UmmsPlayerBackend *self, gint channel, gchar **audio_codec, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_audio_codec, channel, audio_codec, err);
+  BACKEND_QUERY_CALL (get_audio_codec, channel, audio_codec, err);
 }
 
 gboolean umms_player_backend_get_video_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_bitrate, channel, bit_rate, err);
+  BACKEND_QUERY_CALL (get_video_bitrate, channel, bit_rate, err);
 }
 
 gboolean umms_player_backend_get_audio_bitrate (UmmsPlayerBackend *self, gint channel, gint *bit_rate, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_audio_bitrate, channel, bit_rate, err);
+  BACKEND_QUERY_CALL (get_audio_bitrate, channel, bit_rate, err);
 }
 
 gboolean umms_player_backend_get_encapsulation(UmmsPlayerBackend *self, gchar ** encapsulation, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_encapsulation, encapsulation, err);
+  BACKEND_QUERY_CALL (get_encapsulation, encapsulation, err);
 }
 
 gboolean umms_player_backend_get_audio_samplerate(UmmsPlayerBackend *self, gint channel,
     gint * sample_rate, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_audio_samplerate, channel, sample_rate, err);
+  BACKEND_QUERY_CALL (get_audio_samplerate, channel, sample_rate, err);
 }
 
 gboolean umms_player_backend_get_video_framerate(UmmsPlayerBackend *self, gint channel,
     gint * frame_rate_num, gint * frame_rate_denom, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_framerate, channel, frame_rate_num, frame_rate_denom, err);
+  BACKEND_QUERY_CALL (get_video_framerate, channel, frame_rate_num, frame_rate_denom, err);
 }
 
 gboolean umms_player_backend_get_video_resolution(UmmsPlayerBackend *self, gint channel,
     gint * width, gint * height, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_resolution, channel, width, height, err);
+  BACKEND_QUERY_CALL (get_video_resolution, channel, width, height, err);
 }
 
 
 gboolean umms_player_backend_get_video_aspect_ratio(UmmsPlayerBackend *self,
     gint channel, gint * ratio_num, gint * ratio_denom, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_video_aspect_ratio, channel, ratio_num, ratio_denom, err);
+  BACKEND_QUERY_CALL (get_video_aspect_ratio, channel, ratio_num, ratio_denom, err);
 }
 
 gboolean umms_player_backend_get_protocol_name(UmmsPlayerBackend *self, gchar ** prot_name, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_protocol_name, prot_name, err);
+  BACKEND_QUERY_CALL (get_protocol_name, prot_name, err);
 }
 
 gboolean umms_player_backend_get_current_uri(UmmsPlayerBackend *self, gchar ** uri, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_current_uri, uri, err);
+  BACKEND_QUERY_CALL (get_current_uri, uri, err);
 }
 
 gboolean umms_player_backend_get_title (UmmsPlayerBackend *self, gchar ** title, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_title, title, err);
+  BACKEND_QUERY_CALL (get_title, title, err);
 }
 
 gboolean umms_player_backend_get_artist(UmmsPlayerBackend *self, gchar ** artist, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_artist, artist, err);
+  BACKEND_QUERY_CALL (get_artist, artist, err);
 }
 
 gboolean umms_player_backend_record (UmmsPlayerBackend *self, gboolean to_record, gchar *location, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, record, to_record, location, err);
+  BACKEND_VMETHOD_CALL (record, to_record, location, err);
 }
 
 gboolean umms_player_backend_get_pat (UmmsPlayerBackend *self, GPtrArray **pat, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_pat, pat, err);
+  if (umms_psi_cache_get_pat (self->priv->psi_cache, pat))
+    return TRUE;
+  BACKEND_QUERY_CALL (get_pat, pat, err);
 }
 
 gboolean umms_player_backend_get_pmt (UmmsPlayerBackend *self, guint *program_num, guint *pcr_pid,
                                       GPtrArray **stream_info, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_pmt, program_num, pcr_pid, stream_info, err);
+  guint program = 0;
+
+  if (umms_psi_cache_get_pmt (self->priv->psi_cache, &program, pcr_pid, stream_info)) {
+    *program_num = program;
+    return TRUE;
+  }
+  BACKEND_QUERY_CALL (get_pmt, program_num, pcr_pid, stream_info, err);
+}
+
+UmmsPsiCache *
+umms_player_backend_get_psi_cache (UmmsPlayerBackend *self)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), NULL);
+
+  return self->priv->psi_cache;
 }
 
 gboolean
 umms_player_backend_get_associated_data_channel (UmmsPlayerBackend *self, gchar **ip, gint *port, GError **err)
 {
-  TYPE_VMETHOD_CALL (PLAYER_BACKEND, get_associated_data_channel, ip, port, err);
+  BACKEND_QUERY_CALL (get_associated_data_channel, ip, port, err);
+}
+
+static void
+complete_in_place (UmmsPlayerBackend *self, gboolean ret, GError *err,
+                   UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  if (callback)
+    callback (self, ret, err, user_data);
+  if (err)
+    g_error_free (err);
+}
+
+void
+umms_player_backend_play_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  UmmsPlayerBackendClass *klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
+  GError *err = NULL;
+  gboolean ret;
+
+  if (klass->play_async) {
+    umms_player_backend_lock (self);
+    klass->play_async (self, callback, user_data);
+    umms_player_backend_unlock (self);
+    return;
+  }
+
+  ret = umms_player_backend_play (self, &err);
+  complete_in_place (self, ret, err, callback, user_data);
+}
+
+void
+umms_player_backend_pause_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  UmmsPlayerBackendClass *klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
+  GError *err = NULL;
+  gboolean ret;
+
+  if (klass->pause_async) {
+    umms_player_backend_lock (self);
+    klass->pause_async (self, callback, user_data);
+    umms_player_backend_unlock (self);
+    return;
+  }
+
+  ret = umms_player_backend_pause (self, &err);
+  complete_in_place (self, ret, err, callback, user_data);
+}
+
+void
+umms_player_backend_set_position_async (UmmsPlayerBackend *self, gint64 pos,
+                                        UmmsPlayerBackendCallback callback, gpointer user_data)
+{
+  UmmsPlayerBackendClass *klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
+  GError *err = NULL;
+  gboolean ret;
+
+  if (klass->set_position_async) {
+    umms_player_backend_lock (self);
+    klass->set_position_async (self, pos, callback, user_data);
+    umms_player_backend_unlock (self);
+    return;
+  }
+
+  ret = umms_player_backend_set_position (self, pos, &err);
+  complete_in_place (self, ret, err, callback, user_data);
 }
 
 void
@@ -815,6 +1286,26 @@ umms_player_backend_emit_record_stop (UmmsPlayerBackend *self)
                  0);
 }
 
+void
+umms_player_backend_emit_preempted (UmmsPlayerBackend *self, gint type)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  g_signal_emit (self,
+                 umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_Preempted],
+                 0, type);
+}
+
+void
+umms_player_backend_emit_resource_available (UmmsPlayerBackend *self, gint type)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  g_signal_emit (self,
+                 umms_player_backend_signals[SIGNAL_UMMS_PLAYER_BACKEND_ResourceAvailable],
+                 0, type);
+}
+
 void
 umms_player_backend_set_plugin (UmmsPlayerBackend *self, UmmsPlugin *plugin)
 {
@@ -841,7 +1332,7 @@ umms_player_backend_release_resource (UmmsPlayerBackend *self)
 
   for (g = self->res_list; g; g = g->next) {
     Resource *res = (Resource *) (g->data);
-    umms_resource_manager_release_resource (self->res_mngr, res);
+    umms_resource_manager_release_resource (self->res_mngr, res, self);
   }
 
   g_list_free (self->res_list);
@@ -849,6 +1340,119 @@ umms_player_backend_release_resource (UmmsPlayerBackend *self)
   return;
 }
 
+gboolean
+umms_player_backend_reset (UmmsPlayerBackend *self, GError **err)
+{
+  UmmsPlayerBackendClass *klass;
+
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), FALSE);
+
+  klass = UMMS_PLAYER_BACKEND_GET_CLASS (self);
+  if (!klass->reset) {
+    g_set_error (err, UMMS_BACKEND_ERROR, UMMS_BACKEND_ERROR_METHOD_NOT_IMPLEMENTED, get_mesg_str (MSG_NOT_IMPLEMENTED));
+    return FALSE;
+  }
+
+  umms_player_backend_lock (self);
+  if (!klass->reset (self, err)) {
+    umms_player_backend_unlock (self);
+    return FALSE;
+  }
+
+  umms_player_backend_release_resource (self);
+  umms_resource_manager_forget_owner (self->res_mngr, self);
+  umms_player_backend_state_lock (self);
+  self->priv->priority = ResourcePriorityNormal;
+  //The ring belongs to the former user.
+  frame_ring_swap (self, NULL);
+  umms_timeshift_free (self->priv->timeshift);
+  self->priv->timeshift = NULL;
+  umms_psi_cache_reset (self->priv->psi_cache);
+  umms_psi_cache_set_program (self->priv->psi_cache, 0);
+  self->priv->share_multiplex = FALSE;
+  RESET_STR(self->priv->share_key);
+  RESET_STR(self->uri);
+  RESET_STR(self->title);
+  RESET_STR(self->artist);
+  self->buffering = FALSE;
+  self->buffer_percent = 0;
+  self->seekable = 0;
+  self->is_live = FALSE;
+  self->duration = 0;
+  self->total_bytes = 0;
+  self->suspended = FALSE;
+  self->pos = 0;
+  self->player_state = PlayerStateNull;
+  self->pending_state = PlayerStateNull;
+  umms_player_backend_state_unlock (self);
+  umms_player_backend_unlock (self);
+
+  return TRUE;
+}
+
+void
+umms_player_backend_set_priority (UmmsPlayerBackend *self, gint priority)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  self->priv->priority = priority;
+  umms_resource_manager_set_owner_priority (self->res_mngr, self, priority);
+}
+
+gint
+umms_player_backend_get_priority (UmmsPlayerBackend *self)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), ResourcePriorityNormal);
+
+  return self->priv->priority;
+}
+
+void
+umms_player_backend_set_share_multiplex (UmmsPlayerBackend *self, gboolean share)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  umms_player_backend_state_lock (self);
+  self->priv->share_multiplex = share;
+  g_free (self->priv->share_key);
+  self->priv->share_key = share ? uri_get_multiplex (self->uri) : NULL;
+  umms_player_backend_state_unlock (self);
+}
+
+const gchar *
+umms_player_backend_get_share_key (UmmsPlayerBackend *self)
+{
+  g_return_val_if_fail (UMMS_IS_PLAYER_BACKEND (self), NULL);
+
+  return self->priv->share_key;
+}
+
+//Called with the resource manager locked, see umms_player_backend_set_priority().
+static void
+resource_preempt_cb (Resource *res, gpointer owner)
+{
+  umms_player_backend_emit_preempted (UMMS_PLAYER_BACKEND (owner), res->type);
+}
+
+static void
+resource_available_cb (gint type, gpointer owner)
+{
+  umms_player_backend_emit_resource_available (UMMS_PLAYER_BACKEND (owner), type);
+}
+
+void
+umms_player_backend_init_resource_request (UmmsPlayerBackend *self, ResourceRequest *req, gint type, gint preference)
+{
+  g_return_if_fail (UMMS_IS_PLAYER_BACKEND (self));
+
+  req->type = type;
+  req->preference = preference;
+  req->priority = self->priv->priority;
+  req->owner = self;
+  req->preempt = resource_preempt_cb;
+  req->available = resource_available_cb;
+}
+
 gboolean
 umms_player_backend_is_live_uri (const gchar *uri)
 {
@@ -26,6 +26,9 @@
 #include <glib-object.h>
 #include <umms-resource-manager.h>
 #include <umms-plugin.h>
+#include <umms-frame-ring.h>
+#include <umms-timeshift.h>
+#include <umms-psi-cache.h>
 #include "umms-types.h"
 
 G_BEGIN_DECLS
@@ -52,13 +55,35 @@ G_BEGIN_DECLS
   (G_TYPE_INSTANCE_GET_CLASS ((obj), \
   UMMS_TYPE_PLAYER_BACKEND, UmmsPlayerBackendClass))
 
-#define REQUEST_RES(self, t, p, e_msg)                                        \
+/*
+ * Shared with the other recorders of the multiplex if the backend records
+ * one, see umms_player_backend_set_share_multiplex().
+ */
+#define REQUEST_RES(self, t, p, e_msg) \
+  REQUEST_RES_FULL(self, t, p, umms_player_backend_get_share_key (UMMS_PLAYER_BACKEND (self)), 0, e_msg)
+
+/*
+ * key:             Backends requesting the same key share one resource, e.g.
+ *                  the tuner of a multiplex, see ResourceRequest.
+ */
+#define REQUEST_SHARED_RES(self, t, p, key, e_msg) REQUEST_RES_FULL(self, t, p, key, 0, e_msg)
+
+/*
+ * timeout:         ms to wait for a release if no resource is free nor can
+ *                  be preempted, see umms_resource_manager_request_resource_timed().
+ *                  For the transitions run on the worker of the player.
+ */
+#define REQUEST_RES_TIMED(self, t, p, timeout, e_msg) \
+  REQUEST_RES_FULL(self, t, p, umms_player_backend_get_share_key (UMMS_PLAYER_BACKEND (self)), timeout, e_msg)
+
+#define REQUEST_RES_FULL(self, t, p, key, timeout, e_msg)                     \
   do{                                                                         \
     ResourceRequest req = {0,};                                               \
     Resource *res = NULL;                                                     \
-    req.type = t;                                                             \
-    req.preference = p;                                                       \
-    res = umms_resource_manager_request_resource (self->res_mngr, &req);      \
+    umms_player_backend_init_resource_request (UMMS_PLAYER_BACKEND (self),    \
+                                               &req, t, p);                   \
+    req.share_key = key;                                                      \
+    res = umms_resource_manager_request_resource_timed (self->res_mngr, &req, timeout);\
     if (!res) {                                                               \
       umms_player_backend_release_resource(self);                                                 \
       umms_player_backend_emit_error (self,              \
@@ -75,6 +100,13 @@ typedef struct _UmmsPlayerBackend UmmsPlayerBackend;
 typedef struct _UmmsPlayerBackendClass UmmsPlayerBackendClass;
 typedef struct _UmmsPlayerBackendPrivate UmmsPlayerBackendPrivate;
 
+/*
+ * Completion callback of the asynchronous state transitions.
+ * It must be called exactly once per request, possibly from a streaming thread.
+ * err:             Reason of failure, owned by the caller of the callback.
+ */
+typedef void (*UmmsPlayerBackendCallback) (UmmsPlayerBackend *self, gboolean success, const GError *err, gpointer user_data);
+
 struct _UmmsPlayerBackend {
   GObject parent;
   UmmsPlayerBackendPrivate *priv;
@@ -106,6 +138,28 @@ struct _UmmsPlayerBackend {
   gchar *artist;
 };
 
+/*
+ * Threading contract: the media player calls the backend from its worker
+ * thread (state transitions) and from the main loop (getters, light setters,
+ * progress and metadata polling) at the same time, so two locks are used:
+ *
+ * - the control lock, umms_player_backend_lock(), is held by the wrappers
+ *   around the transitions (set_uri, play, pause, stop, set_position,
+ *   set_playback_rate, suspend, restore, record, reset and the async ones).
+ *   They may block on the pipeline with it held, nothing on the main loop
+ *   may wait for it, use umms_player_backend_trylock() there.
+ * - the state lock, umms_player_backend_state_lock(), is held by the wrappers
+ *   around all the other vmethods. They run on the main loop and must not
+ *   block: answer from the fields the backend keeps up to date, or from
+ *   queries that don't wait for the pipeline.
+ *
+ * The state lock is short and taken inside the control lock, never the
+ * reverse. Fields the transitions and the main loop share, the public ones
+ * above included, are written with the state lock held, and read with either
+ * lock if only the transitions write them. The bus watches, timers and
+ * streaming threads of the plugin take the state lock only. Signals may be
+ * emitted with the state lock held, the async callbacks are invoked without.
+ */
 struct _UmmsPlayerBackendClass {
   GObjectClass parent_class;
   gboolean (*set_uri) (UmmsPlayerBackend *self, const gchar *in_uri, GError **err);
@@ -167,6 +221,21 @@ struct _UmmsPlayerBackendClass {
   gboolean (*get_pat) (UmmsPlayerBackend *self, GPtrArray **pat, GError **err);
   gboolean (*get_pmt) (UmmsPlayerBackend *self, guint *program_num, guint *pcr_pid, GPtrArray **stream_info, GError **err);
   gboolean (*get_associated_data_channel) (UmmsPlayerBackend *self, gchar **ip, gint *port, GError **err);
+  /*
+   * Tear down everything the former user left in a stopped backend (pipeline
+   * state, uri, target, pending requests), so that it can be handed to another
+   * media player as if it was new. Backends without it are never pooled.
+   */
+  gboolean (*reset) (UmmsPlayerBackend *self, GError **err);
+
+  /*
+   * Optional asynchronous variants, they should return as soon as the request is
+   * issued to the pipeline and invoke the callback when the transition is done.
+   * Completion must also be announced by PlayerStateChanged/Seeked as usual.
+   */
+  void (*play_async) (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data);
+  void (*pause_async) (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data);
+  void (*set_position_async) (UmmsPlayerBackend *self, gint64 in_pos, UmmsPlayerBackendCallback callback, gpointer user_data);
 };
 
 GType umms_player_backend_get_type (void) G_GNUC_CONST;
@@ -238,10 +307,95 @@ gboolean umms_player_backend_get_pat (UmmsPlayerBackend *player, GPtrArray **pat
 gboolean umms_player_backend_get_pmt (UmmsPlayerBackend *player, guint *program_num, guint *pcr_pid, GPtrArray **stream_info, GError **err);
 gboolean umms_player_backend_get_associated_data_channel (UmmsPlayerBackend *player, gchar **ip, gint *port, GError **err);
 
+/*
+ * Fall back to the blocking vmethods and invoke the callback in place if the
+ * backend doesn't implement the asynchronous ones.
+ */
+void umms_player_backend_play_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data);
+void umms_player_backend_pause_async (UmmsPlayerBackend *self, UmmsPlayerBackendCallback callback, gpointer user_data);
+void umms_player_backend_set_position_async (UmmsPlayerBackend *self, gint64 pos, UmmsPlayerBackendCallback callback, gpointer user_data);
+
 /* non-dbus-exported methods */
+//Recursive, see the threading contract above UmmsPlayerBackendClass.
+void umms_player_backend_lock (UmmsPlayerBackend *self);
+void umms_player_backend_unlock (UmmsPlayerBackend *self);
+gboolean umms_player_backend_trylock (UmmsPlayerBackend *self);
+void umms_player_backend_state_lock (UmmsPlayerBackend *self);
+void umms_player_backend_state_unlock (UmmsPlayerBackend *self);
 void umms_player_backend_set_plugin (UmmsPlayerBackend *self, UmmsPlugin *plugin);
 gboolean umms_player_backend_support_prot (UmmsPlayerBackend *player, const gchar *prot);
 void umms_player_backend_release_resource (UmmsPlayerBackend *self);
+/*
+ * Reset the plugin state, see the reset vmethod, then the URI specific fields.
+ * FALSE if the backend can't be reused.
+ */
+gboolean umms_player_backend_reset (UmmsPlayerBackend *self, GError **err);
+/*
+ * Resources are requested with this priority (ResourcePriority). The backend
+ * emits "preempted" when one of its resources has been handed to a higher
+ * priority request, it must stop using it at once, and "resource-available"
+ * when a resource it missed or lost is released. Both may be emitted from any
+ * thread with the resource manager locked, handlers must only schedule the
+ * work. A new priority also applies to the resources already held.
+ */
+void umms_player_backend_set_priority (UmmsPlayerBackend *self, gint priority);
+gint umms_player_backend_get_priority (UmmsPlayerBackend *self);
+void umms_player_backend_init_resource_request (UmmsPlayerBackend *self, ResourceRequest *req, gint type, gint preference);
+/*
+ * For the scheduled recorders: the resources of REQUEST_RES are then shared
+ * with the other backends recording a service of the same multiplex, i.e. a
+ * uri differing only by its program-number, so that they take one tuner. The
+ * share key is the uri without the program-number, NULL if it has none or if
+ * not sharing. Cleared by reset.
+ */
+void umms_player_backend_set_share_multiplex (UmmsPlayerBackend *self, gboolean share);
+const gchar *umms_player_backend_get_share_key (UmmsPlayerBackend *self);
+
+/*
+ * DataCopy target: umms_player_backend_set_target() creates the frame ring
+ * before calling the set_target vmethod. The backend then writes the decoded
+ * frames with umms_player_backend_push_frame(), which fails if no DataCopy
+ * target is set. The ring has its own lock, so the streaming thread never
+ * waits for a transition.
+ *
+ * umms_player_backend_open_frame_ring: a read-only fd of the ring memory and
+ *                                      a dup of its eventfd, for the client.
+ */
+gboolean umms_player_backend_open_frame_ring (UmmsPlayerBackend *self, gint *fd, gint *event_fd, GError **err);
+gboolean umms_player_backend_push_frame (UmmsPlayerBackend *self, const UmmsFrameInfo *info, gconstpointer data);
+
+/*
+ * Timeshift of live streams: umms-server sets where and how large the ring
+ * file may be with umms_player_backend_set_timeshift(), size 0 disables it.
+ * Once the backend knows the stream is live, it calls
+ * umms_player_backend_start_timeshift(), writes the incoming stream into the
+ * ring and plays from it with umms_timeshift_read(), so that Pause and the
+ * seeks within the window (umms_timeshift_seek() from set_position) work on
+ * live content. The gst backend does so, playback rates other than 1 are
+ * refused while timeshifting.
+ *
+ * The ring is dropped on a new uri, on reset and by
+ * umms_player_backend_stop_timeshift(), which the backend calls once it no
+ * longer reads nor writes it. umms_player_backend_get_timeshift() is for the
+ * backend between the two, with the control lock held.
+ */
+void umms_player_backend_set_timeshift (UmmsPlayerBackend *self, const gchar *dir, guint64 size);
+gboolean umms_player_backend_has_timeshift (UmmsPlayerBackend *self);
+gboolean umms_player_backend_start_timeshift (UmmsPlayerBackend *self, GError **err);
+void umms_player_backend_stop_timeshift (UmmsPlayerBackend *self);
+UmmsTimeshift *umms_player_backend_get_timeshift (UmmsPlayerBackend *self);
+//Stream times in ms of the earliest and latest data of the ring.
+gboolean umms_player_backend_get_timeshift_window (UmmsPlayerBackend *self, gint64 *earliest, gint64 *latest, GError **err);
+
+/*
+ * PSI cache: a backend handling the transport stream feeds its packets (or
+ * the sections from its demux) to the cache, then get_pat/get_pmt are
+ * answered from it and the get_pat/get_pmt vmethods are only called until
+ * the tables are received. "psi-changed" is emitted when a table gets a new
+ * version. The cache is cleared on a new uri, the program of get_pmt is the
+ * "program-number" of the uri unless the backend sets another one.
+ */
+UmmsPsiCache *umms_player_backend_get_psi_cache (UmmsPlayerBackend *self);
 gboolean umms_player_backend_is_live_uri (const gchar *uri);
 const gchar * umms_player_backend_state_get_name (PlayerState state);
 
@@ -260,6 +414,8 @@ void umms_player_backend_emit_text_tag_changed (UmmsPlayerBackend *self, gint ch
 void umms_player_backend_emit_metadata_changed (UmmsPlayerBackend *self);
 void umms_player_backend_emit_record_start (UmmsPlayerBackend *self);
 void umms_player_backend_emit_record_stop (UmmsPlayerBackend *self);
+void umms_player_backend_emit_preempted (UmmsPlayerBackend *self, gint type);
+void umms_player_backend_emit_resource_available (UmmsPlayerBackend *self, gint type);
 
 G_END_DECLS
 
@@ -21,6 +21,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlayer
+
 #include <dbus/dbus-glib.h>
 #include "umms-server.h"
 #include "umms-debug.h"
@@ -37,10 +39,33 @@ G_DEFINE_TYPE (UmmsPlayingContentMetadataViewer, umms_playing_content_metadata_v
 
 #define GET_PRIVATE(o) ((UmmsPlayingContentMetadataViewer *)o)->priv
 
+/*
+ * Snapshot of the players, kept up to date by the player signals so that
+ * GetPlayingContentMetadata doesn't need to query the backends.
+ * Only touched from the main loop.
+ */
 struct _UmmsPlayingContentMetadataViewerPrivate {
   UmmsObjectManager *obj_mngr;
+  GQueue     entries;//MetadataEntry, in player creation order
+  GHashTable *entry_table;//UmmsMediaPlayer * ==> MetadataEntry
 };
 
+typedef struct _MetadataEntry {
+  UmmsMediaPlayer *player;//not referenced, entry is dropped on "player-removed"
+  gboolean    playing;//PlayerStatePlaying or PlayerStatePaused
+  gchar       *uri;
+  gchar       *title;
+  gchar       *artist;
+  GList       *link;
+} MetadataEntry;
+
+//Player signal handled on the main loop.
+typedef struct _PlayerUpdate {
+  UmmsPlayingContentMetadataViewer *viewer;
+  UmmsMediaPlayer *player;
+  gint        new_state;//-1 if only the metadata changed
+} PlayerUpdate;
+
 /* props */
 enum {
   PROP_OBJECT_MANAGER = 1
@@ -65,39 +90,174 @@ umms_playing_content_metadata_viewer_get_property (GObject    *object,
   }
 }
 
-static void
-player_state_changed_cb(UmmsMediaPlayer *player, gint old_state, gint new_state, UmmsPlayingContentMetadataViewer *viewer)
+static GType
+get_metadata_type ()
 {
-  GPtrArray *metadata;
+  return dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE);
+}
 
-  if (((old_state <= PlayerStateStopped) && (new_state >= PlayerStateStopped)) || (old_state >= PlayerStatePaused && new_state <= PlayerStateStopped)) {
-    if (umms_playing_content_metadata_viewer_get_playing_content_metadata (viewer, &metadata, NULL)) {
-      g_signal_emit (viewer, signals[SIGNAL_METADATA_UPDATED], 0, metadata);
-    } else {
-      UMMS_DEBUG ("getting playing content matadata failed");
-    }
-  }
+static GType
+get_metadata_array_type ()
+{
+  return dbus_g_type_get_collection ("GPtrArray", get_metadata_type ());
 }
 
 static void
-player_metadata_changed_cb(UmmsMediaPlayer *player, UmmsPlayingContentMetadataViewer *viewer)
+emit_metadata_updated (UmmsPlayingContentMetadataViewer *viewer)
 {
   GPtrArray *metadata;
 
   if (umms_playing_content_metadata_viewer_get_playing_content_metadata (viewer, &metadata, NULL)) {
     g_signal_emit (viewer, signals[SIGNAL_METADATA_UPDATED], 0, metadata);
+    g_boxed_free (get_metadata_array_type (), metadata);
   } else {
     UMMS_DEBUG ("getting playing content matadata failed");
   }
 }
 
+static void
+metadata_entry_free (gpointer data)
+{
+  MetadataEntry *entry = (MetadataEntry *)data;
+
+  g_free (entry->uri);
+  g_free (entry->title);
+  g_free (entry->artist);
+  g_free (entry);
+}
+
+//Returns TRUE if any of the tags changed.
+static gboolean
+metadata_entry_refresh_tags (MetadataEntry *entry)
+{
+  gchar *uri = NULL;
+  gchar *title = NULL;
+  gchar *artist = NULL;
+  gboolean changed;
+
+  umms_media_player_get_current_uri (entry->player, &uri, NULL);
+  umms_media_player_get_title (entry->player, &title, NULL);
+  umms_media_player_get_artist (entry->player, &artist, NULL);
+
+  changed = g_strcmp0 (uri, entry->uri) || g_strcmp0 (title, entry->title) || g_strcmp0 (artist, entry->artist);
+
+  g_free (entry->uri);
+  g_free (entry->title);
+  g_free (entry->artist);
+  entry->uri = uri;
+  entry->title = title;
+  entry->artist = artist;
+
+  return changed;
+}
+
+static gboolean
+player_update_run (gpointer data)
+{
+  PlayerUpdate *update = (PlayerUpdate *)data;
+  UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (update->viewer);
+  MetadataEntry *entry;
+  gboolean playing;
+  gboolean changed = FALSE;
+
+  //The player may have been removed meanwhile.
+  if (!(entry = g_hash_table_lookup (priv->entry_table, update->player)))
+    return FALSE;
+
+  if (update->new_state >= 0) {
+    playing = (update->new_state == PlayerStatePlaying || update->new_state == PlayerStatePaused);
+    if (playing != entry->playing) {
+      entry->playing = playing;
+      changed = TRUE;
+      if (playing)
+        metadata_entry_refresh_tags (entry);
+    }
+  } else if (entry->playing) {
+    changed = metadata_entry_refresh_tags (entry);
+  }
+
+  if (changed)
+    emit_metadata_updated (update->viewer);
+
+  return FALSE;
+}
+
+static void
+player_update_free (gpointer data)
+{
+  PlayerUpdate *update = (PlayerUpdate *)data;
+
+  g_object_unref (update->player);
+  g_object_unref (update->viewer);
+  g_free (update);
+}
+
+/*
+ * Player signals may be emitted from the worker thread of the player, the
+ * snapshot belongs to the main loop, so update it there.
+ */
+static void
+queue_player_update (UmmsPlayingContentMetadataViewer *viewer, UmmsMediaPlayer *player, gint new_state)
+{
+  PlayerUpdate *update = g_new0 (PlayerUpdate, 1);
+
+  update->viewer = g_object_ref (viewer);
+  update->player = g_object_ref (player);
+  update->new_state = new_state;
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, player_update_run, update, player_update_free);
+}
+
+static void
+player_state_changed_cb(UmmsMediaPlayer *player, gint old_state, gint new_state, UmmsPlayingContentMetadataViewer *viewer)
+{
+  queue_player_update (viewer, player, new_state);
+}
+
+static void
+player_metadata_changed_cb(UmmsMediaPlayer *player, UmmsPlayingContentMetadataViewer *viewer)
+{
+  queue_player_update (viewer, player, -1);
+}
+
 static void
 player_added_cb(UmmsObjectManager *obj_mngr, UmmsMediaPlayer *player, UmmsPlayingContentMetadataViewer *viewer)
 {
+  UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (viewer);
+  MetadataEntry *entry;
+
+  if (g_hash_table_lookup (priv->entry_table, player))
+    return;
+
+  entry = g_new0 (MetadataEntry, 1);
+  entry->player = player;
+  g_queue_push_tail (&priv->entries, entry);
+  entry->link = priv->entries.tail;
+  g_hash_table_insert (priv->entry_table, player, entry);
+
   g_signal_connect (player, "player-state-changed", G_CALLBACK(player_state_changed_cb), viewer);
   g_signal_connect (player, "metadata-changed", G_CALLBACK(player_metadata_changed_cb), viewer);
 }
 
+static void
+player_removed_cb(UmmsObjectManager *obj_mngr, UmmsMediaPlayer *player, UmmsPlayingContentMetadataViewer *viewer)
+{
+  UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (viewer);
+  MetadataEntry *entry;
+  gboolean playing;
+
+  if (!(entry = g_hash_table_lookup (priv->entry_table, player)))
+    return;
+
+  g_signal_handlers_disconnect_matched (player, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, viewer);
+
+  playing = entry->playing;
+  g_queue_delete_link (&priv->entries, entry->link);
+  g_hash_table_remove (priv->entry_table, player);
+
+  if (playing)
+    emit_metadata_updated (viewer);
+}
+
 static void
 umms_playing_content_metadata_viewer_set_property (GObject      *object,
     guint         property_id,
@@ -108,9 +268,14 @@ umms_playing_content_metadata_viewer_set_property (GObject      *object,
 
   switch (property_id) {
   case PROP_OBJECT_MANAGER: {
+    GList *g;
+
     priv->obj_mngr = g_value_get_object (value);
     g_object_ref (priv->obj_mngr);
     g_signal_connect (priv->obj_mngr, "player-added", G_CALLBACK(player_added_cb), object);
+    g_signal_connect (priv->obj_mngr, "player-removed", G_CALLBACK(player_removed_cb), object);
+    for (g = umms_object_manager_get_player_list (priv->obj_mngr); g; g = g->next)
+      player_added_cb (priv->obj_mngr, UMMS_MEDIA_PLAYER (g->data), UMMS_PLAYING_CONTENT_METADATA_VIEWER (object));
     break;
   }
   default:
@@ -123,8 +288,11 @@ umms_playing_content_metadata_viewer_dispose (GObject *object)
 {
   UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (object);
 
-  if (priv->obj_mngr)
+  if (priv->obj_mngr) {
+    g_signal_handlers_disconnect_matched (priv->obj_mngr, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, object);
     g_object_unref (priv->obj_mngr);
+    priv->obj_mngr = NULL;
+  }
 
   G_OBJECT_CLASS (umms_playing_content_metadata_viewer_parent_class)->dispose (object);
 }
@@ -132,13 +300,12 @@ umms_playing_content_metadata_viewer_dispose (GObject *object)
 static void
 umms_playing_content_metadata_viewer_finalize (GObject *object)
 {
-  G_OBJECT_CLASS (umms_playing_content_metadata_viewer_parent_class)->finalize (object);
-}
+  UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (object);
 
-static GType
-get_metadata_type ()
-{
-  return dbus_g_type_get_map ("GHashTable", G_TYPE_STRING, G_TYPE_VALUE);
+  g_queue_clear (&priv->entries);
+  g_hash_table_destroy (priv->entry_table);
+
+  G_OBJECT_CLASS (umms_playing_content_metadata_viewer_parent_class)->finalize (object);
 }
 
 static void
@@ -166,7 +333,7 @@ umms_playing_content_metadata_viewer_class_init (UmmsPlayingContentMetadataViewe
                   NULL, NULL,
                   g_cclosure_marshal_VOID__BOXED,
                   G_TYPE_NONE,
-                  1, dbus_g_type_get_collection("GPtrArray", get_metadata_type()));
+                  1, get_metadata_array_type ());
 }
 
 static void
@@ -176,6 +343,8 @@ umms_playing_content_metadata_viewer_init (UmmsPlayingContentMetadataViewer *sel
 
   self->priv = PLAYER_PRIVATE (self);
   priv = self->priv;
+  g_queue_init (&priv->entries);
+  priv->entry_table = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, metadata_entry_free);
 }
 
 UmmsPlayingContentMetadataViewer *
@@ -184,17 +353,31 @@ umms_playing_content_metadata_viewer_new (UmmsObjectManager *obj_mngr)
   return g_object_new (UMMS_TYPE_PLAYING_CONTENT_METADATA_VIEWER, "umms-object-manager", obj_mngr, NULL);
 }
 
+static void
+tag_value_free (gpointer data)
+{
+  GValue *val = (GValue *)data;
+
+  g_value_unset (val);
+  g_free (val);
+}
+
+static void
+insert_tag (GHashTable *ht, const gchar *name, const gchar *tag)
+{
+  GValue *val = g_new0 (GValue, 1);
+
+  g_value_init (val, G_TYPE_STRING);
+  g_value_set_string (val, tag);
+  g_hash_table_insert (ht, (gpointer)name, val);
+}
+
 gboolean
 umms_playing_content_metadata_viewer_get_playing_content_metadata (UmmsPlayingContentMetadataViewer *self, GPtrArray **metadata, GError **err)
 {
   GHashTable *ht;
-  GValue *val;
-  gint i, state;
-  GList *players, *item;
-  UmmsMediaPlayer *player;
-  gchar *uri = NULL;
-  gchar *title = NULL;
-  gchar *artist = NULL;
+  GList *g;
+  MetadataEntry *entry;
   UmmsPlayingContentMetadataViewerPrivate *priv = GET_PRIVATE (self);
 
   *metadata = g_ptr_array_new ();
@@ -205,45 +388,17 @@ umms_playing_content_metadata_viewer_get_playing_content_metadata (UmmsPlayingCo
     return FALSE;
   }
 
-  players = umms_object_manager_get_player_list (priv->obj_mngr);
-  for (i = 0; i < g_list_length(players); i++) {
-
-    item = g_list_nth (players, i);
-    player = UMMS_MEDIA_PLAYER (item->data);
-    umms_media_player_get_player_state (player,  &state, NULL);
-
-    if (state == PlayerStatePlaying || state == PlayerStatePaused) {
-      /*
-       * 1. get tags of URI, Title, Artist.
-       * 2. Fill the metadata.
-       */
-      umms_media_player_get_current_uri (player, &uri, NULL);
-      umms_media_player_get_title (player, &title, NULL);
-      umms_media_player_get_artist (player, &artist, NULL);
-
-      ht = g_hash_table_new (NULL, NULL);
-
-      val = g_new0(GValue, 1);
-      g_value_init (val, G_TYPE_STRING);
-      g_value_set_string (val, uri);
-      g_hash_table_insert (ht, "URI", val);
+  for (g = priv->entries.head; g; g = g->next) {
+    entry = (MetadataEntry *)g->data;
+    if (!entry->playing)
+      continue;
 
-      val = g_new0(GValue, 1);
-      g_value_init (val, G_TYPE_STRING);
-      g_value_set_string (val, title);
-      g_hash_table_insert (ht, "Title", val);
-
-      val = g_new0(GValue, 1);
-      g_value_init (val, G_TYPE_STRING);
-      g_value_set_string (val, artist);
-      g_hash_table_insert (ht, "Artist", val);
-
-      g_ptr_array_add (*metadata, ht);
-    }
+    ht = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, tag_value_free);
+    insert_tag (ht, "URI", entry->uri);
+    insert_tag (ht, "Title", entry->title);
+    insert_tag (ht, "Artist", entry->artist);
+    g_ptr_array_add (*metadata, ht);
   }
 
   return TRUE;
 }
-
-
-
@@ -1,3 +1,5 @@
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlugin
+
 #include <glib.h>
 #include "umms-plugin.h"
 #include "umms-debug.h"
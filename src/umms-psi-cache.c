@@ -0,0 +1,616 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <glib-object.h>
+#include "umms-debug.h"
+#include "umms-psi-cache.h"
+
+#define TS_PACKET_SIZE   188
+#define TS_PID_NUM       8192
+#define TS_PID_PAT       0x0000
+#define SECTION_MAX      1024 //PAT and PMT sections are at most 1024 bytes
+#define SECTION_HDR_LEN  8 //table_id to last_section_number
+#define CRC_LEN          4
+#define MAX_CHANGES      (TS_PACKET_SIZE / (SECTION_HDR_LEN + CRC_LEN) + 1)
+
+typedef struct {
+  guint16 program_num;
+  guint16 pid;
+} PatEntry;
+
+typedef struct {
+  guint16 pid;
+  guint8  stream_type;
+} PmtStream;
+
+typedef struct {
+  gint       version;//of programs, -1 until all the sections were received
+  GArray     *programs;//PatEntry
+  //Sections of the version being received, which may be the current one.
+  gint       section_version;
+  guint      last_section;
+  GByteArray *sections[256];
+} Pat;
+
+typedef struct {
+  gint       version;
+  guint16    pcr_pid;
+  GArray     *streams;//PmtStream
+  GByteArray *raw;
+} Pmt;
+
+//Section being assembled from the packets of a PID.
+typedef struct {
+  GByteArray *buf;//empty until the start of a section was seen
+  gint       cc;
+} Assembler;
+
+typedef struct {
+  guint table_id;
+  guint program_num;
+  guint version;
+} Change;
+
+struct _UmmsPsiCache {
+  GMutex     *lock;
+  UmmsPsiCacheChangedFunc changed;
+  gpointer   user_data;
+  guint32    psi_pids[TS_PID_NUM / 32];//PIDs having an assembler
+  GHashTable *assemblers;//PID -> Assembler
+  Pat        pat;
+  GHashTable *pmts;//program_number -> Pmt
+  guint      program_num;
+  guint64    sections;
+  guint64    parsed;
+  guint64    crc_errors;
+  //Changes found by the current push, reported once the lock is released.
+  Change     changes[MAX_CHANGES];
+  guint      n_changes;
+};
+
+static guint32 crc_table[8][256];
+
+/*
+ * Slicing by 8: crc_table[k][i] is the CRC of byte i followed by k zero
+ * bytes, so that 8 bytes are folded with 8 independent lookups instead of a
+ * chain of 8 dependent ones.
+ */
+static void
+crc_table_init (void)
+{
+  static gsize done = 0;
+  guint32 c;
+  gint i, j;
+
+  if (g_once_init_enter (&done)) {
+    for (i = 0; i < 256; i++) {
+      c = (guint32)i << 24;
+      for (j = 0; j < 8; j++)
+        c = (c & 0x80000000) ? (c << 1) ^ 0x04C11DB7 : c << 1;
+      crc_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i++)
+      for (j = 1; j < 8; j++)
+        crc_table[j][i] = (crc_table[j - 1][i] << 8) ^ crc_table[0][crc_table[j - 1][i] >> 24];
+    g_once_init_leave (&done, 1);
+  }
+}
+
+guint32
+umms_psi_crc32 (const guint8 *data, gsize len)
+{
+  guint32 c = 0xFFFFFFFF;
+  guint32 a, b;
+
+  crc_table_init ();
+
+  for (; len >= 8; data += 8, len -= 8) {
+    a = c ^ ((guint32)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]);
+    b = (guint32)data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+    c = crc_table[7][a >> 24] ^ crc_table[6][(a >> 16) & 0xFF] ^ crc_table[5][(a >> 8) & 0xFF] ^ crc_table[4][a & 0xFF]
+        ^ crc_table[3][b >> 24] ^ crc_table[2][(b >> 16) & 0xFF] ^ crc_table[1][(b >> 8) & 0xFF] ^ crc_table[0][b & 0xFF];
+  }
+  while (len--)
+    c = (c << 8) ^ crc_table[0][((c >> 24) ^ *data++) & 0xFF];
+
+  return c;
+}
+
+static void
+assembler_free (Assembler *as)
+{
+  g_byte_array_free (as->buf, TRUE);
+  g_free (as);
+}
+
+static void
+pmt_free (Pmt *pmt)
+{
+  g_array_free (pmt->streams, TRUE);
+  g_byte_array_free (pmt->raw, TRUE);
+  g_free (pmt);
+}
+
+static void
+psi_pid_add (UmmsPsiCache *cache, guint pid)
+{
+  Assembler *as;
+
+  if (g_hash_table_lookup (cache->assemblers, GUINT_TO_POINTER (pid)))
+    return;
+
+  as = g_new0 (Assembler, 1);
+  as->buf = g_byte_array_sized_new (SECTION_MAX);
+  as->cc = -1;
+  g_hash_table_insert (cache->assemblers, GUINT_TO_POINTER (pid), as);
+  cache->psi_pids[pid / 32] |= 1u << (pid % 32);
+}
+
+UmmsPsiCache *
+umms_psi_cache_new (UmmsPsiCacheChangedFunc changed, gpointer user_data)
+{
+  UmmsPsiCache *cache = g_new0 (UmmsPsiCache, 1);
+
+  crc_table_init ();
+  cache->lock = g_mutex_new ();
+  cache->changed = changed;
+  cache->user_data = user_data;
+  cache->assemblers = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)assembler_free);
+  cache->pmts = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)pmt_free);
+  cache->pat.programs = g_array_new (FALSE, FALSE, sizeof (PatEntry));
+  cache->pat.version = -1;
+  cache->pat.section_version = -1;
+  psi_pid_add (cache, TS_PID_PAT);
+
+  return cache;
+}
+
+static void
+pat_clear_sections (Pat *pat)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (pat->sections); i++) {
+    if (pat->sections[i]) {
+      g_byte_array_free (pat->sections[i], TRUE);
+      pat->sections[i] = NULL;
+    }
+  }
+}
+
+void
+umms_psi_cache_free (UmmsPsiCache *cache)
+{
+  if (!cache)
+    return;
+
+  pat_clear_sections (&cache->pat);
+  g_array_free (cache->pat.programs, TRUE);
+  g_hash_table_destroy (cache->pmts);
+  g_hash_table_destroy (cache->assemblers);
+  g_mutex_free (cache->lock);
+  g_free (cache);
+}
+
+void
+umms_psi_cache_reset (UmmsPsiCache *cache)
+{
+  g_return_if_fail (cache);
+
+  g_mutex_lock (cache->lock);
+  pat_clear_sections (&cache->pat);
+  g_array_set_size (cache->pat.programs, 0);
+  cache->pat.version = -1;
+  cache->pat.section_version = -1;
+  g_hash_table_remove_all (cache->pmts);
+  g_hash_table_remove_all (cache->assemblers);
+  memset (cache->psi_pids, 0, sizeof (cache->psi_pids));
+  psi_pid_add (cache, TS_PID_PAT);
+  g_mutex_unlock (cache->lock);
+}
+
+static void
+change_add (UmmsPsiCache *cache, guint table_id, guint program_num, guint version)
+{
+  Change *change;
+
+  if (cache->n_changes == MAX_CHANGES)
+    return;
+
+  change = &cache->changes[cache->n_changes++];
+  change->table_id = table_id;
+  change->program_num = program_num;
+  change->version = version;
+  UMMS_DEBUG ("table 0x%02x of program %u is now version %u", table_id, program_num, version);
+}
+
+//Called with the lock held, release it and report the changes.
+static void
+unlock_and_notify (UmmsPsiCache *cache)
+{
+  Change changes[MAX_CHANGES];
+  guint n = cache->n_changes;
+  guint i;
+
+  memcpy (changes, cache->changes, n * sizeof (Change));
+  cache->n_changes = 0;
+  g_mutex_unlock (cache->lock);
+
+  for (i = 0; cache->changed && i < n; i++)
+    cache->changed (cache, changes[i].table_id, changes[i].program_num, changes[i].version, cache->user_data);
+}
+
+static inline gboolean
+raw_equal (GByteArray *raw, const guint8 *section, gsize len)
+{
+  return raw && raw->len == len && !memcmp (raw->data, section, len);
+}
+
+//Rebuild the program list once all the sections of a version are there.
+static void
+pat_update (UmmsPsiCache *cache)
+{
+  Pat *pat = &cache->pat;
+  GByteArray *s;
+  PatEntry entry;
+  guint i, pos;
+
+  for (i = 0; i <= pat->last_section; i++)
+    if (!pat->sections[i])
+      return;
+
+  g_array_set_size (pat->programs, 0);
+  for (i = 0; i <= pat->last_section; i++) {
+    s = pat->sections[i];
+    for (pos = SECTION_HDR_LEN; pos + 4 <= s->len - CRC_LEN; pos += 4) {
+      entry.program_num = s->data[pos] << 8 | s->data[pos + 1];
+      entry.pid = (s->data[pos + 2] & 0x1F) << 8 | s->data[pos + 3];
+      //program_number 0 is the network PID.
+      if (entry.program_num) {
+        g_array_append_val (pat->programs, entry);
+        psi_pid_add (cache, entry.pid);
+      }
+    }
+  }
+
+  if (pat->version != pat->section_version) {
+    pat->version = pat->section_version;
+    change_add (cache, UMMS_PSI_TABLE_PAT, 0, pat->version);
+  }
+}
+
+static void
+pat_section (UmmsPsiCache *cache, const guint8 *s, gsize len)
+{
+  Pat *pat = &cache->pat;
+  gint version = (s[5] >> 1) & 0x1F;
+  guint section_num = s[6];
+  guint last_section = s[7];
+
+  if (section_num > last_section)
+    return;
+
+  //Start over on a new version.
+  if (version != pat->section_version || last_section != pat->last_section) {
+    pat_clear_sections (pat);
+    pat->section_version = version;
+    pat->last_section = last_section;
+  }
+
+  if (pat->sections[section_num])
+    g_byte_array_set_size (pat->sections[section_num], 0);
+  else
+    pat->sections[section_num] = g_byte_array_sized_new (len);
+  g_byte_array_append (pat->sections[section_num], s, len);
+
+  pat_update (cache);
+}
+
+static void
+pmt_section (UmmsPsiCache *cache, const guint8 *s, gsize len)
+{
+  guint program_num = s[3] << 8 | s[4];
+  gint version = (s[5] >> 1) & 0x1F;
+  guint pos, end = len - CRC_LEN;
+  PmtStream stream;
+  Pmt *pmt;
+
+  if (len < SECTION_HDR_LEN + 4 + CRC_LEN || s[6] != 0 || s[7] != 0)
+    return;
+
+  if (!(pmt = g_hash_table_lookup (cache->pmts, GUINT_TO_POINTER (program_num)))) {
+    pmt = g_new0 (Pmt, 1);
+    pmt->version = -1;
+    pmt->streams = g_array_new (FALSE, FALSE, sizeof (PmtStream));
+    pmt->raw = g_byte_array_sized_new (len);
+    g_hash_table_insert (cache->pmts, GUINT_TO_POINTER (program_num), pmt);
+  }
+
+  g_array_set_size (pmt->streams, 0);
+  pmt->pcr_pid = (s[8] & 0x1F) << 8 | s[9];
+  //Skip the program_info descriptors, then one entry per stream.
+  pos = SECTION_HDR_LEN + 4 + ((s[10] & 0x0F) << 8 | s[11]);
+  while (pos + 5 <= end) {
+    stream.stream_type = s[pos];
+    stream.pid = (s[pos + 1] & 0x1F) << 8 | s[pos + 2];
+    g_array_append_val (pmt->streams, stream);
+    pos += 5 + ((s[pos + 3] & 0x0F) << 8 | s[pos + 4]);
+  }
+
+  g_byte_array_set_size (pmt->raw, 0);
+  g_byte_array_append (pmt->raw, s, len);
+  if (pmt->version != version) {
+    pmt->version = version;
+    change_add (cache, UMMS_PSI_TABLE_PMT, program_num, version);
+  }
+}
+
+//Called with the lock held.
+static gboolean
+section_locked (UmmsPsiCache *cache, const guint8 *s, gsize len)
+{
+  Pmt *pmt;
+
+  cache->sections++;
+  if (len < SECTION_HDR_LEN + CRC_LEN || len != 3 + ((s[1] & 0x0F) << 8 | s[2]) || !(s[1] & 0x80))
+    return FALSE;
+
+  //The table repeats every few hundred ms, unchanged most of the time.
+  switch (s[0]) {
+    case UMMS_PSI_TABLE_PAT:
+      if (raw_equal (cache->pat.sections[s[6]], s, len))
+        return TRUE;
+      break;
+    case UMMS_PSI_TABLE_PMT:
+      pmt = g_hash_table_lookup (cache->pmts, GUINT_TO_POINTER (s[3] << 8 | s[4]));
+      if (pmt && raw_equal (pmt->raw, s, len))
+        return TRUE;
+      break;
+    default:
+      return TRUE;
+  }
+
+  cache->parsed++;
+  if (umms_psi_crc32 (s, len) != 0) {
+    cache->crc_errors++;
+    return FALSE;
+  }
+  //Not applicable yet.
+  if (!(s[5] & 0x01))
+    return TRUE;
+
+  if (s[0] == UMMS_PSI_TABLE_PAT)
+    pat_section (cache, s, len);
+  else
+    pmt_section (cache, s, len);
+
+  return TRUE;
+}
+
+gboolean
+umms_psi_cache_push_section (UmmsPsiCache *cache, const guint8 *section, gsize len)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (cache && section, FALSE);
+
+  g_mutex_lock (cache->lock);
+  ret = section_locked (cache, section, len);
+  unlock_and_notify (cache);
+
+  return ret;
+}
+
+//Push the complete sections at the start of the buffer, keep the partial one.
+static void
+assembler_drain (UmmsPsiCache *cache, Assembler *as)
+{
+  GByteArray *buf = as->buf;
+  guint len;
+
+  while (buf->len >= 3) {
+    //Stuffing up to the end of the packet.
+    if (buf->data[0] == 0xFF) {
+      g_byte_array_set_size (buf, 0);
+      return;
+    }
+    len = 3 + ((buf->data[1] & 0x0F) << 8 | buf->data[2]);
+    if (len > SECTION_MAX + 3) {
+      g_byte_array_set_size (buf, 0);
+      return;
+    }
+    if (buf->len < len)
+      return;
+    section_locked (cache, buf->data, len);
+    g_byte_array_remove_range (buf, 0, len);
+  }
+}
+
+void
+umms_psi_cache_push_packet (UmmsPsiCache *cache, const guint8 *pkt)
+{
+  guint pid = (pkt[1] & 0x1F) << 8 | pkt[2];
+  guint afc = (pkt[3] >> 4) & 0x3;
+  gint cc = pkt[3] & 0x0F;
+  Assembler *as;
+  guint pos, pointer;
+
+  g_return_if_fail (cache && pkt);
+
+  //Lockless check, a bit being set or cleared meanwhile only costs one packet of the table.
+  if (!((cache->psi_pids[pid / 32] >> (pid % 32)) & 1))
+    return;
+  //Corrupted, or without payload.
+  if (pkt[0] != 0x47 || (pkt[1] & 0x80) || !(afc & 0x1))
+    return;
+
+  g_mutex_lock (cache->lock);
+  if (!(as = g_hash_table_lookup (cache->assemblers, GUINT_TO_POINTER (pid)))) {
+    g_mutex_unlock (cache->lock);
+    return;
+  }
+
+  pos = 4 + ((afc & 0x2) ? 1 + pkt[4] : 0);
+  //A lost packet leaves a hole in the section being assembled.
+  if (as->cc >= 0 && cc != ((as->cc + 1) & 0x0F))
+    g_byte_array_set_size (as->buf, 0);
+  as->cc = cc;
+
+  if (pos >= TS_PACKET_SIZE) {
+    unlock_and_notify (cache);
+    return;
+  }
+
+  if (pkt[1] & 0x40) {
+    //payload_unit_start_indicator: pointer_field, then the end of the previous section.
+    pointer = pkt[pos++];
+    if (pos + pointer > TS_PACKET_SIZE) {
+      g_byte_array_set_size (as->buf, 0);
+      unlock_and_notify (cache);
+      return;
+    }
+    if (as->buf->len) {
+      g_byte_array_append (as->buf, pkt + pos, pointer);
+      assembler_drain (cache, as);
+      g_byte_array_set_size (as->buf, 0);
+    }
+    pos += pointer;
+    g_byte_array_append (as->buf, pkt + pos, TS_PACKET_SIZE - pos);
+    assembler_drain (cache, as);
+  } else if (as->buf->len) {
+    g_byte_array_append (as->buf, pkt + pos, TS_PACKET_SIZE - pos);
+    assembler_drain (cache, as);
+  }
+
+  unlock_and_notify (cache);
+}
+
+void
+umms_psi_cache_set_program (UmmsPsiCache *cache, guint program_num)
+{
+  g_return_if_fail (cache);
+
+  g_mutex_lock (cache->lock);
+  cache->program_num = program_num;
+  g_mutex_unlock (cache->lock);
+}
+
+static void
+value_free (GValue *val)
+{
+  g_value_unset (val);
+  g_free (val);
+}
+
+static void
+entry_set_uint (GHashTable *entry, const gchar *key, guint v)
+{
+  GValue *val = g_new0 (GValue, 1);
+
+  g_value_init (val, G_TYPE_UINT);
+  g_value_set_uint (val, v);
+  g_hash_table_insert (entry, g_strdup (key), val);
+}
+
+static GHashTable *
+entry_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)value_free);
+}
+
+gboolean
+umms_psi_cache_get_pat (UmmsPsiCache *cache, GPtrArray **pat)
+{
+  PatEntry *entry;
+  GHashTable *item;
+  guint i;
+
+  g_return_val_if_fail (cache && pat, FALSE);
+
+  g_mutex_lock (cache->lock);
+  if (cache->pat.version < 0) {
+    g_mutex_unlock (cache->lock);
+    return FALSE;
+  }
+
+  *pat = g_ptr_array_sized_new (cache->pat.programs->len);
+  for (i = 0; i < cache->pat.programs->len; i++) {
+    entry = &g_array_index (cache->pat.programs, PatEntry, i);
+    item = entry_new ();
+    entry_set_uint (item, "program-number", entry->program_num);
+    entry_set_uint (item, "pid", entry->pid);
+    g_ptr_array_add (*pat, item);
+  }
+  g_mutex_unlock (cache->lock);
+
+  return TRUE;
+}
+
+gboolean
+umms_psi_cache_get_pmt (UmmsPsiCache *cache, guint *program_num, guint *pcr_pid, GPtrArray **stream_info)
+{
+  PmtStream *stream;
+  GHashTable *item;
+  guint program;
+  Pmt *pmt;
+  guint i;
+
+  g_return_val_if_fail (cache && program_num && pcr_pid && stream_info, FALSE);
+
+  g_mutex_lock (cache->lock);
+  program = *program_num ? *program_num : cache->program_num;
+  if (!program || !(pmt = g_hash_table_lookup (cache->pmts, GUINT_TO_POINTER (program)))) {
+    g_mutex_unlock (cache->lock);
+    return FALSE;
+  }
+
+  *program_num = program;
+  *pcr_pid = pmt->pcr_pid;
+  *stream_info = g_ptr_array_sized_new (pmt->streams->len);
+  for (i = 0; i < pmt->streams->len; i++) {
+    stream = &g_array_index (pmt->streams, PmtStream, i);
+    item = entry_new ();
+    entry_set_uint (item, "pid", stream->pid);
+    entry_set_uint (item, "stream-type", stream->stream_type);
+    g_ptr_array_add (*stream_info, item);
+  }
+  g_mutex_unlock (cache->lock);
+
+  return TRUE;
+}
+
+void
+umms_psi_cache_get_stats (UmmsPsiCache *cache, guint64 *sections, guint64 *parsed, guint64 *crc_errors)
+{
+  g_return_if_fail (cache);
+
+  g_mutex_lock (cache->lock);
+  if (sections)
+    *sections = cache->sections;
+  if (parsed)
+    *parsed = cache->parsed;
+  if (crc_errors)
+    *crc_errors = cache->crc_errors;
+  g_mutex_unlock (cache->lock);
+}
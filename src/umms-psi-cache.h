@@ -0,0 +1,99 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_PSI_CACHE_H
+#define _UMMS_PSI_CACHE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Cache of the PSI tables (PAT and PMTs) of a transport stream, from which
+ * GetPat/GetPmt are answered without asking the backend.
+ *
+ * The backend feeds either the TS packets, the sections are then assembled
+ * on PID 0 and on the PMT PIDs listed by the PAT, or whole sections it got
+ * from its demux. A section identical to the cached one is dropped by a
+ * memcmp, others are checked with the CRC32 and parsed. The changed callback
+ * is called when the version_number of a table changes, not on each
+ * repetition of the table in the stream.
+ *
+ * Thread safe: fed from the streaming thread, read from the main loop. The
+ * callback is called from the feeding thread, without the lock held.
+ */
+
+#define UMMS_PSI_TABLE_PAT 0x00
+#define UMMS_PSI_TABLE_PMT 0x02
+
+typedef struct _UmmsPsiCache UmmsPsiCache;
+
+/*
+ * table_id:        UMMS_PSI_TABLE_PAT or UMMS_PSI_TABLE_PMT.
+ * program_num:     Of the PMT, 0 for the PAT.
+ * version:         New version_number of the table.
+ */
+typedef void (*UmmsPsiCacheChangedFunc) (UmmsPsiCache *cache, guint table_id, guint program_num, guint version,
+                                         gpointer user_data);
+
+//MPEG-2 CRC32 (polynomial 0x04C11DB7, MSB first), 0 over a section including its CRC_32 field if intact.
+guint32 umms_psi_crc32 (const guint8 *data, gsize len);
+
+UmmsPsiCache *umms_psi_cache_new (UmmsPsiCacheChangedFunc changed, gpointer user_data);
+void umms_psi_cache_free (UmmsPsiCache *cache);
+//Forget the tables, e.g. when tuning to another multiplex.
+void umms_psi_cache_reset (UmmsPsiCache *cache);
+
+//Feed one 188 byte TS packet, any PID.
+void umms_psi_cache_push_packet (UmmsPsiCache *cache, const guint8 *packet);
+//Feed a whole section, from its table_id to its CRC_32. Returns FALSE if it is corrupted.
+gboolean umms_psi_cache_push_section (UmmsPsiCache *cache, const guint8 *section, gsize len);
+
+//Program of the PMT returned by umms_psi_cache_get_pmt() when program_num is 0.
+void umms_psi_cache_set_program (UmmsPsiCache *cache, guint program_num);
+
+/*
+ * Same format as the get_pat vmethod, a GHashTable with "program-number"
+ * and "pid" per program. FALSE if the PAT wasn't received yet.
+ */
+gboolean umms_psi_cache_get_pat (UmmsPsiCache *cache, GPtrArray **pat);
+
+/*
+ * Same format as the get_pmt vmethod, a GHashTable with "pid" and
+ * "stream-type" per stream. FALSE if the PMT wasn't received yet.
+ *
+ * program_num:     In: program wanted, 0 for the one set by
+ *                  umms_psi_cache_set_program(). Out: the program returned.
+ */
+gboolean umms_psi_cache_get_pmt (UmmsPsiCache *cache, guint *program_num, guint *pcr_pid, GPtrArray **stream_info);
+
+/*
+ * sections:        Sections fed, whole or assembled from packets.
+ * parsed:          Sections which had to be checked and parsed.
+ * crc_errors:      Sections dropped for a bad CRC32.
+ */
+void umms_psi_cache_get_stats (UmmsPsiCache *cache, guint64 *sections, guint64 *parsed, guint64 *crc_errors);
+
+G_END_DECLS
+
+#endif /* _UMMS_PSI_CACHE_H */
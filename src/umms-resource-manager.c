@@ -21,10 +21,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define UMMS_LOG_CATEGORY UmmsLogCategoryResource
+
+#include <string.h>
+#include <stdlib.h>
 #include "umms-server.h"
 #include "umms-debug.h"
 #include "umms-types.h"
 #include "umms-resource-manager.h"
+#include "umms-metrics.h"
 
 G_DEFINE_TYPE (UmmsResourceManager, umms_resource_manager, G_TYPE_OBJECT)
 #define MANAGER_PRIVATE(o) \
@@ -32,11 +37,57 @@ G_DEFINE_TYPE (UmmsResourceManager, umms_resource_manager, G_TYPE_OBJECT)
 
 #define GET_PRIVATE(o) ((UmmsResourceManager *)o)->priv
 
+/*
+ * Owner of a claimed slot, or an owner waiting for the type to be available again.
+ * owner is swapped atomically: the claimer publishes it last, and whichever of
+ * the release and a preemption swaps it out first decides who frees the slot.
+ */
+typedef struct _ResourceHolder {
+  volatile gpointer owner;
+  gint     priority;
+  ResourcePreemptFunc   preempt;
+  ResourceAvailableFunc available;
+  gchar    *share_key;//NULL if held exclusively
+  volatile gint shares;//requests holding the shared slot
+  GSList   *sharers;//owner of each of those requests, owner is one of them
+  GThread  *thread;//of the claim, which likely runs the release too
+} ResourceHolder;
+
+/*
+ * Resources of one type. Slots are claimed and released with atomic operations
+ * on the free bitmap (bit set means free), so no lock is needed to find a slot.
+ * id_index maps resource id to slot + 1, read only after init.
+ *
+ * lock protects the arbitration state of this type only: the shared slots,
+ * the preemptions and the owners waiting for availability. It is only taken
+ * when the type is exhausted, shared or missed by someone.
+ */
+typedef struct _ResourcePool {
+  guint        limit;
+  Resource     *slots;
+  volatile gint *free_map;
+  guint        n_words;
+  GHashTable   *id_index;
+
+  GMutex       *lock;
+  GCond        *cond;//signaled on release while waiters
+  volatile gint waiters;
+  ResourceHolder *holders;
+  GList        *pending;//ResourceHolder, highest priority first
+
+  //Metric ids, see umms-metrics.h.
+  gint         m_requests;
+  gint         m_contended;//no free slot at first try
+  gint         m_preempted;
+  gint         m_failed;
+  gint         m_wait;//histogram of the slow path
+} ResourcePool;
+
+#define BITS_PER_WORD 32
+
 struct _UmmsResourceManagerPrivate {
-  GMutex *lock;
   guint type_num;
-  Resource **res_collection;
-  guint *limit;
+  ResourcePool *pools;
 };
 
 static void
@@ -66,16 +117,44 @@ umms_resource_manager_set_property (GObject      *object,
 static void
 umms_resource_manager_dispose (GObject *object)
 {
-  UmmsResourceManagerPrivate *priv = GET_PRIVATE (object);
-
-  g_mutex_free(priv->lock);
-
   G_OBJECT_CLASS (umms_resource_manager_parent_class)->dispose (object);
 }
 
+static void
+resource_pool_clear (ResourcePool *pool)
+{
+  guint i;
+
+  g_free (pool->slots);
+  g_free ((gpointer)pool->free_map);
+  if (pool->id_index)
+    g_hash_table_destroy (pool->id_index);
+  if (pool->lock)
+    g_mutex_free (pool->lock);
+  if (pool->cond)
+    g_cond_free (pool->cond);
+  for (i = 0; pool->holders && i < pool->limit; i++) {
+    g_free (pool->holders[i].share_key);
+    g_slist_free (pool->holders[i].sharers);
+  }
+  g_free (pool->holders);
+  g_list_foreach (pool->pending, (GFunc)g_free, NULL);
+  g_list_free (pool->pending);
+  memset (pool, 0, sizeof (ResourcePool));
+}
+
 static void
 umms_resource_manager_finalize (GObject *object)
 {
+  UmmsResourceManagerPrivate *priv = GET_PRIVATE (object);
+  gint i;
+
+  if (priv->pools) {
+    for (i = 0; i < priv->type_num; i++)
+      resource_pool_clear (&priv->pools[i]);
+    g_free (priv->pools);
+  }
+
   G_OBJECT_CLASS (umms_resource_manager_parent_class)->finalize (object);
 }
 
@@ -93,6 +172,41 @@ umms_resource_manager_class_init (UmmsResourceManagerClass *klass)
 
 }
 
+static gint
+pool_metric (gint type, const gchar *what, UmmsMetricType metric_type)
+{
+  gchar *name = g_strdup_printf ("resource.%d.%s", type, what);
+  gint id = umms_metrics_register (name, metric_type);
+
+  g_free (name);
+  return id;
+}
+
+static void
+resource_pool_setup (ResourcePool *pool, gint type)
+{
+  guint i;
+
+  pool->n_words = (pool->limit + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  pool->free_map = g_new0 (gint, pool->n_words);
+  pool->id_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+  pool->lock = g_mutex_new ();
+  pool->cond = g_cond_new ();
+  pool->holders = g_new0 (ResourceHolder, pool->limit);
+
+  for (i = 0; i < pool->limit; i++) {
+    pool->slots[i].type = type;
+    pool->free_map[i / BITS_PER_WORD] |= (gint)(1u << (i % BITS_PER_WORD));
+    g_hash_table_insert (pool->id_index, GINT_TO_POINTER (pool->slots[i].id), GUINT_TO_POINTER (i + 1));
+  }
+
+  pool->m_requests = pool_metric (type, "requests", UmmsMetricCounter);
+  pool->m_contended = pool_metric (type, "contended", UmmsMetricCounter);
+  pool->m_preempted = pool_metric (type, "preempted", UmmsMetricCounter);
+  pool->m_failed = pool_metric (type, "failed", UmmsMetricCounter);
+  pool->m_wait = pool_metric (type, "arbitration", UmmsMetricHistogram);
+}
+
 static gboolean
 parse_resource_def (UmmsResourceManager *self, const gchar *desc, gint index)
 {
@@ -101,8 +215,8 @@ parse_resource_def (UmmsResourceManager *self, const gchar *desc, gint index)
   gchar **strv = NULL;
   gchar **ids = NULL;
   gint i;
-  gint res_num;
   UmmsResourceManagerPrivate *priv = self->priv;
+  ResourcePool *pool = &priv->pools[index];
 
   g_return_val_if_fail (desc, FALSE);
 
@@ -112,8 +226,8 @@ parse_resource_def (UmmsResourceManager *self, const gchar *desc, gint index)
     return FALSE;
   }
 
-  priv->limit[index] = atoi (strv[0]);
-  if (!(priv->res_collection[index] = g_malloc0 (priv->limit[index] * sizeof (Resource)))) {
+  pool->limit = atoi (strv[0]);
+  if (!(pool->slots = g_malloc0 (pool->limit * sizeof (Resource)))) {
     ret = FALSE;
     goto out;
   }
@@ -121,10 +235,9 @@ parse_resource_def (UmmsResourceManager *self, const gchar *desc, gint index)
 
   if (strv[1]) {
     ids = g_strsplit (strv[1], ",", 0);
-    if (ids && g_strv_length(ids) == priv->limit[index]) {
-      for (i=0; i<priv->limit[index]; i++) {
-        priv->res_collection[index][i].id = atoi (ids[i]);
-        priv->res_collection[index][i].type = index;
+    if (ids && g_strv_length(ids) == pool->limit) {
+      for (i=0; i<pool->limit; i++) {
+        pool->slots[i].id = atoi (ids[i]);
       }
       id_done = TRUE;
       ret = TRUE;
@@ -133,13 +246,14 @@ parse_resource_def (UmmsResourceManager *self, const gchar *desc, gint index)
 
   if (!id_done) {
     //no resource id specified, let's assign them from 0 to limit-1
-    for (i=0; i<priv->limit[index]; i++) {
-      priv->res_collection[index][i].id = i;
-      priv->res_collection[index][i].type = index;
+    for (i=0; i<pool->limit; i++) {
+      pool->slots[i].id = i;
     }
     ret = TRUE;
   }
 
+  resource_pool_setup (pool, index);
+
 out:
   if (strv)
     g_strfreev (strv);
@@ -155,11 +269,11 @@ print_resource (UmmsResourceManager *self)
   gint i, j;
 
   UMMS_DEBUG ("we have %u resource types", priv->type_num);
-  if (priv->res_collection) {
+  if (priv->pools) {
     for (i=0; i<priv->type_num; i++) {
-      UMMS_DEBUG ("type %u: limit (%d)", i, priv->limit[i]);
-      for (j=0; j<priv->limit[i]; j++) {
-        g_print ("\tid=%d used=%d,\t", priv->res_collection[i][j].id, priv->res_collection[i][j].used);
+      UMMS_DEBUG ("type %u: limit (%d)", i, priv->pools[i].limit);
+      for (j=0; j<priv->pools[i].limit; j++) {
+        g_print ("\tid=%d used=%d,\t", priv->pools[i].slots[j].id, priv->pools[i].slots[j].used);
       }
       g_print ("\n");
     }
@@ -180,7 +294,6 @@ umms_resource_manager_init (UmmsResourceManager *self)
 
   self->priv = MANAGER_PRIVATE (self);
   priv = self->priv;
-  priv->lock = g_mutex_new ();
 
   /* get the resource configuration info */
   g_assert (umms_ctx);
@@ -200,18 +313,20 @@ umms_resource_manager_init (UmmsResourceManager *self)
   }
 
   /*
-   * type = priv->limit:resource_id
+   * type = limit:resource_id
    * 0 = 3:1,2,3
    * 1 = 5
    */
-  priv->res_collection = g_malloc0 (type_num * sizeof (Resource*));
-  priv->limit = g_malloc0 (type_num * sizeof (guint));
-  if (!priv->res_collection || !priv->limit) {
+  priv->pools = g_malloc0 (type_num * sizeof (ResourcePool));
+  if (!priv->pools) {
     UMMS_WARNING ("Failed to allocate memory");
     goto out;
   }
 
   for (i=0; i<type_num; i++) {
+    ResourcePool *pool = &priv->pools[i];
+
+    pool->m_requests = pool->m_contended = pool->m_preempted = pool->m_failed = pool->m_wait = -1;
     if (resource_desc = g_key_file_get_string (umms_ctx->resource_conf, RESOURCE_GROUP, keys[i], NULL)) {
       ret = parse_resource_def (self, resource_desc, i);
       g_free (resource_desc);
@@ -228,101 +343,540 @@ out:
   return;
 
 failed:
-  if (priv->res_collection) {
-    for (i=0; priv->res_collection[i] != NULL; i++)
-      g_free (priv->res_collection[i]);
-    g_free (priv->res_collection);
-    priv->res_collection = NULL;
-  }
-
-  if (priv->limit) {
-    g_free (priv->limit);
-    priv->limit = NULL;
+  if (priv->pools) {
+    for (i=0; i<type_num; i++)
+      resource_pool_clear (&priv->pools[i]);
+    g_free (priv->pools);
+    priv->pools = NULL;
   }
 
   goto out;
 }
 
 static UmmsResourceManager *mngr_global = NULL;
+static GStaticMutex mngr_lock = G_STATIC_MUTEX_INIT;
 
 UmmsResourceManager *
 umms_resource_manager_new (void)
 {
+  //Backends may be created on the worker threads concurrently.
+  g_static_mutex_lock (&mngr_lock);
   if (!mngr_global) {
     mngr_global = g_object_new (UMMS_TYPE_RESOURCE_MANAGER, NULL);
   }
+  g_static_mutex_unlock (&mngr_lock);
   return mngr_global;
 }
 
+static gboolean
+claim_slot (ResourcePool *pool, guint slot)
+{
+  volatile gint *word = &pool->free_map[slot / BITS_PER_WORD];
+  guint mask = 1u << (slot % BITS_PER_WORD);
+  gint old;
+
+  do {
+    old = g_atomic_int_get (word);
+    if (!((guint)old & mask))
+      return FALSE;
+  } while (!g_atomic_int_compare_and_exchange (word, old, (gint)((guint)old & ~mask)));
+
+  return TRUE;
+}
+
+static gint
+claim_any_slot (ResourcePool *pool)
+{
+  guint w;
+  gint bit;
+  gint old;
+
+  for (w = 0; w < pool->n_words; w++) {
+    while ((old = g_atomic_int_get (&pool->free_map[w])) != 0) {
+      bit = g_bit_nth_lsf ((guint)old, -1);
+      if (g_atomic_int_compare_and_exchange (&pool->free_map[w], old, (gint)((guint)old & ~(1u << bit))))
+        return w * BITS_PER_WORD + bit;
+    }
+  }
+
+  return -1;
+}
+
+static gint
+try_claim (ResourcePool *pool, ResourceRequest *req)
+{
+  guint pref_slot;
+
+  //Respect the preference given by client.
+  if (req->preference != NO_PREFERENCE && pool->id_index) {
+    pref_slot = GPOINTER_TO_UINT (g_hash_table_lookup (pool->id_index, GINT_TO_POINTER (req->preference)));
+    if (pref_slot && claim_slot (pool, pref_slot - 1))
+      return pref_slot - 1;
+  }
+
+  //Take any available item.
+  return claim_any_slot (pool);
+}
+
+//Publish the owner of a claimed slot, the other fields first, see preempt_lower().
+static void
+holder_take (ResourceHolder *holder, ResourceRequest *req)
+{
+  holder->priority = req->priority;
+  holder->preempt = req->preempt;
+  holder->available = req->available;
+  holder->thread = g_thread_self ();
+  g_atomic_pointer_set (&holder->owner, req->owner);
+}
+
+static gint
+pending_cmp (gconstpointer a, gconstpointer b)
+{
+  return ((ResourceHolder *)b)->priority - ((ResourceHolder *)a)->priority;
+}
+
+//Remember an owner to be notified when this type is available again. Called with lock held.
+static void
+pending_add (ResourcePool *pool, ResourceHolder *holder)
+{
+  GList *g;
+  ResourceHolder *pending;
+
+  if (!holder->owner || !holder->available)
+    return;
+
+  for (g = pool->pending; g; g = g->next) {
+    if (((ResourceHolder *)g->data)->owner == holder->owner)
+      return;
+  }
+
+  pending = g_memdup (holder, sizeof (ResourceHolder));
+  pending->share_key = NULL;
+  pending->shares = 0;
+  pending->sharers = NULL;
+  pool->pending = g_list_insert_sorted (pool->pending, pending, pending_cmp);
+}
+
+//Called with lock held.
+static void
+pending_remove (ResourcePool *pool, gpointer owner)
+{
+  GList *g, *next;
+
+  for (g = pool->pending; g; g = next) {
+    next = g->next;
+    if (((ResourceHolder *)g->data)->owner == owner) {
+      g_free (g->data);
+      pool->pending = g_list_delete_link (pool->pending, g);
+    }
+  }
+}
+
+/*
+ * Notify all the pending owners, highest priority first. They all request
+ * again, a higher priority one coming late preempts the lower ones.
+ * Called with lock held.
+ */
+static void
+pending_notify (ResourcePool *pool, gint type)
+{
+  GList *list = pool->pending;
+  GList *g;
+  ResourceHolder *pending;
+
+  pool->pending = NULL;
+  for (g = list; g; g = g->next) {
+    pending = (ResourceHolder *)g->data;
+    UMMS_DEBUG ("notify owner (%p) that resource type %d is available", pending->owner, type);
+    pending->available (type, pending->owner);
+    g_free (pending);
+  }
+  g_list_free (list);
+}
+
+#define PREEMPT_RACED -2
+
+/*
+ * Revoke the resource of the lowest priority owner below the requester, the
+ * slot stays claimed and is handed to the requester. The victim is asked to
+ * stop using it, its later release is ignored. Shared resources are never
+ * preempted.
+ *
+ * Returns:         The revoked slot, -1 if no victim, PREEMPT_RACED if the
+ *                  victim released it meanwhile.
+ * Called with lock held, the preempt callback must not block.
+ */
+static gint
+preempt_lower (ResourcePool *pool, ResourceRequest *req)
+{
+  ResourceHolder *holder;
+  ResourceHolder victim_holder;
+  gpointer owner;
+  gint victim = -1;
+  gint i;
+
+  for (i = 0; i < pool->limit; i++) {
+    holder = &pool->holders[i];
+    if (!g_atomic_pointer_get (&holder->owner) || !holder->preempt || holder->shares
+        || holder->priority >= req->priority)
+      continue;
+    if (victim < 0 || holder->priority < pool->holders[victim].priority
+        || (holder->priority == pool->holders[victim].priority && pool->slots[i].id == req->preference))
+      victim = i;
+  }
+
+  if (victim < 0)
+    return -1;
+
+  holder = &pool->holders[victim];
+  victim_holder = *holder;
+  owner = victim_holder.owner;
+  if (!owner || !g_atomic_pointer_compare_and_exchange (&holder->owner, owner, NULL))
+    return PREEMPT_RACED;
+
+  umms_metrics_count (pool->m_preempted, 1);
+  UMMS_DEBUG ("preempting resource (type:%d, id:%d) of owner (%p) with priority %d",
+              pool->slots[victim].type, pool->slots[victim].id, owner, victim_holder.priority);
+  pending_add (pool, &victim_holder);
+  victim_holder.preempt (&pool->slots[victim], owner);
+
+  return victim;
+}
+
+//Join the slot shared under req->share_key, -1 if none. Called with lock held.
+static gint
+share_join (ResourcePool *pool, ResourceRequest *req)
+{
+  ResourceHolder *holder;
+  gint i;
+
+  for (i = 0; i < pool->limit; i++) {
+    holder = &pool->holders[i];
+    if (holder->shares && !strcmp (holder->share_key, req->share_key)) {
+      holder->shares++;
+      holder->sharers = g_slist_prepend (holder->sharers, req->owner);
+      UMMS_DEBUG ("resource (type:%d, id:%d) shared by %d requests under '%s'",
+                  pool->slots[i].type, pool->slots[i].id, holder->shares, holder->share_key);
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+//Take a claimed slot for the key, so that share_join() sees it at once. Called with lock held.
+static void
+share_start (ResourcePool *pool, gint slot, ResourceRequest *req)
+{
+  ResourceHolder *holder = &pool->holders[slot];
+
+  holder->share_key = g_strdup (req->share_key);
+  holder->shares = 1;
+  holder->sharers = g_slist_prepend (NULL, req->owner);
+  holder_take (holder, req);
+}
+
+/*
+ * Whether blocking this thread can't hold back the release waited for: not
+ * on the main loop, which dispatches the stops and the preemptions, and not
+ * on the thread of a holder, e.g. the worker shared with the player to
+ * release. Called with lock held.
+ */
+static gboolean
+may_wait (ResourcePool *pool)
+{
+  GThread *self = g_thread_self ();
+  gint i;
+
+  if (g_main_context_is_owner (g_main_context_default ()))
+    return FALSE;
+
+  for (i = 0; i < pool->limit; i++) {
+    if (g_atomic_pointer_get (&pool->holders[i].owner) && pool->holders[i].thread == self)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * Slow path, the type is exhausted: preempt a lower priority owner, else
+ * wait up to timeout ms for a release where may_wait() allows it, else queue
+ * the requester to be notified by the next release.
+ */
+static gint
+arbitrate (ResourcePool *pool, ResourceRequest *req, guint timeout)
+{
+  GTimeVal deadline;
+  gint slot;
+  gint64 start = umms_metrics_now ();
+
+  umms_metrics_count (pool->m_contended, 1);
+  g_mutex_lock (pool->lock);
+
+  while ((slot = try_claim (pool, req)) < 0 && (slot = preempt_lower (pool, req)) == PREEMPT_RACED)
+    ;
+
+  if (slot < 0 && timeout > 0 && may_wait (pool)) {
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, (glong)timeout * 1000);
+    //Counted before the claim, so that a release from now on signals us.
+    g_atomic_int_inc (&pool->waiters);
+    while ((slot = try_claim (pool, req)) < 0) {
+      if (!g_cond_timed_wait (pool->cond, pool->lock, &deadline)) {
+        slot = try_claim (pool, req);
+        break;
+      }
+    }
+    g_atomic_int_add (&pool->waiters, -1);
+  }
+
+  if (slot < 0) {
+    ResourceHolder holder = {0,};
+
+    holder.owner = req->owner;
+    holder.priority = req->priority;
+    holder.available = req->available;
+    pending_add (pool, &holder);
+    //A release between the claim and pending_add() didn't see us pending.
+    if ((slot = try_claim (pool, req)) >= 0)
+      pending_remove (pool, req->owner);
+  }
+
+  if (slot >= 0 && req->share_key)
+    share_start (pool, slot, req);
+  g_mutex_unlock (pool->lock);
+
+  umms_metrics_record (pool->m_wait, umms_metrics_now () - start);
+  if (slot < 0)
+    umms_metrics_count (pool->m_failed, 1);
+  return slot;
+}
+
 Resource *
 umms_resource_manager_request_resource (UmmsResourceManager *self, ResourceRequest *req)
+{
+  return umms_resource_manager_request_resource_timed (self, req, 0);
+}
+
+Resource *
+umms_resource_manager_request_resource_timed (UmmsResourceManager *self, ResourceRequest *req, guint timeout)
 {
   UmmsResourceManagerPrivate *priv;
-  gint i;
-  guint res_num;
+  ResourcePool *pool;
+  gint slot;
   Resource *res = NULL;
-  Resource *res_array = NULL;
 
   g_return_val_if_fail (self, NULL);
   g_return_val_if_fail (req, NULL);
 
   priv = GET_PRIVATE (self);
 
-  if (!priv->res_collection) {
+  if (!priv->pools) {
     UMMS_WARNING ("no resource defined");
     return NULL;
   }
 
-  g_mutex_lock (priv->lock);
-
-  res_num = priv->limit[req->type];
-  res_array = priv->res_collection[req->type];
-
-  //Respect the preference given by client.
-  if (req->preference != NO_PREFERENCE) {
-    for (i = 0; i < res_num; i++) {
-      if ((res_array[i].id == req->preference) && (res_array[i].used == FALSE)) {
-        res_array[i].used = TRUE;
-        res = &res_array[i];
-        goto out;
-      }
+  if (req->type < 0 || req->type >= priv->type_num) {
+    UMMS_WARNING ("unknown resource type (%d)", req->type);
+    return NULL;
+  }
+  pool = &priv->pools[req->type];
+  umms_metrics_count (pool->m_requests, 1);
+
+  //Join or claim under the lock, so that concurrent requests of one key end up on one resource.
+  if (req->share_key && pool->limit > 0) {
+    g_mutex_lock (pool->lock);
+    if ((slot = share_join (pool, req)) >= 0) {
+      g_mutex_unlock (pool->lock);
+      return &pool->slots[slot];
     }
-    UMMS_DEBUG ("Preference (%d) is not available", req->preference);
+    if ((slot = try_claim (pool, req)) >= 0)
+      share_start (pool, slot, req);
+    g_mutex_unlock (pool->lock);
+  } else {
+    slot = try_claim (pool, req);
   }
 
-  //Find the first available item.
-  for (i = 0; i < res_num; i++) {
-    if (!res_array[i].used) {
-      res_array[i].used = TRUE;
-      res = &res_array[i];
-      break;
-    }
+  if (slot < 0 && pool->limit > 0) {
+    UMMS_DEBUG ("no free resource (type:%d), priority %d", req->type, req->priority);
+    slot = arbitrate (pool, req, timeout);
   }
 
-out:
-  if (res)
+  if (slot >= 0) {
+    res = &pool->slots[slot];
+    res->used = TRUE;
+    if (!req->share_key)
+      holder_take (&pool->holders[slot], req);
     UMMS_DEBUG ("resource (type:%d, id:%d) available", res->type, res->id);
-  else
+  } else {
     UMMS_DEBUG ("resource (type:%d, id:%d) unavailable", req->type, req->preference);
+  }
 
-  g_mutex_unlock (priv->lock);
   return res;
 }
 
 void
-umms_resource_manager_release_resource (UmmsResourceManager *self, Resource *res)
+umms_resource_manager_release_resource (UmmsResourceManager *self, Resource *res, gpointer owner)
 {
-  gint i;
-  guint res_num;
-  Resource *res_array = NULL;
   UmmsResourceManagerPrivate *priv;
+  ResourcePool *pool;
+  ResourceHolder *holder;
+  volatile gint *word;
+  guint slot;
+  guint mask;
+  gint old;
 
   g_return_if_fail (self && res);
 
   priv = GET_PRIVATE (self);
-  g_mutex_lock (priv->lock);
+  g_return_if_fail (res->type >= 0 && res->type < priv->type_num);
+
+  pool = &priv->pools[res->type];
+  slot = res - pool->slots;
+  g_return_if_fail (slot < pool->limit);
+
+  word = &pool->free_map[slot / BITS_PER_WORD];
+  mask = 1u << (slot % BITS_PER_WORD);
+  holder = &pool->holders[slot];
+
+  //Shared slots are never preempted, only their sharers need the lock.
+  if (g_atomic_int_get (&holder->shares)) {
+    GSList *link;
+
+    g_mutex_lock (pool->lock);
+    //Released twice, or the last sharer freed it meanwhile.
+    if (!(link = g_slist_find (holder->sharers, owner))) {
+      g_mutex_unlock (pool->lock);
+      UMMS_DEBUG ("resource (type:%d, id:%d) not shared by owner (%p)", res->type, res->id, owner);
+      return;
+    }
+    holder->sharers = g_slist_delete_link (holder->sharers, link);
+    //Still used by the other requests of the key.
+    if (--holder->shares > 0) {
+      g_atomic_pointer_set (&holder->owner, holder->sharers->data);
+      g_mutex_unlock (pool->lock);
+      return;
+    }
+    g_free (holder->share_key);
+    holder->share_key = NULL;
+    g_atomic_pointer_set (&holder->owner, NULL);
+    g_mutex_unlock (pool->lock);
+  } else if (owner && !g_atomic_pointer_compare_and_exchange (&holder->owner, owner, NULL)) {
+    UMMS_DEBUG ("resource (type:%d, id:%d) was revoked from owner (%p)", res->type, res->id, owner);
+    return;
+  }
+
+  //Clear used before the slot is visible as free to the others.
   res->used = FALSE;
+  do {
+    old = g_atomic_int_get (word);
+    if ((guint)old & mask) {
+      UMMS_WARNING ("resouce (type:%d, id:%d) released twice", res->type, res->id);
+      return;
+    }
+  } while (!g_atomic_int_compare_and_exchange (word, old, (gint)((guint)old | mask)));
+
   UMMS_DEBUG ("resouce (type:%d, id:%d) released", res->type, res->id);
-  g_mutex_unlock (priv->lock);
+
+  //Checked after the slot is free, see the retry and the wait in arbitrate().
+  if (g_atomic_int_get (&pool->waiters)) {
+    g_mutex_lock (pool->lock);
+    g_cond_broadcast (pool->cond);
+    g_mutex_unlock (pool->lock);
+  }
+  if (g_atomic_pointer_get ((volatile gpointer *)&pool->pending)) {
+    g_mutex_lock (pool->lock);
+    pending_notify (pool, res->type);
+    g_mutex_unlock (pool->lock);
+  }
+
   return;
 }
+
+void
+umms_resource_manager_forget_owner (UmmsResourceManager *self, gpointer owner)
+{
+  UmmsResourceManagerPrivate *priv;
+  ResourcePool *pool;
+  gint i;
+
+  g_return_if_fail (self);
+
+  priv = GET_PRIVATE (self);
+  if (!priv->pools)
+    return;
+
+  for (i = 0; i < priv->type_num; i++) {
+    pool = &priv->pools[i];
+    if (!pool->lock)
+      continue;
+
+    g_mutex_lock (pool->lock);
+    pending_remove (pool, owner);
+    g_mutex_unlock (pool->lock);
+  }
+}
+
+void
+umms_resource_manager_set_owner_priority (UmmsResourceManager *self, gpointer owner, gint priority)
+{
+  UmmsResourceManagerPrivate *priv;
+  ResourcePool *pool;
+  GList *g;
+  guint j;
+  gint i;
+
+  g_return_if_fail (self);
+
+  priv = GET_PRIVATE (self);
+  if (!priv->pools)
+    return;
+
+  for (i = 0; i < priv->type_num; i++) {
+    pool = &priv->pools[i];
+    if (!pool->lock)
+      continue;
+
+    g_mutex_lock (pool->lock);
+    for (j = 0; j < pool->limit; j++) {
+      if (g_atomic_pointer_get (&pool->holders[j].owner) == owner)
+        pool->holders[j].priority = priority;
+    }
+    for (g = pool->pending; g; g = g->next) {
+      if (((ResourceHolder *)g->data)->owner == owner)
+        ((ResourceHolder *)g->data)->priority = priority;
+    }
+    pool->pending = g_list_sort (pool->pending, pending_cmp);
+    g_mutex_unlock (pool->lock);
+  }
+}
+
+gint
+umms_resource_manager_get_type_num (UmmsResourceManager *self)
+{
+  g_return_val_if_fail (self, 0);
+  return GET_PRIVATE (self)->type_num;
+}
+
+gboolean
+umms_resource_manager_get_usage (UmmsResourceManager *self, gint type, guint *limit, guint *used)
+{
+  UmmsResourceManagerPrivate *priv;
+  ResourcePool *pool;
+  guint i, n = 0;
+
+  g_return_val_if_fail (self, FALSE);
+
+  priv = GET_PRIVATE (self);
+  if (type < 0 || type >= priv->type_num)
+    return FALSE;
+
+  pool = &priv->pools[type];
+  for (i = 0; i < pool->limit; i++) {
+    if (!((guint)g_atomic_int_get (&pool->free_map[i / BITS_PER_WORD]) & (1u << (i % BITS_PER_WORD))))
+      n++;
+  }
+  *limit = pool->limit;
+  *used = n;
+  return TRUE;
+}
@@ -65,24 +65,83 @@ struct _UmmsResourceManagerClass {
 };
 
 #define NO_PREFERENCE -1
+
+//Higher priority requests may preempt the resources of lower priority owners.
+typedef enum {
+  ResourcePriorityBackground = -1,//e.g. preview
+  ResourcePriorityNormal = 0,//e.g. unattended execution, scheduled recording
+  ResourcePriorityForeground = 1//attended execution
+} ResourcePriority;
+
 //Actual resource returned by resource manager.
 struct _Resource {
   gint     type;
   gint     id;
-  gboolean used;
+  gboolean used;//informational, the resource manager tracks the ownership itself
 };
 
+/*
+ * Both callbacks are invoked with the internal lock of the resource type held,
+ * they must only schedule the work (e.g. suspend/restore) and return.
+ *
+ * preempt:         res has been handed to a higher priority request, the owner
+ *                  must stop using it. Its release of res is then ignored.
+ * available:       A resource of type has been released, the owner may request again.
+ */
+typedef void (*ResourcePreemptFunc) (Resource *res, gpointer owner);
+typedef void (*ResourceAvailableFunc) (gint type, gpointer owner);
+
 //Resource requested by user.
 struct _ResourceRequest {
   gint type;
   gint preference;//Expected resource by client (e.g. for ResourceTypePlane, it may be UPP_A).
+  gint priority;//ResourcePriority
+  gpointer owner;
+  ResourcePreemptFunc preempt;//NULL if the owner can't be preempted
+  ResourceAvailableFunc available;//NULL if the owner doesn't want to be notified
+  /*
+   * Requests with the same key share one resource, e.g. "dvb:546000000" for
+   * the tuner of a multiplex recorded by several players. Each request must
+   * be released with its owner, the resource is freed by the last one, the
+   * releases of an owner beyond its requests are ignored. A shared resource
+   * can't be preempted. NULL for exclusive use.
+   */
+  const gchar *share_key;
 };
 
 
 GType umms_resource_manager_get_type (void) G_GNUC_CONST;
 UmmsResourceManager *umms_resource_manager_new (void);
+
+/*
+ * If no resource of the type is free, take the one of the lowest priority
+ * owner below req->priority. Never waits: on failure, req->owner is notified
+ * by req->available once a resource of the type is released.
+ */
 Resource *umms_resource_manager_request_resource (UmmsResourceManager *self, ResourceRequest *req);
-void umms_resource_manager_release_resource (UmmsResourceManager *self, Resource *res);
+/*
+ * Same, but if there is no victim either, wait up to timeout ms for a
+ * release. Only off the main loop and off the threads the holders claimed
+ * from (e.g. the worker of the player which would release), since blocking
+ * those could hold back the very release waited for. Elsewhere, or once timed
+ * out, req->owner is notified as above.
+ */
+Resource *umms_resource_manager_request_resource_timed (UmmsResourceManager *self, ResourceRequest *req,
+                                                        guint timeout);
+//owner:            req->owner of the request, NULL if none.
+void umms_resource_manager_release_resource (UmmsResourceManager *self, Resource *res, gpointer owner);
+
+//Drop all the pending notifications of owner, must be called before owner is destroyed.
+void umms_resource_manager_forget_owner (UmmsResourceManager *self, gpointer owner);
+//Arbitrate the resources held or missed by owner with a new priority, e.g. a pre-tuned backend put in front.
+void umms_resource_manager_set_owner_priority (UmmsResourceManager *self, gpointer owner, gint priority);
+
+/*
+ * Occupancy of a resource type, the slots claimed out of limit. The request,
+ * contention and preemption counts are in the "resource.<type>.*" metrics.
+ */
+gint umms_resource_manager_get_type_num (UmmsResourceManager *self);
+gboolean umms_resource_manager_get_usage (UmmsResourceManager *self, gint type, guint *limit, guint *used);
 
 G_END_DECLS
 
@@ -0,0 +1,582 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define UMMS_LOG_CATEGORY UmmsLogCategoryObjectManager
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "umms-debug.h"
+#include "umms-schedule-journal.h"
+
+/*
+ * File layout: JOURNAL_MAGIC, then records of
+ *   guint32 len, guint32 crc32 of the payload, payload of len bytes.
+ * Payload: guint8 op, guint64 id, and for OP_ADD
+ *   gint64 start, gint64 stop, guint16 uri len, uri, guint16 location len, location,
+ *   guint16 token len, token. The token is absent from the records of older journals.
+ * Integers are in host byte order, the journal isn't meant to be moved.
+ */
+#define JOURNAL_MAGIC      "UMMSJRN1"
+#define JOURNAL_MAGIC_LEN  8
+#define RECORD_HEADER_LEN  8
+#define MAX_PAYLOAD_LEN    (1 + 8 + 8 + 8 + 3 * (2 + G_MAXUINT16))
+
+//Rewrite the journal once it has COMPACT_RATIO times more records than needed.
+#define COMPACT_MIN_RECORDS 1024
+#define COMPACT_RATIO       4
+
+enum {
+  OP_ADD = 1,
+  OP_CANCEL,
+  OP_STARTED,
+  OP_FINISHED
+};
+
+struct _UmmsScheduleJournal {
+  gchar       *path;
+  gint        fd;
+  GHashTable  *entries;//id ==> UmmsScheduleEntry
+  guint64     next_id;
+  guint       records;
+  GString     *pending;//records not written yet
+  guint       sync_interval;
+  guint       sync_id;
+};
+
+static guint32 crc_table[256];
+
+static void
+crc_table_init (void)
+{
+  static gsize initialized = 0;
+  guint32 c;
+  gint i, k;
+
+  if (g_once_init_enter (&initialized)) {
+    for (i = 0; i < 256; i++) {
+      for (c = i, k = 0; k < 8; k++)
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      crc_table[i] = c;
+    }
+    g_once_init_leave (&initialized, 1);
+  }
+}
+
+static guint32
+journal_crc32 (const guint8 *data, gsize len)
+{
+  guint32 c = 0xFFFFFFFF;
+
+  while (len--)
+    c = crc_table[(c ^ *data++) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFF;
+}
+
+static void
+entry_free (gpointer data)
+{
+  UmmsScheduleEntry *entry = (UmmsScheduleEntry *)data;
+
+  g_free (entry->uri);
+  g_free (entry->location);
+  g_free (entry->token);
+  g_free (entry);
+}
+
+static void
+set_errno_error (GError **err, const gchar *what, const gchar *path)
+{
+  gint saved_errno = errno;
+
+  g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+               "%s '%s': %s", what, path, g_strerror (saved_errno));
+}
+
+static gboolean
+write_all (gint fd, const gchar *data, gsize len)
+{
+  gssize n;
+
+  while (len > 0) {
+    if ((n = write (fd, data, len)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return FALSE;
+    }
+    data += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static void
+put_string (GString *buf, const gchar *str)
+{
+  guint16 len = str ? MIN (strlen (str), G_MAXUINT16) : 0;
+
+  g_string_append_len (buf, (const gchar *)&len, sizeof (len));
+  if (len)
+    g_string_append_len (buf, str, len);
+}
+
+static void
+encode_record (GString *buf, guint8 op, guint64 id, const UmmsScheduleEntry *entry)
+{
+  gsize header = buf->len;
+  guint32 len, crc;
+
+  g_string_set_size (buf, header + RECORD_HEADER_LEN);
+  g_string_append_len (buf, (const gchar *)&op, sizeof (op));
+  g_string_append_len (buf, (const gchar *)&id, sizeof (id));
+  if (op == OP_ADD) {
+    g_string_append_len (buf, (const gchar *)&entry->start_time, sizeof (entry->start_time));
+    g_string_append_len (buf, (const gchar *)&entry->stop_time, sizeof (entry->stop_time));
+    put_string (buf, entry->uri);
+    put_string (buf, entry->location);
+    put_string (buf, entry->token);
+  }
+
+  len = buf->len - header - RECORD_HEADER_LEN;
+  crc = journal_crc32 ((const guint8 *)buf->str + header + RECORD_HEADER_LEN, len);
+  memcpy (buf->str + header, &len, sizeof (len));
+  memcpy (buf->str + header + sizeof (len), &crc, sizeof (crc));
+}
+
+static gboolean
+get_string (const guint8 **p, const guint8 *end, gchar **str)
+{
+  guint16 len;
+
+  if (end - *p < sizeof (len))
+    return FALSE;
+  memcpy (&len, *p, sizeof (len));
+  *p += sizeof (len);
+  if (end - *p < len)
+    return FALSE;
+  *str = g_strndup ((const gchar *)*p, len);
+  *p += len;
+  return TRUE;
+}
+
+static gboolean
+apply_record (UmmsScheduleJournal *journal, const guint8 *p, const guint8 *end)
+{
+  UmmsScheduleEntry *entry;
+  guint8 op;
+  guint64 id;
+
+  if (end - p < sizeof (op) + sizeof (id))
+    return FALSE;
+  op = *p++;
+  memcpy (&id, p, sizeof (id));
+  p += sizeof (id);
+
+  switch (op) {
+    case OP_ADD:
+      entry = g_new0 (UmmsScheduleEntry, 1);
+      entry->id = id;
+      if (end - p < 2 * sizeof (gint64)) {
+        g_free (entry);
+        return FALSE;
+      }
+      memcpy (&entry->start_time, p, sizeof (gint64));
+      memcpy (&entry->stop_time, p + sizeof (gint64), sizeof (gint64));
+      p += 2 * sizeof (gint64);
+      if (!get_string (&p, end, &entry->uri) || !get_string (&p, end, &entry->location)) {
+        entry_free (entry);
+        return FALSE;
+      }
+      if (p < end && !get_string (&p, end, &entry->token)) {
+        entry_free (entry);
+        return FALSE;
+      }
+      //replace, not insert, the key lives in the entry.
+      g_hash_table_replace (journal->entries, &entry->id, entry);
+      journal->next_id = MAX (journal->next_id, id + 1);
+      break;
+    case OP_STARTED:
+      if ((entry = g_hash_table_lookup (journal->entries, &id)))
+        entry->started = TRUE;
+      break;
+    case OP_CANCEL:
+    case OP_FINISHED:
+      g_hash_table_remove (journal->entries, &id);
+      break;
+    default:
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Returns:         Offset of the end of the last valid record, the rest is
+ *                  a torn write.
+ */
+static gsize
+replay (UmmsScheduleJournal *journal, const gchar *data, gsize size)
+{
+  const guint8 *p = (const guint8 *)data + JOURNAL_MAGIC_LEN;
+  const guint8 *end = (const guint8 *)data + size;
+  guint32 len, crc;
+
+  while (end - p >= RECORD_HEADER_LEN) {
+    memcpy (&len, p, sizeof (len));
+    memcpy (&crc, p + sizeof (len), sizeof (crc));
+    if (len > MAX_PAYLOAD_LEN || end - p - RECORD_HEADER_LEN < len)
+      break;
+    if (journal_crc32 (p + RECORD_HEADER_LEN, len) != crc
+        || !apply_record (journal, p + RECORD_HEADER_LEN, p + RECORD_HEADER_LEN + len))
+      break;
+    p += RECORD_HEADER_LEN + len;
+    journal->records++;
+  }
+
+  return (const gchar *)p - data;
+}
+
+static gint
+live_records (UmmsScheduleJournal *journal)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gint n = 0;
+
+  g_hash_table_iter_init (&iter, journal->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    n += ((UmmsScheduleEntry *)value)->started ? 2 : 1;
+
+  return n;
+}
+
+static gboolean
+fsync_dir (const gchar *path)
+{
+  gchar *dir = g_path_get_dirname (path);
+  gint fd;
+  gboolean ret = FALSE;
+
+  if ((fd = open (dir, O_RDONLY)) >= 0) {
+    ret = fsync (fd) == 0;
+    close (fd);
+  }
+  g_free (dir);
+  return ret;
+}
+
+//Write the live recordings to a new file and rename it over the journal.
+static gboolean
+compact (UmmsScheduleJournal *journal, GError **err)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GString *buf;
+  gchar *tmp_path;
+  gint fd;
+  guint records = 0;
+  gboolean ret = FALSE;
+
+  buf = g_string_new_len (JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+  g_hash_table_iter_init (&iter, journal->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    UmmsScheduleEntry *entry = (UmmsScheduleEntry *)value;
+    encode_record (buf, OP_ADD, entry->id, entry);
+    records++;
+    if (entry->started) {
+      encode_record (buf, OP_STARTED, entry->id, NULL);
+      records++;
+    }
+  }
+
+  tmp_path = g_strconcat (journal->path, ".tmp", NULL);
+  if ((fd = open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+    set_errno_error (err, "Failed to create", tmp_path);
+    goto out;
+  }
+  if (!write_all (fd, buf->str, buf->len) || fdatasync (fd) < 0) {
+    set_errno_error (err, "Failed to write", tmp_path);
+    close (fd);
+    g_unlink (tmp_path);
+    goto out;
+  }
+  close (fd);
+
+  if (g_rename (tmp_path, journal->path) < 0) {
+    set_errno_error (err, "Failed to rename", tmp_path);
+    g_unlink (tmp_path);
+    goto out;
+  }
+  fsync_dir (journal->path);
+
+  close (journal->fd);
+  if ((journal->fd = open (journal->path, O_WRONLY | O_APPEND | O_CLOEXEC)) < 0) {
+    set_errno_error (err, "Failed to open", journal->path);
+    goto out;
+  }
+
+  UMMS_DEBUG ("journal compacted, %u ==> %u records", journal->records, records);
+  journal->records = records;
+  ret = TRUE;
+
+out:
+  g_free (tmp_path);
+  g_string_free (buf, TRUE);
+  return ret;
+}
+
+static void
+maybe_compact (UmmsScheduleJournal *journal)
+{
+  GError *err = NULL;
+
+  if (journal->records < COMPACT_MIN_RECORDS
+      || journal->records < COMPACT_RATIO * live_records (journal))
+    return;
+
+  if (!compact (journal, &err)) {
+    UMMS_WARNING ("journal compaction failed: %s", err->message);
+    g_error_free (err);
+  }
+}
+
+gboolean
+umms_schedule_journal_sync (UmmsScheduleJournal *journal, GError **err)
+{
+  g_return_val_if_fail (journal, FALSE);
+
+  if (journal->sync_id) {
+    g_source_remove (journal->sync_id);
+    journal->sync_id = 0;
+  }
+
+  if (!journal->pending->len)
+    return TRUE;
+
+  if (journal->fd < 0 || !write_all (journal->fd, journal->pending->str, journal->pending->len)
+      || fdatasync (journal->fd) < 0) {
+    set_errno_error (err, "Failed to write", journal->path);
+    return FALSE;
+  }
+  g_string_truncate (journal->pending, 0);
+
+  maybe_compact (journal);
+  return TRUE;
+}
+
+static gboolean
+sync_timeout (gpointer data)
+{
+  UmmsScheduleJournal *journal = (UmmsScheduleJournal *)data;
+  GError *err = NULL;
+
+  journal->sync_id = 0;
+  if (!umms_schedule_journal_sync (journal, &err)) {
+    UMMS_WARNING ("%s", err->message);
+    g_error_free (err);
+  }
+
+  return FALSE;
+}
+
+static void
+append (UmmsScheduleJournal *journal, guint8 op, guint64 id, const UmmsScheduleEntry *entry)
+{
+  GError *err = NULL;
+
+  encode_record (journal->pending, op, id, entry);
+  journal->records++;
+
+  if (!journal->sync_interval) {
+    if (!umms_schedule_journal_sync (journal, &err)) {
+      UMMS_WARNING ("%s", err->message);
+      g_error_free (err);
+    }
+  } else if (!journal->sync_id) {
+    journal->sync_id = g_timeout_add (journal->sync_interval, sync_timeout, journal);
+  }
+}
+
+UmmsScheduleJournal *
+umms_schedule_journal_open (const gchar *path, guint sync_interval, GError **err)
+{
+  UmmsScheduleJournal *journal;
+  gchar *data = NULL;
+  gsize size = 0;
+  gsize valid;
+  gchar *dir;
+
+  g_return_val_if_fail (path, NULL);
+
+  crc_table_init ();
+
+  journal = g_new0 (UmmsScheduleJournal, 1);
+  journal->path = g_strdup (path);
+  journal->fd = -1;
+  journal->next_id = 1;
+  journal->sync_interval = sync_interval;
+  journal->pending = g_string_new (NULL);
+  journal->entries = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, entry_free);
+
+  dir = g_path_get_dirname (path);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  if ((journal->fd = open (path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+    set_errno_error (err, "Failed to open", path);
+    goto failed;
+  }
+
+  if (!g_file_get_contents (path, &data, &size, err))
+    goto failed;
+
+  if (size < JOURNAL_MAGIC_LEN || memcmp (data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)) {
+    if (size)
+      UMMS_WARNING ("'%s' is not a schedule journal, starting a new one", path);
+    if (ftruncate (journal->fd, 0) < 0 || !write_all (journal->fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN)
+        || fdatasync (journal->fd) < 0) {
+      set_errno_error (err, "Failed to initialize", path);
+      goto failed;
+    }
+  } else if ((valid = replay (journal, data, size)) < size) {
+    UMMS_WARNING ("dropping %u bytes of torn records at the end of '%s'", (guint)(size - valid), path);
+    if (ftruncate (journal->fd, valid) < 0) {
+      set_errno_error (err, "Failed to truncate", path);
+      goto failed;
+    }
+  }
+  g_free (data);
+
+  UMMS_DEBUG ("journal '%s' replayed, %u records, %u recordings",
+              path, journal->records, g_hash_table_size (journal->entries));
+  maybe_compact (journal);
+
+  return journal;
+
+failed:
+  g_free (data);
+  umms_schedule_journal_close (journal);
+  return NULL;
+}
+
+void
+umms_schedule_journal_close (UmmsScheduleJournal *journal)
+{
+  GError *err = NULL;
+
+  if (!journal)
+    return;
+
+  if (journal->fd >= 0 && !umms_schedule_journal_sync (journal, &err)) {
+    UMMS_WARNING ("%s", err->message);
+    g_error_free (err);
+  }
+  if (journal->sync_id)
+    g_source_remove (journal->sync_id);
+  if (journal->fd >= 0)
+    close (journal->fd);
+
+  g_hash_table_destroy (journal->entries);
+  g_string_free (journal->pending, TRUE);
+  g_free (journal->path);
+  g_free (journal);
+}
+
+static gint
+entry_cmp (gconstpointer a, gconstpointer b)
+{
+  const UmmsScheduleEntry *ea = a, *eb = b;
+
+  return ea->start_time < eb->start_time ? -1 : ea->start_time > eb->start_time;
+}
+
+GList *
+umms_schedule_journal_get_entries (UmmsScheduleJournal *journal)
+{
+  g_return_val_if_fail (journal, NULL);
+
+  return g_list_sort (g_hash_table_get_values (journal->entries), entry_cmp);
+}
+
+guint64
+umms_schedule_journal_add (UmmsScheduleJournal *journal, gint64 start_time, gint64 stop_time,
+                           const gchar *uri, const gchar *location, const gchar *token)
+{
+  UmmsScheduleEntry *entry;
+
+  g_return_val_if_fail (journal, 0);
+
+  entry = g_new0 (UmmsScheduleEntry, 1);
+  entry->id = journal->next_id++;
+  entry->start_time = start_time;
+  entry->stop_time = stop_time;
+  entry->uri = g_strdup (uri);
+  entry->location = g_strdup (location);
+  entry->token = g_strdup (token);
+  g_hash_table_replace (journal->entries, &entry->id, entry);
+
+  append (journal, OP_ADD, entry->id, entry);
+  return entry->id;
+}
+
+void
+umms_schedule_journal_cancel (UmmsScheduleJournal *journal, guint64 id)
+{
+  g_return_if_fail (journal);
+
+  if (g_hash_table_remove (journal->entries, &id))
+    append (journal, OP_CANCEL, id, NULL);
+}
+
+void
+umms_schedule_journal_started (UmmsScheduleJournal *journal, guint64 id)
+{
+  UmmsScheduleEntry *entry;
+
+  g_return_if_fail (journal);
+
+  if ((entry = g_hash_table_lookup (journal->entries, &id)) && !entry->started) {
+    entry->started = TRUE;
+    append (journal, OP_STARTED, id, NULL);
+  }
+}
+
+void
+umms_schedule_journal_finished (UmmsScheduleJournal *journal, guint64 id)
+{
+  g_return_if_fail (journal);
+
+  if (g_hash_table_remove (journal->entries, &id))
+    append (journal, OP_FINISHED, id, NULL);
+}
+
+guint
+umms_schedule_journal_get_records (UmmsScheduleJournal *journal)
+{
+  g_return_val_if_fail (journal, 0);
+
+  return journal->records;
+}
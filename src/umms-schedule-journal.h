@@ -0,0 +1,88 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_SCHEDULE_JOURNAL_H
+#define _UMMS_SCHEDULE_JOURNAL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Append-only journal of the scheduled recordings, so that the schedule
+ * survives a restart of umms-server.
+ *
+ * Each operation (add, cancel, started, finished) is appended as a
+ * checksummed record. The records are buffered and written with one
+ * fdatasync() per sync_interval ms, or at once by umms_schedule_journal_sync().
+ * A torn record at the tail (crash while writing) is dropped on open. Once
+ * most of the records are dead, the journal is rewritten with only the live
+ * recordings and atomically renamed over the old one.
+ */
+
+typedef struct _UmmsScheduleJournal UmmsScheduleJournal;
+
+typedef struct _UmmsScheduleEntry {
+  guint64  id;
+  gint64   start_time;//us since the Epoch
+  gint64   stop_time;
+  gchar    *uri;
+  gchar    *location;
+  gchar    *token;//execution token given to the client, may be NULL
+  gboolean started;
+} UmmsScheduleEntry;
+
+/*
+ * Open or create the journal at path and replay it.
+ *
+ * sync_interval:   Max delay in ms before an operation is on disk, 0 syncs
+ *                  each operation at once.
+ */
+UmmsScheduleJournal *umms_schedule_journal_open (const gchar *path, guint sync_interval, GError **err);
+
+//Sync and free.
+void umms_schedule_journal_close (UmmsScheduleJournal *journal);
+
+/*
+ * Returns:         The recordings neither canceled nor finished, sorted by
+ *                  start time. Entries are owned by the journal and valid
+ *                  until the recording is canceled or finished, free the list
+ *                  with g_list_free().
+ */
+GList *umms_schedule_journal_get_entries (UmmsScheduleJournal *journal);
+
+//Returns the id of the new recording, never 0.
+guint64 umms_schedule_journal_add (UmmsScheduleJournal *journal, gint64 start_time, gint64 stop_time,
+                                   const gchar *uri, const gchar *location, const gchar *token);
+void umms_schedule_journal_cancel (UmmsScheduleJournal *journal, guint64 id);
+void umms_schedule_journal_started (UmmsScheduleJournal *journal, guint64 id);
+void umms_schedule_journal_finished (UmmsScheduleJournal *journal, guint64 id);
+
+gboolean umms_schedule_journal_sync (UmmsScheduleJournal *journal, GError **err);
+
+//Number of records in the journal file, live or not.
+guint umms_schedule_journal_get_records (UmmsScheduleJournal *journal);
+
+G_END_DECLS
+
+#endif /* _UMMS_SCHEDULE_JOURNAL_H */
@@ -0,0 +1,480 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define UMMS_LOG_CATEGORY UmmsLogCategoryObjectManager
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <glib.h>
+#include "umms-debug.h"
+#include "umms-scheduler.h"
+
+/*
+ * The wheel counts ticks since the Epoch. Level L has SLOTS slots of
+ * SLOTS^L ticks each, indexed by the bits [L*SLOT_BITS, (L+1)*SLOT_BITS) of
+ * the expiry tick. An event is put on the level of the highest bit group
+ * where its expiry differs from the current tick, so all the events of
+ * level L share the upper bits with the current tick and are ahead of it on
+ * that level. When the current tick enters an occupied slot, its events are
+ * cascaded to the lower levels, down to level 0 where they fire.
+ *
+ * The bitmap of occupied slots per level gives the next tick to wake up at
+ * without walking the empty slots, so the clock can jump over idle periods.
+ */
+#define SLOT_BITS  6
+#define SLOTS      (1 << SLOT_BITS)
+#define SLOT_MASK  (SLOTS - 1)
+#define LEVELS     7 //2^42 ms, ~139 years
+#define WHEEL_MASK ((G_GUINT64_CONSTANT (1) << (SLOT_BITS * LEVELS)) - 1)
+
+#define NO_TICK    G_MAXUINT64
+#define FIRING     -1
+
+typedef struct _Link {
+  struct _Link *prev;
+  struct _Link *next;
+} Link;
+
+typedef struct _Event {
+  Link        link;//first member, see EVENT()
+  guint       id;
+  guint64     expires;//tick
+  gint        level;//FIRING once out of the wheel
+  gint        slot;
+  UmmsSchedulerFunc func;
+  gpointer    data;
+  GDestroyNotify notify;
+} Event;
+
+#define EVENT(l) ((Event *)(l))
+
+struct _UmmsScheduler {
+  UmmsSchedulerClock clock;
+  guint64     cur;//tick, all the events up to it have fired
+  gint64      virtual_now;
+  Link        slots[LEVELS][SLOTS];
+  guint64     occupied[LEVELS];
+  GHashTable  *events;//id ==> Event
+  guint       next_id;
+
+  gint        fd;//timerfd, realtime clock only
+  guint       watch_id;
+  guint64     armed;//tick the timerfd is armed for
+};
+
+static inline void
+list_init (Link *head)
+{
+  head->prev = head->next = head;
+}
+
+static inline gboolean
+list_empty (Link *head)
+{
+  return head->next == head;
+}
+
+static inline void
+list_append (Link *head, Link *link)
+{
+  link->prev = head->prev;
+  link->next = head;
+  head->prev->next = link;
+  head->prev = link;
+}
+
+static inline void
+list_unlink (Link *link)
+{
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->prev = link->next = link;
+}
+
+//Move all the items of src to the empty dest.
+static inline void
+list_move (Link *src, Link *dest)
+{
+  if (list_empty (src)) {
+    list_init (dest);
+    return;
+  }
+  dest->next = src->next;
+  dest->prev = src->prev;
+  dest->next->prev = dest;
+  dest->prev->next = dest;
+  list_init (src);
+}
+
+static gint64
+real_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_REALTIME, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+static inline guint64
+time_to_tick (gint64 time)
+{
+  //Never fire early.
+  return time <= 0 ? 0 : (guint64)(time + UMMS_SCHEDULER_TICK - 1) / UMMS_SCHEDULER_TICK;
+}
+
+gint64
+umms_scheduler_now (UmmsScheduler *sched)
+{
+  g_return_val_if_fail (sched, 0);
+
+  return sched->clock == UMMS_SCHEDULER_CLOCK_VIRTUAL ? sched->virtual_now : real_now ();
+}
+
+static void
+wheel_insert (UmmsScheduler *sched, Event *ev)
+{
+  guint64 expires = MAX (ev->expires, sched->cur);
+  guint64 diff;
+  gint level = 0;
+
+  //Beyond the wheel, parked on the top level and put back when it comes down.
+  if ((expires ^ sched->cur) & ~WHEEL_MASK)
+    expires = sched->cur | WHEEL_MASK;
+
+  diff = expires ^ sched->cur;
+  while (level < LEVELS - 1 && (diff >> (SLOT_BITS * (level + 1))))
+    level++;
+
+  ev->level = level;
+  ev->slot = (expires >> (SLOT_BITS * level)) & SLOT_MASK;
+  list_append (&sched->slots[level][ev->slot], &ev->link);
+  sched->occupied[level] |= G_GUINT64_CONSTANT (1) << ev->slot;
+}
+
+static void
+wheel_remove (UmmsScheduler *sched, Event *ev)
+{
+  list_unlink (&ev->link);
+  if (ev->level != FIRING && list_empty (&sched->slots[ev->level][ev->slot]))
+    sched->occupied[ev->level] &= ~(G_GUINT64_CONSTANT (1) << ev->slot);
+  ev->level = FIRING;
+}
+
+//Tick of the next event to fire or slot to cascade.
+static guint64
+wheel_next_tick (UmmsScheduler *sched)
+{
+  guint64 next = NO_TICK;
+  guint64 base, tick;
+  gint level;
+
+  for (level = 0; level < LEVELS; level++) {
+    if (!sched->occupied[level])
+      continue;
+    base = sched->cur & ~((G_GUINT64_CONSTANT (1) << (SLOT_BITS * (level + 1))) - 1);
+    tick = base | ((guint64)__builtin_ctzll (sched->occupied[level]) << (SLOT_BITS * level));
+    next = MIN (next, tick);
+  }
+
+  return next;
+}
+
+static void
+event_free (Event *ev)
+{
+  if (ev->notify)
+    ev->notify (ev->data);
+  g_slice_free (Event, ev);
+}
+
+static void
+wheel_cascade (UmmsScheduler *sched, gint level, gint slot)
+{
+  Link pending;
+
+  list_move (&sched->slots[level][slot], &pending);
+  sched->occupied[level] &= ~(G_GUINT64_CONSTANT (1) << slot);
+
+  while (!list_empty (&pending)) {
+    Event *ev = EVENT (pending.next);
+    list_unlink (&ev->link);
+    wheel_insert (sched, ev);
+  }
+}
+
+static void
+wheel_fire (UmmsScheduler *sched, gint slot)
+{
+  Link firing;
+  Link *link;
+
+  list_move (&sched->slots[0][slot], &firing);
+  sched->occupied[0] &= ~(G_GUINT64_CONSTANT (1) << slot);
+  //Out of the wheel, the slot may get new events meanwhile.
+  for (link = firing.next; link != &firing; link = link->next)
+    EVENT (link)->level = FIRING;
+
+  //An event may cancel the other ones of this tick, so pop one at a time.
+  while (!list_empty (&firing)) {
+    Event *ev = EVENT (firing.next);
+    list_unlink (&ev->link);
+
+    if (ev->expires > sched->cur) {
+      wheel_insert (sched, ev);
+      continue;
+    }
+
+    g_hash_table_remove (sched->events, GUINT_TO_POINTER (ev->id));
+    ev->func (ev->data);
+    event_free (ev);
+  }
+}
+
+//Run all the events up to tick.
+static void
+wheel_advance (UmmsScheduler *sched, guint64 tick)
+{
+  guint64 next;
+  gint level;
+
+  while ((next = wheel_next_tick (sched)) <= tick) {
+    sched->cur = next;
+    if (sched->clock == UMMS_SCHEDULER_CLOCK_VIRTUAL)
+      sched->virtual_now = MAX (sched->virtual_now, (gint64)(next * UMMS_SCHEDULER_TICK));
+
+    for (level = LEVELS - 1; level > 0; level--) {
+      gint slot = (sched->cur >> (SLOT_BITS * level)) & SLOT_MASK;
+      if (sched->occupied[level] & (G_GUINT64_CONSTANT (1) << slot))
+        wheel_cascade (sched, level, slot);
+    }
+    if (sched->occupied[0] & (G_GUINT64_CONSTANT (1) << (sched->cur & SLOT_MASK)))
+      wheel_fire (sched, sched->cur & SLOT_MASK);
+  }
+
+  sched->cur = MAX (sched->cur, tick);
+}
+
+//The clock went backward, put all the events again relative to the new tick.
+static void
+wheel_rebase (UmmsScheduler *sched, guint64 tick)
+{
+  Link all;
+  gint level, slot;
+
+  list_init (&all);
+  for (level = 0; level < LEVELS; level++) {
+    for (slot = 0; slot < SLOTS; slot++) {
+      Link *head = &sched->slots[level][slot];
+      while (!list_empty (head)) {
+        Link *link = head->next;
+        list_unlink (link);
+        list_append (&all, link);
+      }
+    }
+    sched->occupied[level] = 0;
+  }
+
+  sched->cur = tick;
+  while (!list_empty (&all)) {
+    Event *ev = EVENT (all.next);
+    list_unlink (&ev->link);
+    wheel_insert (sched, ev);
+  }
+}
+
+static void
+timer_arm (UmmsScheduler *sched)
+{
+  struct itimerspec its;
+  guint64 next;
+  gint flags = TFD_TIMER_ABSTIME;
+
+  if (sched->fd < 0)
+    return;
+
+  next = wheel_next_tick (sched);
+  if (next == sched->armed)
+    return;
+
+  memset (&its, 0, sizeof (its));
+  if (next != NO_TICK) {
+    its.it_value.tv_sec = next * UMMS_SCHEDULER_TICK / G_USEC_PER_SEC;
+    its.it_value.tv_nsec = (next * UMMS_SCHEDULER_TICK % G_USEC_PER_SEC) * 1000;
+    //Wake up on clock changes too.
+#ifdef TFD_TIMER_CANCEL_ON_SET
+    flags |= TFD_TIMER_CANCEL_ON_SET;
+#endif
+  }
+
+  if (timerfd_settime (sched->fd, flags, &its, NULL) < 0) {
+    UMMS_WARNING ("timerfd_settime failed: %s", g_strerror (errno));
+    return;
+  }
+  sched->armed = next;
+}
+
+static gboolean
+timer_dispatch (GIOChannel *source, GIOCondition condition, gpointer data)
+{
+  UmmsScheduler *sched = (UmmsScheduler *)data;
+  guint64 expirations;
+  guint64 now;
+
+  if (read (sched->fd, &expirations, sizeof (expirations)) < 0 && errno == ECANCELED)
+    UMMS_DEBUG ("system clock changed");
+
+  now = time_to_tick (real_now ());
+  if (now < sched->cur)
+    wheel_rebase (sched, now);
+  else
+    wheel_advance (sched, now);
+
+  //The timerfd is disarmed once expired.
+  sched->armed = NO_TICK;
+  timer_arm (sched);
+
+  return TRUE;
+}
+
+UmmsScheduler *
+umms_scheduler_new (UmmsSchedulerClock clock, GError **err)
+{
+  UmmsScheduler *sched;
+  GIOChannel *channel;
+  gint level, slot;
+
+  sched = g_new0 (UmmsScheduler, 1);
+  sched->clock = clock;
+  sched->fd = -1;
+  sched->next_id = 1;
+  sched->armed = NO_TICK;
+  sched->virtual_now = real_now ();
+  sched->cur = time_to_tick (sched->virtual_now);
+  sched->events = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (level = 0; level < LEVELS; level++)
+    for (slot = 0; slot < SLOTS; slot++)
+      list_init (&sched->slots[level][slot]);
+
+  if (clock == UMMS_SCHEDULER_CLOCK_REALTIME) {
+    sched->fd = timerfd_create (CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sched->fd < 0) {
+      g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (errno),
+                   "timerfd_create failed: %s", g_strerror (errno));
+      umms_scheduler_free (sched);
+      return NULL;
+    }
+    channel = g_io_channel_unix_new (sched->fd);
+    sched->watch_id = g_io_add_watch (channel, G_IO_IN, timer_dispatch, sched);
+    g_io_channel_unref (channel);
+  }
+
+  return sched;
+}
+
+void
+umms_scheduler_free (UmmsScheduler *sched)
+{
+  GHashTableIter iter;
+  gpointer ev;
+
+  if (!sched)
+    return;
+
+  if (sched->watch_id)
+    g_source_remove (sched->watch_id);
+  if (sched->fd >= 0)
+    close (sched->fd);
+
+  g_hash_table_iter_init (&iter, sched->events);
+  while (g_hash_table_iter_next (&iter, NULL, &ev))
+    event_free ((Event *)ev);
+  g_hash_table_destroy (sched->events);
+  g_free (sched);
+}
+
+guint
+umms_scheduler_add (UmmsScheduler *sched, gint64 time, UmmsSchedulerFunc func,
+                    gpointer data, GDestroyNotify notify)
+{
+  Event *ev;
+
+  g_return_val_if_fail (sched && func, 0);
+
+  ev = g_slice_new0 (Event);
+  ev->func = func;
+  ev->data = data;
+  ev->notify = notify;
+  ev->expires = time_to_tick (time);
+  do {
+    ev->id = sched->next_id++;
+  } while (!ev->id || g_hash_table_lookup (sched->events, GUINT_TO_POINTER (ev->id)));
+
+  g_hash_table_insert (sched->events, GUINT_TO_POINTER (ev->id), ev);
+  wheel_insert (sched, ev);
+  if (ev->expires < sched->armed)
+    timer_arm (sched);
+
+  return ev->id;
+}
+
+gboolean
+umms_scheduler_cancel (UmmsScheduler *sched, guint id)
+{
+  Event *ev;
+
+  g_return_val_if_fail (sched, FALSE);
+
+  if (!(ev = g_hash_table_lookup (sched->events, GUINT_TO_POINTER (id))))
+    return FALSE;
+
+  g_hash_table_remove (sched->events, GUINT_TO_POINTER (id));
+  wheel_remove (sched, ev);
+  event_free (ev);
+  //A stale timerfd expiration is harmless, don't rearm.
+
+  return TRUE;
+}
+
+guint
+umms_scheduler_get_pending (UmmsScheduler *sched)
+{
+  g_return_val_if_fail (sched, 0);
+
+  return g_hash_table_size (sched->events);
+}
+
+void
+umms_scheduler_advance (UmmsScheduler *sched, gint64 time)
+{
+  g_return_if_fail (sched && sched->clock == UMMS_SCHEDULER_CLOCK_VIRTUAL);
+
+  if (time <= sched->virtual_now)
+    return;
+
+  //Ticks are rounded up, only run the events not later than time.
+  wheel_advance (sched, time / UMMS_SCHEDULER_TICK);
+  sched->virtual_now = time;
+}
@@ -0,0 +1,80 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_SCHEDULER_H
+#define _UMMS_SCHEDULER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Scheduler of the absolute time events (scheduled recordings, unattended
+ * execution deadlines), a hierarchical timer wheel with a resolution of
+ * UMMS_SCHEDULER_TICK. Insertion and cancellation are O(1).
+ *
+ * With UMMS_SCHEDULER_CLOCK_REALTIME the wheel is driven by a single timerfd
+ * on CLOCK_REALTIME dispatched by the default main context, so the events
+ * keep their wall clock time across system suspend and clock changes.
+ * With UMMS_SCHEDULER_CLOCK_VIRTUAL the time only moves by
+ * umms_scheduler_advance(), which is meant to simulate long schedules.
+ *
+ * Times are in microseconds since the Epoch. Not thread safe, use it from
+ * the main loop.
+ */
+
+#define UMMS_SCHEDULER_TICK 1000 //us
+
+typedef enum {
+  UMMS_SCHEDULER_CLOCK_REALTIME,
+  UMMS_SCHEDULER_CLOCK_VIRTUAL
+} UmmsSchedulerClock;
+
+typedef struct _UmmsScheduler UmmsScheduler;
+
+typedef void (*UmmsSchedulerFunc) (gpointer data);
+
+UmmsScheduler *umms_scheduler_new (UmmsSchedulerClock clock, GError **err);
+void umms_scheduler_free (UmmsScheduler *sched);
+
+/*
+ * Call func once at time, a time in the past fires on the next dispatch.
+ * notify is called on data after func ran or when the event is canceled.
+ *
+ * Returns:         The event id, never 0.
+ */
+guint umms_scheduler_add (UmmsScheduler *sched, gint64 time, UmmsSchedulerFunc func,
+                          gpointer data, GDestroyNotify notify);
+
+//FALSE if id already fired or is unknown.
+gboolean umms_scheduler_cancel (UmmsScheduler *sched, guint id);
+
+gint64 umms_scheduler_now (UmmsScheduler *sched);
+guint umms_scheduler_get_pending (UmmsScheduler *sched);
+
+//Virtual clock only: run all the events up to time and move the clock there.
+void umms_scheduler_advance (UmmsScheduler *sched, gint64 time);
+
+G_END_DECLS
+
+#endif /* _UMMS_SCHEDULER_H */
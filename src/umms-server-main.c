@@ -20,6 +20,8 @@
  * License along with UMMS; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
+#include <signal.h>
+#include <string.h>
 #include <dbus/dbus-glib-lowlevel.h>
 #include <dbus/dbus-glib.h>
 #include <dbus/dbus-glib-bindings.h>
@@ -35,14 +37,58 @@
 #include "umms-playing-content-metadata-viewer.h"
 #include "umms-audio-manager.h"
 #include "umms-video-output.h"
+#include "umms-worker-pool.h"
+#include "umms-backend-factory.h"
+#include "umms-stats.h"
 #include "./glue/umms-object-manager-glue.h"
 #include "./glue/umms-audio-manager-glue.h"
 #include "./glue/umms-video-output-glue.h"
 #include "./glue/umms-playing-content-metadata-viewer-glue.h"
+#include "./glue/umms-stats-glue.h"
 
 UmmsCtx *umms_ctx = NULL;
 static GMainLoop *loop = NULL;
 
+/*
+ * SIGUSR1 switches all logging to debug and back, SIGUSR2 dumps the log
+ * ring. A crash dumps the ring too, before the default action.
+ */
+static void
+log_signal_handler (int signum)
+{
+  switch (signum) {
+  case SIGUSR1:
+    umms_log_toggle_debug ();
+    break;
+  case SIGUSR2:
+    umms_log_dump_ring ();
+    break;
+  default:
+    umms_log_dump_ring ();
+    raise (signum);//SA_RESETHAND restored the default action
+    break;
+  }
+}
+
+static void
+install_log_signals (void)
+{
+  struct sigaction sa;
+  static const int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+  guint i;
+
+  memset (&sa, 0, sizeof (sa));
+  sigemptyset (&sa.sa_mask);
+  sa.sa_handler = log_signal_handler;
+  sa.sa_flags = SA_RESTART;
+  sigaction (SIGUSR1, &sa, NULL);
+  sigaction (SIGUSR2, &sa, NULL);
+
+  sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+  for (i = 0; i < G_N_ELEMENTS (fatal); i++)
+    sigaction (fatal[i], &sa, NULL);
+}
+
 static gboolean
 request_name (void)
 {
@@ -222,6 +268,25 @@ get_proxy_from_conf (UmmsCtx *ctx, GKeyFile *conf)
   return;
 }
 
+static guint
+get_worker_threads_from_conf (GKeyFile *conf)
+{
+  gint num;
+  GError *err = NULL;
+
+  if (!conf)
+    return 0;
+
+  num = g_key_file_get_integer (conf, DISPATCH_GROUP, "worker-threads", &err);
+  if (err) {
+    UMMS_DEBUG ("worker-threads not configured, dispatch all players on main loop");
+    g_error_free (err);
+    return 0;
+  }
+
+  return num > 0 ? num : 0;
+}
+
 int
 main (int    argc,
       char **argv)
@@ -233,6 +298,7 @@ main (int    argc,
 
   g_type_init ();
   g_thread_init (NULL);
+  dbus_g_thread_init ();
 
   umms_ctx = g_malloc0 (sizeof (UmmsCtx));
 
@@ -243,6 +309,13 @@ main (int    argc,
   umms_ctx->conf = load_conf (conf_path);
   umms_ctx->resource_conf = load_conf (resource_conf_path);
 
+  /* logging levels */
+  umms_log_init (umms_ctx->conf);
+  install_log_signals ();
+  if (umms_log_get_level (UmmsLogCategoryCore) < UmmsLogLevelDebug)
+    g_message ("debug logging off, enable it by level = debug in the [%s] group of %s or UMMS_LOG=debug",
+               LOG_GROUP, conf_path);
+
   /* http proxy */
   umms_ctx->proxy_uri = g_strdup (g_getenv ("http_proxy"));
   if (!umms_ctx->proxy_uri)
@@ -251,27 +324,40 @@ main (int    argc,
   /* plugins */
   load_plugins (umms_ctx);
 
+  /* protocol ==> plugin dispatch */
+  umms_backend_factory_build_index (umms_ctx->conf);
+
+  /* pre-warm player backends */
+  umms_backend_pool_init (umms_ctx->conf);
+
+  /* media players dispatching */
+  umms_worker_pool_init (get_worker_threads_from_conf (umms_ctx->conf));
+
   if (!request_name ()) {
     UMMS_DEBUG("UMMS service already running");
     exit (1);
   }
 
-  /* Global object */
+  /* Global object, the methods of each are timed by the stats */
+  UmmsStats *stats = NULL;
+  umms_stats_install_info (UMMS_TYPE_STATS, &dbus_glib_umms_stats_object_info);
+  stats = umms_stats_new ();
+
   UmmsObjectManager *umms_object_manager = NULL;
-  dbus_g_object_type_install_info (UMMS_TYPE_OBJECT_MANAGER, &dbus_glib_umms_object_manager_object_info);
+  umms_stats_install_info (UMMS_TYPE_OBJECT_MANAGER, &dbus_glib_umms_object_manager_object_info);
   umms_object_manager = umms_object_manager_new ();
 
   UmmsPlayingContentMetadataViewer *metadata_viewer = NULL;
-  dbus_g_object_type_install_info (UMMS_TYPE_PLAYING_CONTENT_METADATA_VIEWER, &dbus_glib_umms_playing_content_metadata_viewer_object_info);
+  umms_stats_install_info (UMMS_TYPE_PLAYING_CONTENT_METADATA_VIEWER, &dbus_glib_umms_playing_content_metadata_viewer_object_info);
   metadata_viewer = umms_playing_content_metadata_viewer_new (umms_object_manager);
 
   UmmsAudioManager *audio_manager = NULL;
-  dbus_g_object_type_install_info (UMMS_TYPE_AUDIO_MANAGER, &dbus_glib_umms_audio_manager_object_info);
+  umms_stats_install_info (UMMS_TYPE_AUDIO_MANAGER, &dbus_glib_umms_audio_manager_object_info);
   audio_manager = umms_audio_manager_new();
 
 
   UmmsVideoOutput *video_output = NULL;
-  dbus_g_object_type_install_info (UMMS_TYPE_VIDEO_OUTPUT, &dbus_glib_umms_video_output_object_info);
+  umms_stats_install_info (UMMS_TYPE_VIDEO_OUTPUT, &dbus_glib_umms_video_output_object_info);
   video_output = umms_video_output_new();
 
   connection = dbus_g_bus_get (DBUS_BUS_SYSTEM, &error);
@@ -285,6 +371,7 @@ main (int    argc,
   dbus_g_connection_register_g_object (connection, UMMS_PLAYING_CONTENT_METADATA_VIEWER_OBJECT_PATH, G_OBJECT (metadata_viewer));
   dbus_g_connection_register_g_object (connection, UMMS_AUDIO_MANAGER_OBJECT_PATH, G_OBJECT (audio_manager));
   dbus_g_connection_register_g_object (connection, UMMS_VIDEO_OUTPUT_OBJECT_PATH, G_OBJECT (video_output));
+  dbus_g_connection_register_g_object (connection, UMMS_STATS_OBJECT_PATH, G_OBJECT (stats));
 
   loop = g_main_loop_new (NULL, TRUE);
   g_main_loop_run (loop);
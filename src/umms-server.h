@@ -40,9 +40,23 @@
 #define UMMS_VIDEO_OUTPUT_OBJECT_PATH "/com/UMMS/VideoOutput"
 #define UMMS_VIDEO_OUTPUT_INTERFACE_NAME "com.UMMS.VideoOutput"
 
+#define UMMS_STATS_OBJECT_PATH "/com/UMMS/Stats"
+#define UMMS_STATS_INTERFACE_NAME "com.UMMS.Stats"
+
 #define RESOURCE_GROUP "Resource Definition"
 #define PROXY_GROUP "Proxy"
 #define PLAYER_PLUGIN_GROUP "Player Plugin Preference"
+#define DISPATCH_GROUP "Dispatch"
+#define BACKEND_POOL_GROUP "Backend Pool"
+#define CLIENT_LIVENESS_GROUP "Client Liveness"
+#define SCHEDULE_GROUP "Schedule"
+#define SCHEDULE_JOURNAL_DEFAULT "/var/lib/umms/schedule.journal"
+#define SCHEDULE_SYNC_INTERVAL_DEFAULT 100 //ms
+#define TIMESHIFT_GROUP "Timeshift"
+#define TIMESHIFT_DIR_DEFAULT "/var/tmp"
+#define FAST_ZAP_GROUP "Fast Zap"
+#define LOG_GROUP "Log"
+#define LOG_RING_DUMP_DEFAULT "/var/tmp/umms-log.ring"
 #define UMMS_PLUGINS_PATH_DEFAULT "/usr/lib/umms"
 
 typedef struct _UmmsCtx {
@@ -0,0 +1,459 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include "umms-server.h"
+#include "umms-debug.h"
+#include "umms-types.h"
+#include "umms-error.h"
+#include "umms-metrics.h"
+#include "umms-resource-manager.h"
+#include "umms-backend-factory.h"
+#include "umms-stats.h"
+
+G_DEFINE_TYPE (UmmsStats, umms_stats, G_TYPE_OBJECT)
+
+#define UMMS_STATS_GET_PRIVATE(o) \
+        (G_TYPE_INSTANCE_GET_PRIVATE ((o), UMMS_TYPE_STATS, UmmsStatsPrivate))
+
+#define GET_PRIVATE(o) ((UmmsStats *)o)->priv
+
+#define LAG_INTERVAL 100 //ms, between two samples of the main loop lag
+#define N_STATES     (PlayerStatePlaying + 1)
+
+struct _UmmsStatsPrivate {
+  guint   lag_id;
+  gint64  lag_due;
+  gint    lag_metric;
+};
+
+//A timed glue method, by its function.
+typedef struct {
+  GClosureMarshal marshaller;
+  gint            metric;
+  gboolean        async;//replied through its DBusGMethodInvocation, maybe later
+} TimedMethod;
+
+//An async call not replied yet.
+typedef struct {
+  gint   metric;
+  gint64 start;
+} PendingCall;
+
+typedef struct {
+  gint   state;
+  gint64 since;
+  gint64 durations[N_STATES];//us
+} PlayerTimes;
+
+static const gchar *state_names[N_STATES] = {"Null", "Stopped", "Paused", "Playing"};
+
+//Main loop only.
+static GHashTable *timed_methods = NULL;
+static GHashTable *installed = NULL;//GType -> the DBusGObjectInfo with the timed marshallers
+
+static GStaticMutex pending_lock = G_STATIC_MUTEX_INIT;
+static GHashTable *pending = NULL;//DBusGMethodInvocation -> PendingCall
+
+static GStaticMutex players_lock = G_STATIC_MUTEX_INIT;
+static GHashTable *players = NULL;//name -> PlayerTimes
+static gint state_metrics[N_STATES];
+
+static void
+timed_marshal (GClosure     *closure,
+               GValue       *return_value,
+               guint         n_param_values,
+               const GValue *param_values,
+               gpointer      invocation_hint,
+               gpointer      marshal_data)
+{
+  //The glue passes the method function as marshal_data.
+  TimedMethod *m = g_hash_table_lookup (timed_methods, marshal_data);
+  gint64 start = umms_metrics_now ();
+  PendingCall *call;
+
+  if (m->async) {
+    //The invocation is the last parameter, timed up to umms_stats_async_reply().
+    call = g_new (PendingCall, 1);
+    call->metric = m->metric;
+    call->start = start;
+    g_static_mutex_lock (&pending_lock);
+    if (!pending)
+      pending = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    g_hash_table_insert (pending, g_value_get_pointer (&param_values[n_param_values - 1]), call);
+    g_static_mutex_unlock (&pending_lock);
+  }
+
+  m->marshaller (closure, return_value, n_param_values, param_values, invocation_hint, marshal_data);
+  if (!m->async)
+    umms_metrics_record (m->metric, umms_metrics_now () - start);
+}
+
+void
+umms_stats_async_reply (DBusGMethodInvocation *context)
+{
+  PendingCall *call;
+  gint64 now = umms_metrics_now ();
+
+  g_static_mutex_lock (&pending_lock);
+  if (pending && (call = g_hash_table_lookup (pending, context))) {
+    umms_metrics_record (call->metric, now - call->start);
+    g_hash_table_remove (pending, context);
+  }
+  g_static_mutex_unlock (&pending_lock);
+}
+
+void
+umms_stats_install_info (GType type, const DBusGObjectInfo *info)
+{
+  DBusGObjectInfo *timed;
+  DBusGMethodInfo *methods;
+  TimedMethod *m;
+  const gchar *iface, *method;
+  gchar *name;
+  gint i;
+
+  if (!installed) {
+    installed = g_hash_table_new (g_direct_hash, g_direct_equal);
+    timed_methods = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  }
+
+  if (!(timed = g_hash_table_lookup (installed, GSIZE_TO_POINTER (type)))) {
+    methods = g_memdup (info->method_infos, info->n_method_infos * sizeof (DBusGMethodInfo));
+    for (i = 0; i < info->n_method_infos; i++) {
+      //"<interface>\0<Method>\0<A for async, S>\0..."
+      iface = info->data + methods[i].data_offset;
+      method = iface + strlen (iface) + 1;
+      name = g_strdup_printf ("%s.%s", iface, method);
+      m = g_new0 (TimedMethod, 1);
+      m->marshaller = methods[i].marshaller;
+      m->async = (method[strlen (method) + 1] == 'A');
+      m->metric = umms_metrics_register (name, UmmsMetricHistogram);
+      g_hash_table_insert (timed_methods, (gpointer)methods[i].function, m);
+      methods[i].marshaller = timed_marshal;
+      g_free (name);
+    }
+    timed = g_memdup (info, sizeof (DBusGObjectInfo));
+    timed->method_infos = methods;
+    g_hash_table_insert (installed, GSIZE_TO_POINTER (type), timed);
+  }
+
+  dbus_g_object_type_install_info (type, timed);
+}
+
+//Called with players_lock held.
+static GHashTable *
+players_get_locked (void)
+{
+  gchar *name;
+  gint i;
+
+  if (!players) {
+    players = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    for (i = 0; i < N_STATES; i++) {
+      name = g_strdup_printf ("player-state.%s", state_names[i]);
+      state_metrics[i] = umms_metrics_register (name, UmmsMetricHistogram);
+      g_free (name);
+    }
+  }
+  return players;
+}
+
+//Called with players_lock held.
+static void
+player_times_close (PlayerTimes *t, gint64 now)
+{
+  t->durations[t->state] += now - t->since;
+  umms_metrics_record (state_metrics[t->state], now - t->since);
+  t->since = now;
+}
+
+void
+umms_stats_player_state (const gchar *name, gint state)
+{
+  PlayerTimes *t;
+  gint64 now = umms_metrics_now ();
+
+  g_return_if_fail (state >= 0 && state < N_STATES);
+  if (!name)
+    return;
+
+  g_static_mutex_lock (&players_lock);
+  if (!(t = g_hash_table_lookup (players_get_locked (), name))) {
+    t = g_new0 (PlayerTimes, 1);
+    t->state = state;
+    t->since = now;
+    g_hash_table_insert (players, g_strdup (name), t);
+  } else if (t->state != state) {
+    player_times_close (t, now);
+    t->state = state;
+  }
+  g_static_mutex_unlock (&players_lock);
+}
+
+void
+umms_stats_player_removed (const gchar *name)
+{
+  PlayerTimes *t;
+
+  if (!name)
+    return;
+
+  g_static_mutex_lock (&players_lock);
+  if ((t = g_hash_table_lookup (players_get_locked (), name))) {
+    player_times_close (t, umms_metrics_now ());
+    g_hash_table_remove (players, name);
+  }
+  g_static_mutex_unlock (&players_lock);
+}
+
+static void
+val_free (gpointer data)
+{
+  GValue *val = (GValue *)data;
+  g_value_unset (val);
+  g_free (val);
+}
+
+//Keys are copied, as the counter names are built on the fly.
+static GHashTable *
+dict_new (void)
+{
+  return g_hash_table_new_full (g_str_hash, g_str_equal, g_free, val_free);
+}
+
+static GValue *
+dict_add (GHashTable *dict, const gchar *key, GType type)
+{
+  GValue *val = g_new0 (GValue, 1);
+
+  g_value_init (val, type);
+  g_hash_table_insert (dict, g_strdup (key), val);
+  return val;
+}
+
+static void
+dict_add_int64 (GHashTable *dict, const gchar *key, gint64 v)
+{
+  g_value_set_int64 (dict_add (dict, key, G_TYPE_INT64), v);
+}
+
+static gboolean
+lag_sample (UmmsStats *self)
+{
+  UmmsStatsPrivate *priv = GET_PRIVATE (self);
+  gint64 now = umms_metrics_now ();
+
+  //How late the timeout is dispatched, i.e. how long the main loop was kept busy.
+  if (priv->lag_due)
+    umms_metrics_record (priv->lag_metric, MAX (now - priv->lag_due, 0));
+  priv->lag_due = now + LAG_INTERVAL * 1000;
+
+  return TRUE;
+}
+
+gboolean
+umms_stats_get_histograms (UmmsStats *self, GPtrArray **histograms, GError **err)
+{
+  UmmsMetricSnapshot *snapshot;
+  GHashTable *dict;
+  GArray *buckets;
+  guint n, i;
+
+  snapshot = umms_metrics_snapshot (&n);
+  *histograms = g_ptr_array_new ();
+  for (i = 0; i < n; i++) {
+    if (snapshot[i].type != UmmsMetricHistogram)
+      continue;
+    dict = dict_new ();
+    g_value_set_string (dict_add (dict, "name", G_TYPE_STRING), snapshot[i].name);
+    g_value_set_uint64 (dict_add (dict, "count", G_TYPE_UINT64), snapshot[i].count);
+    dict_add_int64 (dict, "sum", snapshot[i].sum);
+    dict_add_int64 (dict, "p50", umms_metrics_percentile (&snapshot[i], 50));
+    dict_add_int64 (dict, "p99", umms_metrics_percentile (&snapshot[i], 99));
+    buckets = g_array_sized_new (FALSE, FALSE, sizeof (guint64), UMMS_METRICS_BUCKETS);
+    g_array_append_vals (buckets, snapshot[i].buckets, UMMS_METRICS_BUCKETS);
+    g_value_take_boxed (dict_add (dict, "buckets", DBUS_TYPE_G_UINT64_ARRAY), buckets);
+    g_ptr_array_add (*histograms, dict);
+  }
+  g_free (snapshot);
+
+  return TRUE;
+}
+
+gboolean
+umms_stats_get_counters (UmmsStats *self, GHashTable **counters, GError **err)
+{
+  UmmsResourceManager *mngr = umms_resource_manager_new ();
+  UmmsMetricSnapshot *snapshot;
+  guint hits, misses, limit, used;
+  gchar *key;
+  guint n, i;
+  gint type;
+
+  *counters = dict_new ();
+
+  snapshot = umms_metrics_snapshot (&n);
+  for (i = 0; i < n; i++) {
+    if (snapshot[i].type == UmmsMetricCounter)
+      dict_add_int64 (*counters, snapshot[i].name, snapshot[i].count);
+  }
+  g_free (snapshot);
+
+  for (type = 0; type < umms_resource_manager_get_type_num (mngr); type++) {
+    if (!umms_resource_manager_get_usage (mngr, type, &limit, &used))
+      continue;
+    key = g_strdup_printf ("resource.%d.limit", type);
+    dict_add_int64 (*counters, key, limit);
+    g_free (key);
+    key = g_strdup_printf ("resource.%d.used", type);
+    dict_add_int64 (*counters, key, used);
+    g_free (key);
+  }
+
+  umms_backend_pool_get_stats (&hits, &misses);
+  dict_add_int64 (*counters, "backend-pool.hits", hits);
+  dict_add_int64 (*counters, "backend-pool.misses", misses);
+
+  g_static_mutex_lock (&players_lock);
+  dict_add_int64 (*counters, "players", g_hash_table_size (players_get_locked ()));
+  g_static_mutex_unlock (&players_lock);
+
+  return TRUE;
+}
+
+gboolean
+umms_stats_get_player_states (UmmsStats *self, GPtrArray **out, GError **err)
+{
+  GHashTableIter iter;
+  PlayerTimes *t;
+  GHashTable *dict;
+  gchar *name;
+  gint64 now = umms_metrics_now ();
+  gint64 ms;
+  gint i;
+
+  *out = g_ptr_array_new ();
+
+  g_static_mutex_lock (&players_lock);
+  g_hash_table_iter_init (&iter, players_get_locked ());
+  while (g_hash_table_iter_next (&iter, (gpointer *)&name, (gpointer *)&t)) {
+    dict = dict_new ();
+    g_value_set_string (dict_add (dict, "name", G_TYPE_STRING), name);
+    g_value_set_int (dict_add (dict, "state", G_TYPE_INT), t->state);
+    for (i = 0; i < N_STATES; i++) {
+      ms = t->durations[i] + (i == t->state ? now - t->since : 0);
+      dict_add_int64 (dict, state_names[i], ms / 1000);
+    }
+    g_ptr_array_add (*out, dict);
+  }
+  g_static_mutex_unlock (&players_lock);
+
+  return TRUE;
+}
+
+gboolean
+umms_stats_reset (UmmsStats *self, GError **err)
+{
+  UMMS_DEBUG ("metrics reset");
+  umms_metrics_reset ();
+  return TRUE;
+}
+
+gboolean
+umms_stats_set_log_level (UmmsStats *self, const gchar *category, const gchar *level, GError **err)
+{
+  if (!umms_log_set_level (category, level)) {
+    g_set_error (err, UMMS_GENERIC_ERROR, UMMS_GENERIC_ERROR_INVALID_PARAM,
+                 "Invalid log category '%s' or level '%s'", category, level);
+    return FALSE;
+  }
+  UMMS_DEBUG ("log level of '%s' set to '%s'", category, level);
+  return TRUE;
+}
+
+gboolean
+umms_stats_get_log_levels (UmmsStats *self, GHashTable **levels, GError **err)
+{
+  gint i;
+
+  //The names are static.
+  *levels = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < UmmsLogCategoryNum; i++)
+    g_hash_table_insert (*levels, (gpointer)umms_log_category_name (i),
+                         (gpointer)umms_log_level_name (umms_log_get_level (i)));
+  return TRUE;
+}
+
+gboolean
+umms_stats_get_log_ring (UmmsStats *self, gchar ***records, GError **err)
+{
+  *records = umms_log_ring_lines ();
+  return TRUE;
+}
+
+static void
+umms_stats_dispose (GObject *object)
+{
+  UmmsStatsPrivate *priv = GET_PRIVATE (object);
+
+  if (priv->lag_id) {
+    g_source_remove (priv->lag_id);
+    priv->lag_id = 0;
+  }
+
+  G_OBJECT_CLASS (umms_stats_parent_class)->dispose (object);
+}
+
+static void
+umms_stats_finalize (GObject *object)
+{
+  G_OBJECT_CLASS (umms_stats_parent_class)->finalize (object);
+}
+
+static void
+umms_stats_class_init (UmmsStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (UmmsStatsPrivate));
+
+  object_class->dispose = umms_stats_dispose;
+  object_class->finalize = umms_stats_finalize;
+}
+
+static void
+umms_stats_init (UmmsStats *self)
+{
+  UmmsStatsPrivate *priv;
+
+  priv = self->priv = UMMS_STATS_GET_PRIVATE (self);
+  priv->lag_metric = umms_metrics_register ("main-loop-lag", UmmsMetricHistogram);
+  priv->lag_id = g_timeout_add (LAG_INTERVAL, (GSourceFunc)lag_sample, self);
+}
+
+UmmsStats *
+umms_stats_new ()
+{
+  return g_object_new (UMMS_TYPE_STATS, NULL);
+}
@@ -0,0 +1,101 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_STATS_H
+#define _UMMS_STATS_H
+
+#include <glib-object.h>
+#include <dbus/dbus-glib.h>
+
+G_BEGIN_DECLS
+
+#define UMMS_TYPE_STATS umms_stats_get_type()
+
+#define UMMS_STATS(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+  UMMS_TYPE_STATS, UmmsStats))
+
+#define UMMS_STATS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST ((klass), \
+  UMMS_TYPE_STATS, UmmsStatsClass))
+
+#define UMMS_IS_STATS(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+  UMMS_TYPE_STATS))
+
+#define UMMS_IS_STATS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE ((klass), \
+  UMMS_TYPE_STATS))
+
+#define UMMS_STATS_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), \
+  UMMS_TYPE_STATS, UmmsStatsClass))
+
+typedef struct _UmmsStats UmmsStats;
+typedef struct _UmmsStatsClass UmmsStatsClass;
+typedef struct _UmmsStatsPrivate UmmsStatsPrivate;
+
+struct _UmmsStats {
+  GObject parent;
+  UmmsStatsPrivate *priv;
+};
+
+struct _UmmsStatsClass {
+  GObjectClass parent_class;
+};
+
+GType umms_stats_get_type (void) G_GNUC_CONST;
+
+//The main loop lag is sampled from the creation on.
+UmmsStats *umms_stats_new ();
+
+/*
+ * Replaces dbus_g_object_type_install_info(), so that each method of the
+ * type is timed into the "<interface>.<Method>" histogram. Async methods are
+ * timed up to their reply, see umms_stats_async_reply().
+ *
+ * Main loop only, as the glue dispatch.
+ */
+void umms_stats_install_info (GType type, const DBusGObjectInfo *info);
+
+/*
+ * Call right before dbus_g_method_return() or dbus_g_method_return_error() of
+ * an async method, to record its latency. Any thread.
+ */
+void umms_stats_async_reply (DBusGMethodInvocation *context);
+
+//Time spent in each state, per media player. Any thread.
+void umms_stats_player_state (const gchar *name, gint state);
+void umms_stats_player_removed (const gchar *name);
+
+gboolean umms_stats_get_histograms (UmmsStats *self, GPtrArray **histograms, GError **err);
+gboolean umms_stats_get_counters (UmmsStats *self, GHashTable **counters, GError **err);
+gboolean umms_stats_get_player_states (UmmsStats *self, GPtrArray **players, GError **err);
+gboolean umms_stats_reset (UmmsStats *self, GError **err);
+gboolean umms_stats_set_log_level (UmmsStats *self, const gchar *category, const gchar *level, GError **err);
+gboolean umms_stats_get_log_levels (UmmsStats *self, GHashTable **levels, GError **err);
+gboolean umms_stats_get_log_ring (UmmsStats *self, gchar ***records, GError **err);
+
+G_END_DECLS
+
+#endif /* _UMMS_STATS_H */
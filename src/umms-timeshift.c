@@ -0,0 +1,375 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "umms-debug.h"
+#include "umms-timeshift.h"
+
+#define BLOCK_ALIGN 4096
+
+//Drop the index entries which fell out of the ring once they are the majority.
+#define INDEX_COMPACT_MIN 1024
+
+typedef struct _IndexEntry {
+  gint64  time;
+  guint64 pos;
+} IndexEntry;
+
+/*
+ * Positions are byte offsets in the whole stream, the offset in the file is
+ * pos % size. The file holds [tail, flushed), the block buffer [flushed, head).
+ */
+struct _UmmsTimeshift {
+  GMutex  *lock;
+  gint    fd;
+  guint64 size;
+  guint8  *block;
+  guint64 head;
+  guint64 flushed;
+  guint64 read_pos;
+  GArray  *index;//IndexEntry, in time order
+  guint   index_first;//entries before it are out of the ring
+  gint64  latest;
+};
+
+static void
+set_errno_error (GError **err, const gchar *what)
+{
+  gint saved_errno = errno;
+
+  g_set_error (err, G_FILE_ERROR, g_file_error_from_errno (saved_errno), "%s: %s", what, g_strerror (saved_errno));
+}
+
+static inline guint64
+ring_tail (UmmsTimeshift *ts)
+{
+  return ts->flushed > ts->size ? ts->flushed - ts->size : 0;
+}
+
+static inline IndexEntry *
+index_entry (UmmsTimeshift *ts, guint i)
+{
+  return &g_array_index (ts->index, IndexEntry, i);
+}
+
+UmmsTimeshift *
+umms_timeshift_new (const gchar *dir, guint64 size, GError **err)
+{
+  UmmsTimeshift *ts;
+  gchar *path;
+  gint fd;
+
+  size -= size % UMMS_TIMESHIFT_BLOCK_SIZE;
+  if (size < 2 * UMMS_TIMESHIFT_BLOCK_SIZE) {
+    g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_INVAL, "Timeshift ring must hold at least 2 blocks of %d bytes",
+                 UMMS_TIMESHIFT_BLOCK_SIZE);
+    return NULL;
+  }
+
+  path = g_build_filename (dir, "umms-timeshift-XXXXXX", NULL);
+  fd = g_mkstemp_full (path, O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    set_errno_error (err, "Failed to create timeshift file");
+    g_free (path);
+    return NULL;
+  }
+  //Only reachable through the fd from now on.
+  g_unlink (path);
+  g_free (path);
+
+  //Allocated up front, so that the writer never stalls on block allocation or runs out of space.
+  if (fallocate (fd, 0, 0, size) < 0) {
+    if ((errno != EOPNOTSUPP && errno != ENOSYS) || ftruncate (fd, size) < 0) {
+      set_errno_error (err, "Failed to allocate timeshift file");
+      close (fd);
+      return NULL;
+    }
+    UMMS_DEBUG ("fallocate not supported, timeshift file is sparse");
+  }
+  posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  ts = g_new0 (UmmsTimeshift, 1);
+  if (posix_memalign ((void **)&ts->block, BLOCK_ALIGN, UMMS_TIMESHIFT_BLOCK_SIZE) != 0) {
+    g_set_error (err, G_FILE_ERROR, G_FILE_ERROR_NOMEM, "Failed to allocate timeshift block");
+    close (fd);
+    g_free (ts);
+    return NULL;
+  }
+  ts->fd = fd;
+  ts->size = size;
+  ts->lock = g_mutex_new ();
+  ts->index = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+  ts->latest = -1;
+
+  UMMS_DEBUG ("timeshift ring of %" G_GUINT64_FORMAT " bytes created", size);
+  return ts;
+}
+
+void
+umms_timeshift_free (UmmsTimeshift *ts)
+{
+  if (!ts)
+    return;
+
+  close (ts->fd);
+  free (ts->block);
+  g_array_free (ts->index, TRUE);
+  g_mutex_free (ts->lock);
+  g_free (ts);
+}
+
+static void
+index_prune (UmmsTimeshift *ts)
+{
+  guint64 tail = ring_tail (ts);
+
+  while (ts->index_first < ts->index->len && index_entry (ts, ts->index_first)->pos < tail)
+    ts->index_first++;
+
+  if (ts->index_first >= INDEX_COMPACT_MIN && ts->index_first * 2 >= ts->index->len) {
+    g_array_remove_range (ts->index, 0, ts->index_first);
+    ts->index_first = 0;
+  }
+}
+
+//Called with the lock held.
+static gboolean
+flush_block (UmmsTimeshift *ts, GError **err)
+{
+  const guint8 *p = ts->block;
+  off_t offset = ts->flushed % ts->size;
+  gsize len = UMMS_TIMESHIFT_BLOCK_SIZE;
+  gssize n;
+
+  while (len > 0) {
+    if ((n = pwrite (ts->fd, p, len, offset)) < 0) {
+      if (errno == EINTR)
+        continue;
+      set_errno_error (err, "Failed to write timeshift file");
+      return FALSE;
+    }
+    p += n;
+    offset += n;
+    len -= n;
+  }
+
+  ts->flushed += UMMS_TIMESHIFT_BLOCK_SIZE;
+  index_prune (ts);
+  return TRUE;
+}
+
+gboolean
+umms_timeshift_write (UmmsTimeshift *ts, gint64 time, gconstpointer data, gsize len, GError **err)
+{
+  const guint8 *p = data;
+  gboolean ret = TRUE;
+  gsize n;
+
+  g_return_val_if_fail (ts, FALSE);
+
+  g_mutex_lock (ts->lock);
+  if (ts->index_first == ts->index->len ||
+      time >= index_entry (ts, ts->index->len - 1)->time + UMMS_TIMESHIFT_INDEX_INTERVAL) {
+    IndexEntry entry = {time, ts->head};
+    g_array_append_val (ts->index, entry);
+  }
+  ts->latest = MAX (ts->latest, time);
+
+  while (len > 0) {
+    guint64 used = ts->head - ts->flushed;
+
+    n = MIN (len, UMMS_TIMESHIFT_BLOCK_SIZE - used);
+    memcpy (ts->block + used, p, n);
+    ts->head += n;
+    p += n;
+    len -= n;
+    if (ts->head - ts->flushed == UMMS_TIMESHIFT_BLOCK_SIZE && !(ret = flush_block (ts, err))) {
+      //Drop the block rather than stalling the live stream.
+      ts->head = ts->flushed;
+      break;
+    }
+  }
+  g_mutex_unlock (ts->lock);
+
+  return ret;
+}
+
+//First position which can be read, the overwritten data is skipped up to the next index entry.
+static guint64
+earliest_pos (UmmsTimeshift *ts)
+{
+  if (ts->index_first < ts->index->len)
+    return index_entry (ts, ts->index_first)->pos;
+  return MAX (ring_tail (ts), ts->flushed);
+}
+
+gssize
+umms_timeshift_read (UmmsTimeshift *ts, gpointer buf, gsize len, GError **err)
+{
+  guint64 pos;
+  gsize n;
+  gssize r;
+  gsize done;
+
+  g_return_val_if_fail (ts, -1);
+
+  g_mutex_lock (ts->lock);
+  for (;;) {
+    if (ts->read_pos < ring_tail (ts)) {
+      UMMS_DEBUG ("timeshift reader overrun, skipping %" G_GUINT64_FORMAT " bytes", earliest_pos (ts) - ts->read_pos);
+      ts->read_pos = earliest_pos (ts);
+    }
+    pos = ts->read_pos;
+    n = MIN (len, ts->head - pos);
+
+    //Not flushed yet, in the block buffer.
+    if (pos >= ts->flushed) {
+      memcpy (buf, ts->block + (pos - ts->flushed), n);
+      ts->read_pos += n;
+      g_mutex_unlock (ts->lock);
+      return n;
+    }
+
+    //From the file, without blocking the writer meanwhile.
+    n = MIN (n, ts->flushed - pos);
+    n = MIN (n, ts->size - pos % ts->size);
+    g_mutex_unlock (ts->lock);
+
+    for (done = 0; done < n; done += r) {
+      if ((r = pread (ts->fd, (guint8 *)buf + done, n - done, (pos + done) % ts->size)) <= 0) {
+        if (r < 0 && errno == EINTR) {
+          r = 0;
+          continue;
+        }
+        if (r == 0)
+          errno = EIO;
+        set_errno_error (err, "Failed to read timeshift file");
+        return -1;
+      }
+    }
+
+    g_mutex_lock (ts->lock);
+    //Valid unless the writer overwrote it or the reader seeked meanwhile.
+    if (pos >= ring_tail (ts) && ts->read_pos == pos) {
+      ts->read_pos += n;
+      g_mutex_unlock (ts->lock);
+      return n;
+    }
+  }
+}
+
+//Index of the last entry with time <= t, index_first if none. Called with the lock held.
+static guint
+index_search_time (UmmsTimeshift *ts, gint64 t)
+{
+  guint lo = ts->index_first, hi = ts->index->len;
+
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (index_entry (ts, mid)->time <= t)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+gint64
+umms_timeshift_seek (UmmsTimeshift *ts, gint64 time)
+{
+  IndexEntry *entry;
+  gint64 ret = -1;
+
+  g_return_val_if_fail (ts, -1);
+
+  g_mutex_lock (ts->lock);
+  if (ts->index_first < ts->index->len) {
+    entry = index_entry (ts, index_search_time (ts, time));
+    ts->read_pos = entry->pos;
+    ret = entry->time;
+  }
+  g_mutex_unlock (ts->lock);
+
+  return ret;
+}
+
+gint64
+umms_timeshift_tell (UmmsTimeshift *ts)
+{
+  guint lo, hi;
+  gint64 ret = -1;
+
+  g_return_val_if_fail (ts, -1);
+
+  g_mutex_lock (ts->lock);
+  lo = ts->index_first;
+  hi = ts->index->len;
+  if (lo < hi) {
+    while (hi - lo > 1) {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (index_entry (ts, mid)->pos <= ts->read_pos)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    ret = index_entry (ts, lo)->time;
+  }
+  g_mutex_unlock (ts->lock);
+
+  return ret;
+}
+
+gboolean
+umms_timeshift_get_window (UmmsTimeshift *ts, gint64 *earliest, gint64 *latest)
+{
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (ts, FALSE);
+
+  g_mutex_lock (ts->lock);
+  if (ts->index_first < ts->index->len) {
+    *earliest = index_entry (ts, ts->index_first)->time;
+    *latest = ts->latest;
+    ret = TRUE;
+  }
+  g_mutex_unlock (ts->lock);
+
+  return ret;
+}
+
+guint64
+umms_timeshift_get_size (UmmsTimeshift *ts)
+{
+  g_return_val_if_fail (ts, 0);
+
+  return ts->size;
+}
@@ -0,0 +1,92 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_TIMESHIFT_H
+#define _UMMS_TIMESHIFT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Disk backed ring of a live stream, for pause and rewind on live content.
+ *
+ * The stream is appended in blocks of UMMS_TIMESHIFT_BLOCK_SIZE into a
+ * preallocated file, which is unlinked at once so that it goes away with the
+ * process. Once the file is full, the oldest block is overwritten. The data
+ * not yet in a full block is read from memory, so the reader may follow the
+ * live edge closely.
+ *
+ * Each write carries the stream time of its first byte. An index entry is
+ * kept every UMMS_TIMESHIFT_INDEX_INTERVAL ms of stream time, seeks are a
+ * binary search in it. Times must not decrease, use the running time rather
+ * than the PCR/PTS which may wrap or jump.
+ *
+ * One writer (the source of the stream) and one reader (the playback) may
+ * run on different threads.
+ */
+
+//4096 aligned and a whole number of TS packets, so that no packet straddles the end of the file.
+#define UMMS_TIMESHIFT_BLOCK_SIZE     (188 * 4096)
+#define UMMS_TIMESHIFT_INDEX_INTERVAL 100 //ms
+
+typedef struct _UmmsTimeshift UmmsTimeshift;
+
+/*
+ * dir:             Directory of the ring file.
+ * size:            Size of the ring file in bytes, rounded down to whole
+ *                  blocks, at least 2 blocks.
+ */
+UmmsTimeshift *umms_timeshift_new (const gchar *dir, guint64 size, GError **err);
+void umms_timeshift_free (UmmsTimeshift *ts);
+
+//time:            Stream time of the first byte of data, in ms.
+gboolean umms_timeshift_write (UmmsTimeshift *ts, gint64 time, gconstpointer data, gsize len, GError **err);
+
+/*
+ * Read from the read position, which starts at the beginning of the ring and
+ * jumps forward to the earliest data left if the writer overwrote it.
+ *
+ * Returns:         Bytes read, 0 at the live edge, -1 on error.
+ */
+gssize umms_timeshift_read (UmmsTimeshift *ts, gpointer buf, gsize len, GError **err);
+
+/*
+ * Move the read position to the last index entry not later than time, or to
+ * the earliest one.
+ *
+ * Returns:         Time of the new read position, -1 if the ring is empty.
+ */
+gint64 umms_timeshift_seek (UmmsTimeshift *ts, gint64 time);
+
+//Returns the time of the read position, -1 if the ring is empty.
+gint64 umms_timeshift_tell (UmmsTimeshift *ts);
+
+//Stream times of the earliest seekable and of the latest data, FALSE if the ring is empty.
+gboolean umms_timeshift_get_window (UmmsTimeshift *ts, gint64 *earliest, gint64 *latest);
+
+guint64 umms_timeshift_get_size (UmmsTimeshift *ts);
+
+G_END_DECLS
+
+#endif /* _UMMS_TIMESHIFT_H */
@@ -0,0 +1,396 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "umms-debug.h"
+#include "umms-ts-scanner.h"
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#define SYNC_BYTE  0x47
+#define N_PIDS     (UMMS_TS_PID_MAX + 1)
+#define CC_UNKNOWN 0xFF
+
+struct _UmmsTsScanner {
+  UmmsTsScannerImpl impl;
+  guint32        filter[N_PIDS / 32];//one bit per PID
+  guint8         last_cc[N_PIDS];
+  UmmsTsPidStats *stats;//N_PIDS entries
+  guint64        packets;
+  guint64        sync_errors;
+  guint64        tei_errors;
+};
+
+static UmmsTsScannerImpl
+best_impl (void)
+{
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    return UmmsTsScannerImplAVX2;
+  if (__builtin_cpu_supports ("sse2"))
+    return UmmsTsScannerImplSSE2;
+#endif
+  return UmmsTsScannerImplScalar;
+}
+
+UmmsTsScanner *
+umms_ts_scanner_new (void)
+{
+  UmmsTsScanner *sc = g_new0 (UmmsTsScanner, 1);
+
+  sc->stats = g_new0 (UmmsTsPidStats, N_PIDS);
+  memset (sc->last_cc, CC_UNKNOWN, sizeof (sc->last_cc));
+  sc->impl = best_impl ();
+  UMMS_DEBUG ("TS scanner using %s", umms_ts_scanner_impl_name (sc->impl));
+
+  return sc;
+}
+
+void
+umms_ts_scanner_free (UmmsTsScanner *sc)
+{
+  if (!sc)
+    return;
+
+  g_free (sc->stats);
+  g_free (sc);
+}
+
+gboolean
+umms_ts_scanner_set_impl (UmmsTsScanner *sc, UmmsTsScannerImpl impl)
+{
+  UmmsTsScannerImpl best = best_impl ();
+
+  g_return_val_if_fail (sc, FALSE);
+
+  if (impl == UmmsTsScannerImplAuto)
+    impl = best;
+  //The impls are ordered, each CPU level supports the ones below it.
+  if (impl > best)
+    return FALSE;
+
+  sc->impl = impl;
+  return TRUE;
+}
+
+UmmsTsScannerImpl
+umms_ts_scanner_get_impl (UmmsTsScanner *sc)
+{
+  g_return_val_if_fail (sc, UmmsTsScannerImplScalar);
+
+  return sc->impl;
+}
+
+const gchar *
+umms_ts_scanner_impl_name (UmmsTsScannerImpl impl)
+{
+  switch (impl) {
+    case UmmsTsScannerImplAuto:
+      return "auto";
+    case UmmsTsScannerImplScalar:
+      return "scalar";
+    case UmmsTsScannerImplSSE2:
+      return "sse2";
+    case UmmsTsScannerImplAVX2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+void
+umms_ts_scanner_add_pid (UmmsTsScanner *sc, guint pid)
+{
+  g_return_if_fail (sc && pid <= UMMS_TS_PID_MAX);
+
+  sc->filter[pid / 32] |= 1u << (pid % 32);
+}
+
+void
+umms_ts_scanner_remove_pid (UmmsTsScanner *sc, guint pid)
+{
+  g_return_if_fail (sc && pid <= UMMS_TS_PID_MAX);
+
+  sc->filter[pid / 32] &= ~(1u << (pid % 32));
+  memset (&sc->stats[pid], 0, sizeof (UmmsTsPidStats));
+  sc->last_cc[pid] = CC_UNKNOWN;
+}
+
+void
+umms_ts_scanner_add_all_pids (UmmsTsScanner *sc)
+{
+  g_return_if_fail (sc);
+
+  memset (sc->filter, 0xFF, sizeof (sc->filter));
+}
+
+static inline gboolean
+pid_filtered (UmmsTsScanner *sc, guint pid)
+{
+  return (sc->filter[pid / 32] >> (pid % 32)) & 1;
+}
+
+/*
+ * Account a packet of a filtered PID, common to all the impls.
+ *
+ * The continuity_counter is incremented by the packets carrying a payload
+ * only, and may be repeated once for a duplicate packet. Not checked for
+ * the null packets, after a discontinuity_indicator or on a packet whose
+ * header may be corrupted (TEI).
+ */
+static inline void
+account_packet (UmmsTsScanner *sc, const guint8 *pkt, guint pid)
+{
+  UmmsTsPidStats *stats = &sc->stats[pid];
+  guint afc = (pkt[3] >> 4) & 0x3;
+  guint cc = pkt[3] & 0x0F;
+  guint last = sc->last_cc[pid];
+  gboolean discontinuity;
+
+  stats->packets++;
+  if (pkt[1] & 0x80) {
+    stats->tei_errors++;
+    return;
+  }
+  if (pid == UMMS_TS_PID_NULL)
+    return;
+
+  discontinuity = (afc & 0x2) && pkt[4] > 0 && (pkt[5] & 0x80);
+  if (last != CC_UNKNOWN && !discontinuity) {
+    if (afc & 0x1) {
+      if (cc != ((last + 1) & 0x0F) && cc != last)
+        stats->cc_errors++;
+    } else if (cc != last) {
+      stats->cc_errors++;
+    }
+  }
+  sc->last_cc[pid] = cc;
+}
+
+static inline void
+scan_packet (UmmsTsScanner *sc, const guint8 *pkt, guint32 offset, guint32 *matches, guint *n)
+{
+  guint pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+
+  sc->packets++;
+  if (pkt[1] & 0x80)
+    sc->tei_errors++;
+  if (pid_filtered (sc, pid)) {
+    account_packet (sc, pkt, pid);
+    if (matches)
+      matches[*n] = offset;
+    (*n)++;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+//Account the lanes of a batch, from the masks computed by the SIMD impls.
+static inline void
+scan_batch_masks (UmmsTsScanner *sc, const guint8 *data, gsize pos, guint n_lanes, guint tei_mask,
+                  guint match_mask, guint32 *matches, guint *n)
+{
+  const guint8 *pkt;
+  guint lane;
+
+  sc->packets += n_lanes;
+  sc->tei_errors += __builtin_popcount (tei_mask);
+  while (match_mask) {
+    lane = __builtin_ctz (match_mask);
+    match_mask &= match_mask - 1;
+    pkt = data + pos + lane * UMMS_TS_PACKET_LEN;
+    account_packet (sc, pkt, ((pkt[1] & 0x1F) << 8) | pkt[2]);
+    if (matches)
+      matches[*n] = pos + lane * UMMS_TS_PACKET_LEN;
+    (*n)++;
+  }
+}
+
+static inline guint32
+load_header (const guint8 *pkt)
+{
+  guint32 v;
+
+  memcpy (&v, pkt, sizeof (v));
+  return GUINT32_FROM_LE (v);
+}
+
+/*
+ * 4 packets: the headers are gathered in one register, read little endian,
+ * so sync is bits 0-7, TEI bit 15, PID bits 8-12 and 16-23. FALSE without
+ * side effect if a sync byte is wrong, for the scalar path to resync.
+ */
+__attribute__ ((target ("sse2"))) static gboolean
+scan_batch_sse2 (UmmsTsScanner *sc, const guint8 *data, gsize pos, guint32 *matches, guint *n)
+{
+  const guint8 *p = data + pos;
+  __m128i hdr, pid;
+  guint32 pids[4] __attribute__ ((aligned (16)));
+  guint tei_mask, match_mask, i;
+
+  hdr = _mm_setr_epi32 (load_header (p), load_header (p + UMMS_TS_PACKET_LEN),
+                        load_header (p + 2 * UMMS_TS_PACKET_LEN), load_header (p + 3 * UMMS_TS_PACKET_LEN));
+  if (_mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_and_si128 (hdr, _mm_set1_epi32 (0xFF)),
+                                                          _mm_set1_epi32 (SYNC_BYTE)))) != 0xF)
+    return FALSE;
+
+  tei_mask = _mm_movemask_ps (_mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_and_si128 (hdr, _mm_set1_epi32 (0x8000)),
+                                                                 _mm_set1_epi32 (0x8000))));
+  pid = _mm_or_si128 (_mm_and_si128 (hdr, _mm_set1_epi32 (0x1F00)),
+                      _mm_and_si128 (_mm_srli_epi32 (hdr, 16), _mm_set1_epi32 (0xFF)));
+  _mm_store_si128 ((__m128i *)pids, pid);
+
+  //No gather in SSE2, the filter lookup is branchless per lane.
+  match_mask = 0;
+  for (i = 0; i < 4; i++)
+    match_mask |= ((sc->filter[pids[i] / 32] >> (pids[i] % 32)) & 1) << i;
+
+  scan_batch_masks (sc, data, pos, 4, tei_mask, match_mask, matches, n);
+  return TRUE;
+}
+
+//8 packets, headers and filter words gathered.
+__attribute__ ((target ("avx2"))) static gboolean
+scan_batch_avx2 (UmmsTsScanner *sc, const guint8 *data, gsize pos, guint32 *matches, guint *n)
+{
+  const __m256i offsets = _mm256_setr_epi32 (0, UMMS_TS_PACKET_LEN, 2 * UMMS_TS_PACKET_LEN, 3 * UMMS_TS_PACKET_LEN,
+                                             4 * UMMS_TS_PACKET_LEN, 5 * UMMS_TS_PACKET_LEN, 6 * UMMS_TS_PACKET_LEN,
+                                             7 * UMMS_TS_PACKET_LEN);
+  __m256i hdr, pid, words, bits;
+  guint tei_mask, match_mask;
+
+  hdr = _mm256_i32gather_epi32 ((const int *)(data + pos), offsets, 1);
+  if (_mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (_mm256_and_si256 (hdr, _mm256_set1_epi32 (0xFF)),
+                                                                   _mm256_set1_epi32 (SYNC_BYTE)))) != 0xFF)
+    return FALSE;
+
+  tei_mask = _mm256_movemask_ps (_mm256_castsi256_ps (
+                                   _mm256_cmpeq_epi32 (_mm256_and_si256 (hdr, _mm256_set1_epi32 (0x8000)),
+                                                       _mm256_set1_epi32 (0x8000))));
+  pid = _mm256_or_si256 (_mm256_and_si256 (hdr, _mm256_set1_epi32 (0x1F00)),
+                         _mm256_and_si256 (_mm256_srli_epi32 (hdr, 16), _mm256_set1_epi32 (0xFF)));
+  words = _mm256_i32gather_epi32 ((const int *)sc->filter, _mm256_srli_epi32 (pid, 5), 4);
+  bits = _mm256_and_si256 (_mm256_srlv_epi32 (words, _mm256_and_si256 (pid, _mm256_set1_epi32 (31))),
+                           _mm256_set1_epi32 (1));
+  match_mask = _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (bits, _mm256_set1_epi32 (1))));
+
+  scan_batch_masks (sc, data, pos, 8, tei_mask, match_mask, matches, n);
+  return TRUE;
+}
+#endif
+
+/*
+ * Find the next packet start at or after pos: a sync byte followed by
+ * another one a packet further, or by the end of data. len if none.
+ */
+static gsize
+resync (const guint8 *data, gsize pos, gsize len)
+{
+  const guint8 *p;
+
+  while (pos < len) {
+    if (!(p = memchr (data + pos, SYNC_BYTE, len - pos)))
+      return len;
+    pos = p - data;
+    if (pos + UMMS_TS_PACKET_LEN >= len || data[pos + UMMS_TS_PACKET_LEN] == SYNC_BYTE)
+      return pos;
+    pos++;
+  }
+  return len;
+}
+
+gsize
+umms_ts_scanner_scan (UmmsTsScanner *sc, const guint8 *data, gsize len, guint32 *matches, guint *n_matches)
+{
+  gsize pos = 0, next;
+  guint n = 0;
+
+  g_return_val_if_fail (sc && data, 0);
+
+  while (pos + UMMS_TS_PACKET_LEN <= len) {
+#ifdef HAVE_X86_SIMD
+    if (sc->impl == UmmsTsScannerImplAVX2 && pos + 8 * UMMS_TS_PACKET_LEN <= len
+        && scan_batch_avx2 (sc, data, pos, matches, &n)) {
+      pos += 8 * UMMS_TS_PACKET_LEN;
+      continue;
+    }
+    if (sc->impl >= UmmsTsScannerImplSSE2 && pos + 4 * UMMS_TS_PACKET_LEN <= len
+        && scan_batch_sse2 (sc, data, pos, matches, &n)) {
+      pos += 4 * UMMS_TS_PACKET_LEN;
+      continue;
+    }
+#endif
+    //Scalar path, also the tail and the packets around a sync loss for the SIMD impls.
+    if (data[pos] != SYNC_BYTE) {
+      next = resync (data, pos, len);
+      UMMS_DEBUG ("lost sync, skipping %" G_GSIZE_FORMAT " bytes", next - pos);
+      sc->sync_errors++;
+      pos = next;
+      continue;
+    }
+    scan_packet (sc, data + pos, pos, matches, &n);
+    pos += UMMS_TS_PACKET_LEN;
+  }
+
+  if (n_matches)
+    *n_matches = n;
+  return pos;
+}
+
+gboolean
+umms_ts_scanner_get_pid_stats (UmmsTsScanner *sc, guint pid, UmmsTsPidStats *stats)
+{
+  g_return_val_if_fail (sc && stats, FALSE);
+
+  if (pid > UMMS_TS_PID_MAX || !pid_filtered (sc, pid))
+    return FALSE;
+
+  *stats = sc->stats[pid];
+  return TRUE;
+}
+
+void
+umms_ts_scanner_get_totals (UmmsTsScanner *sc, guint64 *packets, guint64 *sync_errors, guint64 *tei_errors)
+{
+  g_return_if_fail (sc);
+
+  if (packets)
+    *packets = sc->packets;
+  if (sync_errors)
+    *sync_errors = sc->sync_errors;
+  if (tei_errors)
+    *tei_errors = sc->tei_errors;
+}
+
+void
+umms_ts_scanner_reset (UmmsTsScanner *sc)
+{
+  g_return_if_fail (sc);
+
+  memset (sc->stats, 0, N_PIDS * sizeof (UmmsTsPidStats));
+  memset (sc->last_cc, CC_UNKNOWN, sizeof (sc->last_cc));
+  sc->packets = sc->sync_errors = sc->tei_errors = 0;
+}
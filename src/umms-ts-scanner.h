@@ -0,0 +1,98 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_TS_SCANNER_H
+#define _UMMS_TS_SCANNER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Transport stream packet scanner, for the backends handling TS in software
+ * (recording, PSI parsing for get_pat/get_pmt, ...).
+ *
+ * Checks the sync bytes, filters the packets against a set of PIDs, and
+ * keeps per PID statistics: packets, continuity counter errors and packets
+ * flagged by the transport_error_indicator. The headers are decoded several
+ * packets at a time with SSE2 or AVX2 when the CPU has them, the scalar path
+ * is used elsewhere and gives the same results.
+ *
+ * Not thread safe.
+ */
+
+#define UMMS_TS_PACKET_LEN 188
+#define UMMS_TS_PID_MAX    0x1FFF
+#define UMMS_TS_PID_NULL   0x1FFF
+
+typedef enum {
+  UmmsTsScannerImplAuto,//best one supported by the CPU
+  UmmsTsScannerImplScalar,
+  UmmsTsScannerImplSSE2,
+  UmmsTsScannerImplAVX2
+} UmmsTsScannerImpl;
+
+typedef struct {
+  guint64 packets;
+  guint64 cc_errors;
+  guint64 tei_errors;
+} UmmsTsPidStats;
+
+typedef struct _UmmsTsScanner UmmsTsScanner;
+
+UmmsTsScanner *umms_ts_scanner_new (void);
+void umms_ts_scanner_free (UmmsTsScanner *sc);
+
+//FALSE if the CPU doesn't support impl.
+gboolean umms_ts_scanner_set_impl (UmmsTsScanner *sc, UmmsTsScannerImpl impl);
+UmmsTsScannerImpl umms_ts_scanner_get_impl (UmmsTsScanner *sc);
+const gchar *umms_ts_scanner_impl_name (UmmsTsScannerImpl impl);
+
+//Statistics are kept for the PIDs of the filter only.
+void umms_ts_scanner_add_pid (UmmsTsScanner *sc, guint pid);
+void umms_ts_scanner_remove_pid (UmmsTsScanner *sc, guint pid);
+void umms_ts_scanner_add_all_pids (UmmsTsScanner *sc);
+
+/*
+ * Scan the whole packets of data. After garbage, the input is resynchronized
+ * on a 0x47 followed by another one a packet further.
+ *
+ * matches:         Filled with the offset in data of each packet whose PID
+ *                  is in the filter, room for len / UMMS_TS_PACKET_LEN
+ *                  entries. May be NULL.
+ * n_matches:       Number of entries written to matches.
+ * Returns:         Bytes consumed. The rest, less than a packet, must be
+ *                  passed again in front of the next data.
+ */
+gsize umms_ts_scanner_scan (UmmsTsScanner *sc, const guint8 *data, gsize len, guint32 *matches, guint *n_matches);
+
+//FALSE if pid is not in the filter.
+gboolean umms_ts_scanner_get_pid_stats (UmmsTsScanner *sc, guint pid, UmmsTsPidStats *stats);
+//Totals over all the PIDs, filtered or not. Any of the pointers may be NULL.
+void umms_ts_scanner_get_totals (UmmsTsScanner *sc, guint64 *packets, guint64 *sync_errors, guint64 *tei_errors);
+//Clear the statistics and the continuity state, the filter is kept.
+void umms_ts_scanner_reset (UmmsTsScanner *sc);
+
+G_END_DECLS
+
+#endif /* _UMMS_TS_SCANNER_H */
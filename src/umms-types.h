@@ -31,6 +31,11 @@ typedef enum {
   PlayerStatePlaying
 } PlayerState;
 
+typedef enum {
+  ExecutionStatePending,  /* Recording waiting for its start time. */
+  ExecutionStateRunning
+} ExecutionState;
+
 typedef enum {
   TargetTypeInvalid = -1,
   XWindow,
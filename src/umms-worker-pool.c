@@ -0,0 +1,169 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define UMMS_LOG_CATEGORY UmmsLogCategoryPlayer
+
+#include <glib.h>
+#include "umms-debug.h"
+#include "umms-worker-pool.h"
+
+struct _UmmsWorker {
+  GThread      *thread;
+  GMainContext *context;
+  GMainLoop    *loop;
+  guint        load;//number of media players bound to this worker
+  gint         index;
+};
+
+static GStaticMutex pool_lock = G_STATIC_MUTEX_INIT;
+static GPtrArray *workers = NULL;
+static guint max_workers = 0;
+
+static gpointer
+worker_thread_func (gpointer data)
+{
+  UmmsWorker *worker = (UmmsWorker *)data;
+
+  /*
+   * Make the worker context the thread default one, so that sources which
+   * the backend attaches while running on this thread are dispatched here.
+   */
+  g_main_context_push_thread_default (worker->context);
+  UMMS_DEBUG ("worker %d started", worker->index);
+  g_main_loop_run (worker->loop);
+  g_main_context_pop_thread_default (worker->context);
+
+  return NULL;
+}
+
+static UmmsWorker *
+worker_new (gint index)
+{
+  UmmsWorker *worker;
+  GError *err = NULL;
+
+  worker = g_new0 (UmmsWorker, 1);
+  worker->index = index;
+  worker->context = g_main_context_new ();
+  worker->loop = g_main_loop_new (worker->context, FALSE);
+  worker->thread = g_thread_create (worker_thread_func, worker, FALSE, &err);
+
+  if (!worker->thread) {
+    UMMS_WARNING ("failed to create worker thread: %s", err ? err->message : "unknown error");
+    if (err)
+      g_error_free (err);
+    g_main_loop_unref (worker->loop);
+    g_main_context_unref (worker->context);
+    g_free (worker);
+    worker = NULL;
+  }
+
+  return worker;
+}
+
+void
+umms_worker_pool_init (guint max)
+{
+  g_static_mutex_lock (&pool_lock);
+  if (!workers)
+    workers = g_ptr_array_new ();
+  max_workers = max;
+  g_static_mutex_unlock (&pool_lock);
+
+  UMMS_DEBUG ("worker pool bound: %u", max);
+}
+
+gboolean
+umms_worker_pool_is_enabled (void)
+{
+  return max_workers > 0;
+}
+
+UmmsWorker *
+umms_worker_pool_acquire (void)
+{
+  UmmsWorker *worker = NULL;
+  UmmsWorker *tmp;
+  gint i;
+
+  if (!umms_worker_pool_is_enabled ())
+    return NULL;
+
+  g_static_mutex_lock (&pool_lock);
+
+  for (i = 0; i < workers->len; i++) {
+    tmp = g_ptr_array_index (workers, i);
+    if (!worker || tmp->load < worker->load)
+      worker = tmp;
+  }
+
+  //Prefer an idle thread over sharing a busy one, as long as the bound allows.
+  if ((!worker || worker->load > 0) && workers->len < max_workers) {
+    if ((tmp = worker_new (workers->len))) {
+      g_ptr_array_add (workers, tmp);
+      worker = tmp;
+    }
+  }
+
+  if (worker)
+    worker->load++;
+
+  g_static_mutex_unlock (&pool_lock);
+
+  if (worker)
+    UMMS_DEBUG ("worker %d acquired, load=%u", worker->index, worker->load);
+  return worker;
+}
+
+void
+umms_worker_pool_release (UmmsWorker *worker)
+{
+  g_return_if_fail (worker);
+
+  g_static_mutex_lock (&pool_lock);
+  if (worker->load > 0)
+    worker->load--;
+  g_static_mutex_unlock (&pool_lock);
+}
+
+GMainContext *
+umms_worker_get_context (UmmsWorker *worker)
+{
+  g_return_val_if_fail (worker, NULL);
+  return worker->context;
+}
+
+void
+umms_worker_invoke (UmmsWorker *worker, GSourceFunc func, gpointer data, GDestroyNotify notify)
+{
+  GSource *source;
+
+  g_return_if_fail (worker);
+  g_return_if_fail (func);
+
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback (source, func, data, notify);
+  g_source_attach (source, worker->context);
+  g_source_unref (source);
+}
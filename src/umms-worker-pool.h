@@ -0,0 +1,59 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _UMMS_WORKER_POOL_H
+#define _UMMS_WORKER_POOL_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _UmmsWorker UmmsWorker;
+
+/*
+ * max_workers:     upper bound of worker threads, 0 disables the pool and
+ *                  every media player is dispatched on the main loop.
+ *
+ * Workers are spawned lazily, each one runs a GMainLoop on its own GMainContext.
+ */
+void umms_worker_pool_init (guint max_workers);
+gboolean umms_worker_pool_is_enabled (void);
+
+/*
+ * Returns:         The least loaded worker, spawning a new one if the bound
+ *                  allows it. NULL if the pool is disabled.
+ */
+UmmsWorker *umms_worker_pool_acquire (void);
+void umms_worker_pool_release (UmmsWorker *worker);
+
+GMainContext *umms_worker_get_context (UmmsWorker *worker);
+
+/*
+ * Queue func on the worker's context. Calls are run in FIFO order, so all
+ * the requests of one media player are serialized.
+ */
+void umms_worker_invoke (UmmsWorker *worker, GSourceFunc func, gpointer data, GDestroyNotify notify);
+
+G_END_DECLS
+
+#endif /* _UMMS_WORKER_POOL_H */
@@ -32,6 +32,13 @@
 #include "umms-marshals.h"
 #include "umms-plugin.h"
 #include "umms-resource-manager.h"
+#include "umms-metrics.h"
+#include "umms-frame-ring.h"
+#include "umms-timeshift.h"
+#include "umms-mux-recorder.h"
+#include "umms-ts-scanner.h"
+#include "umms-psi-cache.h"
+#include "umms-gop-cache.h"
 #include "umms-player-backend.h"
 #include "umms-video-output-backend.h"
 #include "umms-audio-manager-backend.h"
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Generate the test clips of bench-e2e from videotestsrc/audiotestsrc, with
+# the encoders found in the GStreamer 0.10 install. Existing clips are kept.
+#
+# Usage: bench-clips.sh dir [seconds]
+
+DIR=${1:-bench-clips}
+SECONDS_LEN=${2:-20}
+FRAMES=$((SECONDS_LEN * 25))
+BUFFERS=$((SECONDS_LEN * 44100 / 1024))
+LAUNCH=gst-launch-0.10
+INSPECT=gst-inspect-0.10
+
+VIDEO="videotestsrc num-buffers=$FRAMES pattern=smpte ! video/x-raw-yuv,width=640,height=480,framerate=25/1 ! timeoverlay"
+AUDIO="audiotestsrc num-buffers=$BUFFERS samplesperbuffer=1024 ! audio/x-raw-int,rate=44100,channels=2 ! audioconvert"
+
+have() {
+    for e in "$@"; do
+        $INSPECT $e > /dev/null 2>&1 || return 1
+    done
+}
+
+make_clip() {
+    out=$DIR/$1
+    shift
+    [ -s "$out" ] && return 0
+    echo "generating $out"
+    $LAUNCH -q "$@" > /dev/null || { rm -f "$out"; echo "failed to generate $out" >&2; }
+}
+
+if ! have videotestsrc audiotestsrc; then
+    echo "$LAUNCH with videotestsrc and audiotestsrc is needed to generate the clips" >&2
+    exit 1
+fi
+mkdir -p "$DIR"
+
+if have theoraenc vorbisenc oggmux; then
+    make_clip clip-theora.ogg $VIDEO ! theoraenc ! queue ! oggmux name=mux ! filesink location=$DIR/clip-theora.ogg \
+        $AUDIO ! vorbisenc ! queue ! mux.
+fi
+
+if have x264enc faac qtmux; then
+    make_clip clip-h264.mp4 $VIDEO ! x264enc key-int-max=25 ! queue ! qtmux name=mux ! filesink location=$DIR/clip-h264.mp4 \
+        $AUDIO ! faac ! queue ! mux.
+fi
+
+# The transport stream is also replayed over UDP by bench-e2e, for the zap scenario.
+if have mpegtsmux ffenc_mpeg2video ffenc_mp2; then
+    make_clip clip-mpeg2.ts $VIDEO ! ffenc_mpeg2video bitrate=4000000 gop-size=12 ! queue ! mpegtsmux name=mux \
+        ! filesink location=$DIR/clip-mpeg2.ts $AUDIO ! ffenc_mp2 ! queue ! mux.
+elif have mpegtsmux x264enc; then
+    make_clip clip-h264.ts $VIDEO ! x264enc key-int-max=25 ! queue ! mpegtsmux name=mux ! filesink location=$DIR/clip-h264.ts
+fi
+
+ls "$DIR"/clip-* > /dev/null 2>&1 || { echo "no encoder found to generate the clips" >&2; exit 1; }
@@ -0,0 +1,117 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench-common.h"
+
+gint64
+bench_now_usec (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+//Seconds, for the throughput benchmarks.
+gdouble
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//Set by make check: small default sizes, only the checks matter.
+gboolean
+bench_quick (void)
+{
+  return g_getenv ("BENCH_QUICK") != NULL;
+}
+
+BenchStat *
+bench_stat_new (const gchar *name)
+{
+  BenchStat *stat = g_new0 (BenchStat, 1);
+
+  stat->name = g_strdup (name);
+  stat->samples = g_array_new (FALSE, FALSE, sizeof (gint64));
+  return stat;
+}
+
+void
+bench_stat_free (BenchStat *stat)
+{
+  g_return_if_fail (stat);
+
+  g_array_free (stat->samples, TRUE);
+  g_free (stat->name);
+  g_free (stat);
+}
+
+void
+bench_stat_add (BenchStat *stat, gint64 usec)
+{
+  g_array_append_val (stat->samples, usec);
+}
+
+void
+bench_stat_merge (BenchStat *dest, BenchStat *src)
+{
+  g_array_append_vals (dest->samples, src->samples->data, src->samples->len);
+}
+
+static gint
+sample_cmp (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+
+  return x < y ? -1 : (x > y);
+}
+
+gint64
+bench_stat_percentile (BenchStat *stat, gdouble percent)
+{
+  guint index;
+
+  if (!stat->samples->len)
+    return 0;
+
+  g_array_sort (stat->samples, sample_cmp);
+  index = (guint)((stat->samples->len - 1) * percent / 100.0 + 0.5);
+  return g_array_index (stat->samples, gint64, index);
+}
+
+void
+bench_stat_print (BenchStat *stat)
+{
+  g_print ("%-20s calls=%-8u p50=%-8" G_GINT64_FORMAT " p99=%-8" G_GINT64_FORMAT " max=%" G_GINT64_FORMAT " (us)\n",
+           stat->name, stat->samples->len,
+           bench_stat_percentile (stat, 50),
+           bench_stat_percentile (stat, 99),
+           bench_stat_percentile (stat, 100));
+}
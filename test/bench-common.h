@@ -0,0 +1,45 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _BENCH_COMMON_H
+#define _BENCH_COMMON_H
+
+#include <glib.h>
+
+typedef struct _BenchStat {
+  gchar  *name;
+  GArray *samples;//gint64, micro seconds
+} BenchStat;
+
+gint64 bench_now_usec (void);
+gdouble bench_now (void);
+gboolean bench_quick (void);
+
+BenchStat *bench_stat_new (const gchar *name);
+void bench_stat_free (BenchStat *stat);
+void bench_stat_add (BenchStat *stat, gint64 usec);
+void bench_stat_merge (BenchStat *dest, BenchStat *src);
+gint64 bench_stat_percentile (BenchStat *stat, gdouble percent);
+void bench_stat_print (BenchStat *stat);
+
+#endif /* _BENCH_COMMON_H */
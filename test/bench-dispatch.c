@@ -0,0 +1,235 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Measure the method call latency of umms-server with many concurrent media players.
+ *
+ * Each client thread owns a private bus connection and an unattended media player,
+ * it keeps polling GetPosition and toggles Play/Pause periodically. Latencies of
+ * all threads are merged and P50/P99 are printed per method.
+ *
+ * Usage: bench-dispatch [players] [seconds] [uri]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dbus/dbus.h>
+#include "bench-common.h"
+
+#define UMMS_SERVICE_NAME "com.UMMS"
+#define UMMS_OBJECT_MANAGER_OBJECT_PATH "/com/UMMS/ObjectManager"
+#define UMMS_OBJECT_MANAGER_INTERFACE_NAME "com.UMMS.ObjectManager.iface"
+#define MEDIA_PLAYER_INTERFACE_NAME "com.UMMS.MediaPlayer"
+
+#define DEFAULT_PLAYERS 16
+#define DEFAULT_SECONDS 10
+#define DEFAULT_URI "file:///root/test.mp4"
+#define POLL_INTERVAL 20000 //us
+#define TOGGLE_EVERY  25    //toggle Play/Pause every N polls
+#define CALL_TIMEOUT  10000 //ms
+
+typedef struct {
+  gint       index;
+  BenchStat  *get_position;
+  BenchStat  *play;
+  BenchStat  *pause;
+  guint      failures;
+} BenchClient;
+
+static gint    seconds = DEFAULT_SECONDS;
+static gchar  *uri = DEFAULT_URI;
+
+static DBusMessage *
+call_method (DBusConnection *conn, const char *path, const char *iface,
+             const char *method, int first_arg_type, ...)
+{
+  DBusMessage *msg;
+  DBusMessage *reply;
+  DBusError err;
+  va_list args;
+
+  msg = dbus_message_new_method_call (UMMS_SERVICE_NAME, path, iface, method);
+  va_start (args, first_arg_type);
+  dbus_message_append_args_valist (msg, first_arg_type, args);
+  va_end (args);
+
+  dbus_error_init (&err);
+  reply = dbus_connection_send_with_reply_and_block (conn, msg, CALL_TIMEOUT, &err);
+  dbus_message_unref (msg);
+
+  if (!reply) {
+    g_printerr ("%s failed: %s\n", method, err.message);
+    dbus_error_free (&err);
+  }
+  return reply;
+}
+
+static gboolean
+timed_call (DBusConnection *conn, const char *path, const char *method, BenchStat *stat)
+{
+  DBusMessage *reply;
+  gint64 start;
+
+  start = bench_now_usec ();
+  reply = call_method (conn, path, MEDIA_PLAYER_INTERFACE_NAME, method, DBUS_TYPE_INVALID);
+  if (!reply)
+    return FALSE;
+
+  bench_stat_add (stat, bench_now_usec () - start);
+  dbus_message_unref (reply);
+  return TRUE;
+}
+
+static gpointer
+client_thread (gpointer data)
+{
+  BenchClient *client = (BenchClient *)data;
+  DBusConnection *conn;
+  DBusMessage *reply;
+  DBusError err;
+  double tte = seconds + 10;//keep the player alive without heart beat
+  const char *token = NULL;
+  const char *path = NULL;
+  gchar *obj_path = NULL;
+  gboolean playing = TRUE;
+  gint64 deadline;
+  guint n = 0;
+
+  dbus_error_init (&err);
+  conn = dbus_bus_get_private (DBUS_BUS_SYSTEM, &err);
+  if (!conn) {
+    g_printerr ("client %d: can't connect to system bus: %s\n", client->index, err.message);
+    dbus_error_free (&err);
+    return NULL;
+  }
+
+  reply = call_method (conn, UMMS_OBJECT_MANAGER_OBJECT_PATH, UMMS_OBJECT_MANAGER_INTERFACE_NAME,
+                       "RequestMediaPlayerUnattended", DBUS_TYPE_DOUBLE, &tte, DBUS_TYPE_INVALID);
+  if (!reply)
+    goto out;
+  if (dbus_message_get_args (reply, NULL, DBUS_TYPE_STRING, &token, DBUS_TYPE_STRING, &path, DBUS_TYPE_INVALID))
+    obj_path = g_strdup (path);
+  dbus_message_unref (reply);
+  if (!obj_path)
+    goto out;
+
+  if ((reply = call_method (conn, obj_path, MEDIA_PLAYER_INTERFACE_NAME, "SetUri",
+                            DBUS_TYPE_STRING, &uri, DBUS_TYPE_INVALID)))
+    dbus_message_unref (reply);
+
+  if (!timed_call (conn, obj_path, "Play", client->play))
+    client->failures++;
+
+  deadline = bench_now_usec () + (gint64)seconds * G_USEC_PER_SEC;
+  while (bench_now_usec () < deadline) {
+    if (!timed_call (conn, obj_path, "GetPosition", client->get_position))
+      client->failures++;
+
+    if (++n % TOGGLE_EVERY == 0) {
+      if (!timed_call (conn, obj_path, playing ? "Pause" : "Play", playing ? client->pause : client->play))
+        client->failures++;
+      playing = !playing;
+    }
+    g_usleep (POLL_INTERVAL);
+  }
+
+  if ((reply = call_method (conn, obj_path, MEDIA_PLAYER_INTERFACE_NAME, "Stop", DBUS_TYPE_INVALID)))
+    dbus_message_unref (reply);
+  if ((reply = call_method (conn, UMMS_OBJECT_MANAGER_OBJECT_PATH, UMMS_OBJECT_MANAGER_INTERFACE_NAME,
+                            "RemoveMediaPlayer", DBUS_TYPE_STRING, &obj_path, DBUS_TYPE_INVALID)))
+    dbus_message_unref (reply);
+
+out:
+  g_free (obj_path);
+  dbus_connection_close (conn);
+  dbus_connection_unref (conn);
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  BenchClient *clients;
+  GThread **threads;
+  BenchStat *get_position, *play, *pause;
+  gint players = DEFAULT_PLAYERS;
+  guint failures = 0;
+  gint i;
+
+  if (argc > 1)
+    players = atoi (argv[1]);
+  if (argc > 2)
+    seconds = atoi (argv[2]);
+  if (argc > 3)
+    uri = argv[3];
+
+  if (players <= 0 || seconds <= 0) {
+    g_printerr ("Usage: %s [players] [seconds] [uri]\n", argv[0]);
+    return 1;
+  }
+
+  g_thread_init (NULL);
+  dbus_threads_init_default ();
+
+  g_print ("%d players, %d seconds, uri=%s\n", players, seconds, uri);
+
+  clients = g_new0 (BenchClient, players);
+  threads = g_new0 (GThread *, players);
+  for (i = 0; i < players; i++) {
+    clients[i].index = i;
+    clients[i].get_position = bench_stat_new ("GetPosition");
+    clients[i].play = bench_stat_new ("Play");
+    clients[i].pause = bench_stat_new ("Pause");
+    threads[i] = g_thread_create (client_thread, &clients[i], TRUE, NULL);
+  }
+
+  get_position = bench_stat_new ("GetPosition");
+  play = bench_stat_new ("Play");
+  pause = bench_stat_new ("Pause");
+
+  for (i = 0; i < players; i++) {
+    if (threads[i])
+      g_thread_join (threads[i]);
+    bench_stat_merge (get_position, clients[i].get_position);
+    bench_stat_merge (play, clients[i].play);
+    bench_stat_merge (pause, clients[i].pause);
+    failures += clients[i].failures;
+    bench_stat_free (clients[i].get_position);
+    bench_stat_free (clients[i].play);
+    bench_stat_free (clients[i].pause);
+  }
+
+  bench_stat_print (get_position);
+  bench_stat_print (play);
+  bench_stat_print (pause);
+  g_print ("failures: %u\n", failures);
+
+  bench_stat_free (get_position);
+  bench_stat_free (play);
+  bench_stat_free (pause);
+  g_free (threads);
+  g_free (clients);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,485 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * End-to-end latencies of umms-server, as a client sees them.
+ *
+ * For each clip and iteration a media player is requested, the clip is
+ * played, seeked, stopped and the player removed, timing:
+ *   request-player        RequestMediaPlayer
+ *   first-playing         SetUri+Play until PlayerStateChanged(Playing)
+ *   seek                  SetPosition until Seeked, seekable clips only
+ *   zap                   SetUri+Play of another stream while playing,
+ *                         until PlayerStateChanged(Playing), live only
+ *   stop                  Stop
+ *   remove-player         RemoveMediaPlayer
+ *
+ * Transport stream clips are also replayed to udp://127.0.0.1 on two ports,
+ * paced by their PCR, as a live source to zap between. The clips are made
+ * by bench-clips.sh, see "make bench". umms-server must be running.
+ *
+ * The results are written as JSON to the output file, one entry per clip
+ * and scenario with the sample count, failures and percentiles in us.
+ *
+ * Usage: bench-e2e output.json iterations clip...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+#include "umms-client-object.h"
+#include "umms-marshals.h"
+#include "umms-types.h"
+#include "umms-version.h"
+#include "bench-common.h"
+
+#define WAIT_TIMEOUT     10000 //ms, for a signal
+#define TS_PACKET_LEN    188
+#define DATAGRAM_LEN     (TS_PACKET_LEN * 7)
+#define REPLAY_BASE_PORT 5100
+#define REPLAY_RATE      (500 * 1000) //bytes/s, if the clip has no PCR
+
+typedef enum {
+  SCENARIO_REQUEST,
+  SCENARIO_FIRST_PLAYING,
+  SCENARIO_SEEK,
+  SCENARIO_ZAP,
+  SCENARIO_STOP,
+  SCENARIO_REMOVE,
+  SCENARIO_NUM
+} Scenario;
+
+static const gchar *scenario_names[SCENARIO_NUM] = {
+  "request-player", "first-playing", "seek", "zap", "stop", "remove-player"
+};
+
+typedef struct {
+  gchar     *name;
+  gchar     *uri;
+  gchar     *zap_uri;//live streams only
+  BenchStat *stats[SCENARIO_NUM];
+  guint     failures[SCENARIO_NUM];
+} Clip;
+
+typedef struct {
+  guint8    *data;
+  gsize     len;
+  gdouble   rate;//bytes/s
+  guint16   port;
+  GThread   *thread;
+} Replayer;
+
+//Signals seen on a player.
+typedef struct {
+  guint playing;//transitions into PlayerStatePlaying
+  guint seeked;
+  guint errors;
+} Watch;
+
+static volatile gboolean replaying = TRUE;
+
+//Byte rate from the first and last PCR of the first PID carrying one.
+static gdouble
+ts_rate (const guint8 *data, gsize len)
+{
+  const guint8 *p;
+  gint pcr_pid = -1;
+  guint64 pcr, first = 0, last = 0;
+  gsize first_off = 0, last_off = 0, off;
+
+  for (off = 0; off + TS_PACKET_LEN <= len; off += TS_PACKET_LEN) {
+    p = data + off;
+    if (p[0] != 0x47 || !(p[3] & 0x20) || p[4] < 7 || !(p[5] & 0x10))
+      continue;
+    pcr = ((guint64)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+    if (pcr_pid < 0) {
+      pcr_pid = ((p[1] & 0x1F) << 8) | p[2];
+      first = pcr;
+      first_off = off;
+    } else if ((((p[1] & 0x1F) << 8) | p[2]) != pcr_pid) {
+      continue;
+    }
+    last = pcr;
+    last_off = off;
+  }
+
+  if (last <= first || last_off <= first_off)
+    return REPLAY_RATE;
+  return (last_off - first_off) * 90000.0 / (last - first);
+}
+
+static gpointer
+replay_thread (gpointer data)
+{
+  Replayer *r = data;
+  struct sockaddr_in addr;
+  gint64 start;
+  guint64 sent = 0;
+  gsize off = 0, n;
+  gint64 due;
+  gint fd;
+
+  fd = socket (AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return NULL;
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons (r->port);
+  addr.sin_addr.s_addr = inet_addr ("127.0.0.1");
+
+  start = bench_now_usec ();
+  while (replaying) {
+    n = MIN (DATAGRAM_LEN, r->len - off);
+    sendto (fd, r->data + off, n, 0, (struct sockaddr *)&addr, sizeof (addr));
+    sent += n;
+    off = (off + n) % r->len;//looped
+
+    due = start + sent * G_USEC_PER_SEC / r->rate;
+    if (due > bench_now_usec ())
+      g_usleep (due - bench_now_usec ());
+  }
+
+  close (fd);
+  return NULL;
+}
+
+static Replayer *
+replayer_new (const gchar *path, guint16 port)
+{
+  Replayer *r = g_new0 (Replayer, 1);
+  GError *err = NULL;
+  gchar *contents;
+
+  if (!g_file_get_contents (path, &contents, &r->len, &err)) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_free (r);
+    return NULL;
+  }
+  r->data = (guint8 *)contents;
+  r->len -= r->len % TS_PACKET_LEN;
+  if (!r->len) {
+    g_printerr ("%s: too short\n", path);
+    g_free (r->data);
+    g_free (r);
+    return NULL;
+  }
+  r->rate = ts_rate (r->data, r->len);
+  r->port = port;
+  r->thread = g_thread_create (replay_thread, r, TRUE, NULL);
+  return r;
+}
+
+static void
+replayer_free (Replayer *r)
+{
+  if (r->thread)
+    g_thread_join (r->thread);
+  g_free (r->data);
+  g_free (r);
+}
+
+static void
+state_changed_cb (DBusGProxy *proxy, gint old_state, gint new_state, gpointer user_data)
+{
+  Watch *w = user_data;
+
+  if (new_state == PlayerStatePlaying)
+    w->playing++;
+}
+
+static void
+seeked_cb (DBusGProxy *proxy, gpointer user_data)
+{
+  ((Watch *)user_data)->seeked++;
+}
+
+static void
+error_cb (DBusGProxy *proxy, guint code, const gchar *msg, gpointer user_data)
+{
+  g_printerr ("error %u: %s\n", code, msg);
+  ((Watch *)user_data)->errors++;
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+  *(gboolean *)user_data = TRUE;
+  return FALSE;
+}
+
+//Run the main loop until *count reaches target, an Error is emitted or the timeout.
+static gboolean
+wait_count (Watch *w, guint *count, guint target)
+{
+  gboolean timed_out = FALSE;
+  guint errors = w->errors;
+  guint id;
+
+  id = g_timeout_add (WAIT_TIMEOUT, timeout_cb, &timed_out);
+  while (*count < target && w->errors == errors && !timed_out)
+    g_main_context_iteration (NULL, TRUE);
+  if (!timed_out)
+    g_source_remove (id);
+
+  return *count >= target;
+}
+
+static gboolean
+call (DBusGProxy *proxy, const gchar *method, GError **err)
+{
+  return dbus_g_proxy_call (proxy, method, err, G_TYPE_INVALID, G_TYPE_INVALID);
+}
+
+static gboolean
+set_uri_and_play (DBusGProxy *proxy, const gchar *uri, GError **err)
+{
+  return dbus_g_proxy_call (proxy, "SetUri", err, G_TYPE_STRING, uri, G_TYPE_INVALID, G_TYPE_INVALID)
+         && call (proxy, "Play", err);
+}
+
+static void
+record (Clip *clip, Scenario s, gint64 start, gboolean ok, GError *err)
+{
+  if (ok) {
+    bench_stat_add (clip->stats[s], bench_now_usec () - start);
+    return;
+  }
+  g_printerr ("%s %s failed: %s\n", clip->name, scenario_names[s], err ? err->message : "timeout or error signal");
+  if (err)
+    g_error_free (err);
+  clip->failures[s]++;
+}
+
+static void
+run_iteration (UmmsClientObject *client, Clip *clip)
+{
+  DBusGProxy *proxy;
+  Watch *w = g_new0 (Watch, 1);
+  GError *err = NULL;
+  gchar *name = NULL;
+  gint64 start, duration = 0;
+  guint target;
+  gboolean ok;
+
+  start = bench_now_usec ();
+  proxy = umms_client_object_request_player (client, TRUE, 0, &name);
+  record (clip, SCENARIO_REQUEST, start, proxy != NULL, NULL);
+  if (!proxy) {
+    g_free (w);
+    return;
+  }
+
+  dbus_g_proxy_add_signal (proxy, "PlayerStateChanged", G_TYPE_INT, G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Seeked", G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Error", G_TYPE_UINT, G_TYPE_STRING, G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal (proxy, "PlayerStateChanged", G_CALLBACK (state_changed_cb), w, NULL);
+  dbus_g_proxy_connect_signal (proxy, "Seeked", G_CALLBACK (seeked_cb), w, NULL);
+  dbus_g_proxy_connect_signal (proxy, "Error", G_CALLBACK (error_cb), w, NULL);
+
+  start = bench_now_usec ();
+  ok = set_uri_and_play (proxy, clip->uri, &err) && wait_count (w, &w->playing, 1);
+  record (clip, SCENARIO_FIRST_PLAYING, start, ok, err);
+  err = NULL;
+
+  if (ok && !clip->zap_uri
+      && dbus_g_proxy_call (proxy, "GetMediaSizeTime", NULL, G_TYPE_INVALID, G_TYPE_INT64, &duration, G_TYPE_INVALID)
+      && duration > 0) {
+    target = w->seeked + 1;
+    start = bench_now_usec ();
+    ok = dbus_g_proxy_call (proxy, "SetPosition", &err, G_TYPE_INT64, duration / 2, G_TYPE_INVALID, G_TYPE_INVALID)
+         && wait_count (w, &w->seeked, target);
+    record (clip, SCENARIO_SEEK, start, ok, err);
+    err = NULL;
+  }
+
+  if (ok && clip->zap_uri) {
+    target = w->playing + 1;
+    start = bench_now_usec ();
+    ok = set_uri_and_play (proxy, clip->zap_uri, &err) && wait_count (w, &w->playing, target);
+    record (clip, SCENARIO_ZAP, start, ok, err);
+    err = NULL;
+  }
+
+  start = bench_now_usec ();
+  ok = call (proxy, "Stop", &err);
+  record (clip, SCENARIO_STOP, start, ok, err);
+
+  start = bench_now_usec ();
+  umms_client_object_remove_player (client, proxy);
+  record (clip, SCENARIO_REMOVE, start, TRUE, NULL);
+
+  g_object_unref (proxy);
+  g_free (name);
+  g_free (w);
+}
+
+static Clip *
+clip_new (const gchar *name, gchar *uri, gchar *zap_uri)
+{
+  Clip *clip = g_new0 (Clip, 1);
+  gint i;
+
+  clip->name = g_strdup (name);
+  clip->uri = uri;
+  clip->zap_uri = zap_uri;
+  for (i = 0; i < SCENARIO_NUM; i++)
+    clip->stats[i] = bench_stat_new (scenario_names[i]);
+  return clip;
+}
+
+static void
+clip_free (Clip *clip)
+{
+  gint i;
+
+  for (i = 0; i < SCENARIO_NUM; i++)
+    bench_stat_free (clip->stats[i]);
+  g_free (clip->name);
+  g_free (clip->uri);
+  g_free (clip->zap_uri);
+  g_free (clip);
+}
+
+static gboolean
+write_json (const gchar *path, GPtrArray *clips, gint iterations)
+{
+  FILE *f;
+  Clip *clip;
+  BenchStat *stat;
+  gchar *name;
+  gboolean first = TRUE;
+  guint i;
+  gint s;
+
+  if (!(f = fopen (path, "w"))) {
+    g_printerr ("can't write %s\n", path);
+    return FALSE;
+  }
+
+  fprintf (f, "{\n  \"umms-version\": \"%d.%d.%d\",\n  \"iterations\": %d,\n  \"results\": [",
+           UMMS_MAJOR_VERSION, UMMS_MINOR_VERSION, UMMS_MICRO_VERSION, iterations);
+  for (i = 0; i < clips->len; i++) {
+    clip = g_ptr_array_index (clips, i);
+    name = g_strescape (clip->name, NULL);
+    for (s = 0; s < SCENARIO_NUM; s++) {
+      stat = clip->stats[s];
+      if (!stat->samples->len && !clip->failures[s])
+        continue;//not applicable to the clip
+      fprintf (f, "%s\n    {\"clip\": \"%s\", \"scenario\": \"%s\", \"samples\": %u, \"failures\": %u, "
+               "\"p50-us\": %" G_GINT64_FORMAT ", \"p99-us\": %" G_GINT64_FORMAT ", \"max-us\": %" G_GINT64_FORMAT "}",
+               first ? "" : ",", name, scenario_names[s], stat->samples->len, clip->failures[s],
+               bench_stat_percentile (stat, 50), bench_stat_percentile (stat, 99), bench_stat_percentile (stat, 100));
+      first = FALSE;
+    }
+    g_free (name);
+  }
+  fprintf (f, "\n  ]\n}\n");
+
+  return fclose (f) == 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  UmmsClientObject *client;
+  GPtrArray *clips, *replayers;
+  Replayer *r;
+  Clip *clip;
+  gchar *cwd, *abs, *name;
+  gint iterations, i, s;
+  guint16 port = REPLAY_BASE_PORT;
+  guint failures = 0;
+  guint j;
+
+  if (argc < 4 || (iterations = atoi (argv[2])) <= 0) {
+    g_printerr ("Usage: %s output.json iterations clip...\n", argv[0]);
+    return 1;
+  }
+
+  g_thread_init (NULL);
+  g_type_init ();
+  dbus_g_object_register_marshaller (umms_marshal_VOID__INT_INT, G_TYPE_NONE, G_TYPE_INT, G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_object_register_marshaller (umms_marshal_VOID__UINT_STRING, G_TYPE_NONE, G_TYPE_UINT, G_TYPE_STRING,
+                                     G_TYPE_INVALID);
+
+  cwd = g_get_current_dir ();
+  clips = g_ptr_array_new ();
+  replayers = g_ptr_array_new ();
+  for (i = 3; i < argc; i++) {
+    abs = g_path_is_absolute (argv[i]) ? g_strdup (argv[i]) : g_build_filename (cwd, argv[i], NULL);
+    g_ptr_array_add (clips, clip_new (argv[i], g_strconcat ("file://", abs, NULL), NULL));
+    g_free (abs);
+
+    if (!g_str_has_suffix (argv[i], ".ts"))
+      continue;
+    //Two streams of the clip to zap between.
+    if (!(r = replayer_new (argv[i], port)))
+      continue;
+    g_ptr_array_add (replayers, r);
+    if (!(r = replayer_new (argv[i], port + 1)))
+      continue;
+    g_ptr_array_add (replayers, r);
+    name = g_strdup_printf ("udp:%s", argv[i]);
+    g_ptr_array_add (clips, clip_new (name, g_strdup_printf ("udp://127.0.0.1:%u", port),
+                                      g_strdup_printf ("udp://127.0.0.1:%u", port + 1)));
+    g_free (name);
+    port += 2;
+  }
+  g_free (cwd);
+
+  client = umms_client_object_new ();
+  for (i = 0; i < iterations; i++) {
+    for (j = 0; j < clips->len; j++)
+      run_iteration (client, g_ptr_array_index (clips, j));
+  }
+
+  for (j = 0; j < clips->len; j++) {
+    clip = g_ptr_array_index (clips, j);
+    g_print ("%s\n", clip->name);
+    for (s = 0; s < SCENARIO_NUM; s++) {
+      if (clip->stats[s]->samples->len)
+        bench_stat_print (clip->stats[s]);
+      failures += clip->failures[s];
+    }
+  }
+  if (!write_json (argv[1], clips, iterations))
+    failures++;
+  g_print ("failures: %u, results in %s\n", failures, argv[1]);
+
+  replaying = FALSE;
+  g_ptr_array_foreach (replayers, (GFunc)replayer_free, NULL);
+  g_ptr_array_free (replayers, TRUE);
+  g_ptr_array_foreach (clips, (GFunc)clip_free, NULL);
+  g_ptr_array_free (clips, TRUE);
+  g_object_unref (client);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Measure the DataCopy frame ring without a server: the parent is a synthetic
+ * decoder pushing frames at a fixed rate, a forked child maps the ring like a
+ * client does and copies every frame it gets out. The child prints the
+ * write ==> copied out latency P50/P99, the throughput, and the dropped and torn
+ * (overwritten while being copied) frames.
+ *
+ * Usage: bench-frame-ring [fps] [seconds] [width] [height] [slots]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include "umms-frame-ring.h"
+#include "bench-common.h"
+
+#define DEFAULT_FPS     60
+#define DEFAULT_SECONDS 10
+#define DEFAULT_WIDTH   1920
+#define DEFAULT_HEIGHT  1080
+#define BYTES_PER_PIXEL 4
+#define FOURCC_BGRA     0x41524742
+#define EOS_PTS         -1
+
+static gint
+run_reader (gint fd, gint event_fd, guint frame_size)
+{
+  UmmsFrameRing *ring;
+  UmmsFrame frame;
+  BenchStat *latency;
+  GError *err = NULL;
+  guint8 *copy;
+  guint frames = 0, torn = 0;
+  guint64 bytes = 0;
+  gint64 start = 0, end;
+
+  if (!(ring = umms_frame_ring_open (fd, event_fd, &err))) {
+    g_printerr ("reader: %s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+
+  latency = bench_stat_new ("latency");
+  copy = g_malloc (frame_size);
+
+  for (;;) {
+    if (!umms_frame_ring_wait (ring, 1000)) {
+      g_printerr ("reader: timeout\n");
+      break;
+    }
+    if (!umms_frame_ring_acquire (ring, &frame))
+      continue;
+    if (frame.info.pts == EOS_PTS)
+      break;
+
+    memcpy (copy, frame.data, frame.info.size);
+    if (!umms_frame_ring_frame_valid (ring, &frame)) {
+      torn++;
+      continue;
+    }
+    bench_stat_add (latency, bench_now_usec () - frame.info.pts / 1000);
+    if (!frames++)
+      start = bench_now_usec ();
+    bytes += frame.info.size;
+  }
+  end = bench_now_usec ();
+
+  bench_stat_print (latency);
+  if (frames > 1 && end > start)
+    g_print ("read %u frames, %.1f frames/s, %.1f MB/s\n", frames,
+             (frames - 1) * 1e6 / (end - start), bytes / (gdouble)(end - start));
+  g_print ("dropped: %u, torn: %u\n", umms_frame_ring_get_dropped (ring), torn);
+
+  g_free (copy);
+  bench_stat_free (latency);
+  umms_frame_ring_free (ring);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  UmmsFrameRing *ring;
+  UmmsFrameInfo info = {0};
+  GError *err = NULL;
+  gint fps = DEFAULT_FPS;
+  gint seconds = DEFAULT_SECONDS;
+  gint width = DEFAULT_WIDTH;
+  gint height = DEFAULT_HEIGHT;
+  gint slots = UMMS_FRAME_RING_DEFAULT_SLOTS;
+  guint8 *frame;
+  gint64 next, deadline;
+  guint frame_size, written = 0;
+  gint status = 1;
+  pid_t pid;
+
+  if (argc > 1)
+    fps = atoi (argv[1]);
+  if (argc > 2)
+    seconds = atoi (argv[2]);
+  if (argc > 3)
+    width = atoi (argv[3]);
+  if (argc > 4)
+    height = atoi (argv[4]);
+  if (argc > 5)
+    slots = atoi (argv[5]);
+
+  if (fps <= 0 || seconds <= 0 || width <= 0 || height <= 0 || slots < 2) {
+    g_printerr ("Usage: %s [fps] [seconds] [width] [height] [slots]\n", argv[0]);
+    return 1;
+  }
+
+  frame_size = width * height * BYTES_PER_PIXEL;
+  if (!(ring = umms_frame_ring_new (slots, frame_size, &err))) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+
+  g_print ("%d fps, %d seconds, %dx%d, %d slots\n", fps, seconds, width, height, slots);
+
+  pid = fork ();
+  if (pid < 0) {
+    g_printerr ("fork failed\n");
+    umms_frame_ring_free (ring);
+    return 1;
+  }
+  if (pid == 0)
+    _exit (run_reader (umms_frame_ring_open_reader_fd (ring, NULL),
+                       dup (umms_frame_ring_get_event_fd (ring)), frame_size));
+
+  frame = g_malloc (frame_size);
+  memset (frame, 0x80, frame_size);
+  info.size = frame_size;
+  info.width = width;
+  info.height = height;
+  info.stride = width * BYTES_PER_PIXEL;
+  info.format = FOURCC_BGRA;
+
+  //Give the reader time to map the ring.
+  g_usleep (G_USEC_PER_SEC / 10);
+
+  next = bench_now_usec ();
+  deadline = next + (gint64)seconds * G_USEC_PER_SEC;
+  while (next < deadline) {
+    gint64 now = bench_now_usec ();
+
+    if (now < next)
+      g_usleep (next - now);
+    //Stamped before the copy, so the latency includes the copy by the producer.
+    info.pts = bench_now_usec () * 1000;
+    umms_frame_ring_write (ring, &info, frame);
+    written++;
+    next += G_USEC_PER_SEC / fps;
+  }
+
+  info.size = 0;
+  info.pts = EOS_PTS;
+  umms_frame_ring_commit (ring, &info);
+
+  waitpid (pid, &status, 0);
+  g_print ("wrote %u frames\n", written);
+
+  g_free (frame);
+  umms_frame_ring_free (ring);
+  return WIFEXITED (status) ? WEXITSTATUS (status) : 1;
+}
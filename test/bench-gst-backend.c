@@ -0,0 +1,206 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Benchmark of the hot paths of the GStreamer backend, per queueing preset.
+ *
+ * The backend is driven directly, headless: the sinks are fakesinks synced
+ * on the clock unless a preset sets others. Each iteration sets the uri, then
+ * times the preroll (Pause), the start (Play), a seek to a random position and
+ * the position query, the way a client polling the progress would. The
+ * same uri is played with each preset in turn. Fails if a transition fails.
+ *
+ * Usage: bench-gst-backend uri [iterations] [preset...]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <gst/gst.h>
+#include <umms.h>
+#include "umms-gst-backend.h"
+#include "bench-common.h"
+
+#define DEFAULT_ITERATIONS 20
+#define POSITION_QUERIES   1000
+#define HEADLESS_SINK      "fakesink sync=true"
+
+typedef struct {
+  gdouble *preroll, *start, *seek, *position;
+  guint n, n_seek;
+} Result;
+
+static const gchar *default_presets[] = {"default", "low-latency", "high-throughput", NULL};
+
+static gint
+double_cmp (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gdouble
+percentile (gdouble *v, guint n, gdouble p)
+{
+  return n ? v[(guint)((n - 1) * p)] : 0;
+}
+
+//The bus watch runs on the default main context.
+static void
+drain (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+static gboolean
+run (const gchar *uri, const gchar *preset, gint iterations, Result *r)
+{
+  UmmsGstQueueConf conf = {0,};
+  UmmsGstBackend *backend;
+  UmmsPlayerBackend *self;
+  GError *err = NULL;
+  gint64 duration = 0, pos;
+  gdouble start;
+  gint i, j;
+  gboolean ret = TRUE;
+
+  umms_gst_queue_conf_preset (&conf, preset);
+  conf.video_sink = g_strdup (HEADLESS_SINK);
+  conf.audio_sink = g_strdup (HEADLESS_SINK);
+  umms_gst_backend_set_default_conf (&conf);
+  umms_gst_queue_conf_clear (&conf);
+
+  if (!(backend = umms_gst_backend_new ())) {
+    g_printerr ("can't create the backend, is playbin2 installed?\n");
+    return FALSE;
+  }
+  self = UMMS_PLAYER_BACKEND (backend);
+
+  for (i = 0; i < iterations; i++) {
+    if (!umms_player_backend_set_uri (self, uri, &err))
+      goto failed;
+
+    start = bench_now ();
+    if (!umms_player_backend_pause (self, &err))
+      goto failed;
+    r->preroll[r->n] = (bench_now () - start) * 1e3;
+    drain ();
+
+    start = bench_now ();
+    if (!umms_player_backend_play (self, &err))
+      goto failed;
+    r->start[r->n] = (bench_now () - start) * 1e3;
+    drain ();
+
+    umms_player_backend_get_media_size_time (self, &duration, NULL);
+    if (self->seekable && duration > 0) {
+      start = bench_now ();
+      if (!umms_player_backend_set_position (self, g_random_double () * duration * 0.8, &err))
+        goto failed;
+      r->seek[r->n_seek++] = (bench_now () - start) * 1e3;
+      drain ();
+    }
+
+    start = bench_now ();
+    for (j = 0; j < POSITION_QUERIES; j++)
+      umms_player_backend_get_position (self, &pos, NULL);
+    r->position[r->n] = (bench_now () - start) * 1e6 / POSITION_QUERIES;
+
+    umms_player_backend_stop (self, NULL);
+    drain ();
+    r->n++;
+  }
+  goto out;
+
+failed:
+  g_printerr ("%s: %s\n", preset, err->message);
+  g_error_free (err);
+  umms_player_backend_stop (self, NULL);
+  ret = FALSE;
+out:
+  g_object_unref (backend);
+  drain ();
+  return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar **presets = default_presets;
+  const gchar *uri;
+  gint iterations = DEFAULT_ITERATIONS;
+  Result r;
+  gint i;
+  gint ret = 0;
+
+  if (argc > 2)
+    iterations = atoi (argv[2]);
+  if (argc > 3)
+    presets = (const gchar **)argv + 3;
+  if (argc < 2 || iterations <= 0) {
+    g_printerr ("Usage: %s uri [iterations] [preset...]\n", argv[0]);
+    return 1;
+  }
+  gst_init (&argc, &argv);
+  uri = argv[1];
+
+  r.preroll = g_new (gdouble, iterations);
+  r.start = g_new (gdouble, iterations);
+  r.seek = g_new (gdouble, iterations);
+  r.position = g_new (gdouble, iterations);
+
+  for (i = 0; presets[i]; i++) {
+    UmmsGstQueueConf conf;
+
+    if (!umms_gst_queue_conf_preset (&conf, presets[i])) {
+      g_printerr ("unknown preset \"%s\"\n", presets[i]);
+      ret = 1;
+      continue;
+    }
+    r.n = r.n_seek = 0;
+    if (!run (uri, presets[i], iterations, &r))
+      ret = 1;
+
+    qsort (r.preroll, r.n, sizeof (gdouble), double_cmp);
+    qsort (r.start, r.n, sizeof (gdouble), double_cmp);
+    qsort (r.seek, r.n_seek, sizeof (gdouble), double_cmp);
+    qsort (r.position, r.n, sizeof (gdouble), double_cmp);
+    g_print ("%s (%u/%d):\n", presets[i], r.n, iterations);
+    g_print ("  preroll   P50 %.1f ms, P99 %.1f ms\n", percentile (r.preroll, r.n, 0.5),
+             percentile (r.preroll, r.n, 0.99));
+    g_print ("  start     P50 %.1f ms, P99 %.1f ms\n", percentile (r.start, r.n, 0.5),
+             percentile (r.start, r.n, 0.99));
+    g_print ("  seek      P50 %.1f ms, P99 %.1f ms (%u)\n", percentile (r.seek, r.n_seek, 0.5),
+             percentile (r.seek, r.n_seek, 0.99), r.n_seek);
+    g_print ("  position  P50 %.2f us, P99 %.2f us\n", percentile (r.position, r.n, 0.5),
+             percentile (r.position, r.n, 0.99));
+  }
+
+  g_free (r.preroll);
+  g_free (r.start);
+  g_free (r.seek);
+  g_free (r.position);
+  return ret;
+}
@@ -0,0 +1,156 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the schedule journal: write a schedule of recordings with
+ * batched syncs, tear the last record as a crash would, then measure the
+ * replay on open. Fails if the replay takes longer than max-ms or doesn't
+ * give back the expected schedule.
+ *
+ * Usage: bench-journal [recordings] [max-ms] [path]
+ * make check runs it with BENCH_QUICK set, on 10000 recordings by default.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "umms-schedule-journal.h"
+#include "bench-common.h"
+
+#define DEFAULT_RECORDINGS 100000
+#define DEFAULT_MAX_MS     1000
+#define QUICK_RECORDINGS   10000 //make check
+#define SYNC_EVERY         256 //operations per fdatasync, as the sync timer would batch them
+#define CANCEL_EVERY       5
+#define START_EVERY        3
+
+int
+main (int argc, char **argv)
+{
+  UmmsScheduleJournal *journal;
+  GError *err = NULL;
+  GList *entries;
+  gchar *path = NULL;
+  gchar *tmp_path;
+  gint n = bench_quick () ? QUICK_RECORDINGS : DEFAULT_RECORDINGS;
+  gint max_ms = DEFAULT_MAX_MS;
+  guint live = 0, ops = 0, records;
+  gint64 t0 = (gint64)time (NULL) * G_USEC_PER_SEC;
+  gdouble start, write_time, replay_time;
+  gint fd, i;
+  gint ret = 0;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+  if (argc > 2)
+    max_ms = atoi (argv[2]);
+  if (argc > 3) {
+    path = g_strdup (argv[3]);
+  } else if ((fd = g_file_open_tmp ("bench-journal-XXXXXX", &path, &err)) >= 0) {
+    close (fd);
+    g_unlink (path);
+  }
+
+  if (n <= 0 || max_ms <= 0 || !path) {
+    g_printerr ("Usage: %s [recordings] [max-ms] [path]\n", argv[0]);
+    return 1;
+  }
+
+  if (!(journal = umms_schedule_journal_open (path, G_MAXUINT, &err))) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+
+  start = bench_now ();
+  for (i = 0; i < n; i++) {
+    gint64 begin = t0 + g_random_int_range (60, 7 * 24 * 3600) * (gint64)G_USEC_PER_SEC;
+    guint64 id = umms_schedule_journal_add (journal, begin, begin + 3600 * (gint64)G_USEC_PER_SEC,
+                                            "dvb://?program-number=1&frequency=546000000",
+                                            "/var/lib/umms/recordings/rec.ts",
+                                            "0123456789abcdef0123456789abcdef");
+    ops++;
+    if (i % CANCEL_EVERY == 0) {
+      umms_schedule_journal_cancel (journal, id);
+      ops++;
+    } else {
+      live++;
+      if (i % START_EVERY == 0) {
+        umms_schedule_journal_started (journal, id);
+        ops++;
+      }
+    }
+    if (ops % SYNC_EVERY == 0)
+      umms_schedule_journal_sync (journal, NULL);
+  }
+  umms_schedule_journal_sync (journal, NULL);
+  write_time = bench_now () - start;
+  records = umms_schedule_journal_get_records (journal);
+  umms_schedule_journal_close (journal);
+
+  //Half written record, as left by a crash.
+  if ((fd = open (path, O_WRONLY | O_APPEND)) >= 0) {
+    if (write (fd, "\x20\0\0\0\xde\xad", 6) < 0)
+      g_printerr ("failed to tear the journal\n");
+    close (fd);
+  }
+
+  start = bench_now ();
+  journal = umms_schedule_journal_open (path, G_MAXUINT, &err);
+  replay_time = bench_now () - start;
+  if (!journal) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_unlink (path);
+    g_free (path);
+    return 1;
+  }
+
+  entries = umms_schedule_journal_get_entries (journal);
+  g_print ("%d recordings, %u operations, %u records\n", n, ops, records);
+  g_print ("write: %.3f s, %.0f ops/s, %u syncs\n", write_time, ops / write_time, (ops + SYNC_EVERY - 1) / SYNC_EVERY);
+  g_print ("replay: %.1f ms, %.0f records/s, %u recordings restored\n",
+           replay_time * 1e3, records / replay_time, g_list_length (entries));
+
+  if (g_list_length (entries) != live) {
+    g_printerr ("expected %u recordings\n", live);
+    ret = 1;
+  }
+  if (replay_time * 1e3 > max_ms) {
+    g_printerr ("replay slower than %d ms\n", max_ms);
+    ret = 1;
+  }
+
+  g_list_free (entries);
+  umms_schedule_journal_close (journal);
+  g_unlink (path);
+  tmp_path = g_strconcat (path, ".tmp", NULL);
+  g_unlink (tmp_path);
+  g_free (tmp_path);
+  g_free (path);
+
+  return ret;
+}
@@ -0,0 +1,346 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Load generator for umms-server, run against the null backend to measure
+ * the server itself.
+ *
+ * Drives many unattended media players through libummsclient, each in a
+ * closed loop over a scenario: SetUri, Play, GetPosition polls, a seek, Pause
+ * and Stop. The calls are asynchronous, all players share the one bus
+ * connection and the main loop, and the next call of a player is issued as
+ * soon as the reply of the previous one arrives. Prints P50/P99 per method,
+ * the overall throughput, and the signals received.
+ *
+ * Usage: bench-load [players] [seconds] [uri]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <dbus/dbus-glib.h>
+#include "umms-client-object.h"
+#include "umms-marshals.h"
+#include "bench-common.h"
+
+#define DEFAULT_PLAYERS 64
+#define DEFAULT_SECONDS 10
+#define DEFAULT_URI     "null://load"
+#define CALL_TIMEOUT    10000 //ms
+
+typedef enum {
+  ARG_NONE,
+  ARG_URI,
+  ARG_POS
+} StepArg;
+
+typedef enum {
+  OUT_NONE,
+  OUT_INT,
+  OUT_INT64
+} StepOut;
+
+typedef struct {
+  const gchar *method;
+  StepArg     arg;
+  StepOut     out;
+} Step;
+
+static const Step scenario[] = {
+  {"SetUri", ARG_URI, OUT_NONE},
+  {"Play", ARG_NONE, OUT_NONE},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"GetPlayerState", ARG_NONE, OUT_INT},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"SetPosition", ARG_POS, OUT_NONE},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"Pause", ARG_NONE, OUT_NONE},
+  {"GetPlayerState", ARG_NONE, OUT_INT},
+  {"Play", ARG_NONE, OUT_NONE},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"GetPosition", ARG_NONE, OUT_INT64},
+  {"Stop", ARG_NONE, OUT_NONE},
+};
+
+//Signals counted, in the order of the counters.
+typedef enum {
+  SIG_EOF,
+  SIG_ERROR,
+  SIG_BUFFERING,
+  SIG_SEEKED,
+  SIG_STOPPED,
+  SIG_STATE_CHANGED,
+  SIG_VIDEO_TAG,
+  SIG_AUDIO_TAG,
+  SIG_TEXT_TAG,
+  SIG_NUM
+} Signal;
+
+static const gchar *signal_names[SIG_NUM] = {
+  "Eof", "Error", "Buffering", "Seeked", "Stopped", "PlayerStateChanged",
+  "VideoTagChanged", "AudioTagChanged", "TextTagChanged"
+};
+
+typedef struct {
+  DBusGProxy *proxy;
+  gchar      *name;
+  guint      step;
+  gint64     call_start;
+  gboolean   in_flight;
+} LoadPlayer;
+
+static GHashTable *stats;//method ==> BenchStat
+static guint64    signal_counts[SIG_NUM];
+static guint      failures;
+static guint      in_flight;
+static gboolean   stopping;
+static GMainLoop  *loop;
+static gchar      *uri = DEFAULT_URI;
+
+static void issue_call (LoadPlayer *p);
+
+static BenchStat *
+get_stat (const gchar *method)
+{
+  BenchStat *stat = g_hash_table_lookup (stats, method);
+
+  if (!stat) {
+    stat = bench_stat_new (method);
+    g_hash_table_insert (stats, (gpointer)method, stat);
+  }
+  return stat;
+}
+
+static void
+reply_cb (DBusGProxy *proxy, DBusGProxyCall *call, gpointer user_data)
+{
+  LoadPlayer *p = user_data;
+  const Step *step = &scenario[p->step];
+  GError *err = NULL;
+  gboolean ok;
+  gint64 pos;
+  gint state;
+
+  if (step->out == OUT_INT64)
+    ok = dbus_g_proxy_end_call (proxy, call, &err, G_TYPE_INT64, &pos, G_TYPE_INVALID);
+  else if (step->out == OUT_INT)
+    ok = dbus_g_proxy_end_call (proxy, call, &err, G_TYPE_INT, &state, G_TYPE_INVALID);
+  else
+    ok = dbus_g_proxy_end_call (proxy, call, &err, G_TYPE_INVALID);
+
+  if (ok) {
+    bench_stat_add (get_stat (step->method), bench_now_usec () - p->call_start);
+  } else {
+    g_printerr ("%s %s failed: %s\n", p->name, step->method, err ? err->message : "unknown error");
+    if (err)
+      g_error_free (err);
+    failures++;
+  }
+
+  p->in_flight = FALSE;
+  in_flight--;
+  p->step = (p->step + 1) % G_N_ELEMENTS (scenario);
+
+  if (!stopping)
+    issue_call (p);
+  else if (!in_flight)
+    g_main_loop_quit (loop);
+}
+
+static void
+issue_call (LoadPlayer *p)
+{
+  const Step *step = &scenario[p->step];
+  DBusGProxyCall *call;
+  gint64 pos;
+
+  p->call_start = bench_now_usec ();
+  if (step->arg == ARG_URI) {
+    call = dbus_g_proxy_begin_call_with_timeout (p->proxy, step->method, reply_cb, p, NULL, CALL_TIMEOUT,
+                                                 G_TYPE_STRING, uri, G_TYPE_INVALID);
+  } else if (step->arg == ARG_POS) {
+    pos = g_random_int_range (0, 30000);
+    call = dbus_g_proxy_begin_call_with_timeout (p->proxy, step->method, reply_cb, p, NULL, CALL_TIMEOUT,
+                                                 G_TYPE_INT64, pos, G_TYPE_INVALID);
+  } else {
+    call = dbus_g_proxy_begin_call_with_timeout (p->proxy, step->method, reply_cb, p, NULL, CALL_TIMEOUT,
+                                                 G_TYPE_INVALID);
+  }
+
+  if (!call) {
+    g_printerr ("%s %s not sent\n", p->name, step->method);
+    failures++;
+    return;
+  }
+  p->in_flight = TRUE;
+  in_flight++;
+}
+
+static void
+void_signal_cb (DBusGProxy *proxy, gpointer user_data)
+{
+  (*(guint64 *)user_data)++;
+}
+
+static void
+int_signal_cb (DBusGProxy *proxy, gint arg, gpointer user_data)
+{
+  (*(guint64 *)user_data)++;
+}
+
+static void
+int_int_signal_cb (DBusGProxy *proxy, gint arg1, gint arg2, gpointer user_data)
+{
+  (*(guint64 *)user_data)++;
+}
+
+static void
+error_signal_cb (DBusGProxy *proxy, guint code, const gchar *msg, gpointer user_data)
+{
+  (*(guint64 *)user_data)++;
+}
+
+static void
+connect_signals (DBusGProxy *proxy)
+{
+  Signal i;
+
+  dbus_g_proxy_add_signal (proxy, "Eof", G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Error", G_TYPE_UINT, G_TYPE_STRING, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Buffering", G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Seeked", G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "Stopped", G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "PlayerStateChanged", G_TYPE_INT, G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "VideoTagChanged", G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "AudioTagChanged", G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal (proxy, "TextTagChanged", G_TYPE_INT, G_TYPE_INVALID);
+
+  for (i = 0; i < SIG_NUM; i++) {
+    GCallback cb;
+
+    if (i == SIG_ERROR)
+      cb = G_CALLBACK (error_signal_cb);
+    else if (i == SIG_STATE_CHANGED)
+      cb = G_CALLBACK (int_int_signal_cb);
+    else if (i == SIG_BUFFERING || i == SIG_VIDEO_TAG || i == SIG_AUDIO_TAG || i == SIG_TEXT_TAG)
+      cb = G_CALLBACK (int_signal_cb);
+    else
+      cb = G_CALLBACK (void_signal_cb);
+    dbus_g_proxy_connect_signal (proxy, signal_names[i], cb, &signal_counts[i], NULL);
+  }
+}
+
+static gboolean
+deadline_cb (gpointer user_data)
+{
+  //Let the calls in flight complete, so that each player is left idle.
+  stopping = TRUE;
+  if (!in_flight)
+    g_main_loop_quit (loop);
+  return FALSE;
+}
+
+static void
+print_stat (gpointer key, gpointer value, gpointer user_data)
+{
+  BenchStat *stat = value;
+
+  bench_stat_print (stat);
+  *(guint64 *)user_data += stat->samples->len;
+}
+
+int
+main (int argc, char **argv)
+{
+  UmmsClientObject *client;
+  LoadPlayer *players;
+  gint n_players = DEFAULT_PLAYERS;
+  gint seconds = DEFAULT_SECONDS;
+  gint64 start, elapsed;
+  guint64 calls = 0;
+  gint i;
+
+  if (argc > 1)
+    n_players = atoi (argv[1]);
+  if (argc > 2)
+    seconds = atoi (argv[2]);
+  if (argc > 3)
+    uri = argv[3];
+
+  if (n_players <= 0 || seconds <= 0) {
+    g_printerr ("Usage: %s [players] [seconds] [uri]\n", argv[0]);
+    return 1;
+  }
+
+  g_type_init ();
+  dbus_g_object_register_marshaller (g_cclosure_marshal_VOID__INT, G_TYPE_NONE, G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_object_register_marshaller (umms_marshal_VOID__INT_INT, G_TYPE_NONE, G_TYPE_INT, G_TYPE_INT, G_TYPE_INVALID);
+  dbus_g_object_register_marshaller (umms_marshal_VOID__UINT_STRING, G_TYPE_NONE, G_TYPE_UINT, G_TYPE_STRING,
+                                     G_TYPE_INVALID);
+
+  g_print ("%d players, %d seconds, uri=%s\n", n_players, seconds, uri);
+
+  client = umms_client_object_new ();
+  stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)bench_stat_free);
+  players = g_new0 (LoadPlayer, n_players);
+  for (i = 0; i < n_players; i++) {
+    //Unattended, kept alive without the heart beat for the whole run.
+    players[i].proxy = umms_client_object_request_player (client, FALSE, seconds + 10, &players[i].name);
+    if (!players[i].proxy) {
+      g_printerr ("can't get player %d\n", i);
+      n_players = i;
+      break;
+    }
+    connect_signals (players[i].proxy);
+  }
+
+  loop = g_main_loop_new (NULL, FALSE);
+  start = bench_now_usec ();
+  for (i = 0; i < n_players; i++)
+    issue_call (&players[i]);
+  g_timeout_add_seconds (seconds, deadline_cb, NULL);
+  if (in_flight)
+    g_main_loop_run (loop);
+  elapsed = bench_now_usec () - start;
+
+  g_hash_table_foreach (stats, print_stat, &calls);
+  g_print ("%" G_GUINT64_FORMAT " calls in %.2f s, %.0f calls/s, failures: %u\n", calls, elapsed / 1e6,
+           calls * 1e6 / MAX (elapsed, 1), failures);
+  for (i = 0; i < SIG_NUM; i++)
+    g_print ("%-20s signals=%" G_GUINT64_FORMAT "\n", signal_names[i], signal_counts[i]);
+
+  for (i = 0; i < n_players; i++) {
+    umms_client_object_remove_player (client, players[i].proxy);
+    g_object_unref (players[i].proxy);
+    g_free (players[i].name);
+  }
+  g_main_loop_unref (loop);
+  g_hash_table_destroy (stats);
+  g_free (players);
+  g_object_unref (client);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the shared multiplex recorder, with a TS file standing in for
+ * the tuner.
+ *
+ * A multiplex of PROGRAMS programs (PAT, PMT, video and audio PIDs, null
+ * stuffing) is generated into a file, which is then read back in chunks not
+ * aligned on packets and recorded into one file per service. Fails if a
+ * recording doesn't hold exactly the packets of its program.
+ *
+ * Usage: bench-mux-record [services] [megabytes] [dir]
+ * make check runs it with BENCH_QUICK set, on 16 MB by default.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "umms-mux-recorder.h"
+#include "bench-common.h"
+
+#define PROGRAMS          8
+#define DEFAULT_SERVICES  4
+#define DEFAULT_MEGABYTES 256
+#define QUICK_MEGABYTES   16 //make check
+#define CHUNK_SIZE        (64 * 1024 + 100) //as the DVR device would deliver, not packet aligned
+#define PAT_EVERY         100 //packets
+#define PMT_EVERY         100
+
+#define PMT_PID(prog)     (0x1000 + (prog))
+#define VIDEO_PID(prog)   (0x100 + (prog) * 0x10)
+#define AUDIO_PID(prog)   (VIDEO_PID (prog) + 1)
+
+static void
+put_header (guint8 *pkt, guint pid, guint8 *cc)
+{
+  memset (pkt, 0xFF, UMMS_TS_PACKET_SIZE);
+  pkt[0] = 0x47;
+  pkt[1] = (pid >> 8) & 0x1F;
+  pkt[2] = pid & 0xFF;
+  pkt[3] = 0x10 | ((*cc)++ & 0x0F);
+}
+
+/*
+ * Write the multiplex, and count the packets of each program which should
+ * end up in its recording, the PAT aside.
+ */
+static guint64
+generate (const gchar *path, guint64 size, guint64 *program_packets, guint64 *pats)
+{
+  guint8 cc[0x2000] = {0,};
+  GString *buf = g_string_sized_new (CHUNK_SIZE + UMMS_TS_PACKET_SIZE);
+  guint8 pkt[UMMS_TS_PACKET_SIZE];
+  guint64 n = 0, written = 0;
+  guint prog, pid;
+  FILE *f;
+
+  if (!(f = fopen (path, "wb")))
+    return 0;
+
+  for (n = 0; written * UMMS_TS_PACKET_SIZE < size; n++) {
+    if (n % PAT_EVERY == 0) {
+      put_header (pkt, 0, &cc[0]);
+      pkt[1] |= 0x40;
+      pkt[4] = 0;//pointer_field, the section content doesn't matter here
+      pkt[5] = 0;
+      pkt[8] = 0x12;//transport_stream_id
+      pkt[9] = 0x34;
+      (*pats)++;
+    } else if (n % PMT_EVERY == 1) {
+      for (prog = 0; prog < PROGRAMS; prog++) {
+        put_header (pkt, PMT_PID (prog), &cc[PMT_PID (prog)]);
+        program_packets[prog]++;
+        g_string_append_len (buf, (const gchar *)pkt, UMMS_TS_PACKET_SIZE);
+      }
+      written += PROGRAMS;
+      continue;
+    } else if (n % 20 == 19) {
+      put_header (pkt, 0x1FFF, &cc[0x1FFF]);
+    } else {
+      //Video heavy, one audio packet out of eight.
+      prog = g_random_int_range (0, PROGRAMS);
+      pid = (n % 8 == 0) ? AUDIO_PID (prog) : VIDEO_PID (prog);
+      put_header (pkt, pid, &cc[pid]);
+      program_packets[prog]++;
+    }
+    g_string_append_len (buf, (const gchar *)pkt, UMMS_TS_PACKET_SIZE);
+    written++;
+    if (buf->len >= CHUNK_SIZE) {
+      fwrite (buf->str, 1, buf->len, f);
+      g_string_truncate (buf, 0);
+    }
+  }
+  fwrite (buf->str, 1, buf->len, f);
+  fclose (f);
+  g_string_free (buf, TRUE);
+
+  return written;
+}
+
+//Every packet of the recording belongs to the program, and its PAT lists only this one.
+static gboolean
+check_recording (const gchar *path, guint prog, guint64 expected)
+{
+  gchar *data;
+  gsize len, i;
+  guint pid;
+  gboolean ok;
+
+  if (!g_file_get_contents (path, &data, &len, NULL))
+    return FALSE;
+
+  ok = (len == expected * UMMS_TS_PACKET_SIZE);
+  for (i = 0; ok && i + UMMS_TS_PACKET_SIZE <= len; i += UMMS_TS_PACKET_SIZE) {
+    const guint8 *pkt = (const guint8 *)data + i;
+
+    pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+    if (pid == 0)
+      ok = ((pkt[5 + 8] << 8 | pkt[5 + 9]) == prog + 1) && (((pkt[5 + 10] & 0x1F) << 8 | pkt[5 + 11]) == PMT_PID (prog));
+    else
+      ok = (pid == PMT_PID (prog) || pid == VIDEO_PID (prog) || pid == AUDIO_PID (prog));
+  }
+  g_free (data);
+
+  return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+  UmmsMuxRecorder *rec;
+  guint64 program_packets[PROGRAMS] = {0,};
+  guint64 pats = 0, packets, total = 0;
+  gint services = DEFAULT_SERVICES;
+  gint megabytes = bench_quick () ? QUICK_MEGABYTES : DEFAULT_MEGABYTES;
+  const gchar *dir = g_get_tmp_dir ();
+  gint ids[PROGRAMS];
+  gchar *input, *outputs[PROGRAMS];
+  gchar *buf;
+  GError *err = NULL;
+  gdouble start, elapsed;
+  gsize n;
+  FILE *f;
+  gint i, ret = 0;
+
+  if (argc > 1)
+    services = atoi (argv[1]);
+  if (argc > 2)
+    megabytes = atoi (argv[2]);
+  if (argc > 3)
+    dir = argv[3];
+
+  if (services <= 0 || services > PROGRAMS || megabytes <= 0) {
+    g_printerr ("Usage: %s [services (1-%d)] [megabytes] [dir]\n", argv[0], PROGRAMS);
+    return 1;
+  }
+
+  input = g_build_filename (dir, "bench-mux-record-input.ts", NULL);
+  packets = generate (input, (guint64)megabytes * 1024 * 1024, program_packets, &pats);
+  if (!packets) {
+    g_printerr ("Failed to write '%s'\n", input);
+    return 1;
+  }
+
+  rec = umms_mux_recorder_new ();
+  for (i = 0; i < services; i++) {
+    //The PCR is carried by the video PID.
+    guint16 pids[] = {VIDEO_PID (i), VIDEO_PID (i), AUDIO_PID (i)};
+    gchar *name = g_strdup_printf ("bench-mux-record-%d.ts", i);
+
+    outputs[i] = g_build_filename (dir, name, NULL);
+    g_free (name);
+    if ((ids[i] = umms_mux_recorder_add_service_pids (rec, i + 1, PMT_PID (i), pids, G_N_ELEMENTS (pids),
+                                                      outputs[i], &err)) < 0) {
+      g_printerr ("%s\n", err->message);
+      return 1;
+    }
+  }
+
+  //Read as a tuner would deliver it, including the page cache miss.
+  buf = g_malloc (CHUNK_SIZE);
+  start = bench_now ();
+  if (!(f = fopen (input, "rb"))) {
+    g_printerr ("Failed to read '%s'\n", input);
+    return 1;
+  }
+  while ((n = fread (buf, 1, CHUNK_SIZE, f)) > 0) {
+    total += n;
+    if (!umms_mux_recorder_push (rec, buf, n, &err)) {
+      g_printerr ("%s\n", err->message);
+      g_clear_error (&err);
+      ret = 1;
+    }
+  }
+  fclose (f);
+  for (i = 0; i < services; i++)
+    umms_mux_recorder_remove_service (rec, ids[i], NULL);
+  elapsed = bench_now () - start;
+
+  g_print ("%" G_GUINT64_FORMAT " packets, %d programs, %d services recorded, 1 tuner\n", packets, PROGRAMS, services);
+  g_print ("%.3f s, %.1f MB/s input, %.0f ns/packet\n", elapsed, total / elapsed / (1024 * 1024), elapsed * 1e9 / packets);
+
+  for (i = 0; i < services; i++) {
+    //Our PAT at the start, then one per input PAT.
+    if (!check_recording (outputs[i], i, program_packets[i] + 1 + pats)) {
+      g_printerr ("recording of program %d is wrong\n", i + 1);
+      ret = 1;
+    }
+    g_unlink (outputs[i]);
+    g_free (outputs[i]);
+  }
+  if (umms_mux_recorder_get_dropped (rec)) {
+    g_printerr ("lost sync on %" G_GUINT64_FORMAT " bytes\n", umms_mux_recorder_get_dropped (rec));
+    ret = 1;
+  }
+
+  umms_mux_recorder_free (rec);
+  g_unlink (input);
+  g_free (input);
+  g_free (buf);
+
+  return ret;
+}
@@ -0,0 +1,141 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Micro benchmark of the player plugin lookup, with and without the
+ * protocol ==> plugin dispatch index. Fails if a uri isn't dispatched to the
+ * plugin expected, by the scan or by the index.
+ *
+ * Usage: bench-plugin-lookup [iterations]
+ * make check runs it with BENCH_QUICK set, 10000 iterations by default.
+ */
+
+#include <stdlib.h>
+#include <glib.h>
+#include "umms-server.h"
+#include "umms-plugin.h"
+#include "umms-backend-factory.h"
+#include "bench-common.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define QUICK_ITERATIONS   10000 //make check
+
+UmmsCtx *umms_ctx = NULL;
+
+static const gchar *dvb_prots[] = {"dvb", NULL};
+static const gchar *rtsp_prots[] = {"rtsp", "rtp", "udp", NULL};
+static const gchar *all_prots[] = {NULL};
+static const gchar *all_blacklist[] = {"dvb", "rtsp", NULL};
+
+static UmmsPlugin plugins[] = {
+  {.type = UMMS_PLUGIN_TYPE_PLAYER_BACKEND, .filename = "libplayerbackend1.so", .name = "dvb",
+   .supported_uri_protocols = dvb_prots, .unsupported_uri_protocols = all_prots},
+  {.type = UMMS_PLUGIN_TYPE_PLAYER_BACKEND, .filename = "libplayerbackend2.so", .name = "rtsp",
+   .supported_uri_protocols = rtsp_prots, .unsupported_uri_protocols = all_prots},
+  {.type = UMMS_PLUGIN_TYPE_PLAYER_BACKEND, .filename = "libplayerbackend3.so", .name = "generic",
+   .supported_uri_protocols = all_prots, .unsupported_uri_protocols = all_blacklist},
+};
+
+static const gchar *conf_data =
+  "[" PLAYER_PLUGIN_GROUP "]\n"
+  "dvb = libplayerbackend1.so\n"
+  "rtsp = libplayerbackend2.so\n"
+  "all = libplayerbackend3.so\n";
+
+static const gchar *uris[] = {
+  "dvb://?program-number=1&frequency=546000000",
+  "rtsp://10.0.0.1/stream",
+  "file:///media/movie.mp4",
+  "http://example.com/clip.ogg",
+  "udp://239.0.0.1:1234",
+  NULL
+};
+
+//Index in plugins[] of the plugin each uri goes to.
+static const gint expected[] = {0, 1, 2, 2, 1};
+
+static gint
+check (const gchar *name)
+{
+  UmmsPlugin *plugin;
+  gint errors = 0;
+  gint i;
+
+  for (i = 0; uris[i]; i++) {
+    plugin = umms_backend_factory_query_player_plugin (uris[i]);
+    if (plugin != &plugins[expected[i]]) {
+      g_printerr ("%s: '%s' dispatched to %s instead of %s\n", name, uris[i],
+                  plugin ? plugin->name : "no plugin", plugins[expected[i]].name);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+static void
+run (const gchar *name, guint iterations)
+{
+  guint i;
+  guint n_uris = G_N_ELEMENTS (uris) - 1;
+  gdouble start, elapsed;
+
+  start = bench_now ();
+  for (i = 0; i < iterations; i++)
+    umms_backend_factory_query_player_plugin (uris[i % n_uris]);
+  elapsed = bench_now () - start;
+
+  g_print ("%-8s %u lookups in %.3f s, %.0f lookups/s, %.1f ns/lookup\n",
+           name, iterations, elapsed, iterations / elapsed, elapsed * 1e9 / iterations);
+}
+
+int
+main (int argc, char **argv)
+{
+  guint iterations = bench_quick () ? QUICK_ITERATIONS : DEFAULT_ITERATIONS;
+  gint errors = 0;
+  gint i;
+
+  if (argc > 1)
+    iterations = atoi (argv[1]);
+
+  g_type_init ();
+  g_thread_init (NULL);
+
+  umms_ctx = g_malloc0 (sizeof (UmmsCtx));
+  umms_ctx->conf = g_key_file_new ();
+  g_key_file_load_from_data (umms_ctx->conf, conf_data, -1, G_KEY_FILE_NONE, NULL);
+  for (i = 0; i < G_N_ELEMENTS (plugins); i++)
+    umms_ctx->plugins = g_list_append (umms_ctx->plugins, &plugins[i]);
+
+  errors += check ("scan");
+  run ("scan", iterations);
+  umms_backend_factory_build_index (umms_ctx->conf);
+  errors += check ("index");
+  run ("index", iterations);
+
+  g_list_free (umms_ctx->plugins);
+  g_key_file_free (umms_ctx->conf);
+  g_free (umms_ctx);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the PSI cache.
+ *
+ * The PAT and the PMTs of a multiplex are packetized and fed repeatedly, as
+ * they repeat in a broadcast, with a PMT getting a new version now and then
+ * and a corrupted section injected. Measures the cost of a repeated table,
+ * of a new one, and of GetPat/GetPmt answered from the cache. Fails if the
+ * changes reported, the parsed tables or the CRC32 are wrong.
+ *
+ * Usage: bench-psi-cache [repetitions]
+ * make check runs it with BENCH_QUICK set, 5000 repetitions by default.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib-object.h>
+#include "umms-psi-cache.h"
+#include "bench-common.h"
+
+#define DEFAULT_REPETITIONS 100000
+#define QUICK_REPETITIONS   5000 //make check, still a few PMT versions
+#define PROGRAMS            16
+#define STREAMS             6
+#define DESCRIPTOR_LEN      24 //per stream, so that the PMTs span two packets
+#define BUMP_EVERY          1000 //repetitions between two versions of a PMT
+#define PMT_PID(prog)       (0x1000 + (prog))
+#define STREAM_PID(prog, i) (0x100 + (prog) * 0x10 + (i))
+
+static guint n_changes;
+
+static guint32
+crc32_reference (const guint8 *data, gsize len)
+{
+  guint32 c = 0xFFFFFFFF;
+  gint i;
+
+  while (len--) {
+    c ^= (guint32)*data++ << 24;
+    for (i = 0; i < 8; i++)
+      c = (c & 0x80000000) ? (c << 1) ^ 0x04C11DB7 : c << 1;
+  }
+  return c;
+}
+
+static void
+section_finish (GByteArray *s)
+{
+  guint32 crc;
+  guint8 tail[4];
+
+  s->data[1] = 0xB0 | (((s->len + 4 - 3) >> 8) & 0x0F);
+  s->data[2] = (s->len + 4 - 3) & 0xFF;
+  crc = umms_psi_crc32 (s->data, s->len);
+  tail[0] = crc >> 24;
+  tail[1] = crc >> 16;
+  tail[2] = crc >> 8;
+  tail[3] = crc;
+  g_byte_array_append (s, tail, 4);
+}
+
+static GByteArray *
+make_pat (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint8 hdr[8] = {0x00, 0, 0, 0x12, 0x34, 0xC1, 0, 0};
+  guint8 entry[4];
+  guint i;
+
+  g_byte_array_append (s, hdr, sizeof (hdr));
+  for (i = 0; i < PROGRAMS; i++) {
+    entry[0] = (i + 1) >> 8;
+    entry[1] = (i + 1) & 0xFF;
+    entry[2] = 0xE0 | (PMT_PID (i) >> 8);
+    entry[3] = PMT_PID (i) & 0xFF;
+    g_byte_array_append (s, entry, 4);
+  }
+  section_finish (s);
+  return s;
+}
+
+static GByteArray *
+make_pmt (guint prog, guint version)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint8 hdr[12] = {0x02, 0, 0, (prog + 1) >> 8, (prog + 1) & 0xFF, 0xC1 | ((version & 0x1F) << 1), 0, 0,
+                    0xE0 | (STREAM_PID (prog, 0) >> 8), STREAM_PID (prog, 0) & 0xFF, 0xF0, 0};
+  guint8 es[5], desc[DESCRIPTOR_LEN];
+  guint i;
+
+  memset (desc, 0x55, sizeof (desc));
+  g_byte_array_append (s, hdr, sizeof (hdr));
+  for (i = 0; i < STREAMS; i++) {
+    es[0] = i ? 0x03 : 0x1B;
+    es[1] = 0xE0 | (STREAM_PID (prog, i) >> 8);
+    es[2] = STREAM_PID (prog, i) & 0xFF;
+    es[3] = 0xF0;
+    es[4] = DESCRIPTOR_LEN;
+    g_byte_array_append (s, es, 5);
+    g_byte_array_append (s, desc, DESCRIPTOR_LEN);
+  }
+  section_finish (s);
+  return s;
+}
+
+//Split a section into packets, stuffed with 0xFF.
+static GByteArray *
+packetize (GByteArray *section, guint pid, guint8 *cc)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint8 pkt[188];
+  guint pos = 0, n, start;
+
+  while (pos < section->len) {
+    memset (pkt, 0xFF, sizeof (pkt));
+    pkt[0] = 0x47;
+    pkt[1] = (pos == 0 ? 0x40 : 0) | (pid >> 8);
+    pkt[2] = pid & 0xFF;
+    pkt[3] = 0x10 | ((*cc)++ & 0x0F);
+    start = 4;
+    if (pos == 0)
+      pkt[start++] = 0;//pointer_field
+    n = MIN (section->len - pos, 188 - start);
+    memcpy (pkt + start, section->data + pos, n);
+    pos += n;
+    g_byte_array_append (out, pkt, sizeof (pkt));
+  }
+  return out;
+}
+
+static void
+feed (UmmsPsiCache *cache, GByteArray *packets)
+{
+  guint i;
+
+  for (i = 0; i < packets->len; i += 188)
+    umms_psi_cache_push_packet (cache, packets->data + i);
+}
+
+static void
+changed_cb (UmmsPsiCache *cache, guint table_id, guint program_num, guint version, gpointer user_data)
+{
+  n_changes++;
+}
+
+static guint
+value_uint (GHashTable *entry, const gchar *key)
+{
+  return g_value_get_uint (g_hash_table_lookup (entry, key));
+}
+
+int
+main (int argc, char **argv)
+{
+  UmmsPsiCache *cache;
+  GByteArray *pat_packets, *pmt_packets[PROGRAMS], *section;
+  guint8 cc[0x2000] = {0,};
+  guint8 buf[1024];
+  guint versions[PROGRAMS] = {0,};
+  gint repetitions = bench_quick () ? QUICK_REPETITIONS : DEFAULT_REPETITIONS;
+  guint expected_changes, bumps = 0, program, pcr_pid;
+  guint64 sections, parsed, crc_errors, packets = 0;
+  GPtrArray *pat, *streams;
+  gdouble start, repeat_time, get_time;
+  guint i, j, k;
+  gint ret = 0;
+
+  if (argc > 1)
+    repetitions = atoi (argv[1]);
+  if (repetitions <= 0) {
+    g_printerr ("Usage: %s [repetitions]\n", argv[0]);
+    return 1;
+  }
+  g_type_init ();
+
+  for (i = 0; i < 1000; i++) {
+    gsize len = g_random_int_range (0, sizeof (buf));
+
+    for (j = 0; j < len; j++)
+      buf[j] = g_random_int ();
+    if (umms_psi_crc32 (buf, len) != crc32_reference (buf, len)) {
+      g_printerr ("CRC32 differs from the reference on %" G_GSIZE_FORMAT " bytes\n", len);
+      return 1;
+    }
+  }
+
+  cache = umms_psi_cache_new (changed_cb, NULL);
+  section = make_pat ();
+  pat_packets = packetize (section, 0, &cc[0]);
+  g_byte_array_free (section, TRUE);
+  for (i = 0; i < PROGRAMS; i++) {
+    section = make_pmt (i, 0);
+    pmt_packets[i] = packetize (section, PMT_PID (i), &cc[PMT_PID (i)]);
+    g_byte_array_free (section, TRUE);
+  }
+
+  start = bench_now ();
+  for (i = 0; i < (guint)repetitions; i++) {
+    //A new PMT version now and then, the rest of the time the tables just repeat.
+    if (i && i % BUMP_EVERY == 0) {
+      j = (i / BUMP_EVERY) % PROGRAMS;
+      g_byte_array_free (pmt_packets[j], TRUE);
+      section = make_pmt (j, ++versions[j]);
+      pmt_packets[j] = packetize (section, PMT_PID (j), &cc[PMT_PID (j)]);
+      g_byte_array_free (section, TRUE);
+      bumps++;
+    }
+    //Keep the continuity counters going, as a real stream would.
+    pat_packets->data[3] = 0x10 | (cc[0]++ & 0x0F);
+    feed (cache, pat_packets);
+    packets += pat_packets->len / 188;
+    for (j = 0; j < PROGRAMS; j++) {
+      for (k = 0; k < pmt_packets[j]->len; k += 188)
+        pmt_packets[j]->data[k + 3] = 0x10 | (cc[PMT_PID (j)]++ & 0x0F);
+      feed (cache, pmt_packets[j]);
+      packets += pmt_packets[j]->len / 188;
+    }
+  }
+  repeat_time = bench_now () - start;
+
+  //A corrupted section must be dropped.
+  section = make_pmt (0, versions[0] + 1);
+  section->data[section->len - 1] ^= 0x01;
+  if (umms_psi_cache_push_section (cache, section->data, section->len)) {
+    g_printerr ("corrupted section accepted\n");
+    ret = 1;
+  }
+  g_byte_array_free (section, TRUE);
+
+  start = bench_now ();
+  for (i = 0; i < 10000; i++) {
+    program = (i % PROGRAMS) + 1;
+    if (!umms_psi_cache_get_pat (cache, &pat) || !umms_psi_cache_get_pmt (cache, &program, &pcr_pid, &streams)) {
+      g_printerr ("tables not cached\n");
+      return 1;
+    }
+    if (i < PROGRAMS) {
+      if (pat->len != PROGRAMS || value_uint (g_ptr_array_index (pat, i), "pid") != PMT_PID (i)
+          || streams->len != STREAMS || pcr_pid != STREAM_PID (i, 0)
+          || value_uint (g_ptr_array_index (streams, STREAMS - 1), "pid") != STREAM_PID (i, STREAMS - 1)
+          || value_uint (g_ptr_array_index (streams, 0), "stream-type") != 0x1B) {
+        g_printerr ("tables of program %u are wrong\n", program);
+        ret = 1;
+      }
+    }
+    g_ptr_array_foreach (pat, (GFunc)g_hash_table_unref, NULL);
+    g_ptr_array_free (pat, TRUE);
+    g_ptr_array_foreach (streams, (GFunc)g_hash_table_unref, NULL);
+    g_ptr_array_free (streams, TRUE);
+  }
+  get_time = bench_now () - start;
+
+  umms_psi_cache_get_stats (cache, &sections, &parsed, &crc_errors);
+  //The PAT, the first version of each PMT and each bump.
+  expected_changes = 1 + PROGRAMS + bumps;
+  g_print ("%" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " sections, %" G_GUINT64_FORMAT " parsed, %"
+           G_GUINT64_FORMAT " CRC errors, %u changes\n", packets, sections, parsed, crc_errors, n_changes);
+  g_print ("%.1f ns/section fed, GetPat+GetPmt %.2f us\n", repeat_time * 1e9 / sections, get_time * 1e6 / 10000);
+
+  if (n_changes != expected_changes || parsed != expected_changes + 1 || crc_errors != 1) {
+    g_printerr ("expected %u changes and %u parsed sections\n", expected_changes, expected_changes + 1);
+    ret = 1;
+  }
+
+  for (i = 0; i < PROGRAMS; i++)
+    g_byte_array_free (pmt_packets[i], TRUE);
+  g_byte_array_free (pat_packets, TRUE);
+  umms_psi_cache_free (cache);
+
+  return ret;
+}
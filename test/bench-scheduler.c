@@ -0,0 +1,155 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Simulate a schedule of recordings on the virtual clock of the scheduler.
+ *
+ * Recordings start at random times over the period and last 30 to 120
+ * minutes, the stop event is added when a recording starts like
+ * umms-server does. One recording out of ten is canceled before it starts.
+ * Events firing at another time than the one they were scheduled for are
+ * reported as errors.
+ *
+ * Usage: bench-scheduler [recordings] [days]
+ * make check runs it with BENCH_QUICK set, on 10000 recordings by default.
+ */
+
+#include <stdlib.h>
+#include <glib.h>
+#include "umms-scheduler.h"
+#include "bench-common.h"
+
+#define DEFAULT_RECORDINGS 100000
+#define DEFAULT_DAYS       7
+#define QUICK_RECORDINGS   10000 //make check
+#define STEP               ((gint64)60 * G_USEC_PER_SEC) //virtual clock step
+#define CANCEL_EVERY       10
+
+typedef struct {
+  gint64  start;
+  gint64  stop;
+  guint   event;
+  gboolean done;
+} Recording;
+
+static UmmsScheduler *sched;
+static guint errors = 0;
+static guint started = 0;
+static guint stopped = 0;
+
+static void
+check_time (gint64 expected)
+{
+  //Fired on the first tick not earlier than the expected time.
+  gint64 late = umms_scheduler_now (sched) - expected;
+
+  if (late < 0 || late >= UMMS_SCHEDULER_TICK)
+    errors++;
+}
+
+static void
+stop_cb (gpointer data)
+{
+  Recording *rec = (Recording *)data;
+
+  check_time (rec->stop);
+  rec->done = TRUE;
+  stopped++;
+}
+
+static void
+start_cb (gpointer data)
+{
+  Recording *rec = (Recording *)data;
+
+  check_time (rec->start);
+  started++;
+  rec->event = umms_scheduler_add (sched, rec->stop, stop_cb, rec, NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+  Recording *recs;
+  gint n = bench_quick () ? QUICK_RECORDINGS : DEFAULT_RECORDINGS;
+  gint days = DEFAULT_DAYS;
+  guint canceled = 0;
+  gint64 t0, end, t;
+  gdouble start, insert, cancel, run;
+  gint i;
+
+  if (argc > 1)
+    n = atoi (argv[1]);
+  if (argc > 2)
+    days = atoi (argv[2]);
+
+  if (n <= 0 || days <= 0) {
+    g_printerr ("Usage: %s [recordings] [days]\n", argv[0]);
+    return 1;
+  }
+
+  sched = umms_scheduler_new (UMMS_SCHEDULER_CLOCK_VIRTUAL, NULL);
+  t0 = umms_scheduler_now (sched);
+  end = t0 + (gint64)days * 24 * 3600 * G_USEC_PER_SEC;
+
+  recs = g_new0 (Recording, n);
+  for (i = 0; i < n; i++) {
+    recs[i].start = t0 + g_random_int_range (1, days * 24 * 3600) * (gint64)G_USEC_PER_SEC
+                    + g_random_int_range (0, G_USEC_PER_SEC);
+    recs[i].stop = recs[i].start + g_random_int_range (30, 121) * 60 * (gint64)G_USEC_PER_SEC;
+  }
+
+  start = bench_now ();
+  for (i = 0; i < n; i++)
+    recs[i].event = umms_scheduler_add (sched, recs[i].start, start_cb, &recs[i], NULL);
+  insert = bench_now () - start;
+
+  start = bench_now ();
+  for (i = 0; i < n; i += CANCEL_EVERY) {
+    umms_scheduler_cancel (sched, recs[i].event);
+    recs[i].done = TRUE;
+    canceled++;
+  }
+  cancel = bench_now () - start;
+
+  start = bench_now ();
+  for (t = t0; t < end + (gint64)3 * 3600 * G_USEC_PER_SEC; t += STEP)
+    umms_scheduler_advance (sched, t);
+  run = bench_now () - start;
+
+  for (i = 0; i < n; i++)
+    if (!recs[i].done)
+      errors++;
+
+  g_print ("%d recordings over %d days, %u canceled\n", n, days, canceled);
+  g_print ("insert: %.1f ns/event\n", insert * 1e9 / n);
+  g_print ("cancel: %.1f ns/event\n", cancel * 1e9 / MAX (canceled, 1));
+  g_print ("simulated in %.3f s, %u started, %u stopped, %u pending\n",
+           run, started, stopped, umms_scheduler_get_pending (sched));
+  g_print ("errors: %u\n", errors);
+
+  umms_scheduler_free (sched);
+  g_free (recs);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the timeshift ring.
+ *
+ * A writer thread appends a numbered stream of TS packets, 10 ms of stream
+ * time per write, while a reader follows it, lagging behind on purpose now
+ * and then so that it gets overrun. Then seeks to random times within the
+ * window. Fails if the reader gets a packet out of order other than at the
+ * index entry it must jump to when overrun, or if a seek, tell or the window
+ * disagree with the times written.
+ *
+ * Usage: bench-timeshift [laps] [directory]
+ * laps is how many times the stream fills the ring, make check runs it with
+ * BENCH_QUICK set, on a small ring in the temp directory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "umms-timeshift.h"
+#include "bench-common.h"
+
+#define DEFAULT_LAPS     16
+#define QUICK_LAPS       4
+#define DEFAULT_BLOCKS   64
+#define QUICK_BLOCKS     8
+#define PACKET_LEN       188
+#define WRITE_PACKETS    64
+#define WRITE_MS         10
+#define WRITE_LEN        (PACKET_LEN * WRITE_PACKETS)
+#define READ_LEN         (PACKET_LEN * 100)
+#define SEEKS            10000
+//Writes between two index entries.
+#define INDEX_WRITES     (UMMS_TIMESHIFT_INDEX_INTERVAL / WRITE_MS)
+
+typedef struct {
+  UmmsTimeshift *ts;
+  guint64 writes;
+  gdouble elapsed;
+  gboolean failed;
+  volatile gint done;
+} Writer;
+
+static void
+packet_fill (guint8 *pkt, guint64 seq)
+{
+  memset (pkt, 0xFF, PACKET_LEN);
+  pkt[0] = 0x47;
+  memcpy (pkt + 4, &seq, sizeof (seq));
+}
+
+//The sequence number of the packet, G_MAXUINT64 if not a packet written.
+static guint64
+packet_seq (const guint8 *pkt)
+{
+  guint64 seq;
+
+  if (pkt[0] != 0x47 || pkt[PACKET_LEN - 1] != 0xFF)
+    return G_MAXUINT64;
+  memcpy (&seq, pkt + 4, sizeof (seq));
+  return seq;
+}
+
+static gint64
+seq_time (guint64 seq)
+{
+  return seq / WRITE_PACKETS * WRITE_MS;
+}
+
+static gpointer
+writer_thread (gpointer data)
+{
+  Writer *w = data;
+  guint8 *buf = g_malloc (WRITE_LEN);
+  GError *err = NULL;
+  gdouble start = bench_now ();
+  guint64 i;
+  guint j;
+
+  for (i = 0; i < w->writes; i++) {
+    for (j = 0; j < WRITE_PACKETS; j++)
+      packet_fill (buf + j * PACKET_LEN, i * WRITE_PACKETS + j);
+    if (!umms_timeshift_write (w->ts, i * WRITE_MS, buf, WRITE_LEN, &err)) {
+      g_printerr ("write failed: %s\n", err->message);
+      g_error_free (err);
+      w->failed = TRUE;
+      break;
+    }
+    //Leave the reader a chance to keep up now and then.
+    if (i % 256 == 0)
+      g_thread_yield ();
+  }
+  w->elapsed = bench_now () - start;
+  g_atomic_int_set (&w->done, TRUE);
+  g_free (buf);
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  gint laps = bench_quick () ? QUICK_LAPS : DEFAULT_LAPS;
+  guint64 blocks = bench_quick () ? QUICK_BLOCKS : DEFAULT_BLOCKS;
+  const gchar *dir = g_get_tmp_dir ();
+  Writer writer = {0,};
+  GThread *thread;
+  BenchStat *seek_stat;
+  guint8 *buf;
+  GError *err = NULL;
+  guint64 expected = 0, seq, bytes_read = 0, overruns = 0;
+  gint64 earliest, latest, t, time, start;
+  gdouble read_start, read_time = 0;
+  gssize len;
+  gssize i;
+  gint ret = 0;
+
+  if (argc > 1)
+    laps = atoi (argv[1]);
+  if (argc > 2)
+    dir = argv[2];
+  if (laps <= 0) {
+    g_printerr ("Usage: %s [laps] [directory]\n", argv[0]);
+    return 1;
+  }
+  g_thread_init (NULL);
+
+  if (!(writer.ts = umms_timeshift_new (dir, blocks * UMMS_TIMESHIFT_BLOCK_SIZE, &err))) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return 1;
+  }
+  buf = g_malloc (READ_LEN);
+
+  //Nothing written yet.
+  if (umms_timeshift_get_window (writer.ts, &earliest, &latest) || umms_timeshift_seek (writer.ts, 0) != -1
+      || umms_timeshift_tell (writer.ts) != -1 || umms_timeshift_read (writer.ts, buf, READ_LEN, NULL) != 0) {
+    g_printerr ("empty ring not reported as such\n");
+    ret = 1;
+  }
+
+  writer.writes = laps * blocks * UMMS_TIMESHIFT_BLOCK_SIZE / WRITE_LEN;
+  thread = g_thread_create (writer_thread, &writer, TRUE, NULL);
+
+  read_start = bench_now ();
+  for (;;) {
+    gboolean done = g_atomic_int_get (&writer.done);
+
+    if ((len = umms_timeshift_read (writer.ts, buf, READ_LEN, &err)) < 0) {
+      g_printerr ("read failed: %s\n", err->message);
+      g_error_free (err);
+      ret = 1;
+      break;
+    }
+    if (len == 0) {
+      //The writer is done, and was before this read.
+      if (done)
+        break;
+      g_thread_yield ();
+      continue;
+    }
+    if (len % PACKET_LEN) {
+      g_printerr ("read of %" G_GSSIZE_FORMAT " bytes, not whole packets\n", len);
+      ret = 1;
+      break;
+    }
+    for (i = 0; i < len; i += PACKET_LEN) {
+      seq = packet_seq (buf + i);
+      if (seq != expected) {
+        //Overrun, the reader must land on an index entry further on.
+        if (seq == G_MAXUINT64 || seq < expected || seq % (WRITE_PACKETS * INDEX_WRITES)) {
+          g_printerr ("packet %" G_GUINT64_FORMAT " read, expected %" G_GUINT64_FORMAT "\n", seq, expected);
+          ret = 1;
+          goto out;
+        }
+        overruns++;
+      }
+      expected = seq + 1;
+    }
+    bytes_read += len;
+    //Lag behind for a while on each lap, so that the writer overruns the reader.
+    if (bytes_read / UMMS_TIMESHIFT_BLOCK_SIZE % blocks == blocks - 1)
+      g_usleep (1000);
+  }
+  read_time = bench_now () - read_start;
+out:
+  g_thread_join (thread);
+  if (writer.failed)
+    ret = 1;
+  if (ret)
+    goto done;
+  if (expected != writer.writes * WRITE_PACKETS) {
+    g_printerr ("read up to packet %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " written\n", expected,
+                writer.writes * WRITE_PACKETS);
+    ret = 1;
+    goto done;
+  }
+
+  if (!umms_timeshift_get_window (writer.ts, &earliest, &latest) || latest != (gint64)(writer.writes - 1) * WRITE_MS
+      || earliest % UMMS_TIMESHIFT_INDEX_INTERVAL
+      || latest - earliest >= (gint64)((blocks + 1) * UMMS_TIMESHIFT_BLOCK_SIZE / WRITE_LEN) * WRITE_MS) {
+    g_printerr ("window %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT " ms is wrong\n", earliest, latest);
+    ret = 1;
+    goto done;
+  }
+
+  //Before the window, the earliest entry.
+  if (umms_timeshift_seek (writer.ts, 0) != earliest) {
+    g_printerr ("seek before the window didn't land on %" G_GINT64_FORMAT "\n", earliest);
+    ret = 1;
+  }
+
+  seek_stat = bench_stat_new ("seek");
+  for (i = 0; i < SEEKS && !ret; i++) {
+    t = earliest + g_random_int_range (0, latest - earliest + 1);
+    start = bench_now_usec ();
+    time = umms_timeshift_seek (writer.ts, t);
+    bench_stat_add (seek_stat, bench_now_usec () - start);
+
+    if (time > t || t - time >= UMMS_TIMESHIFT_INDEX_INTERVAL || umms_timeshift_tell (writer.ts) != time) {
+      g_printerr ("seek to %" G_GINT64_FORMAT " ms landed on %" G_GINT64_FORMAT " ms\n", t, time);
+      ret = 1;
+    } else if (umms_timeshift_read (writer.ts, buf, PACKET_LEN, NULL) != PACKET_LEN
+               || (seq = packet_seq (buf)) == G_MAXUINT64 || seq % WRITE_PACKETS || seq_time (seq) != time) {
+      g_printerr ("seek to %" G_GINT64_FORMAT " ms didn't read the packet written at that time\n", time);
+      ret = 1;
+    }
+  }
+
+  g_print ("%d laps of a %" G_GUINT64_FORMAT " MB ring, %" G_GUINT64_FORMAT " overruns\n", laps,
+           blocks * UMMS_TIMESHIFT_BLOCK_SIZE >> 20, overruns);
+  g_print ("write %.1f MB/s, read %.1f MB/s\n", writer.writes * WRITE_LEN / writer.elapsed / 1e6,
+           bytes_read / read_time / 1e6);
+  bench_stat_print (seek_stat);
+  bench_stat_free (seek_stat);
+
+done:
+  g_free (buf);
+  umms_timeshift_free (writer.ts);
+  return ret;
+}
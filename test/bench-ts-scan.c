@@ -0,0 +1,232 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Benchmark of the TS scanner, each impl supported by the CPU against the
+ * scalar one.
+ *
+ * Scans a capture file if given, else a generated multiplex kept in memory
+ * (continuity errors, TEI packets and garbage injected), scanned again until
+ * gigabytes have been processed. Only the PIDs of one program are filtered,
+ * as a recording would. Fails if an impl doesn't give the same matches and
+ * statistics as the scalar one.
+ *
+ * Usage: bench-ts-scan [gigabytes] [capture.ts]
+ * Run by make check with BENCH_QUICK set, which scans the generated multiplex
+ * once with each implementation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "umms-ts-scanner.h"
+#include "bench-common.h"
+
+#define DEFAULT_GIGABYTES 2
+#define GENERATED_SIZE    (UMMS_TS_PACKET_LEN * 350 * 1024) //~64MB
+#define CHUNK_SIZE        (1024 * 1024)
+#define PROGRAMS          8
+#define VIDEO_PID(prog)   (0x100 + (prog) * 0x10)
+#define AUDIO_PID(prog)   (VIDEO_PID (prog) + 1)
+#define PMT_PID(prog)     (0x1000 + (prog))
+
+typedef struct {
+  UmmsTsScannerImpl impl;
+  gdouble   elapsed;
+  guint64   bytes;
+  guint64   matches;
+  guint64   match_sum;//of the offsets in the stream, to compare the matches
+  guint64   packets, sync_errors, tei_errors;
+  UmmsTsPidStats pid_stats[4];
+} Result;
+
+static const guint filtered[] = {0, PMT_PID (0), VIDEO_PID (0), AUDIO_PID (0)};
+
+static guint8 *
+generate (gsize size)
+{
+  guint8 cc[0x2000] = {0,};
+  guint8 *data = g_malloc (size);
+  guint8 *pkt;
+  gsize pos;
+  guint pid, n = 0;
+
+  for (pos = 0; pos + UMMS_TS_PACKET_LEN <= size; pos += UMMS_TS_PACKET_LEN, n++) {
+    pkt = data + pos;
+    if (n % 100 == 0)
+      pid = 0;
+    else if (n % 100 == 1)
+      pid = PMT_PID (g_random_int_range (0, PROGRAMS));
+    else if (n % 20 == 19)
+      pid = 0x1FFF;
+    else
+      pid = (n % 8 == 0) ? AUDIO_PID (n % PROGRAMS) : VIDEO_PID (g_random_int_range (0, PROGRAMS));
+
+    memset (pkt, 0xFF, UMMS_TS_PACKET_LEN);
+    pkt[0] = 0x47;
+    pkt[1] = (pid >> 8) & 0x1F;
+    pkt[2] = pid & 0xFF;
+    pkt[3] = 0x10 | (cc[pid]++ & 0x0F);
+
+    if (g_random_int_range (0, 10000) == 0)
+      cc[pid]++;//a lost packet
+    if (g_random_int_range (0, 20000) == 0)
+      pkt[1] |= 0x80;
+    if (g_random_int_range (0, 50000) == 0)
+      pkt[0] = 0x00;//garbage, the scanner resyncs on the next packet
+  }
+
+  return data;
+}
+
+static void
+result_add_matches (Result *r, guint64 base, const guint32 *matches, guint n)
+{
+  guint i;
+
+  r->matches += n;
+  for (i = 0; i < n; i++)
+    r->match_sum += base + matches[i];
+}
+
+static void
+run (Result *r, const guint8 *generated, gsize generated_len, const gchar *capture, guint64 total)
+{
+  UmmsTsScanner *sc = umms_ts_scanner_new ();
+  guint32 *matches = g_new (guint32, CHUNK_SIZE / UMMS_TS_PACKET_LEN + 1);
+  guint8 *buf = NULL;
+  gsize consumed, pos, fill = 0;
+  gdouble start;
+  guint n, i;
+  FILE *f = NULL;
+
+  umms_ts_scanner_set_impl (sc, r->impl);
+  for (i = 0; i < G_N_ELEMENTS (filtered); i++)
+    umms_ts_scanner_add_pid (sc, filtered[i]);
+
+  start = bench_now ();
+  if (capture) {
+    //Chunks read from the file, the partial packet carried over to the next one.
+    buf = g_malloc (CHUNK_SIZE);
+    while (r->bytes < total) {
+      if (!f && !(f = fopen (capture, "rb")))
+        break;
+      n = fread (buf + fill, 1, CHUNK_SIZE - fill, f);
+      if (n == 0) {
+        fclose (f);
+        f = NULL;
+        fill = 0;//the next pass starts fresh
+        continue;
+      }
+      fill += n;
+      consumed = umms_ts_scanner_scan (sc, buf, fill, matches, &n);
+      result_add_matches (r, r->bytes, matches, n);
+      r->bytes += consumed;
+      memmove (buf, buf + consumed, fill - consumed);
+      fill -= consumed;
+    }
+    if (f)
+      fclose (f);
+  } else {
+    for (pos = 0; r->bytes < total; pos = (pos + consumed) % generated_len) {
+      consumed = umms_ts_scanner_scan (sc, generated + pos, MIN (CHUNK_SIZE, generated_len - pos), matches, &n);
+      result_add_matches (r, r->bytes, matches, n);
+      r->bytes += consumed;
+    }
+  }
+  r->elapsed = bench_now () - start;
+
+  umms_ts_scanner_get_totals (sc, &r->packets, &r->sync_errors, &r->tei_errors);
+  for (i = 0; i < G_N_ELEMENTS (filtered); i++)
+    umms_ts_scanner_get_pid_stats (sc, filtered[i], &r->pid_stats[i]);
+
+  umms_ts_scanner_free (sc);
+  g_free (matches);
+  g_free (buf);
+}
+
+int
+main (int argc, char **argv)
+{
+  Result results[3];
+  const gchar *capture = NULL;
+  guint8 *generated = NULL;
+  gint gigabytes = DEFAULT_GIGABYTES;
+  guint64 total;
+  UmmsTsScanner *probe;
+  gint n = 0, i;
+  gint ret = 0;
+
+  if (argc > 1)
+    gigabytes = atoi (argv[1]);
+  if (argc > 2)
+    capture = argv[2];
+  if (gigabytes <= 0) {
+    g_printerr ("Usage: %s [gigabytes] [capture.ts]\n", argv[0]);
+    return 1;
+  }
+  total = (guint64)gigabytes * 1024 * 1024 * 1024;
+  if (bench_quick () && argc < 2)
+    total = GENERATED_SIZE;
+
+  if (!capture)
+    generated = generate (GENERATED_SIZE);
+
+  probe = umms_ts_scanner_new ();
+  for (i = UmmsTsScannerImplScalar; i <= UmmsTsScannerImplAVX2; i++) {
+    if (!umms_ts_scanner_set_impl (probe, i))
+      continue;
+    memset (&results[n], 0, sizeof (Result));
+    results[n].impl = i;
+    run (&results[n], generated, GENERATED_SIZE, capture, total);
+    n++;
+  }
+  umms_ts_scanner_free (probe);
+
+  for (i = 0; i < n; i++) {
+    Result *r = &results[i];
+
+    g_print ("%-6s %.3f s, %.2f GB/s, %.2f ns/packet, speedup %.2fx\n", umms_ts_scanner_impl_name (r->impl),
+             r->elapsed, r->bytes / r->elapsed / (1024.0 * 1024 * 1024), r->elapsed * 1e9 / r->packets,
+             results[0].elapsed / r->elapsed);
+    if (r->matches != results[0].matches || r->match_sum != results[0].match_sum
+        || r->packets != results[0].packets || r->sync_errors != results[0].sync_errors
+        || r->tei_errors != results[0].tei_errors
+        || memcmp (r->pid_stats, results[0].pid_stats, sizeof (r->pid_stats))) {
+      g_printerr ("%s differs from scalar\n", umms_ts_scanner_impl_name (r->impl));
+      ret = 1;
+    }
+  }
+
+  g_print ("%" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " matched, %" G_GUINT64_FORMAT " sync losses, %"
+           G_GUINT64_FORMAT " TEI\n", results[0].packets, results[0].matches, results[0].sync_errors,
+           results[0].tei_errors);
+  for (i = 0; i < G_N_ELEMENTS (filtered); i++)
+    g_print ("  PID 0x%04x: %" G_GUINT64_FORMAT " packets, %" G_GUINT64_FORMAT " CC errors, %" G_GUINT64_FORMAT
+             " TEI\n", filtered[i], results[0].pid_stats[i].packets, results[0].pid_stats[i].cc_errors,
+             results[0].pid_stats[i].tei_errors);
+
+  g_free (generated);
+  return ret;
+}
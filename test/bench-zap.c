@@ -0,0 +1,476 @@
+/*
+ * UMMS (Unified Multi Media Service) provides a set of DBus APIs to support
+ * playing Audio and Video as well as DVB playback.
+ *
+ * Authored by Zhiwen Wu <zhiwen.wu@intel.com>
+ *             Junyan He <junyan.he@intel.com>
+ * Copyright (c) 2011 Intel Corp.
+ *
+ * UMMS is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * UMMS is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with UMMS; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Benchmark of the fast channel change, on a local TS replayer.
+ *
+ * A capture file, or a generated multiplex, is replayed in a loop at constant
+ * bitrate, the times are stream times. Zaps to each program in turn, at random
+ * points of the stream, are timed both ways:
+ *  - cold: a new demux waits for the PAT, the PMT of the program and the next
+ *    random access point of its video, as a backend tuned on SetUri does.
+ *  - fast: the program was pre-tuned, its PSI cache and GOP cache have been fed
+ *    all along. The zap takes the PMT and the GOP from the caches, decoding
+ *    starts at once from the last random access point.
+ * Fails if a cached GOP doesn't start at the last random access point or
+ * misses packets.
+ *
+ * Usage: bench-zap [zaps] [capture.ts mbps]
+ * make check runs it with BENCH_QUICK set, 100 zaps by default.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib-object.h>
+#include "umms-psi-cache.h"
+#include "umms-gop-cache.h"
+#include "bench-common.h"
+
+#define DEFAULT_ZAPS        1000
+#define QUICK_ZAPS          100 //make check
+#define TS_PACKET_SIZE      188
+#define PROGRAMS            8
+#define PACKETS_PER_SECOND  10000 //~15 Mbps
+#define DURATION            12 //s
+#define PSI_INTERVAL        100 //ms
+#define GOP_DURATION        1000 //ms
+#define GOP_MAX_SIZE        (4 * 1024 * 1024)
+#define PMT_PID(prog)       (0x1000 + (prog))
+#define VIDEO_PID(prog)     (0x100 + (prog) * 0x10)
+#define AUDIO_PID(prog)     (VIDEO_PID (prog) + 1)
+
+typedef struct {
+  guint        program_num;
+  guint        video_pid;
+  //Pre-tuned demux.
+  UmmsPsiCache *psi;
+  UmmsGopCache *gop;
+  //Reference, to check the GOP cache.
+  gint64       last_rap;//packet index, -1 if none yet
+  guint        gop_packets;
+} Program;
+
+typedef struct {
+  guint64  at;//packet index
+  guint    program;
+} Zap;
+
+static inline guint
+packet_pid (const guint8 *pkt)
+{
+  return (pkt[1] & 0x1F) << 8 | pkt[2];
+}
+
+static inline gboolean
+packet_is_rap (const guint8 *pkt)
+{
+  return (pkt[3] & 0x20) && pkt[4] > 0 && (pkt[5] & 0x40);
+}
+
+static void
+section_finish (GByteArray *s)
+{
+  guint32 crc;
+  guint8 tail[4];
+
+  s->data[1] = 0xB0 | (((s->len + 4 - 3) >> 8) & 0x0F);
+  s->data[2] = (s->len + 4 - 3) & 0xFF;
+  crc = umms_psi_crc32 (s->data, s->len);
+  tail[0] = crc >> 24;
+  tail[1] = crc >> 16;
+  tail[2] = crc >> 8;
+  tail[3] = crc;
+  g_byte_array_append (s, tail, 4);
+}
+
+//Single packet section, stuffed with 0xFF.
+static void
+write_section (guint8 *pkt, GByteArray *s, guint pid, guint8 *cc)
+{
+  memset (pkt, 0xFF, TS_PACKET_SIZE);
+  pkt[0] = 0x47;
+  pkt[1] = 0x40 | (pid >> 8);
+  pkt[2] = pid & 0xFF;
+  pkt[3] = 0x10 | ((*cc)++ & 0x0F);
+  pkt[4] = 0;//pointer_field
+  memcpy (pkt + 5, s->data, s->len);
+}
+
+static GByteArray *
+make_pat (void)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint8 hdr[8] = {0x00, 0, 0, 0x00, 0x01, 0xC1, 0, 0};
+  guint8 entry[4];
+  guint i;
+
+  g_byte_array_append (s, hdr, sizeof (hdr));
+  for (i = 0; i < PROGRAMS; i++) {
+    entry[0] = (i + 1) >> 8;
+    entry[1] = (i + 1) & 0xFF;
+    entry[2] = 0xE0 | (PMT_PID (i) >> 8);
+    entry[3] = PMT_PID (i) & 0xFF;
+    g_byte_array_append (s, entry, 4);
+  }
+  section_finish (s);
+  return s;
+}
+
+static GByteArray *
+make_pmt (guint prog)
+{
+  GByteArray *s = g_byte_array_new ();
+  guint8 hdr[12] = {0x02, 0, 0, (prog + 1) >> 8, (prog + 1) & 0xFF, 0xC1, 0, 0,
+                    0xE0 | (VIDEO_PID (prog) >> 8), VIDEO_PID (prog) & 0xFF, 0xF0, 0};
+  guint8 video[5] = {0x1B, 0xE0 | (VIDEO_PID (prog) >> 8), VIDEO_PID (prog) & 0xFF, 0xF0, 0};
+  guint8 audio[5] = {0x03, 0xE0 | (AUDIO_PID (prog) >> 8), AUDIO_PID (prog) & 0xFF, 0xF0, 0};
+
+  g_byte_array_append (s, hdr, sizeof (hdr));
+  g_byte_array_append (s, video, sizeof (video));
+  g_byte_array_append (s, audio, sizeof (audio));
+  section_finish (s);
+  return s;
+}
+
+/*
+ * PAT and PMTs every PSI_INTERVAL, audio on one packet out of 8, video on the
+ * others. Each program has a random access point every GOP_DURATION, at its
+ * own phase.
+ */
+static guint8 *
+generate (gsize *len)
+{
+  guint n = PACKETS_PER_SECOND * DURATION;
+  guint psi_every = PACKETS_PER_SECOND * PSI_INTERVAL / 1000;
+  guint gop_every = PACKETS_PER_SECOND * GOP_DURATION / 1000;
+  guint8 *data = g_malloc (n * TS_PACKET_SIZE);
+  guint8 cc[0x2000] = {0,};
+  guint next_rap[PROGRAMS];
+  GByteArray *pat, *pmts[PROGRAMS];
+  guint8 *pkt;
+  guint i, prog, pid;
+
+  pat = make_pat ();
+  for (prog = 0; prog < PROGRAMS; prog++) {
+    pmts[prog] = make_pmt (prog);
+    next_rap[prog] = g_random_int_range (0, gop_every);
+  }
+
+  for (i = 0; i < n; i++) {
+    pkt = data + (gsize)i * TS_PACKET_SIZE;
+    if (i % psi_every == 0) {
+      write_section (pkt, pat, 0, &cc[0]);
+      continue;
+    }
+    if (i % psi_every <= PROGRAMS) {
+      prog = i % psi_every - 1;
+      write_section (pkt, pmts[prog], PMT_PID (prog), &cc[PMT_PID (prog)]);
+      continue;
+    }
+
+    prog = g_random_int_range (0, PROGRAMS);
+    pid = (i % 8 == 0) ? AUDIO_PID (prog) : VIDEO_PID (prog);
+    memset (pkt, 0xAA, TS_PACKET_SIZE);
+    pkt[0] = 0x47;
+    pkt[1] = pid >> 8;
+    pkt[2] = pid & 0xFF;
+    pkt[3] = 0x10 | (cc[pid]++ & 0x0F);
+    if (pid == VIDEO_PID (prog) && i >= next_rap[prog]) {
+      //Adaptation field with the random_access_indicator, the frame starts here.
+      pkt[1] |= 0x40;
+      pkt[3] |= 0x20;
+      pkt[4] = 1;
+      pkt[5] = 0x40;
+      next_rap[prog] += gop_every;
+    }
+  }
+
+  g_byte_array_free (pat, TRUE);
+  for (prog = 0; prog < PROGRAMS; prog++)
+    g_byte_array_free (pmts[prog], TRUE);
+
+  *len = (gsize)n * TS_PACKET_SIZE;
+  return data;
+}
+
+static void
+pmt_changed_cb (UmmsPsiCache *cache, guint table_id, guint program_num, guint version, gpointer user_data)
+{
+  if (table_id == UMMS_PSI_TABLE_PMT)
+    *(gboolean *)user_data = TRUE;
+}
+
+static void
+free_entries (GPtrArray *a)
+{
+  g_ptr_array_foreach (a, (GFunc)g_hash_table_unref, NULL);
+  g_ptr_array_free (a, TRUE);
+}
+
+static guint
+entry_uint (GHashTable *entry, const gchar *key)
+{
+  return g_value_get_uint (g_hash_table_lookup (entry, key));
+}
+
+//PID of the first video stream of the program, 0 if none.
+static guint
+pmt_video_pid (UmmsPsiCache *cache, guint program_num)
+{
+  GPtrArray *streams;
+  guint pcr_pid, type, pid = 0, i;
+
+  if (!umms_psi_cache_get_pmt (cache, &program_num, &pcr_pid, &streams))
+    return 0;
+  for (i = 0; i < streams->len && !pid; i++) {
+    type = entry_uint (g_ptr_array_index (streams, i), "stream-type");
+    if (type == 0x01 || type == 0x02 || type == 0x1B || type == 0x24)
+      pid = entry_uint (g_ptr_array_index (streams, i), "pid");
+  }
+  free_entries (streams);
+  return pid;
+}
+
+//Programs with video, from the PSI of the whole stream.
+static GArray *
+find_programs (const guint8 *data, guint64 n)
+{
+  UmmsPsiCache *cache = umms_psi_cache_new (NULL, NULL);
+  GArray *programs = g_array_new (FALSE, TRUE, sizeof (Program));
+  GPtrArray *pat;
+  Program p;
+  guint64 i;
+  guint j;
+
+  for (i = 0; i < n; i++)
+    umms_psi_cache_push_packet (cache, data + i * TS_PACKET_SIZE);
+
+  if (umms_psi_cache_get_pat (cache, &pat)) {
+    for (j = 0; j < pat->len; j++) {
+      memset (&p, 0, sizeof (p));
+      p.program_num = entry_uint (g_ptr_array_index (pat, j), "program-number");
+      if (p.program_num && (p.video_pid = pmt_video_pid (cache, p.program_num)))
+        g_array_append_val (programs, p);
+    }
+    free_entries (pat);
+  }
+  umms_psi_cache_free (cache);
+
+  return programs;
+}
+
+/*
+ * Packets from start to the first random access point of the program once its
+ * PMT is known, the stream looping. 0 if none.
+ */
+static guint64
+cold_zap (const guint8 *data, guint64 n, guint64 start, Program *p)
+{
+  gboolean pmt_ready = FALSE;
+  UmmsPsiCache *cache = umms_psi_cache_new (pmt_changed_cb, &pmt_ready);
+  const guint8 *pkt;
+  guint video_pid = 0;
+  guint64 k, ret = 0;
+
+  umms_psi_cache_set_program (cache, p->program_num);
+  for (k = 0; k < n && !ret; k++) {
+    pkt = data + ((start + k) % n) * TS_PACKET_SIZE;
+    if (!video_pid) {
+      umms_psi_cache_push_packet (cache, pkt);
+      if (pmt_ready)
+        video_pid = pmt_video_pid (cache, p->program_num);
+    } else if (packet_pid (pkt) == video_pid && packet_is_rap (pkt)) {
+      ret = k + 1;
+    }
+  }
+  umms_psi_cache_free (cache);
+
+  return ret;
+}
+
+static gint
+zap_cmp (gconstpointer a, gconstpointer b)
+{
+  guint64 x = ((const Zap *)a)->at, y = ((const Zap *)b)->at;
+
+  return x < y ? -1 : x > y;
+}
+
+static gint
+double_cmp (gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gdouble
+percentile (gdouble *v, guint n, gdouble p)
+{
+  return n ? v[(guint)((n - 1) * p)] : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *capture = NULL;
+  gdouble packets_per_second = PACKETS_PER_SECOND;
+  gint zaps = bench_quick () ? QUICK_ZAPS : DEFAULT_ZAPS;
+  guint8 *data;
+  gsize len;
+  guint64 n, i, packets;
+  GArray *programs;
+  Program *p;
+  Zap *plan;
+  gdouble *cold, *fast, start, gop_ms = 0, gop_kb = 0;
+  guint n_cold = 0, n_fast = 0, z, j;
+  GByteArray *gop;
+  GPtrArray *streams;
+  guint program_num, pcr_pid;
+  gint ret = 0;
+
+  if (argc > 1)
+    zaps = atoi (argv[1]);
+  if (argc > 3) {
+    capture = argv[2];
+    packets_per_second = atof (argv[3]) * 1e6 / (TS_PACKET_SIZE * 8);
+  }
+  if (zaps <= 0 || argc == 3 || packets_per_second <= 0) {
+    g_printerr ("Usage: %s [zaps] [capture.ts mbps]\n", argv[0]);
+    return 1;
+  }
+  g_type_init ();
+
+  if (capture) {
+    GError *err = NULL;
+
+    if (!g_file_get_contents (capture, (gchar **)&data, &len, &err)) {
+      g_printerr ("%s\n", err->message);
+      g_error_free (err);
+      return 1;
+    }
+  } else {
+    data = generate (&len);
+  }
+  n = len / TS_PACKET_SIZE;
+
+  programs = find_programs (data, n);
+  if (!programs->len) {
+    g_printerr ("no program with video\n");
+    return 1;
+  }
+
+  //Channel up through the programs, at random points after the first quarter.
+  plan = g_new (Zap, zaps);
+  for (z = 0; z < (guint)zaps; z++) {
+    plan[z].at = n / 4 + (guint64)(g_random_double () * (n - n / 4));
+    plan[z].program = z % programs->len;
+  }
+  qsort (plan, zaps, sizeof (Zap), zap_cmp);
+
+  cold = g_new (gdouble, zaps);
+  fast = g_new (gdouble, zaps);
+
+  for (z = 0; z < (guint)zaps; z++) {
+    p = &g_array_index (programs, Program, plan[z].program);
+    if ((packets = cold_zap (data, n, plan[z].at, p)))
+      cold[n_cold++] = packets * 1000.0 / packets_per_second;
+  }
+
+  //The pre-tuned demuxes see the whole stream, the zaps take what they cached.
+  for (j = 0; j < programs->len; j++) {
+    p = &g_array_index (programs, Program, j);
+    p->psi = umms_psi_cache_new (NULL, NULL);
+    umms_psi_cache_set_program (p->psi, p->program_num);
+    p->gop = umms_gop_cache_new (p->video_pid, GOP_MAX_SIZE);
+    p->last_rap = -1;
+  }
+
+  for (i = 0, z = 0; i < n && z < (guint)zaps; i++) {
+    const guint8 *pkt = data + i * TS_PACKET_SIZE;
+
+    while (z < (guint)zaps && plan[z].at == i) {
+      p = &g_array_index (programs, Program, plan[z].program);
+      program_num = 0;
+      start = bench_now ();
+      gop = umms_gop_cache_get (p->gop);
+      if (umms_psi_cache_get_pmt (p->psi, &program_num, &pcr_pid, &streams))
+        free_entries (streams);
+      else
+        program_num = 0;
+      if (gop && program_num) {
+        fast[n_fast++] = (bench_now () - start) * 1e6;
+        gop_ms += (i - p->last_rap) * 1000.0 / packets_per_second;
+        gop_kb += gop->len / 1024.0;
+      }
+
+      if (p->last_rap >= 0 && (!gop || gop->len != p->gop_packets * TS_PACKET_SIZE
+          || packet_pid (gop->data) != p->video_pid || !packet_is_rap (gop->data))) {
+        g_printerr ("GOP of program %u at packet %" G_GUINT64_FORMAT " is wrong\n", p->program_num, i);
+        ret = 1;
+      }
+      if (gop)
+        g_byte_array_free (gop, TRUE);
+      z++;
+    }
+
+    for (j = 0; j < programs->len; j++) {
+      p = &g_array_index (programs, Program, j);
+      umms_psi_cache_push_packet (p->psi, pkt);
+      umms_gop_cache_push_packet (p->gop, pkt);
+      if (packet_pid (pkt) == p->video_pid && !(pkt[1] & 0x80)) {
+        if (packet_is_rap (pkt)) {
+          p->last_rap = i;
+          p->gop_packets = 0;
+        }
+        if (p->last_rap >= 0)
+          p->gop_packets++;
+      }
+    }
+  }
+
+  qsort (cold, n_cold, sizeof (gdouble), double_cmp);
+  qsort (fast, n_fast, sizeof (gdouble), double_cmp);
+
+  g_print ("%u programs, %.1f s of stream at %.1f Mbps, %d zaps\n", programs->len, n / packets_per_second,
+           packets_per_second * TS_PACKET_SIZE * 8 / 1e6, zaps);
+  g_print ("cold zap: P50 %.1f ms, P99 %.1f ms (%u/%d)\n", percentile (cold, n_cold, 0.5),
+           percentile (cold, n_cold, 0.99), n_cold, zaps);
+  g_print ("fast zap: P50 %.2f us, P99 %.2f us (%u/%d from the caches), GOP of %.0f ms, %.0f KB on average\n",
+           percentile (fast, n_fast, 0.5), percentile (fast, n_fast, 0.99), n_fast, zaps,
+           n_fast ? gop_ms / n_fast : 0, n_fast ? gop_kb / n_fast : 0);
+
+  for (j = 0; j < programs->len; j++) {
+    p = &g_array_index (programs, Program, j);
+    umms_psi_cache_free (p->psi);
+    umms_gop_cache_free (p->gop);
+  }
+  g_array_free (programs, TRUE);
+  g_free (plan);
+  g_free (cold);
+  g_free (fast);
+  g_free (data);
+
+  return ret;
+}